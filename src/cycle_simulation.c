@@ -8,32 +8,961 @@
     supposed to be the time taken for a packet to be outputted. This evaluates
     to:
         PACKET_SIZE / OUTPUT BANDWIDTH
-    Where the output bandwidth of one port is also called the line rate. */
+    Where the output bandwidth of one port is also called the line rate.
+
+    Usage:
+        cycle_simulation [scheduler] [load] [slots] [mode] [buffer] [policy]
+            [threads] [pattern] [arrivals] [rng] [record] [precision]
+
+    where scheduler is one of islip, pim, ilqf, iocf, drrm, serena or mwm
+    (maximum size matching), load is the offered load per input in [0, 1] and slots is
+    the number of time slots to run for. mode is packets (the default) to
+    buffer whole packets, or counts to buffer only their arrival times.
+    buffer is the number of cells of the buffer shared by all VOQs, 0 (the
+    default) for an unbounded buffer, and policy its admission policy -
+    taildrop, static (each VOQ limited to buffer / ports cells) or dt
+    (Dynamic Threshold with alpha 1, the default). threads is 1 (the
+    default) to run everything on one thread, or 3 to pipeline the run
+    across a traffic generator thread, the switch thread and a sink thread,
+    which records deliveries and frees packets. The stages are linked by
+    SPSC rings, carrying the arrivals of each slot to the switch and the
+    deliveries of each slot to the sink, so consecutive slots overlap. Both
+    give the same results. pattern is the traffic pattern - uniform (the
+    default), hotspot, diagonal, logdiagonal or bursty - and arrivals how
+    arrivals are drawn - trials at every input in every slot (the default),
+    or geometric or poisson gaps between them, which are cheaper under low
+    loads. rng is the random number generator behind the traffic - xoshiro
+    (the default) or philox, whose arrivals do not depend on how they are
+    split between threads. See traffic.h.
+
+    pattern may instead be replay:path, to replay the arrivals of the trace
+    at path (see trace.h), or pcap:ns:path, to replay the packet capture at
+    path in slots of ns nanoseconds (see pcap.h), ignoring load, arrivals
+    and rng. Packets of a capture arrive at inputs by a hash of their source
+    address, and are sent to hosts by a hash of their destination address,
+    unless given rules as pcap:ns:rules:path, where rules is the path, with
+    no colon, of a file of rules mapping IPv4 prefixes to ports (see
+    pcap_rules_read in pcap.h). Addresses matching a rule then arrive at,
+    or are sent to, the port of the first rule they match.
+    record is a path to record the arrivals of the run to, so that it can be
+    replayed exactly, or - not to record them. Arrivals keep their length in
+    a trace and in the switch's packet descriptors, which saturate at
+    PACKET_DESC_MAX_LENGTH bytes, but every packet is switched as one cell.
+
+    precision, if given, ends the run once the 95% confidence intervals of
+    the mean latency and the throughput are within that fraction of their
+    estimates, e.g. 0.01 for 1%, with slots only the longest it may run.
+    The intervals are found by batch means over batches of BATCH_SLOTS
+    slots (see batch_means.h), and judged at the end of every batch from
+    the MIN_BATCHES-th on, so a run stops on a batch boundary. When
+    pipelined the generator waits at every boundary for the judgement, so
+    that it never generates, or records, slots which are not switched.
+
+    Every run also reports its warm-up - the transient from the empty
+    switch at the start, found by MSER-5 (see mser.h) in the series of
+    latencies of deliveries and of the backlog of the VOQs at the end of
+    each slot - and the mean latency and backlog once it is discarded.
+
+    Packets are allocated from the packet pool of the simulation thread,
+    backed by huge pages where available. */
 
-/*  Define duration of a time slot in terms of numbers of cycles - this allows
-    flexibility even if it is unlikely to change from 1. */
 #include "./network_switch/implementations/cb_ib_voqs_iSLIP.h"
+#include "./network_switch/packet_pool.h"
+#include "./network_switch/schedulers/iSLIP.h"
+#include "./network_switch/schedulers/pim.h"
+#include "./network_switch/schedulers/iLQF.h"
+#include "./network_switch/schedulers/drrm.h"
+#include "./network_switch/schedulers/hopcroft_karp.h"
+#include "./network_switch/schedulers/serena.h"
+#include "./data_structures/spsc_ring.h"
+#include "./traffic/traffic.h"
+#include "./traffic/trace.h"
+#include "./traffic/pcap.h"
+#include "./stats/batch_means.h"
+#include "./stats/mser.h"
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
 
+/*  Define duration of a time slot in terms of numbers of cycles - this allows
+    flexibility even if it is unlikely to change from 1. */
 #define TIME_SLOT 1
 #define NUM_PORTS 8
 
-/*  Packet format - */
+#define DEFAULT_LOAD 0.8
+#define DEFAULT_SLOTS 100000
+
+/*  Packet format - the first ADDR_SIZE bytes of a packet hold the destination
+    address, followed by the time slot in which the packet was generated and
+    the length in bytes of the packet it stands for. The remainder of the
+    PACKET_SIZE bytes are unused payload. */
+#define PACKET_ADDR_OFFSET 0
+#define PACKET_SLOT_OFFSET ADDR_SIZE
+#define PACKET_LENGTH_OFFSET (PACKET_SLOT_OFFSET + sizeof(unsigned long))
+
+/*  Pipeline ring sizes, in slots of arrivals and in deliveries, and the
+    number of slots or deliveries moved through a ring at once. */
+#define ARRIVALS_RING_SIZE 256
+#define DELIVERIES_RING_SIZE 4096
+#define PIPELINE_BATCH 32
+
+/*  Batches of slots over which the means behind the confidence intervals
+    are taken, and the fewest batches from which the run may stop. */
+#define BATCH_SLOTS 1000
+#define MIN_BATCHES 20
+
+/*  Host - counts the packets delivered to it and their total latency. */
+struct host {
+    unsigned int addr;
+    unsigned long delivered;
+    unsigned long total_latency;
+};
+
+typedef struct host *host_t;
+
+/*  Workload - where the arrivals of each slot come from, the traffic
+    generator, a trace being replayed or a packet capture with the rules
+    mapping its addresses to ports, and the trace they are recorded to, if
+    any. A replay which runs out of slots or into a malformed record offers
+    no more arrivals. */
+struct workload {
+    traffic_t traffic;
+    trace_reader_t replay;
+    pcap_reader_t capture;
+    pcap_rule_t *rules;
+    unsigned int num_rules;
+    trace_writer_t record;
+    int malformed;
+};
+
+/*  Arrivals - the packets generated in one slot, one per input port. */
+struct arrivals {
+    void *traffic[NUM_PORTS];
+};
+
+/*  Delivery - a packet delivered to a host and its latency, passed from the
+    switch thread to the sink thread. packet is NULL when only counting, and
+    host is NULL in the delivery which ends the run. */
+struct delivery {
+    host_t host;
+    unsigned long latency;
+    void *packet;
+};
+
+/*  Pipeline - the rings between the stages, and what the generator thread
+    hands back once it is done. */
+struct pipeline {
+    spsc_ring_t arrivals;
+    spsc_ring_t deliveries;
+    struct workload *workload;
+    unsigned long num_slots;
+    unsigned long offered;
+    packet_pool_t packet_pool;
+};
+
+/*  Termination - the target relative precision, 0 to run every slot, the
+    batch means of the latencies of deliveries and of the throughput of
+    each batch, and the deliveries of the current batch. judged is the
+    number of slots switched when the switch thread last judged the
+    estimates, and stop whether it found them precise enough then, which
+    the generator waits for when pipelined. */
+struct termination {
+    double precision;
+    batch_means_t latency;
+    batch_means_t throughput;
+    unsigned long batch_delivered;
+    atomic_ulong judged;
+    int stop;
+};
+
+/*  current_slot is the slot being switched, which is ahead of the sink and
+    behind the generator when pipelined. Deliveries of the current slot are
+    collected in slot_deliveries when pipelined, and recorded directly
+    otherwise. */
+static unsigned long current_slot;
+static voq_mode_t voq_mode;
+static int pipelined = 0;
+static struct delivery slot_deliveries[NUM_PORTS];
+static unsigned int num_slot_deliveries = 0;
+static struct termination termination;
+static mser_t warmup_latency;
+
+/*  Create custom address format - addresses are 4 byte unsigned integers, so
+    hashing and comparison can work on their values directly. */
+static void *get_addr_from_packet(void *packet) {
+    return (char *) packet + PACKET_ADDR_OFFSET;
+};
+
+/*  Length of a packet, as given by the workload, for its descriptor. */
+static unsigned long get_length_from_packet(void *packet) {
+    uint32_t length;
+    memcpy(&length, (char *) packet + PACKET_LENGTH_OFFSET, sizeof(uint32_t));
+    return length;
+};
+
+static hash_t addr_hash(void *addr) {
+    unsigned int value;
+    memcpy(&value, addr, ADDR_SIZE);
+    return value;
+};
+
+static comparison_t addr_compare(void *lhs, void *rhs) {
+    unsigned int lhs_value;
+    unsigned int rhs_value;
+    memcpy(&lhs_value, lhs, ADDR_SIZE);
+    memcpy(&rhs_value, rhs, ADDR_SIZE);
+
+    if (lhs_value < rhs_value) {
+        return LT;
+    } else if (lhs_value > rhs_value) {
+        return GT;
+    } else {
+        return EQ;
+    };
+};
+
+static void addr_free(void *addr) {
+    free(addr);
+};
+
+/*  Host send - invoked by the switch when a packet is delivered to a host. The
+    host owns the packet and frees it once its latency is recorded, which
+    when pipelined is left to the sink thread. When only counting, the switch
+    sends the packet descriptor instead, whose arrival slot is the generation
+    slot, and which remains owned by the switch. */
+static void host_send(void *host_desc_ptr, void *packet) {
+    host_desc_t *host_desc = (host_desc_t *) host_desc_ptr;
+    host_t host = (host_t) host_desc->data;
+
+    unsigned long latency;
+    if (voq_mode == VOQ_MODE_COUNTS) {
+        /*  Arrival slots of descriptors wrap at 2^32. */
+        uint32_t arrival_slot = ((packet_desc_t *) packet)->arrival_slot;
+        latency = (uint32_t) ((uint32_t) current_slot - arrival_slot) + 1UL;
+        packet = NULL;
+    } else {
+        unsigned long generated_slot;
+        memcpy(&generated_slot, (char *) packet + PACKET_SLOT_OFFSET,
+            sizeof(unsigned long));
+
+        latency = current_slot - generated_slot + 1;
+    };
+
+    mser_observe(warmup_latency, (double) latency, current_slot);
+
+    if (termination.precision > 0) {
+        batch_means_observe(termination.latency, (double) latency);
+        termination.batch_delivered++;
+    };
+
+    if (pipelined) {
+        struct delivery *delivery = &slot_deliveries[num_slot_deliveries++];
+        delivery->host = host;
+        delivery->latency = latency;
+        delivery->packet = packet;
+        return;
+    };
+
+    packet_free(packet);
+
+    host->delivered++;
+    host->total_latency += latency;
+};
+
+/*  Create a packet destined for the given address, generated in slot, which
+    stands for a packet of length bytes. */
+static void *packet_create(
+    unsigned int dest_addr,
+    unsigned long slot,
+    uint32_t length
+) {
+    void *packet = packet_alloc();
+    assert(packet);
+
+    memset(packet, 0, PACKET_SIZE);
+    memcpy((char *) packet + PACKET_ADDR_OFFSET, &dest_addr, ADDR_SIZE);
+    memcpy((char *) packet + PACKET_SLOT_OFFSET, &slot, sizeof(unsigned long));
+    memcpy((char *) packet + PACKET_LENGTH_OFFSET, &length, sizeof(uint32_t));
+
+    return packet;
+};
+
+/*  Generate the arrivals of one slot - a packet for each input the workload
+    gives an arrival, and NULL for the rest, recording them if asked to.
+    Returns the number of packets generated. */
+static unsigned int arrivals_generate(
+    struct workload *workload,
+    void **arrivals,
+    unsigned long slot
+) {
+    uint32_t addrs[NUM_PORTS] = {0};
+    uint32_t lengths[NUM_PORTS] = {0};
+    unsigned int generated = 0;
+    port_num_t i;
+
+    if (workload->replay) {
+        int read = workload->malformed
+            ? TRACE_MALFORMED
+            : trace_read(workload->replay, addrs, lengths);
+
+        if (read == TRACE_MALFORMED) {
+            workload->malformed = 1;
+        };
+
+        generated = read > 0 ? read : 0;
+    } else if (workload->capture) {
+        int read = workload->malformed
+            ? PCAP_MALFORMED
+            : pcap_read(workload->capture, addrs, lengths);
+
+        if (read == PCAP_MALFORMED) {
+            workload->malformed = 1;
+        };
+
+        /*  pcap_read only writes the addresses of inputs with arrivals. */
+        for (i = 0; i < NUM_PORTS; i++) {
+            if (lengths[i] != 0) {
+                addrs[i] = pcap_port_lookup(
+                    workload->rules,
+                    workload->num_rules,
+                    addrs[i],
+                    NUM_PORTS
+                );
+            };
+        };
+
+        generated = read > 0 ? read : 0;
+    } else {
+        port_num_t dests[NUM_PORTS];
+        generated = traffic_generate(workload->traffic, dests);
+
+        for (i = 0; i < NUM_PORTS; i++) {
+            addrs[i] = dests[i];
+            lengths[i] = dests[i] == TRAFFIC_NO_ARRIVAL ? 0 : PACKET_SIZE;
+        };
+    };
+
+    if (workload->record) {
+        trace_write(workload->record, addrs, lengths);
+    };
+
+    for (i = 0; i < NUM_PORTS; i++) {
+        arrivals[i] = lengths[i] == 0
+            ? NULL
+            : packet_create(addrs[i], slot, lengths[i]);
+    };
+
+    return generated;
+};
+
+/*  Whether the run may stop before slot - at the start of every batch but
+    the first, if there is a target precision. */
+static int termination_boundary(unsigned long slot) {
+    return termination.precision > 0 && slot > 0 && slot % BATCH_SLOTS == 0;
+};
+
+/*  End a slot, given the number of slots switched, judging at the end of a
+    batch whether the estimates are precise enough to stop. Returns whether
+    to stop. Called by the thread which switches. */
+static int termination_slot_end(unsigned long slots) {
+    if (!termination_boundary(slots)) {
+        return 0;
+    };
+
+    batch_means_observe(termination.throughput,
+        (double) termination.batch_delivered / (BATCH_SLOTS * NUM_PORTS));
+    termination.batch_delivered = 0;
+    batch_means_end_batch(termination.throughput);
+    batch_means_end_batch(termination.latency);
+
+    batch_means_t latency = termination.latency;
+    batch_means_t throughput = termination.throughput;
+    termination.stop =
+        batch_means_batches(throughput) >= MIN_BATCHES &&
+        batch_means_half_width(latency) <=
+            termination.precision * batch_means_mean(latency) &&
+        batch_means_half_width(throughput) <=
+            termination.precision * batch_means_mean(throughput);
+
+    atomic_store_explicit(&termination.judged, slots, memory_order_release);
+
+    return termination.stop;
+};
+
+/*  Wait until the slots before slot have been judged, if the run may stop
+    there, and return whether it does. Called by the generator thread. */
+static int termination_wait(unsigned long slot) {
+    if (!termination_boundary(slot)) {
+        return 0;
+    };
+
+    while (atomic_load_explicit(&termination.judged, memory_order_acquire) <
+        slot) {
+        sched_yield();
+    };
+
+    return termination.stop;
+};
+
+/*  Push all of count elements onto a ring, waiting for the consumer to make
+    room as needed. */
+static void ring_push_all(
+    spsc_ring_t ring,
+    const void *elems,
+    size_t elem_size,
+    unsigned int count
+) {
+    const char *next = (const char *) elems;
+
+    while (count > 0) {
+        unsigned int pushed = spsc_ring_push(ring, next, count);
+
+        if (pushed == 0) {
+            sched_yield();
+        };
+
+        next += elem_size * pushed;
+        count -= pushed;
+    };
+};
+
+/*  Pop between 1 and max_count elements from a ring, waiting for the
+    producer as needed. */
+static unsigned int ring_pop_some(
+    spsc_ring_t ring,
+    void *elems_out,
+    unsigned int max_count
+) {
+    unsigned int popped;
+
+    while ((popped = spsc_ring_pop(ring, elems_out, max_count)) == 0) {
+        sched_yield();
+    };
+
+    return popped;
+};
+
+/*  Generator thread - generates the arrivals of every slot, in batches
+    which end at the boundaries where the run may stop. Its packet pool
+    outlives the thread, as packets are still in flight when it finishes,
+    and is handed back through the pipeline. */
+static void *generator_main(void *pipeline_ptr) {
+    struct pipeline *pipeline = (struct pipeline *) pipeline_ptr;
+    struct arrivals batch[PIPELINE_BATCH];
+
+    pipeline->packet_pool = packet_pool_local_init(PACKET_POOL_HUGE_PAGES);
+
+    unsigned long slot = 0;
+    while (slot < pipeline->num_slots && !termination_wait(slot)) {
+        unsigned int count = 0;
+
+        while (count < PIPELINE_BATCH && slot < pipeline->num_slots &&
+            (count == 0 || !termination_boundary(slot))) {
+            pipeline->offered += arrivals_generate(
+                pipeline->workload,
+                batch[count].traffic,
+                slot
+            );
+            count++;
+            slot++;
+        };
+
+        ring_push_all(
+            pipeline->arrivals,
+            batch,
+            sizeof(struct arrivals),
+            count
+        );
+    };
+
+    return NULL;
+};
+
+/*  Sink thread - records deliveries and frees their packets until the
+    delivery which ends the run. */
+static void *sink_main(void *pipeline_ptr) {
+    struct pipeline *pipeline = (struct pipeline *) pipeline_ptr;
+    struct delivery batch[PIPELINE_BATCH];
+
+    while (1) {
+        unsigned int count =
+            ring_pop_some(pipeline->deliveries, batch, PIPELINE_BATCH);
 
-/*  Create custom address format. */
+        unsigned int k;
+        for (k = 0; k < count; k++) {
+            if (batch[k].host == NULL) {
+                return NULL;
+            };
+
+            batch[k].host->delivered++;
+            batch[k].host->total_latency += batch[k].latency;
+            packet_free(batch[k].packet);
+        };
+    };
+};
+
+/*  Run pipelined - the calling thread switches, taking the arrivals of each
+    slot from the generator and passing its deliveries on to the sink, until
+    num_slots have been switched or the estimates are precise enough. The
+    backlog at the end of each slot is observed in warmup_backlog. Returns
+    the number of packets offered, and the generator's packet pool in
+    packet_pool_out. */
+static unsigned long run_pipelined(
+    i_cycle_sim_switch_t network_switch_desc,
+    void *network_switch,
+    struct workload *workload,
+    unsigned long num_slots,
+    mser_t warmup_backlog,
+    packet_pool_t *packet_pool_out
+) {
+    struct pipeline pipeline;
+    pipeline.arrivals =
+        spsc_ring_create(sizeof(struct arrivals), ARRIVALS_RING_SIZE);
+    pipeline.deliveries =
+        spsc_ring_create(sizeof(struct delivery), DELIVERIES_RING_SIZE);
+    pipeline.workload = workload;
+    pipeline.num_slots = num_slots;
+    pipeline.offered = 0;
+    pipeline.packet_pool = NULL;
+
+    pipelined = 1;
+
+    pthread_t generator;
+    pthread_t sink;
+    pthread_create(&generator, NULL, generator_main, &pipeline);
+    pthread_create(&sink, NULL, sink_main, &pipeline);
+
+    struct arrivals batch[PIPELINE_BATCH];
+
+    int stop = 0;
+    current_slot = 0;
+    while (current_slot < num_slots && !stop) {
+        unsigned int count =
+            ring_pop_some(pipeline.arrivals, batch, PIPELINE_BATCH);
+
+        unsigned int k;
+        for (k = 0; k < count; k++) {
+            num_slot_deliveries = 0;
+            network_switch_desc.tick(network_switch, batch[k].traffic);
+            mser_observe(warmup_backlog,
+                (double) cb_ib_voqs_iSLIP_backlog(network_switch),
+                current_slot);
+
+            ring_push_all(
+                pipeline.deliveries,
+                slot_deliveries,
+                sizeof(struct delivery),
+                num_slot_deliveries
+            );
+
+            current_slot++;
+            stop = termination_slot_end(current_slot);
+        };
+    };
+
+    struct delivery end;
+    end.host = NULL;
+    end.latency = 0;
+    end.packet = NULL;
+    ring_push_all(pipeline.deliveries, &end, sizeof(struct delivery), 1);
+
+    pthread_join(generator, NULL);
+    pthread_join(sink, NULL);
+
+    pipelined = 0;
+
+    spsc_ring_free(pipeline.arrivals);
+    spsc_ring_free(pipeline.deliveries);
+
+    *packet_pool_out = pipeline.packet_pool;
+    return pipeline.offered;
+};
+
+/*  Look up a scheduler by name. */
+static int scheduler_from_name(
+    const char *name,
+    i_crossbar_scheduler_t *scheduler_out
+) {
+    if (strcmp(name, "islip") == 0) {
+        *scheduler_out = iSLIP_scheduler();
+    } else if (strcmp(name, "pim") == 0) {
+        *scheduler_out = pim_scheduler();
+    } else if (strcmp(name, "ilqf") == 0) {
+        *scheduler_out = iLQF_scheduler();
+    } else if (strcmp(name, "iocf") == 0) {
+        *scheduler_out = iOCF_scheduler();
+    } else if (strcmp(name, "drrm") == 0) {
+        *scheduler_out = drrm_scheduler();
+    } else if (strcmp(name, "serena") == 0) {
+        *scheduler_out = serena_scheduler();
+    } else if (strcmp(name, "mwm") == 0) {
+        *scheduler_out = hopcroft_karp_scheduler();
+    } else {
+        return 0;
+    };
+
+    return 1;
+};
 
 int main(int argc, char *argv[]) {
-    /*  Get switch interface implementaiton/ */
+    const char *scheduler_name = argc > 1 ? argv[1] : "islip";
+    double load = argc > 2 ? atof(argv[2]) : DEFAULT_LOAD;
+    unsigned long num_slots = argc > 3 ? strtoul(argv[3], NULL, 10) :
+        DEFAULT_SLOTS;
+    const char *mode_name = argc > 4 ? argv[4] : "packets";
+    unsigned long buffer_cells = argc > 5 ? strtoul(argv[5], NULL, 10) : 0;
+    const char *policy_name = argc > 6 ? argv[6] : "dt";
+    int num_threads = argc > 7 ? atoi(argv[7]) : 1;
+    const char *pattern_name = argc > 8 ? argv[8] : "uniform";
+    const char *arrivals_name = argc > 9 ? argv[9] : "trials";
+    const char *rng_name = argc > 10 ? argv[10] : "xoshiro";
+    const char *record_path = argc > 11 && strcmp(argv[11], "-") != 0
+        ? argv[11]
+        : NULL;
+    double precision = argc > 12 ? atof(argv[12]) : 0.0;
+    const char *replay_path = strncmp(pattern_name, "replay:", 7) == 0
+        ? pattern_name + 7
+        : NULL;
+    const char *capture_path = NULL;
+    char *rules_path = NULL;
+    unsigned long capture_slot_ns = 0;
+
+    if (strncmp(pattern_name, "pcap:", 5) == 0) {
+        char *end;
+        capture_slot_ns = strtoul(pattern_name + 5, &end, 10);
+        capture_path = *end == ':' ? end + 1 : NULL;
+
+        if (!capture_path || capture_slot_ns == 0) {
+            fprintf(stderr, "Capture must be given as pcap:ns:path or "
+                "pcap:ns:rules:path\n");
+            return 1;
+        };
+
+        const char *colon = strchr(capture_path, ':');
+        if (colon) {
+            size_t length = colon - capture_path;
+            rules_path = (char *) malloc(length + 1);
+            assert(rules_path);
+            memcpy(rules_path, capture_path, length);
+            rules_path[length] = '\0';
+            capture_path = colon + 1;
+        };
+    };
+
+    if (num_threads != 1 && num_threads != 3) {
+        fprintf(stderr, "Threads must be 1 or 3\n");
+        return 1;
+    };
+
+    traffic_pattern_t pattern = TRAFFIC_UNIFORM;
+    if (!replay_path && !capture_path &&
+        !traffic_pattern_from_name(pattern_name, &pattern)) {
+        fprintf(stderr, "Unknown pattern %s\n", pattern_name);
+        return 1;
+    };
+
+    traffic_config_t traffic_config = traffic_default_config(pattern, load);
+    if (!traffic_arrivals_from_name(arrivals_name, &traffic_config.arrivals)) {
+        fprintf(stderr, "Unknown arrivals %s\n", arrivals_name);
+        return 1;
+    };
+
+    if (!traffic_rng_from_name(rng_name, &traffic_config.rng)) {
+        fprintf(stderr, "Unknown rng %s\n", rng_name);
+        return 1;
+    };
+
+    if (load < 0 || load > 1) {
+        fprintf(stderr, "Load must be in [0, 1]\n");
+        return 1;
+    };
+
+    if (precision < 0) {
+        fprintf(stderr, "Precision must not be negative\n");
+        return 1;
+    };
+
+    cb_ib_voqs_iSLIP_config_t config = cb_ib_voqs_iSLIP_default_config();
+    if (!scheduler_from_name(scheduler_name, &config.scheduler)) {
+        fprintf(stderr, "Unknown scheduler %s\n", scheduler_name);
+        return 1;
+    };
+
+    if (strcmp(mode_name, "counts") == 0) {
+        voq_mode = VOQ_MODE_COUNTS;
+    } else if (strcmp(mode_name, "packets") == 0) {
+        voq_mode = VOQ_MODE_PACKETS;
+    } else {
+        fprintf(stderr, "Unknown mode %s\n", mode_name);
+        return 1;
+    };
+    config.voq_mode = voq_mode;
+    config.get_length_from_packet = get_length_from_packet;
+
+    if (buffer_cells > 0) {
+        config.buffer.capacity = buffer_cells;
+        config.buffer.voq_threshold = buffer_cells / NUM_PORTS;
+        config.buffer.alpha = 1.0;
+
+        if (strcmp(policy_name, "taildrop") == 0) {
+            config.buffer.policy = BUFFER_POLICY_TAIL_DROP;
+        } else if (strcmp(policy_name, "static") == 0) {
+            config.buffer.policy = BUFFER_POLICY_STATIC;
+        } else if (strcmp(policy_name, "dt") == 0) {
+            config.buffer.policy = BUFFER_POLICY_DYNAMIC;
+        } else {
+            fprintf(stderr, "Unknown policy %s\n", policy_name);
+            return 1;
+        };
+    };
+
+    /*  Get switch interface implementation. */
     i_cycle_sim_switch_t network_switch_desc = cb_ib_voqs_iSLIP_cycle_switch();
 
-    void *network_switch = network_switch_desc.create(NUM_PORTS);
+    addr_desc_t addr_desc;
+    addr_desc.get_addr_from_packet = get_addr_from_packet;
+    addr_desc.addr_hash = addr_hash;
+    addr_desc.addr_compare = addr_compare;
+    addr_desc.addr_free = addr_free;
 
-    /* Register hosts. */
+    void *network_switch =
+        cb_ib_voqs_iSLIP_create_with_config(NUM_PORTS, addr_desc, config);
 
-    int running = 1;
+    /* Register hosts - host i has address i and is attached to port i. */
+    struct host hosts[NUM_PORTS];
+    port_num_t i;
+    for (i = 0; i < NUM_PORTS; i++) {
+        hosts[i].addr = i;
+        hosts[i].delivered = 0;
+        hosts[i].total_latency = 0;
 
-    while (running) {
-        network_switch_desc.tick();
+        host_desc_t *host_desc =
+            host_desc_create(&hosts[i], &hosts[i].addr, host_send, addr_free);
+
+        register_result_t res = network_switch_desc.register_host(
+            network_switch,
+            *host_desc,
+            i
+        );
+        assert(res == REG_SUCCESS);
+
+        free(host_desc);
+    };
+
+    /*  Run the simulation. The switch takes ownership of the generated
+        packets. */
+    unsigned long offered = 0;
+    packet_pool_t packet_pool;
+
+    struct workload workload;
+    workload.traffic = NULL;
+    workload.replay = NULL;
+    workload.capture = NULL;
+    workload.rules = NULL;
+    workload.num_rules = 0;
+    workload.record = NULL;
+    workload.malformed = 0;
+
+    if (capture_path) {
+        if (rules_path) {
+            int num_rules =
+                pcap_rules_read(rules_path, NUM_PORTS, &workload.rules);
+            if (num_rules < 0) {
+                fprintf(stderr, "Cannot read rules %s\n", rules_path);
+                return 1;
+            };
+
+            workload.num_rules = num_rules;
+        };
+
+        pcap_config_t pcap_config;
+        pcap_config.num_ports = NUM_PORTS;
+        pcap_config.slot_ns = capture_slot_ns;
+        pcap_config.rules = workload.rules;
+        pcap_config.num_rules = workload.num_rules;
+
+        workload.capture = pcap_reader_open(capture_path, pcap_config);
+        if (!workload.capture) {
+            fprintf(stderr, "Cannot read capture %s\n", capture_path);
+            return 1;
+        };
+    } else if (replay_path) {
+        workload.replay = trace_reader_open(replay_path);
+        if (!workload.replay) {
+            fprintf(stderr, "Cannot read trace %s\n", replay_path);
+            return 1;
+        };
+
+        if (trace_reader_num_ports(workload.replay) != NUM_PORTS) {
+            fprintf(stderr, "Trace %s is not of %d ports\n", replay_path,
+                NUM_PORTS);
+            return 1;
+        };
+    } else {
+        workload.traffic = traffic_create(NUM_PORTS, traffic_config);
+    };
+
+    if (record_path) {
+        workload.record = trace_writer_create(record_path, NUM_PORTS);
+        if (!workload.record) {
+            fprintf(stderr, "Cannot create trace %s\n", record_path);
+            return 1;
+        };
+    };
+
+    termination.precision = precision;
+    termination.latency = batch_means_create();
+    termination.throughput = batch_means_create();
+    termination.batch_delivered = 0;
+    atomic_init(&termination.judged, 0);
+    termination.stop = 0;
+
+    warmup_latency = mser_create();
+    mser_t warmup_backlog = mser_create();
+
+    if (num_threads == 3) {
+        offered = run_pipelined(
+            network_switch_desc,
+            network_switch,
+            &workload,
+            num_slots,
+            warmup_backlog,
+            &packet_pool
+        );
+    } else {
+        packet_pool = packet_pool_local_init(PACKET_POOL_HUGE_PAGES);
+
+        void *arrivals[NUM_PORTS];
+        int stop = 0;
+        for (current_slot = 0; current_slot < num_slots && !stop;
+            current_slot++) {
+            offered += arrivals_generate(&workload, arrivals, current_slot);
+            network_switch_desc.tick(network_switch, arrivals);
+            mser_observe(warmup_backlog,
+                (double) cb_ib_voqs_iSLIP_backlog(network_switch),
+                current_slot);
+            stop = termination_slot_end(current_slot + 1);
+        };
+    };
+
+    /*  The run may have stopped early. */
+    num_slots = current_slot;
+
+    if (workload.traffic) {
+        traffic_free(workload.traffic);
+    };
+
+    if (workload.replay) {
+        trace_reader_close(workload.replay);
+    };
+
+    pcap_stats_t capture_stats;
+    if (workload.capture) {
+        pcap_reader_stats(workload.capture, &capture_stats);
+        pcap_reader_close(workload.capture);
+    };
+
+    free(workload.rules);
+    free(rules_path);
+
+    if (workload.record && !trace_writer_close(workload.record)) {
+        fprintf(stderr, "Cannot write trace %s\n", record_path);
+        return 1;
     };
 
+    if (workload.malformed) {
+        fprintf(stderr, "%s is malformed\n",
+            capture_path ? capture_path : replay_path);
+        return 1;
+    };
+
+    /*  Report results. */
+    unsigned long delivered = 0;
+    unsigned long total_latency = 0;
+    for (i = 0; i < NUM_PORTS; i++) {
+        delivered += hosts[i].delivered;
+        total_latency += hosts[i].total_latency;
+    };
+
+    printf("scheduler:     %s\n", scheduler_name);
+    if (capture_path) {
+        printf("traffic:       capture %s, %lu ns slots\n", capture_path,
+            capture_slot_ns);
+        printf("capture:       %lu packets, %lu skipped, %lu deferred, "
+            "%lu dropped\n", capture_stats.packets, capture_stats.skipped,
+            capture_stats.deferred, capture_stats.dropped);
+    } else if (replay_path) {
+        printf("traffic:       replay of %s\n", replay_path);
+    } else {
+        printf("traffic:       %s, %s, %s\n", pattern_name, arrivals_name,
+            rng_name);
+    };
+    printf("offered load:  %f\n", (double) offered / (num_slots * NUM_PORTS));
+    printf("throughput:    %f\n", (double) delivered / (num_slots * NUM_PORTS));
+    printf("mean latency:  %f slots\n",
+        delivered ? (double) total_latency / delivered : 0.0);
+    if (precision > 0) {
+        printf("precision:     latency +-%f, throughput +-%f (95%%), "
+            "%lu slots, %s\n",
+            batch_means_half_width(termination.latency),
+            batch_means_half_width(termination.throughput), num_slots,
+            termination.stop ? "converged" : "not converged");
+    };
+
+    /*  The warm-up ends where both series have settled. */
+    mser_truncation_t latency_truncation;
+    mser_truncation_t backlog_truncation;
+    mser_truncate(warmup_latency, &latency_truncation);
+    mser_truncate(warmup_backlog, &backlog_truncation);
+    printf("warm-up:       latency from slot %lu, backlog from slot %lu%s\n",
+        latency_truncation.start, backlog_truncation.start,
+        latency_truncation.settled && backlog_truncation.settled
+            ? ""
+            : ", not settled");
+    printf("steady state:  mean latency %f slots, mean backlog %f cells\n",
+        latency_truncation.mean, backlog_truncation.mean);
+
+    /*  Delays from arrival at the switch to departure, which are one slot
+        less than latencies, as packets arrive in the slot they are
+        generated and are received in the slot after they leave. */
+    histogram_t delay = histogram_create();
+    cb_ib_voqs_iSLIP_delay_histogram(network_switch, delay);
+    printf("delay:         p50 %lu, p90 %lu, p99 %lu, p99.9 %lu, "
+        "p99.99 %lu, p99.999 %lu, max %lu slots\n",
+        histogram_percentile(delay, 50), histogram_percentile(delay, 90),
+        histogram_percentile(delay, 99), histogram_percentile(delay, 99.9),
+        histogram_percentile(delay, 99.99),
+        histogram_percentile(delay, 99.999), histogram_max(delay));
+    histogram_free(delay);
+
+    shared_buffer_stats_t buffer_stats;
+    cb_ib_voqs_iSLIP_buffer_stats(network_switch, &buffer_stats);
+    printf("dropped:       %lu cells, %lu cells high water\n",
+        buffer_stats.dropped, buffer_stats.high_water);
+
+    packet_pool_stats_t pool_stats;
+    packet_pool_stats(packet_pool, &pool_stats);
+    printf("packet pool:   %lu cells high water, %lu slabs\n",
+        pool_stats.high_water, pool_stats.slabs);
+
+    /*  The switch still holds packets, which go back to the pool. */
     network_switch_desc.free(network_switch);
-};
\ No newline at end of file
+
+    if (num_threads == 3) {
+        packet_pool_free(packet_pool);
+    } else {
+        packet_pool_local_free();
+    };
+
+    batch_means_free(termination.latency);
+    batch_means_free(termination.throughput);
+    mser_free(warmup_latency);
+    mser_free(warmup_backlog);
+
+    return 0;
+};
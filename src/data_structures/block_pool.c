@@ -0,0 +1,124 @@
+/*  block_pool.c */
+
+#include "block_pool.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <malloc.h>
+
+#define CACHE_LINE_SIZE 64
+#define BLOCK_ALIGN 16
+#define BLOCKS_PER_CHUNK 64
+
+/*  Block pool structure. Free blocks are linked through their first word,
+    and chunks through a pointer in the last BLOCK_ALIGN bytes of each chunk,
+    after its blocks. */
+struct block_pool {
+    size_t block_size;
+    void *free_list;
+    void *chunks;
+    unsigned long in_use;
+    unsigned long capacity;
+};
+
+/*  Forward declare helper functions. */
+static void chunk_create(block_pool_t block_pool);
+
+/*  Block pool API implementation. */
+
+/*  Block pool create - blocks are block_size bytes, rounded up to a multiple
+    of BLOCK_ALIGN, so a block size which is a multiple of the cache line size
+    gives cache aligned blocks. */
+block_pool_t block_pool_create(size_t block_size) {
+    block_pool_t block_pool = (block_pool_t) malloc(sizeof(struct block_pool));
+    assert(block_pool);
+
+    block_size = (block_size + BLOCK_ALIGN - 1) & ~((size_t) BLOCK_ALIGN - 1);
+    if (block_size < BLOCK_ALIGN) {
+        block_size = BLOCK_ALIGN;
+    };
+
+    block_pool->block_size = block_size;
+    block_pool->free_list = NULL;
+    block_pool->chunks = NULL;
+    block_pool->in_use = 0;
+    block_pool->capacity = 0;
+
+    return block_pool;
+};
+
+/*  Block pool free - releases every chunk, including any blocks still in
+    use. */
+void block_pool_free(block_pool_t block_pool) {
+    size_t link = block_pool->block_size * BLOCKS_PER_CHUNK;
+    void *chunk = block_pool->chunks;
+
+    while (chunk) {
+        void *next = *(void **) ((char *) chunk + link);
+        free(chunk);
+        chunk = next;
+    };
+
+    free(block_pool);
+};
+
+/*  Allocate a block - from the free list, which is refilled with a new chunk
+    when empty. */
+void *block_pool_alloc(block_pool_t block_pool) {
+    if (block_pool->free_list == NULL) {
+        chunk_create(block_pool);
+    };
+
+    void *block = block_pool->free_list;
+    block_pool->free_list = *(void **) block;
+    block_pool->in_use++;
+
+    return block;
+};
+
+/*  Free a block back to its pool. */
+void block_pool_dealloc(block_pool_t block_pool, void *block) {
+    assert(block);
+
+    *(void **) block = block_pool->free_list;
+    block_pool->free_list = block;
+    block_pool->in_use--;
+};
+
+size_t block_pool_block_size(block_pool_t block_pool) {
+    return block_pool->block_size;
+};
+
+unsigned long block_pool_in_use(block_pool_t block_pool) {
+    return block_pool->in_use;
+};
+
+/*  Capacity - the number of blocks in every chunk allocated so far. */
+unsigned long block_pool_capacity(block_pool_t block_pool) {
+    return block_pool->capacity;
+};
+
+/*  Helper function implementations. */
+
+/*  Create chunk - allocate BLOCKS_PER_CHUNK blocks and push them onto the
+    free list, in address order. */
+static void chunk_create(block_pool_t block_pool) {
+    size_t block_size = block_pool->block_size;
+    size_t link = block_size * BLOCKS_PER_CHUNK;
+
+    char *chunk = (char *) aligned_alloc(CACHE_LINE_SIZE,
+        (link + BLOCK_ALIGN + CACHE_LINE_SIZE - 1) &
+            ~((size_t) CACHE_LINE_SIZE - 1));
+    assert(chunk);
+
+    *(void **) (chunk + link) = block_pool->chunks;
+    block_pool->chunks = chunk;
+
+    int i;
+    for (i = BLOCKS_PER_CHUNK - 1; i >= 0; i--) {
+        void *block = chunk + block_size * i;
+        *(void **) block = block_pool->free_list;
+        block_pool->free_list = block;
+    };
+
+    block_pool->capacity += BLOCKS_PER_CHUNK;
+};
@@ -0,0 +1,26 @@
+/*  block_pool.h
+
+    Pool of fixed size memory blocks, shared by the queues built from them.
+    Blocks are carved out of larger cache aligned chunks, and freed blocks
+    are kept on a free list for reuse, so that allocating and freeing a block
+    is O(1) and only the occasional new chunk touches malloc. Chunks are only
+    returned to the system when the pool is freed. */
+
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include <stddef.h>
+
+struct block_pool;
+typedef struct block_pool *block_pool_t;
+
+/*  Block pool API. */
+block_pool_t block_pool_create(size_t block_size);
+void block_pool_free(block_pool_t block_pool);
+void *block_pool_alloc(block_pool_t block_pool);
+void block_pool_dealloc(block_pool_t block_pool, void *block);
+size_t block_pool_block_size(block_pool_t block_pool);
+unsigned long block_pool_in_use(block_pool_t block_pool);
+unsigned long block_pool_capacity(block_pool_t block_pool);
+
+#endif
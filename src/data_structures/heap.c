@@ -22,7 +22,7 @@ static inline unsigned int parent_index(unsigned int index);
 static inline unsigned int left_child_index(unsigned int index);
 static inline unsigned int right_child_index(unsigned int index);
 static char has_child(heap_t heap, unsigned int index);
-static unsigned int largest_child_greater_than(
+static unsigned int smallest_child_less_than(
     heap_t heap,
     unsigned int index
 );
@@ -96,6 +96,7 @@ void heap_insert(heap_t heap, void *elem) {
             (void *) heap->elems,
             sizeof(void *) * heap->capacity
         );
+        assert(heap->elems);
     }
 
     heap->elems[heap->size] = elem;
@@ -126,8 +127,8 @@ void *heap_min(heap_t heap) {
 
 /*  Pop elements from heap - popping the minimum elements from a heap simply
     works by swapping the last element in the array into the place of the
-    first and then bubbling it down, by swapping it with the larger child
-    node until it is smaller than both children. This, of course, all assumes
+    first and then bubbling it down, by swapping it with the smaller child
+    node until it is no greater than both children. This, of course, all assumes
     that the number of elements is greater than zero. */
 void *heap_pop_min(heap_t heap) {
     assert(heap->size > 0);
@@ -142,9 +143,10 @@ void *heap_pop_min(heap_t heap) {
 
     while (
         has_child(heap, index) &&
-        (child_index = largest_child_greater_than(heap, index))
+        (child_index = smallest_child_less_than(heap, index))
     ) {
         swap_elem(heap, index, child_index);
+        index = child_index;
     }
 
     return min;
@@ -270,9 +272,10 @@ unsigned int heap_size(heap_t heap) {
     Then in 0-index: x - 1 has children y = 2x - 1 or y = 2x
     So if i = x - 1, then x = i + 1 and then i has children j = 2x - 1 or j = 2x
     so j = 2(i + 1) - 1 = 2i + 1 or j = 2(i + 1) = 2i + 2.
-    So when 0-indexed, i has children j = 2i + 1 and 2i + 2. */
+    So when 0-indexed, i has children j = 2i + 1 and 2i + 2, and so j has
+    parent i = (j - 1) / 2, rounding down. */
 static inline unsigned int parent_index(unsigned int index) {
-    return index / 2;
+    return (index - 1) / 2;
 };
 
 static inline unsigned int left_child_index(unsigned int index) {
@@ -288,12 +291,12 @@ static char has_child(heap_t heap, unsigned int index) {
         right_child_index(index) < heap->size;
 }
 
-/*  Get the largest child node of the provided index for which the indexed node
-    is greater than said child. If the indexed node is smaller than both of its
-    children return 0, otherwise return the index of the largest child node
-    that the provided node is greater than (for use in bubbling down during the
-    heap pop function).*/
-static unsigned int largest_child_greater_than(
+/*  Get the smallest child node of the provided index for which the indexed
+    node is greater than said child. If the indexed node is no greater than
+    both of its children return 0, otherwise return the index of the smallest
+    child node that the provided node is greater than (for use in bubbling
+    down during the heap pop function).*/
+static unsigned int smallest_child_less_than(
     heap_t heap,
     unsigned int index
 ) {
@@ -315,8 +318,9 @@ static unsigned int largest_child_greater_than(
 
         if (curr_left == GT && curr_right == GT) {
             /*  If curent > left and current > right then we want to return the
-                larger of the left and right children. */
-            return (left_right == GT) ? left_child : right_child; 
+                smaller of the left and right children, which becomes the
+                parent of the other. */
+            return (left_right == GT) ? right_child : left_child;
         } else if (curr_left == GT) {
             /* If current > left but not current > right then we only want to
                 swap with the left. */
@@ -3,6 +3,7 @@
     Generic array-based heap. */
 
 #ifndef HEAP_H
+#define HEAP_H
 
 /*  Forward declare heap in this file but define it in .c file as heap
     implementation is hidden to users for modularity. */
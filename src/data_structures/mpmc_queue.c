@@ -0,0 +1,221 @@
+/*  mpmc_queue.c */
+
+#include "mpmc_queue.h"
+#include <assert.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <malloc.h>
+
+#define CACHE_LINE_SIZE 64
+
+/*  Cell - for position pos of the ring, seq is pos while the cell is free
+    for a producer, and pos + 1 once it holds an element for a consumer, who
+    then frees it for the next lap by setting it to pos + capacity. */
+struct cell {
+    atomic_size_t seq;
+    void *elem;
+};
+
+/*  Queue structure. The producer and consumer positions count every
+    enqueue and dequeue ever claimed, and are kept on separate cache lines
+    from each other and from the read only fields. */
+struct mpmc_queue {
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t enqueue_pos;
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t dequeue_pos;
+    _Alignas(CACHE_LINE_SIZE) struct cell *cells;
+    size_t mask;
+    free_func_t free_elem;
+};
+
+/*  MPMC queue API implementation. */
+
+/*  MPMC queue create - the capacity is rounded up to a power of two, of at
+    least 2. */
+mpmc_queue_t mpmc_queue_create(unsigned int capacity, free_func_t free_elem) {
+    mpmc_queue_t queue = (mpmc_queue_t) aligned_alloc(
+        CACHE_LINE_SIZE,
+        sizeof(struct mpmc_queue)
+    );
+    assert(queue);
+
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    };
+
+    queue->cells = (struct cell *) aligned_alloc(
+        CACHE_LINE_SIZE,
+        (sizeof(struct cell) * size + CACHE_LINE_SIZE - 1) &
+            ~((size_t) CACHE_LINE_SIZE - 1)
+    );
+    assert(queue->cells);
+
+    size_t pos;
+    for (pos = 0; pos < size; pos++) {
+        atomic_init(&queue->cells[pos].seq, pos);
+    };
+
+    queue->mask = size - 1;
+    queue->free_elem = free_elem;
+    atomic_init(&queue->enqueue_pos, 0);
+    atomic_init(&queue->dequeue_pos, 0);
+
+    return queue;
+};
+
+/*  MPMC queue free - free the remaining elements with the function provided
+    at creation time. No other thread may be using the queue. */
+void mpmc_queue_free(mpmc_queue_t queue) {
+    void *elem;
+    while (mpmc_queue_dequeue(queue, &elem)) {
+        if (queue->free_elem) {
+            queue->free_elem(elem);
+        };
+    };
+
+    free(queue->cells);
+    free(queue);
+};
+
+/*  Enqueue elem - claim the cell at the producer position if it is free
+    for this lap. A cell still full from the last lap means the queue is
+    full. */
+int mpmc_queue_enqueue(mpmc_queue_t queue, void *elem) {
+    return mpmc_queue_enqueue_bulk(queue, &elem, 1) == 1;
+};
+
+/*  Dequeue - claim the cell at the consumer position if it is full for
+    this lap. A cell not yet filled means the queue is empty. */
+int mpmc_queue_dequeue(mpmc_queue_t queue, void **elem_out) {
+    assert(elem_out);
+    return mpmc_queue_dequeue_bulk(queue, elem_out, 1) == 1;
+};
+
+/*  Bulk enqueue - claim as many consecutive free cells as are available, up
+    to count, with one compare and swap, then fill them in order. Since a
+    free cell can only be filled by the producer which claims its position,
+    the cells seen free stay free until the claim. */
+unsigned int mpmc_queue_enqueue_bulk(
+    mpmc_queue_t queue,
+    void **elems,
+    unsigned int count
+) {
+    assert(elems || count == 0);
+
+    size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    size_t available;
+
+    while (1) {
+        available = 0;
+        while (available < count) {
+            struct cell *cell = &queue->cells[(pos + available) & queue->mask];
+            size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+
+            if (seq != pos + available) {
+                break;
+            };
+            available++;
+        };
+
+        if (available == 0) {
+            /*  Either the queue is full, or another producer has claimed pos
+                and the position must be reloaded. */
+            struct cell *cell = &queue->cells[pos & queue->mask];
+            size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+
+            if ((ptrdiff_t) (seq - pos) < 0 || count == 0) {
+                return 0;
+            };
+
+            pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+            continue;
+        };
+
+        if (atomic_compare_exchange_weak_explicit(
+            &queue->enqueue_pos,
+            &pos,
+            pos + available,
+            memory_order_relaxed,
+            memory_order_relaxed
+        )) {
+            break;
+        };
+    };
+
+    size_t k;
+    for (k = 0; k < available; k++) {
+        struct cell *cell = &queue->cells[(pos + k) & queue->mask];
+        cell->elem = elems[k];
+        atomic_store_explicit(&cell->seq, pos + k + 1, memory_order_release);
+    };
+
+    return available;
+};
+
+/*  Bulk dequeue - claim as many consecutive full cells as are available, up
+    to max_count, with one compare and swap, then empty them in order. */
+unsigned int mpmc_queue_dequeue_bulk(
+    mpmc_queue_t queue,
+    void **elems_out,
+    unsigned int max_count
+) {
+    assert(elems_out || max_count == 0);
+
+    size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    size_t available;
+
+    while (1) {
+        available = 0;
+        while (available < max_count) {
+            struct cell *cell = &queue->cells[(pos + available) & queue->mask];
+            size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+
+            if (seq != pos + available + 1) {
+                break;
+            };
+            available++;
+        };
+
+        if (available == 0) {
+            /*  Either the queue is empty, or another consumer has claimed
+                pos and the position must be reloaded. */
+            struct cell *cell = &queue->cells[pos & queue->mask];
+            size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+
+            if ((ptrdiff_t) (seq - (pos + 1)) < 0 || max_count == 0) {
+                return 0;
+            };
+
+            pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+            continue;
+        };
+
+        if (atomic_compare_exchange_weak_explicit(
+            &queue->dequeue_pos,
+            &pos,
+            pos + available,
+            memory_order_relaxed,
+            memory_order_relaxed
+        )) {
+            break;
+        };
+    };
+
+    size_t k;
+    for (k = 0; k < available; k++) {
+        struct cell *cell = &queue->cells[(pos + k) & queue->mask];
+        elems_out[k] = cell->elem;
+        atomic_store_explicit(
+            &cell->seq,
+            pos + k + queue->mask + 1,
+            memory_order_release
+        );
+    };
+
+    return available;
+};
+
+unsigned int mpmc_queue_capacity(mpmc_queue_t queue) {
+    return (unsigned int) (queue->mask + 1);
+};
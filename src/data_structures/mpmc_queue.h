@@ -0,0 +1,42 @@
+/*  mpmc_queue.h
+
+    Bounded lock-free queue of pointers for any number of producer and
+    consumer threads, after Dmitry Vyukov's bounded MPMC queue. Every cell
+    carries a sequence number which tells producers and consumers whether it
+    is free or full for the current lap of the ring, so each operation is a
+    single compare and swap on a shared position plus writes to the cell
+    itself, and producers and consumers only contend among themselves.
+
+    The queue never allocates after creation. Operations fail rather than
+    wait when the queue is full (or empty), leaving the caller to decide how
+    to back off. */
+
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include "heap.h"
+
+struct mpmc_queue;
+typedef struct mpmc_queue *mpmc_queue_t;
+
+/*  MPMC queue API. Every function but create and free may be called from
+    any number of threads at once. enqueue and dequeue return 1 on success
+    and 0 if the queue was full or empty, and the bulk variants return the
+    number of elements moved, which may be fewer than asked for. */
+mpmc_queue_t mpmc_queue_create(unsigned int capacity, free_func_t free_elem);
+void mpmc_queue_free(mpmc_queue_t queue);
+int mpmc_queue_enqueue(mpmc_queue_t queue, void *elem);
+int mpmc_queue_dequeue(mpmc_queue_t queue, void **elem_out);
+unsigned int mpmc_queue_enqueue_bulk(
+    mpmc_queue_t queue,
+    void **elems,
+    unsigned int count
+);
+unsigned int mpmc_queue_dequeue_bulk(
+    mpmc_queue_t queue,
+    void **elems_out,
+    unsigned int max_count
+);
+unsigned int mpmc_queue_capacity(mpmc_queue_t queue);
+
+#endif
@@ -15,8 +15,16 @@ struct queue {
     free_func_t free_elem;
 };
 
+/*  The capacity starts at DEFAULT_CAPACITY, which must be a power of two,
+    and only ever doubles, so indices wrap with a mask rather than a
+    modulo. */
 #define DEFAULT_CAPACITY 16
 
+_Static_assert(
+    (DEFAULT_CAPACITY & (DEFAULT_CAPACITY - 1)) == 0,
+    "DEFAULT_CAPACITY must be a power of two"
+);
+
 /*  Queue API implementation. */
 
 /*  Queue create - creating a queue simply involves allocating a new queue
@@ -44,11 +52,12 @@ queue_t queue_create(free_func_t free_elem) {
     be deallocated. Finally, the queue structure itself needs to be freed. */
 void queue_free(queue_t queue) {
     int i = queue->head;
+    int count;
 
-    while (i != queue->tail) {
+    for (count = 0; count < queue->size; count++) {
         queue->free_elem(queue->elems[i]);
 
-        i = (i + 1) % queue->capacity;
+        i = (i + 1) & (queue->capacity - 1);
     };
 
     free((void *) queue->elems);
@@ -80,19 +89,20 @@ void queue_enqueue(queue_t queue, void *elem) {
         
         int i = queue->head;
         int index = 0;
-        while (i != queue->tail) {
+        while (index < size) {
             new_buffer[index] = queue->elems[i];
-            i = (i + 1) % queue->capacity;
+            i = (i + 1) & (queue->capacity - 1);
             index++;
         };
         free(queue->elems);
         queue->elems = new_buffer;
+        queue->capacity = queue->capacity * 2;
         queue->head = 0;
         queue->tail = index;
     };
 
     queue->elems[queue->tail] = elem;
-    queue->tail = (queue->tail + 1) % queue->capacity;
+    queue->tail = (queue->tail + 1) & (queue->capacity - 1);
     queue->size++;
 };
 
@@ -114,7 +124,7 @@ void *queue_dequeue(queue_t queue) {
     };
 
     void *elem = queue->elems[queue->head];
-    queue->head = (queue->head + 1) % queue->capacity;
+    queue->head = (queue->head + 1) & (queue->capacity - 1);
     queue->size--;
     
     return elem;
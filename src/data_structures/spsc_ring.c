@@ -0,0 +1,191 @@
+/*  spsc_ring.c */
+
+#include "spsc_ring.h"
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#define CACHE_LINE_SIZE 64
+
+/*  Ring structure. head and tail count elements popped and pushed, and wrap
+    freely, so the ring holds tail - head elements and full and empty are
+    never ambiguous. Each group of fields is only written by one side. */
+struct spsc_ring {
+    /*  Producer. */
+    _Alignas(CACHE_LINE_SIZE) atomic_uint tail;
+    unsigned int cached_head;
+
+    /*  Consumer. */
+    _Alignas(CACHE_LINE_SIZE) atomic_uint head;
+    unsigned int cached_tail;
+
+    /*  Read only after creation. */
+    _Alignas(CACHE_LINE_SIZE) size_t elem_size;
+    unsigned int capacity;
+    unsigned int mask;
+    char *elems;
+};
+
+/*  Forward declare helper functions. */
+static void copy_in(
+    spsc_ring_t ring,
+    unsigned int pos,
+    const char *elems,
+    unsigned int count
+);
+static void copy_out(
+    spsc_ring_t ring,
+    unsigned int pos,
+    char *elems_out,
+    unsigned int count
+);
+
+/*  SPSC ring API implementation. */
+
+/*  SPSC ring create - the capacity is rounded up to a power of two, so
+    indices wrap with a mask. */
+spsc_ring_t spsc_ring_create(size_t elem_size, unsigned int capacity) {
+    assert(elem_size > 0);
+    assert(capacity > 0);
+
+    spsc_ring_t ring = (spsc_ring_t) aligned_alloc(
+        CACHE_LINE_SIZE,
+        sizeof(struct spsc_ring)
+    );
+    assert(ring);
+
+    unsigned int size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    };
+
+    atomic_init(&ring->tail, 0);
+    ring->cached_head = 0;
+    atomic_init(&ring->head, 0);
+    ring->cached_tail = 0;
+
+    ring->elem_size = elem_size;
+    ring->capacity = size;
+    ring->mask = size - 1;
+
+    ring->elems = (char *) aligned_alloc(
+        CACHE_LINE_SIZE,
+        (elem_size * size + CACHE_LINE_SIZE - 1) &
+            ~((size_t) CACHE_LINE_SIZE - 1)
+    );
+    assert(ring->elems);
+
+    return ring;
+};
+
+/*  SPSC ring free - neither side may be using the ring. */
+void spsc_ring_free(spsc_ring_t ring) {
+    free(ring->elems);
+    free(ring);
+};
+
+/*  Push - copy up to count elements in, in order, and publish them. */
+unsigned int spsc_ring_push(
+    spsc_ring_t ring,
+    const void *elems,
+    unsigned int count
+) {
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned int space = ring->capacity - (tail - ring->cached_head);
+
+    if (space < count) {
+        ring->cached_head =
+            atomic_load_explicit(&ring->head, memory_order_acquire);
+        space = ring->capacity - (tail - ring->cached_head);
+    };
+
+    if (count > space) {
+        count = space;
+    };
+
+    if (count > 0) {
+        copy_in(ring, tail, (const char *) elems, count);
+        atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+    };
+
+    return count;
+};
+
+/*  Pop - copy up to max_count elements out, in order, and release their
+    slots to the producer. */
+unsigned int spsc_ring_pop(
+    spsc_ring_t ring,
+    void *elems_out,
+    unsigned int max_count
+) {
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int count = ring->cached_tail - head;
+
+    if (count < max_count) {
+        ring->cached_tail =
+            atomic_load_explicit(&ring->tail, memory_order_acquire);
+        count = ring->cached_tail - head;
+    };
+
+    if (count > max_count) {
+        count = max_count;
+    };
+
+    if (count > 0) {
+        copy_out(ring, head, (char *) elems_out, count);
+        atomic_store_explicit(&ring->head, head + count, memory_order_release);
+    };
+
+    return count;
+};
+
+unsigned int spsc_ring_capacity(spsc_ring_t ring) {
+    return ring->capacity;
+};
+
+/*  Helper function implementations. */
+
+/*  Copy count elements into the ring from index pos, in at most two pieces
+    either side of the wrap. */
+static void copy_in(
+    spsc_ring_t ring,
+    unsigned int pos,
+    const char *elems,
+    unsigned int count
+) {
+    unsigned int start = pos & ring->mask;
+    unsigned int first = ring->capacity - start;
+    if (first > count) {
+        first = count;
+    };
+
+    memcpy(ring->elems + ring->elem_size * start, elems, ring->elem_size * first);
+    memcpy(
+        ring->elems,
+        elems + ring->elem_size * first,
+        ring->elem_size * (count - first)
+    );
+};
+
+/*  Copy count elements out of the ring from index pos. */
+static void copy_out(
+    spsc_ring_t ring,
+    unsigned int pos,
+    char *elems_out,
+    unsigned int count
+) {
+    unsigned int start = pos & ring->mask;
+    unsigned int first = ring->capacity - start;
+    if (first > count) {
+        first = count;
+    };
+
+    memcpy(elems_out, ring->elems + ring->elem_size * start, ring->elem_size * first);
+    memcpy(
+        elems_out + ring->elem_size * first,
+        ring->elems,
+        ring->elem_size * (count - first)
+    );
+};
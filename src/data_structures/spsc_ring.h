@@ -0,0 +1,39 @@
+/*  spsc_ring.h
+
+    Bounded lock-free ring buffer for exactly one producer thread and one
+    consumer thread, e.g. to link the stages of a pipeline. Elements are
+    fixed size records copied in and out in batches - a batch is published
+    to the consumer, or released back to the producer, with a single store.
+
+    The producer and consumer indices live on separate cache lines, and each
+    side keeps a private copy of the other side's index, which it only
+    refreshes when the ring looks full (or empty). In steady state a batch
+    therefore costs one shared cache line transfer rather than one per
+    element. */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stddef.h>
+
+struct spsc_ring;
+typedef struct spsc_ring *spsc_ring_t;
+
+/*  SPSC ring API. push may only be called from the producer thread and pop
+    from the consumer thread, and both return the number of elements moved,
+    which may be fewer than asked for. */
+spsc_ring_t spsc_ring_create(size_t elem_size, unsigned int capacity);
+void spsc_ring_free(spsc_ring_t ring);
+unsigned int spsc_ring_push(
+    spsc_ring_t ring,
+    const void *elems,
+    unsigned int count
+);
+unsigned int spsc_ring_pop(
+    spsc_ring_t ring,
+    void *elems_out,
+    unsigned int max_count
+);
+unsigned int spsc_ring_capacity(spsc_ring_t ring);
+
+#endif
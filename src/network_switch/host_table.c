@@ -1,6 +1,8 @@
 /*  host_table.c */
 #include "host_table.h"
 #include <assert.h>
+#include <string.h>
+#include <malloc.h>
 
 struct port_elem {
     port_num_t port_num;
@@ -16,8 +18,8 @@ struct host_table {
 
 /*  Forward declare functions. */
 port_elem_t port_elem_create(port_num_t port);
-void port_elem_free(port_elem_t port_elem);
-port_elem_t port_elem_value(port_elem_t port_elem);
+void port_elem_free(void *port_elem);
+port_num_t port_elem_value(port_elem_t port_elem);
 
 /*  API Implementation. */
 host_table_t host_table_create(port_num_t num_ports, addr_desc_t addr_desc) {
@@ -35,9 +37,14 @@ host_table_t host_table_create(port_num_t num_ports, addr_desc_t addr_desc) {
     assert(host_table->addr_table);
 
     host_table->hosts =
-        (host_desc_t *) malloc(sizeof(struct host_table) * num_ports);
+        (host_desc_t *) malloc(sizeof(host_desc_t) * num_ports);
     assert(host_table->hosts);
 
+    port_num_t i;
+    for (i = 0; i < num_ports; i++) {
+        host_table->hosts[i].active = HOST_DESC_INACTIVE;
+    };
+
     return host_table;
 };
 
@@ -48,6 +55,14 @@ void host_table_free(host_table_t host_table) {
 
     hash_table_free(host_table->addr_table);
 
+    /*  Registered host descriptors own their address structures. */
+    port_num_t i;
+    for (i = 0; i < host_table->num_ports; i++) {
+        if (host_table->hosts[i].active == HOST_DESC_ACTIVE) {
+            host_table->hosts[i].addr_free(host_table->hosts[i].addr);
+        };
+    };
+
     free((void *) host_table->hosts);
 
     free((void *) host_table);
@@ -73,12 +88,12 @@ register_result_t host_table_register(
 
     port_elem_t port_elem = port_elem_create(port);
 
-    hash_table_insert(host_table->addr_table, addr, (void *) port_elem_create);
+    hash_table_insert(host_table->addr_table, addr, (void *) port_elem);
 
     host_table->hosts[port] = host_desc;
     host_table->hosts[port].active = HOST_DESC_ACTIVE;
 
-    return hash_table_insert;
+    return REG_SUCCESS;
 };
 
 register_result_t host_table_deregister(
@@ -99,9 +114,11 @@ register_result_t host_table_deregister(
         This is not the same memory as &host_table->hosts[port].addr, but the
         value will be the same according to the comparator as it is simply
         a copy of this. */
-    hash_table_remove(host_table->addr_table, &host_table->hosts[port].addr);
+    hash_table_remove(host_table->addr_table, host_table->hosts[port].addr);
 
     host_table->hosts[port].active = HOST_DESC_INACTIVE;
+
+    return REG_SUCCESS;
 };
 
 int host_table_port_lookup(
@@ -126,7 +143,7 @@ int host_table_host_lookup(
     port_num_t port,
     host_desc_t *host_out
 ) {
-    if (host_table->hosts[port].active) {
+    if (host_table->hosts[port].active == HOST_DESC_ACTIVE) {
         *host_out = host_table->hosts[port];
         
         return 1;
@@ -135,6 +152,17 @@ int host_table_host_lookup(
     return 0;
 };
 
+/*  Host get - like host_table_host_lookup, but returns a pointer to the
+    registered descriptor rather than copying it, or NULL if no host is
+    registered on the port. The pointer is invalidated by deregistering. */
+host_desc_t *host_table_host_get(host_table_t host_table, port_num_t port) {
+    if (host_table->hosts[port].active == HOST_DESC_ACTIVE) {
+        return &host_table->hosts[port];
+    };
+
+    return NULL;
+};
+
 /*  Helper function implementations. */
 port_elem_t port_elem_create(port_num_t port) {
     port_elem_t port_elem = (port_elem_t) malloc(sizeof(struct port_elem));
@@ -142,10 +170,10 @@ port_elem_t port_elem_create(port_num_t port) {
     return port_elem;
 };
 
-void port_elem_free(port_elem_t port_elem) {
+void port_elem_free(void *port_elem) {
     free((void *) port_elem);
 };
 
-port_elem_t port_elem_value(port_elem_t port_elem) {
+port_num_t port_elem_value(port_elem_t port_elem) {
     return port_elem->port_num;
 };
\ No newline at end of file
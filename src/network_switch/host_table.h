@@ -34,5 +34,6 @@ int host_table_host_lookup(
     port_num_t port,
     host_desc_t *host_out
 );
+host_desc_t *host_table_host_get(host_table_t host_table, port_num_t port);
 
 #endif
\ No newline at end of file
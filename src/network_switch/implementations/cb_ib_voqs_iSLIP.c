@@ -1,111 +1,186 @@
 /*  cb_ib_voqs_iSLIP.c
 
     Crossbar, input buffered, virtual output queues, iSLIP-scheduled switch
-    implementation. */
+    implementation. The crossbar scheduler is pluggable, see
+    cb_ib_voqs_iSLIP_create_with_config, with iSLIP as the default.
+
+    Cells are stamped with their arrival slot at ingress, and the number of
+    slots each waited in its VOQ recorded at egress, in a histogram per
+    output port. The phases of the tick are profiled when built with
+    SWITCH_PROFILE, see switch_profile.h.
+
+    The tick carries the tracepoints (see probes.h)
+        voq_enqueue(slot, input, output, depth)
+        schedule_done(slot, matched, backlog)
+        voq_dequeue(slot, input, output, depth, delay)
+    where depth is the VOQ's length after the cell was added or removed,
+    matched the size of the matching and backlog the cells in all VOQs. */
 
 #include "cb_ib_voqs_iSLIP.h"
-#include "./../data_structures/queue.h"
 #include "./../host_table.h"
+#include "./../voq_matrix.h"
+#include "./../shared_buffer.h"
+#include "./../packet_pool.h"
 #include "./../network_switch_common.h"
+#include "./../switch_profile.h"
+#include "./../../probes.h"
+#include "./../schedulers/iSLIP.h"
+#include "./../../stats/histogram.h"
 #include <assert.h>
 #include <stddef.h>
-#include <math.h>
+#include <string.h>
+#include <malloc.h>
+
+#define DEFAULT_VOQ_IDLE_SLOTS 1024
 
 /*  Switch structure. */
 struct network_switch {
     port_num_t num_ports;
-    queue_t **voqs;
+    voq_matrix_t voqs;
+    shared_buffer_t buffer;
     host_table_t host_table;
     addr_desc_t addr_desc;
+    unsigned long (*get_length_from_packet)(void *);
+    unsigned long slot;
+    voq_mode_t voq_mode;
+
+    i_crossbar_scheduler_t scheduler;
+    void *scheduler_state;
 
-    port_num_t *iSLIP_grant_ptr;
-    port_num_t *iSLIP_accept_ptr;
+    port_num_t *arrival_output;
+    char *arrival_active;
 
-    port_num_t *port_match;
-    char *port_match_active;
+    port_matching_t *port_match;
+
+    histogram_t *delay;
 };
 
 typedef struct network_switch *network_switch_t;
 
-/*  Cycle switch interface implementation. */
+/*  Cycle switch interface implementation. Packets are owned as described in
+    network_switch_interfaces.h, and are cells of the packet pool. */
 static void free_packet(void *packet) {
-    free(packet);
+    packet_free(packet);
 };
 
-/*  Create a new switch of the cb_ib_voqs_iSLIP variety. */
-static void *cb_ib_voqs_iSLIP_create(port_num_t num_ports, addr_desc_t addr_desc) {
+/*  Default configuration - schedule with iSLIP, keep packets in an
+    unbounded buffer, release VOQs which have been empty for
+    DEFAULT_VOQ_IDLE_SLOTS slots, and take every packet to be PACKET_SIZE
+    bytes. */
+cb_ib_voqs_iSLIP_config_t cb_ib_voqs_iSLIP_default_config() {
+    cb_ib_voqs_iSLIP_config_t config;
+    config.scheduler = iSLIP_scheduler();
+    config.voq_idle_slots = DEFAULT_VOQ_IDLE_SLOTS;
+    config.voq_mode = VOQ_MODE_PACKETS;
+    config.buffer = shared_buffer_unbounded_config();
+    config.get_length_from_packet = NULL;
+
+    return config;
+};
+
+/*  Create a new switch of the cb_ib_voqs_iSLIP variety with the given
+    configuration. */
+void *cb_ib_voqs_iSLIP_create_with_config(
+    port_num_t num_ports,
+    addr_desc_t addr_desc,
+    cb_ib_voqs_iSLIP_config_t config
+) {
+    assert(config.scheduler.init);
+    assert(config.scheduler.schedule);
+    assert(config.scheduler.free);
+    assert(num_ports <= PACKET_DESC_MAX_PORTS);
+
     network_switch_t network_switch =
         (network_switch_t) malloc(sizeof(struct network_switch));
     assert(network_switch);
 
     network_switch->num_ports = num_ports;
     network_switch->addr_desc = addr_desc;
+    network_switch->get_length_from_packet = config.get_length_from_packet;
+    network_switch->slot = 0;
+    network_switch->voq_mode = config.voq_mode;
 
-    network_switch->voqs =
-        (queue_t **) malloc(sizeof(queue_t *) * network_switch->num_ports);
+    network_switch->voqs = voq_matrix_create(
+        network_switch->num_ports,
+        config.voq_mode,
+        0,
+        config.voq_idle_slots
+    );
     assert(network_switch->voqs);
-    
-    int i;
-    for (i = 0; i < network_switch->num_ports; i++) {
-        network_switch->voqs[i] = queue_create(&free_packet);
-        assert(network_switch->voqs[i]);
-    };
+
+    network_switch->buffer =
+        shared_buffer_create(network_switch->num_ports, config.buffer);
+    assert(network_switch->buffer);
 
     network_switch->host_table =
         host_table_create(network_switch->num_ports, addr_desc);
     assert(network_switch->host_table);
+
+    network_switch->scheduler = config.scheduler;
+    network_switch->scheduler_state =
+        network_switch->scheduler.init(network_switch->num_ports);
+    assert(network_switch->scheduler_state);
     
-    network_switch->iSLIP_grant_ptr =
-        (port_num_t *) malloc(sizeof(port_num_t) * network_switch->num_ports);
-    assert(network_switch->iSLIP_grant_ptr);
-    memset(
-        network_switch->iSLIP_grant_ptr,
-        0,
-        sizeof(port_num_t) * network_switch->num_ports
-    );
-    
-    network_switch->iSLIP_accept_ptr =
+    network_switch->arrival_output =
         (port_num_t *) malloc(sizeof(port_num_t) * network_switch->num_ports);
-    assert(network_switch->iSLIP_accept_ptr);
-    memset(
-        network_switch->iSLIP_accept_ptr,
-        0,
-        sizeof(port_num_t) * network_switch->num_ports
-    );
-    
+    assert(network_switch->arrival_output);
+
+    network_switch->arrival_active =
+        (char *) malloc(sizeof(char) * network_switch->num_ports);
+    assert(network_switch->arrival_active);
+
     network_switch->port_match =
-        (port_num_t *) malloc(sizeof(port_num_t) * network_switch->num_ports);
+        port_matching_create(network_switch->num_ports);
     assert(network_switch->port_match);
 
-    network_switch->port_match_active =
-        (char *) malloc(sizeof(char) * network_switch->num_ports);
-    assert(network_switch->port_match_active);
+    network_switch->delay =
+        (histogram_t *) malloc(sizeof(histogram_t) * network_switch->num_ports);
+    assert(network_switch->delay);
+
+    port_num_t i;
+    for (i = 0; i < network_switch->num_ports; i++) {
+        network_switch->delay[i] = histogram_create();
+    };
 
     return (void *) network_switch;
 };
 
+/*  Create a new switch of the cb_ib_voqs_iSLIP variety. */
+static void *cb_ib_voqs_iSLIP_create(port_num_t num_ports, addr_desc_t addr_desc) {
+    return cb_ib_voqs_iSLIP_create_with_config(
+        num_ports,
+        addr_desc,
+        cb_ib_voqs_iSLIP_default_config()
+    );
+};
+
 /*  Free a switch of the cb_ib_voqs_iSLIP variety. */
 static void cb_ib_voqs_iSLIP_free(void *network_switch_ptr) {
     assert(network_switch_ptr);
     
     network_switch_t network_switch = (network_switch_t) network_switch_ptr;
 
-    int i;
-    for (i = 0; i < network_switch->num_ports; i++) {
-        queue_free(network_switch->voqs[i]);
-    };
+    voq_matrix_free(network_switch->voqs, &free_packet);
 
-    free(network_switch->voqs);
+    shared_buffer_free(network_switch->buffer);
 
-    free(network_switch->iSLIP_grant_ptr);
+    network_switch->scheduler.free(network_switch->scheduler_state);
 
-    free(network_switch->iSLIP_accept_ptr);
+    free(network_switch->arrival_output);
 
-    free(network_switch->port_match);
+    free(network_switch->arrival_active);
 
-    free(network_switch->port_match_active);
+    port_matching_free(network_switch->port_match);
+
+    port_num_t i;
+    for (i = 0; i < network_switch->num_ports; i++) {
+        histogram_free(network_switch->delay[i]);
+    };
+    free(network_switch->delay);
 
     host_table_free(network_switch->host_table);
+
+    free(network_switch);
 };
 
 /*  Register a host. */
@@ -133,146 +208,9 @@ register_result_t cb_ib_voqs_iSLIP_cycle_switch_deregister_host(
     return host_table_deregister(network_switch->host_table, port_num);
 };
 
-/*  iSLIP works as follows:
-        Input round:
-            The input ports send messages to all of the output ports they wish
-            to output to.
-            
-        Output round:
-            The output ports receive their messages and then choose one to
-            grant starting from the output pointer entry.
-        
-        Input grant:
-            The input ports then receive their grants and accept those starting
-            from the grant.*/
-static void iSLIP_schedule(
-    network_switch_t network_switch,
-    port_num_t *port_mapping,
-    char *mapping_active
-) {
-    assert(network_switch);
-    assert(port_mapping);
-    assert(mapping_active);
-    
-    int r;
-    int i;
-    int j;
-
-    /*  Reset schedule. */
-    for (i = 0; i < network_switch->num_ports; i++) {
-        port_mapping[i] = 0;
-        mapping_active[i] = 0;
-    };
-
-    /*  Create arrays for matched inputs, matched outputs, request granted*/
-    /*  input_matched[i] = 0 if input i unmatched, 1 if input i matched. */
-    char *input_matched =
-        (char *) malloc(sizeof(char) * network_switch->num_ports);
-    assert(input_matched);
-    memset(input_matched, 0, sizeof(char) * network_switch->num_ports);
-
-    /*  output_matched[i] = 0 if output i unmatched, 1 if output i matched. */
-    char *output_matched =
-        (char *) malloc(sizeof(char) * network_switch->num_ports);
-    assert(output_matched);
-    memset(output_matched, 0, sizeof(char) * network_switch->num_ports);
-
-    /*  grant_target[i] = j if output i has made grant to input j. Mapping only
-        valid if grant_made[i] = 1 (see next). */
-    port_num_t *grant_target =
-        (port_num_t *) malloc(sizeof(port_num_t) * network_switch->num_ports);
-    
-    /*  grant_made[i] = 1 if output i has made a grant this round and
-        grant_made[i] = 0 if output i has not made a grant this round. */
-    char *grant_made =
-        (char *) malloc(sizeof(char) * network_switch->num_ports);
-    memset(grant_made, 0, sizeof(char) * network_switch->num_ports);
-
-    /*  Iterate through rounds. */
-    int grant_input_found;
-    int match_found;
-
-    for (r = 0; r < ISLIP_ROUNDS(network_switch->num_ports); r++) {
-        /*  Reset grants. */
-        memset(grant_made, 0, sizeof(char) * network_switch->num_ports);
-
-        /*  Grant phase - each unmatched output cycles through unmatched inputs
-            starting at the input_ptr and sends the grant to the first
-            one with a packet to be sent to said output. */
-        for (i = 0; i < network_switch->num_ports; i++) {
-            if (output_matched[i] == 0) {
-                grant_input_found = 0;
-
-                for (
-                    j = 0;
-                    j < network_switch->num_ports && !grant_input_found;
-                    j++
-                ) {
-                    port_num_t input_port =
-                        (network_switch->iSLIP_grant_ptr[i] + j) %
-                        network_switch->num_ports;
-
-                    if (input_matched[input_port] == 0) {
-                        if (queue_size(
-                            network_switch->voqs[input_port][i]
-                        ) > 0) {
-                            grant_target[i] = input_port;
-                            grant_made[i] = 1;
-                            grant_input_found = 1;
-                        };
-                    };
-                };
-            };
-        };
-
-        /*  Accept phase - each unmatched input cycles through its grants and
-            chooses the first one starting from output_ptr. It accepts the
-            grant and the input and output become matched. */
-        for (
-            i = 0;
-            i < network_switch->num_ports;
-            i++
-        ) {
-            if (input_matched[i] == 0) {
-                match_found = 0;
-                for (j = 0; j < network_switch->num_ports && !match_found; j++) {
-                    port_num_t output_port =
-                        (network_switch->iSLIP_accept_ptr[i] + j) %
-                        network_switch->num_ports;
-                    
-                    if (output_matched[output_port] == 0) {
-                        if (
-                            grant_made[output_port] == 1 &&
-                            grant_target[output_port] == i
-                        ) {
-                            /*  Accept. */
-                            match_found = 1;
-                            input_matched[i] = 1;
-                            output_matched[output_port] = 1;
-                            port_mapping[i] = output_port;
-                            mapping_active[i] = 1;
-                            network_switch->iSLIP_grant_ptr[output_port] =
-                                (network_switch->iSLIP_grant_ptr[output_port] + 1) %
-                                network_switch->num_ports;
-                            network_switch->iSLIP_accept_ptr[i] =
-                                (network_switch->iSLIP_accept_ptr[i] + 1) %
-                                network_switch->num_ports;
-                        };
-                    };
-                };
-            };
-        };
-    };
-
-    free(input_matched);
-    free(output_matched);
-    free(grant_target);
-    free(grant_made);
-};
-
 /*  Tick - in a single tick of the cycle simulation, the switch should take in
-    all received packets and buffer them, then should run the iSLIP scheduler
-    and finally should output to the corresponding hosts. */
+    all received packets and buffer them, then should run the scheduler and
+    finally should output to the corresponding hosts. */
 void cb_ib_voqs_iSLIP_cycle_switch_tick(
     void *network_switch_ptr,
     void *traffic_ptr
@@ -283,9 +221,18 @@ void cb_ib_voqs_iSLIP_cycle_switch_tick(
     assert(traffic_ptr);
     void ** traffic = (void **) traffic_ptr;
 
+    SWITCH_PROFILE_BEGIN(start);
+    SWITCH_PROFILE_RESUME(mark);
+
+    /*  Release VOQs which have been idle for too long. */
+    voq_matrix_advance(network_switch->voqs, network_switch->slot);
+    SWITCH_PROFILE_MARK(SWITCH_PHASE_AGE, mark);
+
     /*  Buffer incoming traffic. */
-    int i;
+    port_num_t i;
     for (i = 0; i < network_switch->num_ports; i++) {
+        network_switch->arrival_active[i] = 0;
+
         if (traffic[i] != NULL) {
             void *addr =
                 network_switch->addr_desc.get_addr_from_packet(traffic[i]);
@@ -297,73 +244,160 @@ void cb_ib_voqs_iSLIP_cycle_switch_tick(
                 &output_port
             );
 
+            /*  Unroutable packets and those refused by the shared buffer
+                are dropped. */
             if (res) {
-                /*  Copy packet and buffer into corresponding VOQ. */
-                void *packet_copy = malloc(PACKET_SIZE);
-                assert(packet_copy);
-                
-                memcpy(packet_copy, traffic[i], PACKET_SIZE);
-                
-                queue_enqueue(
-                    network_switch->voqs[i][output_port],
-                    packet_copy
+                res = shared_buffer_admit(
+                    network_switch->buffer,
+                    network_switch->voqs,
+                    i,
+                    output_port
                 );
             };
 
-            free(traffic[i]);
-        };
-    };
-
-    /*  Invoke scheduler. */
-    port_num_t *port_mapping =
-        (port_num_t *) malloc(
-            sizeof(port_num_t) * network_switch->num_ports
-        );
-    
-    char *map_active =
-        (char *) malloc(sizeof(char) * network_switch->num_ports);
-    
-    iSLIP_schedule(network_switch, port_mapping, map_active);
-    
-    memcpy(
-        network_switch->port_match,
-        port_mapping,
-        sizeof(port_num_t) * network_switch->num_ports
-    );
-    
-    memcpy(
-        network_switch->port_match_active,
-        map_active,
-        sizeof(char) * network_switch->num_ports
-    );
+            if (res) {
+                /*  Describe the packet once, and buffer the descriptor in
+                    the corresponding VOQ. The payload stays in its pool,
+                    unless only counting, in which case it is not needed. */
+                packet_desc_t cell;
+                cell.arrival_slot = (uint32_t) network_switch->slot;
+                cell.flow_id = i * network_switch->num_ports + output_port;
+                cell.payload = PACKET_REF_NONE;
+                cell.src_port = i;
+                cell.dst_port = output_port;
+                cell.length = PACKET_SIZE;
+
+                if (network_switch->get_length_from_packet) {
+                    unsigned long length =
+                        network_switch->get_length_from_packet(traffic[i]);
+                    cell.length = length < PACKET_DESC_MAX_LENGTH
+                        ? length
+                        : PACKET_DESC_MAX_LENGTH;
+                };
 
-    /*  Output on chosen ports. */
-    int i;
-    for (i = 0; i < network_switch->num_ports; i++) {
-        host_desc_t host_out;
-        int res =
-            host_table_host_lookup(network_switch->host_table, i, &host_out);
-
-        if (res) {
-            assert(host_out.send);
-
-            int j;
-            for (j = 0; j < network_switch->num_ports; j++) {
-                if (port_mapping[j] == i) {
-                    void *out_packet =
-                        queue_dequeue(network_switch->voqs[j][i]);
-                    host_out.send(&host_out, out_packet);
-                    free(out_packet);  
+                if (network_switch->voq_mode == VOQ_MODE_COUNTS) {
+                    packet_free(traffic[i]);
+                } else {
+                    cell.payload = packet_ref(traffic[i]);
                 };
+
+                voq_matrix_enqueue(network_switch->voqs, i, output_port, cell);
+                PROBE4(voq_enqueue, network_switch->slot, i, output_port,
+                    voq_matrix_size(network_switch->voqs, i, output_port));
+
+                network_switch->arrival_output[i] = output_port;
+                network_switch->arrival_active[i] = 1;
+            } else {
+                packet_free(traffic[i]);
             };
         };
     };
+    SWITCH_PROFILE_MARK(SWITCH_PHASE_INGRESS, mark);
+
+    /*  Invoke scheduler. The previous slot's matching is still held in
+        port_match, which the scheduler then overwrites with the new forward
+        and inverse matching. */
+    sched_voq_state_t voq_state;
+    voq_state.num_ports = network_switch->num_ports;
+    voq_state.slot = network_switch->slot;
+    voq_state.voqs = network_switch->voqs;
+    voq_state.arrival_output = network_switch->arrival_output;
+    voq_state.arrival_active = network_switch->arrival_active;
+    voq_state.prev_matching = network_switch->port_match;
+
+    network_switch->scheduler.schedule(
+        network_switch->scheduler_state,
+        &voq_state,
+        network_switch->port_match
+    );
+    SWITCH_PROFILE_MARK(SWITCH_PHASE_SCHEDULE, mark);
+    PROBE3(schedule_done, network_switch->slot,
+        network_switch->port_match->size,
+        voq_matrix_total_backlog(network_switch->voqs));
+
+    /*  Output on chosen ports - only the matched pairs are visited, so the
+        cost scales with the number of transfers this slot. Cells matched to
+        an output with no registered host are still dequeued and dropped.
+        Delivered payloads are handed to the host. In VOQ_MODE_COUNTS hosts
+        are instead sent the packet descriptor, which they do not own. */
+    port_matching_t *port_match = network_switch->port_match;
+    port_num_t k;
+    for (k = 0; k < port_match->size; k++) {
+        port_num_t input_port = port_match->matched_inputs[k];
+        port_num_t output_port = port_match->in_to_out[input_port];
+
+        packet_desc_t out_cell;
+        int res = voq_matrix_dequeue(
+            network_switch->voqs,
+            input_port,
+            output_port,
+            &out_cell
+        );
+        assert(res);
+
+        /*  Arrival slots wrap at 2^32, as do delays. */
+        uint32_t delay =
+            (uint32_t) network_switch->slot - out_cell.arrival_slot;
+        histogram_record(network_switch->delay[output_port], delay);
+        PROBE5(voq_dequeue, network_switch->slot, input_port, output_port,
+            voq_matrix_size(network_switch->voqs, input_port, output_port),
+            delay);
+
+        host_desc_t *host_out =
+            host_table_host_get(network_switch->host_table, output_port);
+
+        if (host_out && network_switch->voq_mode == VOQ_MODE_COUNTS) {
+            assert(host_out->send);
+            host_out->send(host_out, &out_cell);
+        } else if (host_out) {
+            assert(host_out->send);
+            host_out->send(host_out, packet_deref(out_cell.payload));
+        } else {
+            packet_free(packet_deref(out_cell.payload));
+        };
+    };
 
-    free(port_mapping);
-    free(map_active);
+    network_switch->slot++;
+    SWITCH_PROFILE_MARK(SWITCH_PHASE_EGRESS, mark);
+    SWITCH_PROFILE_MARK(SWITCH_PHASE_TICK, start);
 };
 
 /*  API implementation. */
+
+/*  Statistics of the shared buffer of a switch. */
+void cb_ib_voqs_iSLIP_buffer_stats(
+    void *network_switch_ptr,
+    shared_buffer_stats_t *stats_out
+) {
+    assert(network_switch_ptr);
+    network_switch_t network_switch = (network_switch_t) network_switch_ptr;
+
+    shared_buffer_stats(network_switch->buffer, stats_out);
+};
+
+/*  Queueing delays of the cells which have left a switch, in slots from
+    arrival to departure, added to delay_out for every output port. */
+void cb_ib_voqs_iSLIP_delay_histogram(
+    void *network_switch_ptr,
+    histogram_t delay_out
+) {
+    assert(network_switch_ptr);
+    network_switch_t network_switch = (network_switch_t) network_switch_ptr;
+
+    port_num_t i;
+    for (i = 0; i < network_switch->num_ports; i++) {
+        histogram_merge(delay_out, network_switch->delay[i]);
+    };
+};
+
+/*  Number of cells queued in the VOQs of a switch. */
+unsigned long cb_ib_voqs_iSLIP_backlog(void *network_switch_ptr) {
+    assert(network_switch_ptr);
+    network_switch_t network_switch = (network_switch_t) network_switch_ptr;
+
+    return voq_matrix_total_backlog(network_switch->voqs);
+};
+
 i_cycle_sim_switch_t cb_ib_voqs_iSLIP_cycle_switch() {
     i_cycle_sim_switch_t cycle_switch;
     cycle_switch.create = cb_ib_voqs_iSLIP_create;
@@ -4,11 +4,49 @@
 #define CB_IB_VOQS_ISLIP_H
 
 #include "./../network_switch_interfaces.h"
+#include "./../voq_matrix.h"
+#include "./../shared_buffer.h"
+#include "./../schedulers/crossbar_scheduler.h"
+#include "./../../stats/histogram.h"
 
 struct cb_ib_voqs_iSLIP;
 typedef struct cb_ib_voqs_iSLIP *cb_ib_voqs_iSLIP_t;
 
+/*  Switch configuration - passed at creation time to select the crossbar
+    scheduler, the number of slots a VOQ may stay empty before its buffer is
+    released (VOQ_IDLE_NEVER to keep every VOQ once used), whether VOQs
+    keep packets or only count them (see voq_mode), the size and admission
+    policy of the buffer shared by all VOQs, and how to find the length in
+    bytes of a packet for its descriptor. Lengths above
+    PACKET_DESC_MAX_LENGTH are saturated, and if get_length_from_packet is
+    NULL every packet is taken to be PACKET_SIZE bytes. The create function
+    of the cycle switch interface uses cb_ib_voqs_iSLIP_default_config. */
+struct cb_ib_voqs_iSLIP_config {
+    i_crossbar_scheduler_t scheduler;
+    unsigned long voq_idle_slots;
+    voq_mode_t voq_mode;
+    shared_buffer_config_t buffer;
+    unsigned long (*get_length_from_packet)(void *);
+};
+
+typedef struct cb_ib_voqs_iSLIP_config cb_ib_voqs_iSLIP_config_t;
+
 /*  API functions. */
 i_cycle_sim_switch_t cb_ib_voqs_iSLIP_cycle_switch();
+cb_ib_voqs_iSLIP_config_t cb_ib_voqs_iSLIP_default_config();
+void *cb_ib_voqs_iSLIP_create_with_config(
+    port_num_t num_ports,
+    addr_desc_t addr_desc,
+    cb_ib_voqs_iSLIP_config_t config
+);
+void cb_ib_voqs_iSLIP_buffer_stats(
+    void *network_switch_ptr,
+    shared_buffer_stats_t *stats_out
+);
+void cb_ib_voqs_iSLIP_delay_histogram(
+    void *network_switch_ptr,
+    histogram_t delay_out
+);
+unsigned long cb_ib_voqs_iSLIP_backlog(void *network_switch_ptr);
 
-#endif
\ No newline at end of file
+#endif
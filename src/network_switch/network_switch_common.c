@@ -3,12 +3,13 @@
 #include "network_switch_common.h"
 #include <assert.h>
 #include <string.h>
+#include <malloc.h>
 
 /*  API function implementations. */
 
 /*  Create address descriptor structure. */
 addr_desc_t *addr_desc_create(
-    void (*get_addr_from_packet)(void *),
+    void *(*get_addr_from_packet)(void *),
     hash_func_t addr_hash,
     comparator_func_t addr_compare,
     free_func_t addr_free
@@ -78,5 +79,5 @@ void *addr_clone(void *addr) {
 
     memcpy(new_addr, addr, ADDR_SIZE);
 
-    return addr;
+    return new_addr;
 };
\ No newline at end of file
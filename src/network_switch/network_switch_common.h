@@ -14,6 +14,7 @@
 
 #include "./../data_structures/heap.h"
 #include "./../data_structures/hash_table.h"
+#include <stdint.h>
 
 /*  Address descriptor - this provides a set of pointers to functions required
     to obtain and process addresses. */
@@ -27,7 +28,9 @@ struct addr_desc {
 typedef struct addr_desc addr_desc_t;
 
 /*  Host descriptor - this stores data required to identify and interact with
-    a host. */
+    a host. send is called with the host descriptor and a delivered packet,
+    which passes ownership of the packet to the host (see
+    network_switch_interfaces.h). */
 enum host_desc_active {
     HOST_DESC_ACTIVE,
     HOST_DESC_INACTIVE
@@ -48,6 +51,37 @@ typedef struct host_desc host_desc_t;
 /*  Port number - must be an integer type as used for array indexing. */
 typedef unsigned int port_num_t;
 
+/*  Packet reference - a 32 bit handle to a packet pool cell (see
+    packet_pool.h), usable from any thread. 0 is never a valid cell. */
+typedef uint32_t packet_ref_t;
+
+#define PACKET_REF_NONE 0
+
+/*  Packet descriptor - the canonical 16 byte description of a packet inside
+    a switch, filled in once at ingress. Queues, schedulers and statistics
+    work on arrays of descriptors, and the payload, if any, is only touched
+    at delivery.
+
+    arrival_slot is the time slot of arrival modulo 2^32, so ages must be
+    computed in 32 bit unsigned arithmetic. Ports are limited to 4096, so
+    that flow_id, src_port * num_ports + dst_port, fits in 24 bits, and the
+    length in bytes to 65535. */
+struct packet_desc {
+    uint32_t arrival_slot;
+    packet_ref_t payload;
+    uint64_t flow_id : 24;
+    uint64_t src_port : 12;
+    uint64_t dst_port : 12;
+    uint64_t length : 16;
+};
+
+typedef struct packet_desc packet_desc_t;
+
+#define PACKET_DESC_MAX_PORTS 4096
+#define PACKET_DESC_MAX_LENGTH 65535
+
+_Static_assert(sizeof(packet_desc_t) == 16, "packet_desc_t must be 16 bytes");
+
 /*  Register result - returned upon registering or deregistering a host. */
 enum register_result {
     REG_SUCCESS,
@@ -60,7 +94,7 @@ typedef enum register_result register_result_t;
 
 /*  Declare API functions. */
 addr_desc_t *addr_desc_create(
-    void (*get_addr_from_packet)(void *),
+    void *(*get_addr_from_packet)(void *),
     hash_func_t addr_hash,
     comparator_func_t addr_compare,
     free_func_t addr_free
@@ -12,7 +12,26 @@
     
     The tick function takes a generic argument, which might be, for example,
     the traffic to be sent to the switch in that cycle (generated by an
-    external traffic generator). */
+    external traffic generator).
+
+    Packet ownership - packets are handed over rather than copied:
+        Ingress:
+            Every packet passed to tick becomes owned by the switch, which
+            either buffers that same buffer or frees it (e.g. when dropped).
+            The caller must not touch it afterwards.
+
+        Delivery:
+            A packet passed to the send function of a host becomes owned by
+            that host, which may keep it or free it. Packets which cannot be
+            delivered are freed by the switch.
+
+        Free:
+            Packets still buffered when the switch is freed are freed with it.
+
+    Packets are freed with packet_free, so they must be allocated from the
+    packet pool (see packet_pool.h). Implementations which do not deliver the
+    packet itself, e.g. a switch which only counts cells, document what send
+    is given instead. */
 struct i_cycle_sim_switch {
     void *(*create)(port_num_t port_num, addr_desc_t addr_desc);
     void (*free)(void *);
@@ -0,0 +1,393 @@
+/*  packet_pool.c */
+
+#include "packet_pool.h"
+#include <assert.h>
+#include <malloc.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+/*  Slabs are aligned to their size, so the slab holding a cell (and through
+    it the owning pool) is found by masking the cell's address. 2MB is the
+    usual huge page size. */
+#define SLAB_SIZE ((size_t) 2 << 20)
+#define CACHE_LINE_SIZE 64
+#define CELL_ALIGN 16
+
+/*  A packet reference holds the index of the slab in slab_table in its top
+    bits and the offset of the cell in the slab, in CELL_ALIGN units, in the
+    remaining REF_OFFSET_BITS. Since a cell never starts at offset 0, no
+    reference is PACKET_REF_NONE. */
+#define REF_OFFSET_BITS 17
+#define MAX_SLABS ((size_t) 1 << (32 - REF_OFFSET_BITS))
+
+_Static_assert(
+    SLAB_SIZE / CELL_ALIGN == (size_t) 1 << REF_OFFSET_BITS,
+    "cell offsets must fill REF_OFFSET_BITS"
+);
+
+/*  Slab header - stored at the start of every slab, followed by its cells
+    from the next cache line. */
+struct slab_header {
+    packet_pool_t owner;
+    struct slab_header *next;
+    unsigned int index;
+    char mapped;
+};
+
+/*  Packet pool structure. Free cells are linked through their first word.
+    Cells freed by the owning thread go straight onto free_list, cells freed
+    by other threads are pushed onto remote_free, which the owner takes in
+    one exchange when free_list runs dry. New slabs are carved lazily from
+    bump, so their pages are only touched as cells are first used. */
+struct packet_pool {
+    size_t cell_size;
+    int flags;
+    const char *owner_thread;
+
+    void *free_list;
+    _Atomic(void *) remote_free;
+
+    char *bump;
+    char *bump_end;
+    struct slab_header *slabs;
+
+    unsigned long num_slabs;
+    unsigned long capacity;
+    unsigned long allocs;
+    unsigned long frees;
+    atomic_ulong remote_frees;
+    unsigned long high_water;
+};
+
+/*  The address of thread_marker identifies the calling thread, and
+    local_pool is the pool used by packet_alloc. */
+static __thread char thread_marker;
+static __thread packet_pool_t local_pool = NULL;
+
+/*  Slab table - every slab of every pool, indexed by the slab index of a
+    packet reference. Indices of freed slabs are reused. The table is only
+    written under slab_table_lock, when a slab is created or freed, and a
+    slab's entry is written before any of its cells are handed out. */
+static char *slab_table[MAX_SLABS];
+static unsigned int free_indices[MAX_SLABS];
+static unsigned int num_free_indices = 0;
+static unsigned int next_index = 0;
+static atomic_flag slab_table_lock = ATOMIC_FLAG_INIT;
+
+/*  Forward declare helper functions. */
+static void slab_create(packet_pool_t packet_pool);
+static unsigned int slab_index_acquire(char *slab);
+static void slab_index_release(unsigned int index);
+
+/*  API implementation. */
+
+/*  Create packet pool - cells are cell_size bytes, rounded up to a multiple
+    of CELL_ALIGN. The pool is owned by the calling thread. */
+packet_pool_t packet_pool_create(size_t cell_size, int flags) {
+    packet_pool_t packet_pool =
+        (packet_pool_t) malloc(sizeof(struct packet_pool));
+    assert(packet_pool);
+
+    cell_size = (cell_size + CELL_ALIGN - 1) & ~((size_t) CELL_ALIGN - 1);
+    if (cell_size < CELL_ALIGN) {
+        cell_size = CELL_ALIGN;
+    };
+    assert(cell_size <= (SLAB_SIZE - CACHE_LINE_SIZE) / 2);
+
+    packet_pool->cell_size = cell_size;
+    packet_pool->flags = flags;
+    packet_pool->owner_thread = &thread_marker;
+
+    packet_pool->free_list = NULL;
+    atomic_init(&packet_pool->remote_free, NULL);
+
+    packet_pool->bump = NULL;
+    packet_pool->bump_end = NULL;
+    packet_pool->slabs = NULL;
+
+    packet_pool->num_slabs = 0;
+    packet_pool->capacity = 0;
+    packet_pool->allocs = 0;
+    packet_pool->frees = 0;
+    atomic_init(&packet_pool->remote_frees, 0);
+    packet_pool->high_water = 0;
+
+    return packet_pool;
+};
+
+/*  Free packet pool - releases every slab, including any cells still in
+    use. */
+void packet_pool_free(packet_pool_t packet_pool) {
+    assert(packet_pool);
+
+    struct slab_header *slab = packet_pool->slabs;
+    while (slab) {
+        struct slab_header *next = slab->next;
+
+        slab_index_release(slab->index);
+
+        if (slab->mapped) {
+            munmap(slab, SLAB_SIZE);
+        } else {
+            free(slab);
+        };
+
+        slab = next;
+    };
+
+    free(packet_pool);
+};
+
+/*  Allocate a cell - from the free list, then from cells freed by other
+    threads, then from the current slab, and only then from a new slab. */
+void *packet_pool_alloc(packet_pool_t packet_pool) {
+    assert(packet_pool);
+    assert(packet_pool->owner_thread == &thread_marker);
+
+    void *cell = packet_pool->free_list;
+
+    if (
+        cell == NULL &&
+        atomic_load_explicit(&packet_pool->remote_free, memory_order_relaxed)
+    ) {
+        cell = atomic_exchange_explicit(
+            &packet_pool->remote_free,
+            NULL,
+            memory_order_acquire
+        );
+    };
+
+    if (cell) {
+        packet_pool->free_list = *(void **) cell;
+    } else {
+        if (packet_pool->bump == packet_pool->bump_end) {
+            slab_create(packet_pool);
+        };
+
+        cell = packet_pool->bump;
+        packet_pool->bump += packet_pool->cell_size;
+    };
+
+    packet_pool->allocs++;
+
+    unsigned long in_use = packet_pool->allocs - packet_pool->frees -
+        atomic_load_explicit(&packet_pool->remote_frees, memory_order_relaxed);
+
+    if (in_use > packet_pool->high_water) {
+        packet_pool->high_water = in_use;
+    };
+
+    return cell;
+};
+
+/*  Free a cell back to the pool it was allocated from. May be called from
+    any thread, and does nothing for NULL. */
+void packet_pool_dealloc(void *cell) {
+    if (cell == NULL) {
+        return;
+    };
+
+    struct slab_header *slab =
+        (struct slab_header *) ((uintptr_t) cell & ~(uintptr_t) (SLAB_SIZE - 1));
+    packet_pool_t packet_pool = slab->owner;
+
+    if (packet_pool->owner_thread == &thread_marker) {
+        *(void **) cell = packet_pool->free_list;
+        packet_pool->free_list = cell;
+        packet_pool->frees++;
+        return;
+    };
+
+    /*  Push onto the remote free list. Since the owner only ever takes the
+        whole list, a plain compare and swap push is safe from ABA. */
+    void *head =
+        atomic_load_explicit(&packet_pool->remote_free, memory_order_relaxed);
+
+    do {
+        *(void **) cell = head;
+    } while (!atomic_compare_exchange_weak_explicit(
+        &packet_pool->remote_free,
+        &head,
+        cell,
+        memory_order_release,
+        memory_order_relaxed
+    ));
+
+    atomic_fetch_add_explicit(
+        &packet_pool->remote_frees,
+        1,
+        memory_order_relaxed
+    );
+};
+
+/*  Pool statistics. */
+void packet_pool_stats(
+    packet_pool_t packet_pool,
+    packet_pool_stats_t *stats_out
+) {
+    assert(packet_pool);
+    assert(stats_out);
+
+    unsigned long frees = packet_pool->frees +
+        atomic_load_explicit(&packet_pool->remote_frees, memory_order_relaxed);
+
+    stats_out->in_use = packet_pool->allocs - frees;
+    stats_out->high_water = packet_pool->high_water;
+    stats_out->capacity = packet_pool->capacity;
+    stats_out->slabs = packet_pool->num_slabs;
+    stats_out->allocs = packet_pool->allocs;
+    stats_out->frees = frees;
+};
+
+/*  Packet reference of a cell. */
+packet_ref_t packet_ref(void *cell) {
+    assert(cell);
+
+    uintptr_t base = (uintptr_t) cell & ~(uintptr_t) (SLAB_SIZE - 1);
+    struct slab_header *slab = (struct slab_header *) base;
+
+    return (packet_ref_t) (
+        (slab->index << REF_OFFSET_BITS) |
+        (((uintptr_t) cell - base) / CELL_ALIGN)
+    );
+};
+
+/*  Cell named by a packet reference, or NULL for PACKET_REF_NONE. */
+void *packet_deref(packet_ref_t ref) {
+    if (ref == PACKET_REF_NONE) {
+        return NULL;
+    };
+
+    return slab_table[ref >> REF_OFFSET_BITS] +
+        (size_t) (ref & (((packet_ref_t) 1 << REF_OFFSET_BITS) - 1)) *
+            CELL_ALIGN;
+};
+
+/*  Create the pool of the calling thread with the given flags. */
+packet_pool_t packet_pool_local_init(int flags) {
+    assert(local_pool == NULL);
+
+    local_pool = packet_pool_create(PACKET_SIZE, flags);
+    return local_pool;
+};
+
+/*  Pool of the calling thread, created with no flags on first use. */
+packet_pool_t packet_pool_local() {
+    if (local_pool == NULL) {
+        local_pool = packet_pool_create(PACKET_SIZE, 0);
+    };
+
+    return local_pool;
+};
+
+/*  Free the pool of the calling thread. */
+void packet_pool_local_free() {
+    if (local_pool) {
+        packet_pool_free(local_pool);
+        local_pool = NULL;
+    };
+};
+
+/*  Allocate a PACKET_SIZE packet from the pool of the calling thread. */
+void *packet_alloc() {
+    return packet_pool_alloc(packet_pool_local());
+};
+
+/*  Free a packet allocated by packet_alloc on any thread. */
+void packet_free(void *packet) {
+    packet_pool_dealloc(packet);
+};
+
+/*  Helper function implementations. */
+
+/*  Create slab - try huge pages first if asked to, falling back to an
+    aligned allocation, which is then advised to use transparent huge pages.
+    The new slab becomes the one cells are carved from. */
+static void slab_create(packet_pool_t packet_pool) {
+    void *memory = NULL;
+    char mapped = 0;
+
+#ifdef MAP_HUGETLB
+    if (packet_pool->flags & PACKET_POOL_HUGE_PAGES) {
+        memory = mmap(
+            NULL,
+            SLAB_SIZE,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+            -1,
+            0
+        );
+
+        if (memory == MAP_FAILED) {
+            memory = NULL;
+        } else if ((uintptr_t) memory & (SLAB_SIZE - 1)) {
+            munmap(memory, SLAB_SIZE);
+            memory = NULL;
+        } else {
+            mapped = 1;
+        };
+    };
+#endif
+
+    if (memory == NULL) {
+        memory = aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+        assert(memory);
+
+#ifdef MADV_HUGEPAGE
+        if (packet_pool->flags & PACKET_POOL_HUGE_PAGES) {
+            madvise(memory, SLAB_SIZE, MADV_HUGEPAGE);
+        };
+#endif
+    };
+
+    struct slab_header *slab = (struct slab_header *) memory;
+    slab->owner = packet_pool;
+    slab->next = packet_pool->slabs;
+    slab->index = slab_index_acquire((char *) memory);
+    slab->mapped = mapped;
+    packet_pool->slabs = slab;
+
+    size_t num_cells = (SLAB_SIZE - CACHE_LINE_SIZE) / packet_pool->cell_size;
+
+    packet_pool->bump = (char *) memory + CACHE_LINE_SIZE;
+    packet_pool->bump_end = packet_pool->bump + num_cells * packet_pool->cell_size;
+    packet_pool->num_slabs++;
+    packet_pool->capacity += num_cells;
+};
+
+/*  Give a slab an index in the slab table. */
+static unsigned int slab_index_acquire(char *slab) {
+    while (atomic_flag_test_and_set_explicit(
+        &slab_table_lock,
+        memory_order_acquire
+    ));
+
+    unsigned int index;
+    if (num_free_indices > 0) {
+        index = free_indices[--num_free_indices];
+    } else {
+        assert(next_index < MAX_SLABS);
+        index = next_index++;
+    };
+
+    slab_table[index] = slab;
+
+    atomic_flag_clear_explicit(&slab_table_lock, memory_order_release);
+
+    return index;
+};
+
+/*  Return the index of a freed slab for reuse. */
+static void slab_index_release(unsigned int index) {
+    while (atomic_flag_test_and_set_explicit(
+        &slab_table_lock,
+        memory_order_acquire
+    ));
+
+    slab_table[index] = NULL;
+    free_indices[num_free_indices++] = index;
+
+    atomic_flag_clear_explicit(&slab_table_lock, memory_order_release);
+};
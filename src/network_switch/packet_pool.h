@@ -0,0 +1,68 @@
+/*  packet_pool.h
+
+    Slab allocator for fixed size packet cells. A pool carves cells out of
+    large slabs, aligned to their size, and keeps freed cells on a free list,
+    so that allocating and freeing a cell are O(1) and never touch malloc once
+    the pool has warmed up.
+
+    Pools are owned by the thread which created them. Every thread has its
+    own pool of PACKET_SIZE cells, used by packet_alloc and packet_free. A
+    cell may be freed from any thread - a cell freed by a thread other than
+    the owner of its pool is handed back to the owner, which reclaims it on
+    a later allocation.
+
+    A cell can also be named by a packet_ref_t, a 32 bit handle which is
+    valid in every thread, e.g. to refer to a payload from a packet_desc_t.
+
+    With PACKET_POOL_HUGE_PAGES, slabs are backed by huge pages where the
+    system allows, which keeps the TLB footprint of a deep buffer small. */
+
+#ifndef PACKET_POOL_H
+#define PACKET_POOL_H
+
+#include "network_switch_common.h"
+#include <stddef.h>
+
+/*  Pool flags. */
+#define PACKET_POOL_HUGE_PAGES 0x1
+
+struct packet_pool;
+typedef struct packet_pool *packet_pool_t;
+
+/*  Pool statistics - in_use and high_water count cells, capacity counts the
+    cells of every slab allocated so far. */
+struct packet_pool_stats {
+    unsigned long in_use;
+    unsigned long high_water;
+    unsigned long capacity;
+    unsigned long slabs;
+    unsigned long allocs;
+    unsigned long frees;
+};
+
+typedef struct packet_pool_stats packet_pool_stats_t;
+
+/*  API functions. */
+packet_pool_t packet_pool_create(size_t cell_size, int flags);
+void packet_pool_free(packet_pool_t packet_pool);
+void *packet_pool_alloc(packet_pool_t packet_pool);
+void packet_pool_dealloc(void *cell);
+void packet_pool_stats(
+    packet_pool_t packet_pool,
+    packet_pool_stats_t *stats_out
+);
+
+/*  Packet references - convert between a cell and its handle. */
+packet_ref_t packet_ref(void *cell);
+void *packet_deref(packet_ref_t ref);
+
+/*  Per-thread pools of PACKET_SIZE cells. packet_pool_local_init must be
+    called before the first packet_alloc of a thread to pass flags, and
+    packet_pool_local_free releases the pool of the calling thread. */
+packet_pool_t packet_pool_local_init(int flags);
+packet_pool_t packet_pool_local();
+void packet_pool_local_free();
+void *packet_alloc();
+void packet_free(void *packet);
+
+#endif
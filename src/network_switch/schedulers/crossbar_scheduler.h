@@ -0,0 +1,82 @@
+/*  crossbar_scheduler.h
+
+    Interface for crossbar schedulers. A crossbar scheduler is given a view of
+    the virtual output queues at the start of a time slot and computes a
+    matching of input ports to output ports, such that each input is matched to
+    at most one output and each output to at most one input.
+
+    Implementations keep any state they need between time slots (e.g. round
+    robin pointers) in the structure returned by init, which is passed back to
+    schedule and free. */
+
+#ifndef CROSSBAR_SCHEDULER_H
+#define CROSSBAR_SCHEDULER_H
+
+#include "./../network_switch_common.h"
+#include "./../voq_matrix.h"
+#include "port_matching.h"
+#include <math.h>
+
+/*  VOQ state - a read only view of the virtual output queues provided to the
+    scheduler on each time slot. voqs must only be queried, never modified.
+    Schedulers should walk the non-empty outputs of each input (see
+    voq_matrix_nonempty_outputs) rather than scan all N^2 VOQs, so that the
+    cost of a slot grows with the number of non-empty VOQs.
+
+    arrival_output[i] is the output of the cell that arrived at input i in
+    this slot, valid where arrival_active[i] = 1. prev_matching is the
+    matching made in the previous slot. It may alias the matching argument of
+    schedule, so schedulers must read it before writing. */
+struct sched_voq_state {
+    port_num_t num_ports;
+    unsigned long slot;
+    voq_matrix_t voqs;
+    const port_num_t *arrival_output;
+    const char *arrival_active;
+    const port_matching_t *prev_matching;
+};
+
+typedef struct sched_voq_state sched_voq_state_t;
+
+/*  Scheduler interface - schedule must clear the given matching and fill it
+    with a valid matching for this slot. Only inputs with a non-empty VOQ to
+    their matched output may be matched. */
+struct i_crossbar_scheduler {
+    void *(*init)(port_num_t num_ports);
+    void (*schedule)(void *, const sched_voq_state_t *, port_matching_t *);
+    void (*free)(void *);
+};
+
+typedef struct i_crossbar_scheduler i_crossbar_scheduler_t;
+
+/*  Number of request-grant-accept iterations used by the iterative
+    schedulers. This is ISLIP_ROUNDS, but at least one round, so that a single
+    port switch is still scheduled. */
+static inline int sched_rounds(port_num_t num_ports) {
+    return num_ports > 1 ? ISLIP_ROUNDS(num_ports) : 1;
+};
+
+/*  Scheduler random numbers - the randomised schedulers keep their own
+    xorshift64 state so that runs are reproducible and independent of any
+    other user of rand(). The state must be non-zero. */
+static inline unsigned long long sched_rand(unsigned long long *state) {
+    unsigned long long x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+};
+
+/*  Round robin distance - how far port to lies after port from, cycling
+    through num_ports ports. Used to pick the first candidate after a pointer
+    when candidates are visited in no particular order. */
+static inline port_num_t sched_distance(
+    port_num_t from,
+    port_num_t to,
+    port_num_t num_ports
+) {
+    return to >= from ? to - from : to + num_ports - from;
+};
+
+#endif
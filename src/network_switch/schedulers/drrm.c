@@ -0,0 +1,184 @@
+/*  drrm.c
+
+    Implementation of the dual round robin matching (DRRM) crossbar
+    scheduler. */
+
+#include "drrm.h"
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+/*  Scheduler state - each input keeps a request pointer and each output a
+    grant pointer between time slots. */
+struct drrm_state {
+    port_num_t num_ports;
+    int rounds;
+
+    port_num_t *request_ptr;
+    port_num_t *grant_ptr;
+
+    char *input_matched;
+    char *output_matched;
+    port_num_t *grant_target;
+    char *grant_made;
+};
+
+typedef struct drrm_state *drrm_state_t;
+
+/*  Create DRRM scheduler state with all pointers starting at port 0. */
+static void *drrm_init(port_num_t num_ports) {
+    drrm_state_t state = (drrm_state_t) malloc(sizeof(struct drrm_state));
+    assert(state);
+
+    state->num_ports = num_ports;
+    state->rounds = sched_rounds(num_ports);
+
+    state->request_ptr = (port_num_t *) calloc(num_ports, sizeof(port_num_t));
+    assert(state->request_ptr);
+
+    state->grant_ptr = (port_num_t *) calloc(num_ports, sizeof(port_num_t));
+    assert(state->grant_ptr);
+
+    state->input_matched = (char *) malloc(sizeof(char) * num_ports);
+    assert(state->input_matched);
+
+    state->output_matched = (char *) malloc(sizeof(char) * num_ports);
+    assert(state->output_matched);
+
+    state->grant_target =
+        (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(state->grant_target);
+
+    state->grant_made = (char *) malloc(sizeof(char) * num_ports);
+    assert(state->grant_made);
+
+    return (void *) state;
+};
+
+/*  Free DRRM scheduler state. */
+static void drrm_free(void *state_ptr) {
+    assert(state_ptr);
+    drrm_state_t state = (drrm_state_t) state_ptr;
+
+    free(state->request_ptr);
+    free(state->grant_ptr);
+    free(state->input_matched);
+    free(state->output_matched);
+    free(state->grant_target);
+    free(state->grant_made);
+    free(state);
+};
+
+/*  DRRM works in two phases rather than three:
+        Request phase:
+            Each unmatched input sends a single request, to the first unmatched
+            output with a non-empty VOQ starting from its request pointer.
+
+        Grant phase:
+            Each unmatched output grants the first request it receives starting
+            from its grant pointer, and the input and output become matched.
+
+    As in iSLIP, pointers move one beyond the matched port, and only in the
+    first iteration.
+
+    Each input finds its request by walking its non-empty outputs for the one
+    nearest after its request pointer, and the request is immediately offered
+    to the output, which keeps the requesting input nearest after its grant
+    pointer. A round is therefore O(N + E) for E non-empty VOQs. */
+static void drrm_schedule(
+    void *state_ptr,
+    const sched_voq_state_t *voq_state,
+    port_matching_t *matching
+) {
+    assert(state_ptr);
+    assert(voq_state);
+    assert(matching);
+
+    drrm_state_t state = (drrm_state_t) state_ptr;
+    port_num_t num_ports = state->num_ports;
+
+    int r;
+    port_num_t i;
+    port_num_t k;
+    port_num_t count;
+    const port_num_t *outputs;
+
+    port_matching_clear(matching);
+    memset(state->input_matched, 0, sizeof(char) * num_ports);
+    memset(state->output_matched, 0, sizeof(char) * num_ports);
+
+    for (r = 0; r < state->rounds; r++) {
+        memset(state->grant_made, 0, sizeof(char) * num_ports);
+
+        /*  Request phase. */
+        for (i = 0; i < num_ports; i++) {
+            if (state->input_matched[i] == 1) {
+                continue;
+            };
+
+            char found = 0;
+            port_num_t request = 0;
+            port_num_t best_dist = 0;
+
+            outputs = voq_matrix_nonempty_outputs(voq_state->voqs, i, &count);
+
+            for (k = 0; k < count; k++) {
+                port_num_t output_port = outputs[k];
+
+                if (state->output_matched[output_port] == 0) {
+                    port_num_t dist = sched_distance(
+                        state->request_ptr[i], output_port, num_ports
+                    );
+
+                    if (!found || dist < best_dist) {
+                        found = 1;
+                        request = output_port;
+                        best_dist = dist;
+                    };
+                };
+            };
+
+            if (
+                found &&
+                (
+                    state->grant_made[request] == 0 ||
+                    sched_distance(state->grant_ptr[request], i, num_ports) <
+                        sched_distance(
+                            state->grant_ptr[request],
+                            state->grant_target[request],
+                            num_ports
+                        )
+                )
+            ) {
+                state->grant_target[request] = i;
+                state->grant_made[request] = 1;
+            };
+        };
+
+        /*  Grant phase. */
+        for (i = 0; i < num_ports; i++) {
+            if (state->grant_made[i] == 1) {
+                port_num_t input_port = state->grant_target[i];
+
+                state->input_matched[input_port] = 1;
+                state->output_matched[i] = 1;
+                port_matching_add(matching, input_port, i);
+
+                if (r == 0) {
+                    state->request_ptr[input_port] = (i + 1) % num_ports;
+                    state->grant_ptr[i] = (input_port + 1) % num_ports;
+                };
+            };
+        };
+    };
+};
+
+/*  API implementation. */
+i_crossbar_scheduler_t drrm_scheduler() {
+    i_crossbar_scheduler_t scheduler;
+    scheduler.init = drrm_init;
+    scheduler.schedule = drrm_schedule;
+    scheduler.free = drrm_free;
+
+    return scheduler;
+};
@@ -0,0 +1,13 @@
+/*  drrm.h
+
+    Dual round robin matching crossbar scheduler (Chao, 1999). */
+
+#ifndef DRRM_H
+#define DRRM_H
+
+#include "crossbar_scheduler.h"
+
+/*  API functions. */
+i_crossbar_scheduler_t drrm_scheduler();
+
+#endif
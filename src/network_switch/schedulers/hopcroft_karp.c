@@ -0,0 +1,213 @@
+/*  hopcroft_karp.c
+
+    Implementation of the maximum size matching (Hopcroft-Karp) crossbar
+    scheduler. */
+
+#include "hopcroft_karp.h"
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+#define INFINITE_DIST ((unsigned int) -1)
+
+/*  Scheduler state - all scratch space for a single call to schedule. The
+    request graph is read straight from the VOQ matrix, with the outputs
+    requested by input i at adjacency[i][0] up to (but not including)
+    adjacency[i][degree[i]]. */
+struct hopcroft_karp_state {
+    port_num_t num_ports;
+
+    const port_num_t **adjacency;
+    port_num_t *degree;
+    port_num_t *next_edge;
+
+    port_num_t *input_match;
+    port_num_t *output_match;
+    unsigned int *dist;
+    port_num_t *bfs_queue;
+};
+
+typedef struct hopcroft_karp_state *hopcroft_karp_state_t;
+
+/*  Forward declare helper functions. */
+static int bfs(hopcroft_karp_state_t state);
+static int dfs(hopcroft_karp_state_t state, port_num_t input_port);
+
+/*  Create Hopcroft-Karp scheduler state. */
+static void *hopcroft_karp_init(port_num_t num_ports) {
+    hopcroft_karp_state_t state =
+        (hopcroft_karp_state_t) malloc(sizeof(struct hopcroft_karp_state));
+    assert(state);
+
+    state->num_ports = num_ports;
+
+    state->adjacency =
+        (const port_num_t **) malloc(sizeof(port_num_t *) * num_ports);
+    assert(state->adjacency);
+
+    state->degree = (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(state->degree);
+
+    state->next_edge = (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(state->next_edge);
+
+    state->input_match =
+        (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(state->input_match);
+
+    state->output_match =
+        (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(state->output_match);
+
+    state->dist = (unsigned int *) malloc(sizeof(unsigned int) * num_ports);
+    assert(state->dist);
+
+    state->bfs_queue = (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(state->bfs_queue);
+
+    return (void *) state;
+};
+
+/*  Free Hopcroft-Karp scheduler state. */
+static void hopcroft_karp_free(void *state_ptr) {
+    assert(state_ptr);
+    hopcroft_karp_state_t state = (hopcroft_karp_state_t) state_ptr;
+
+    free(state->adjacency);
+    free(state->degree);
+    free(state->next_edge);
+    free(state->input_match);
+    free(state->output_match);
+    free(state->dist);
+    free(state->bfs_queue);
+    free(state);
+};
+
+/*  Hopcroft-Karp repeatedly finds a maximal set of vertex disjoint shortest
+    augmenting paths - a breadth first search from the free inputs layers the
+    request graph, and a depth first search then augments along paths that
+    follow the layering. At most O(sqrt(N)) phases are needed, each costing
+    O(N + E), where E <= N^2 is the number of non-empty VOQs. */
+static void hopcroft_karp_schedule(
+    void *state_ptr,
+    const sched_voq_state_t *voq_state,
+    port_matching_t *matching
+) {
+    assert(state_ptr);
+    assert(voq_state);
+    assert(matching);
+
+    hopcroft_karp_state_t state = (hopcroft_karp_state_t) state_ptr;
+    port_num_t num_ports = state->num_ports;
+
+    port_num_t i;
+
+    /*  Build the request graph. */
+    for (i = 0; i < num_ports; i++) {
+        state->adjacency[i] = voq_matrix_nonempty_outputs(
+            voq_state->voqs, i, &state->degree[i]
+        );
+        state->input_match[i] = PORT_UNMATCHED;
+        state->output_match[i] = PORT_UNMATCHED;
+    };
+
+    /*  Augment until no augmenting path remains. */
+    while (bfs(state)) {
+        memset(state->next_edge, 0, sizeof(port_num_t) * num_ports);
+
+        for (i = 0; i < num_ports; i++) {
+            if (state->input_match[i] == PORT_UNMATCHED) {
+                dfs(state, i);
+            };
+        };
+    };
+
+    port_matching_clear(matching);
+
+    for (i = 0; i < num_ports; i++) {
+        if (state->input_match[i] != PORT_UNMATCHED) {
+            port_matching_add(matching, i, state->input_match[i]);
+        };
+    };
+};
+
+/*  API implementation. */
+i_crossbar_scheduler_t hopcroft_karp_scheduler() {
+    i_crossbar_scheduler_t scheduler;
+    scheduler.init = hopcroft_karp_init;
+    scheduler.schedule = hopcroft_karp_schedule;
+    scheduler.free = hopcroft_karp_free;
+
+    return scheduler;
+};
+
+/*  Helper function implementations. */
+
+/*  Breadth first search - computes the layer (dist) of every input reachable
+    from a free input by alternating paths. Returns 1 if some free output is
+    reachable, i.e. an augmenting path exists. */
+static int bfs(hopcroft_karp_state_t state) {
+    port_num_t head = 0;
+    port_num_t tail = 0;
+    int found = 0;
+
+    port_num_t i;
+    for (i = 0; i < state->num_ports; i++) {
+        if (state->input_match[i] == PORT_UNMATCHED) {
+            state->dist[i] = 0;
+            state->bfs_queue[tail++] = i;
+        } else {
+            state->dist[i] = INFINITE_DIST;
+        };
+    };
+
+    while (head != tail) {
+        port_num_t input_port = state->bfs_queue[head++];
+
+        port_num_t e;
+        for (e = 0; e < state->degree[input_port]; e++) {
+            port_num_t next_input =
+                state->output_match[state->adjacency[input_port][e]];
+
+            if (next_input == PORT_UNMATCHED) {
+                found = 1;
+            } else if (state->dist[next_input] == INFINITE_DIST) {
+                state->dist[next_input] = state->dist[input_port] + 1;
+                state->bfs_queue[tail++] = next_input;
+            };
+        };
+    };
+
+    return found;
+};
+
+/*  Depth first search - tries to extend an augmenting path from the given
+    input along the layering computed by bfs, flipping the matching along the
+    path if one is found. Edges already explored in this phase are skipped via
+    next_edge, which keeps each phase O(E). */
+static int dfs(hopcroft_karp_state_t state, port_num_t input_port) {
+    for (
+        ;
+        state->next_edge[input_port] < state->degree[input_port];
+        state->next_edge[input_port]++
+    ) {
+        port_num_t output_port =
+            state->adjacency[input_port][state->next_edge[input_port]];
+        port_num_t next_input = state->output_match[output_port];
+
+        if (
+            next_input == PORT_UNMATCHED ||
+            (
+                state->dist[next_input] == state->dist[input_port] + 1 &&
+                dfs(state, next_input)
+            )
+        ) {
+            state->input_match[input_port] = output_port;
+            state->output_match[output_port] = input_port;
+            return 1;
+        };
+    };
+
+    state->dist[input_port] = INFINITE_DIST;
+    return 0;
+};
@@ -0,0 +1,15 @@
+/*  hopcroft_karp.h
+
+    Maximum size matching crossbar scheduler using the Hopcroft-Karp algorithm.
+    This is far too expensive to implement in switch hardware and is provided
+    as a reference against which the practical schedulers can be compared. */
+
+#ifndef HOPCROFT_KARP_H
+#define HOPCROFT_KARP_H
+
+#include "crossbar_scheduler.h"
+
+/*  API functions. */
+i_crossbar_scheduler_t hopcroft_karp_scheduler();
+
+#endif
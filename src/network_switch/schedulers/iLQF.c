@@ -0,0 +1,256 @@
+/*  iLQF.c
+
+    Implementation of the iLQF and iOCF crossbar schedulers. */
+
+#include "iLQF.h"
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+/*  Request weight - iLQF weights a request by the occupancy of the VOQ, iOCF
+    by the number of slots the cell at the head of the VOQ has waited. */
+enum iLQF_weight {
+    WEIGHT_QUEUE_LENGTH,
+    WEIGHT_CELL_AGE
+};
+
+typedef enum iLQF_weight iLQF_weight_t;
+
+/*  Scheduler state - ties between equal weights are broken round robin from
+    tie_ptr, which advances every slot so that no port is favoured. */
+struct iLQF_state {
+    port_num_t num_ports;
+    int rounds;
+    iLQF_weight_t weight;
+    port_num_t tie_ptr;
+
+    char *input_matched;
+    char *output_matched;
+    port_num_t *grant_target;
+    unsigned long *grant_weight;
+    char *grant_made;
+};
+
+typedef struct iLQF_state *iLQF_state_t;
+
+/*  Forward declare helper functions. */
+static void *iLQF_state_create(port_num_t num_ports, iLQF_weight_t weight);
+static inline unsigned long request_weight(
+    iLQF_state_t state,
+    const sched_voq_state_t *voq_state,
+    unsigned int size,
+    uint32_t hol_arrival
+);
+
+/*  Create iLQF scheduler state. */
+static void *iLQF_init(port_num_t num_ports) {
+    return iLQF_state_create(num_ports, WEIGHT_QUEUE_LENGTH);
+};
+
+/*  Create iOCF scheduler state. */
+static void *iOCF_init(port_num_t num_ports) {
+    return iLQF_state_create(num_ports, WEIGHT_CELL_AGE);
+};
+
+/*  Free iLQF / iOCF scheduler state. */
+static void iLQF_free(void *state_ptr) {
+    assert(state_ptr);
+    iLQF_state_t state = (iLQF_state_t) state_ptr;
+
+    free(state->input_matched);
+    free(state->output_matched);
+    free(state->grant_target);
+    free(state->grant_weight);
+    free(state->grant_made);
+    free(state);
+};
+
+/*  Weighted request-grant-accept - in each round, every unmatched output
+    grants to the unmatched requesting input with the heaviest request, and
+    every unmatched input accepts the heaviest grant it receives. Requests
+    are found by walking the non-empty outputs of each input, and ties go to
+    the candidate nearest after tie_ptr. */
+static void iLQF_schedule(
+    void *state_ptr,
+    const sched_voq_state_t *voq_state,
+    port_matching_t *matching
+) {
+    assert(state_ptr);
+    assert(voq_state);
+    assert(matching);
+
+    iLQF_state_t state = (iLQF_state_t) state_ptr;
+    port_num_t num_ports = state->num_ports;
+    port_num_t tie_ptr = state->tie_ptr;
+
+    int r;
+    port_num_t i;
+    port_num_t k;
+    port_num_t count;
+    const port_num_t *outputs;
+    const unsigned int *sizes;
+    const uint32_t *hol_arrivals;
+
+    port_matching_clear(matching);
+    memset(state->input_matched, 0, sizeof(char) * num_ports);
+    memset(state->output_matched, 0, sizeof(char) * num_ports);
+
+    for (r = 0; r < state->rounds; r++) {
+        memset(state->grant_made, 0, sizeof(char) * num_ports);
+
+        /*  Grant phase. */
+        for (i = 0; i < num_ports; i++) {
+            if (state->input_matched[i] == 1) {
+                continue;
+            };
+
+            outputs = voq_matrix_nonempty_outputs(voq_state->voqs, i, &count);
+            sizes = voq_matrix_nonempty_sizes(voq_state->voqs, i);
+            hol_arrivals = voq_matrix_nonempty_hol_arrivals(voq_state->voqs, i);
+
+            for (k = 0; k < count; k++) {
+                port_num_t output_port = outputs[k];
+
+                if (state->output_matched[output_port] == 1) {
+                    continue;
+                };
+
+                unsigned long weight = request_weight(
+                    state,
+                    voq_state,
+                    sizes[k],
+                    hol_arrivals[k]
+                );
+
+                if (
+                    state->grant_made[output_port] == 0 ||
+                    weight > state->grant_weight[output_port] ||
+                    (
+                        weight == state->grant_weight[output_port] &&
+                        sched_distance(tie_ptr, i, num_ports) <
+                            sched_distance(
+                                tie_ptr,
+                                state->grant_target[output_port],
+                                num_ports
+                            )
+                    )
+                ) {
+                    state->grant_target[output_port] = i;
+                    state->grant_weight[output_port] = weight;
+                    state->grant_made[output_port] = 1;
+                };
+            };
+        };
+
+        /*  Accept phase. */
+        for (i = 0; i < num_ports; i++) {
+            if (state->input_matched[i] == 1) {
+                continue;
+            };
+
+            char found = 0;
+            port_num_t best_output = 0;
+
+            outputs = voq_matrix_nonempty_outputs(voq_state->voqs, i, &count);
+
+            for (k = 0; k < count; k++) {
+                port_num_t output_port = outputs[k];
+
+                if (
+                    state->grant_made[output_port] == 1 &&
+                    state->grant_target[output_port] == i &&
+                    (
+                        !found ||
+                        state->grant_weight[output_port] >
+                            state->grant_weight[best_output] ||
+                        (
+                            state->grant_weight[output_port] ==
+                                state->grant_weight[best_output] &&
+                            sched_distance(tie_ptr, output_port, num_ports) <
+                                sched_distance(tie_ptr, best_output, num_ports)
+                        )
+                    )
+                ) {
+                    found = 1;
+                    best_output = output_port;
+                };
+            };
+
+            if (found) {
+                state->input_matched[i] = 1;
+                state->output_matched[best_output] = 1;
+                port_matching_add(matching, i, best_output);
+            };
+        };
+    };
+
+    state->tie_ptr = (tie_ptr + 1) % num_ports;
+};
+
+/*  API implementation. */
+i_crossbar_scheduler_t iLQF_scheduler() {
+    i_crossbar_scheduler_t scheduler;
+    scheduler.init = iLQF_init;
+    scheduler.schedule = iLQF_schedule;
+    scheduler.free = iLQF_free;
+
+    return scheduler;
+};
+
+i_crossbar_scheduler_t iOCF_scheduler() {
+    i_crossbar_scheduler_t scheduler;
+    scheduler.init = iOCF_init;
+    scheduler.schedule = iLQF_schedule;
+    scheduler.free = iLQF_free;
+
+    return scheduler;
+};
+
+/*  Helper function implementations. */
+static void *iLQF_state_create(port_num_t num_ports, iLQF_weight_t weight) {
+    iLQF_state_t state = (iLQF_state_t) malloc(sizeof(struct iLQF_state));
+    assert(state);
+
+    state->num_ports = num_ports;
+    state->rounds = sched_rounds(num_ports);
+    state->weight = weight;
+    state->tie_ptr = 0;
+
+    state->input_matched = (char *) malloc(sizeof(char) * num_ports);
+    assert(state->input_matched);
+
+    state->output_matched = (char *) malloc(sizeof(char) * num_ports);
+    assert(state->output_matched);
+
+    state->grant_target =
+        (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(state->grant_target);
+
+    state->grant_weight =
+        (unsigned long *) malloc(sizeof(unsigned long) * num_ports);
+    assert(state->grant_weight);
+
+    state->grant_made = (char *) malloc(sizeof(char) * num_ports);
+    assert(state->grant_made);
+
+    return (void *) state;
+};
+
+/*  Request weight of a VOQ of the given size and head of line arrival -
+    cell age is counted from 1 so that a cell which arrived in the current
+    slot still carries a non-zero weight. */
+static inline unsigned long request_weight(
+    iLQF_state_t state,
+    const sched_voq_state_t *voq_state,
+    unsigned int size,
+    uint32_t hol_arrival
+) {
+    if (state->weight == WEIGHT_QUEUE_LENGTH) {
+        return size;
+    };
+
+    /*  Arrival slots wrap at 2^32, so the age is taken modulo 2^32. */
+    uint32_t age = (uint32_t) voq_state->slot - hol_arrival;
+
+    return (unsigned long) age + 1;
+};
@@ -0,0 +1,17 @@
+/*  iLQF.h
+
+    Iterative longest queue first (iLQF) and iterative oldest cell first (iOCF)
+    crossbar schedulers (McKeown, 1995). Both are weighted variants of the
+    request-grant-accept matching used by iSLIP, differing only in the weight
+    given to each request. */
+
+#ifndef ILQF_H
+#define ILQF_H
+
+#include "crossbar_scheduler.h"
+
+/*  API functions. */
+i_crossbar_scheduler_t iLQF_scheduler();
+i_crossbar_scheduler_t iOCF_scheduler();
+
+#endif
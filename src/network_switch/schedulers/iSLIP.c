@@ -0,0 +1,362 @@
+/*  iSLIP.c
+
+    Implementation of the iSLIP crossbar scheduler. */
+
+#include "iSLIP.h"
+#include "./../switch_profile.h"
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+/*  A slot is scheduled by scanning a matrix of requests if more than one in
+    SPARSE_FRACTION VOQs is non-empty, and from the non-empty lists
+    otherwise. */
+#define SPARSE_FRACTION 8
+
+#define WORD_BITS 64
+
+/*  Scheduler state - the grant and accept pointers persist between time
+    slots. The remaining arrays are scratch space for a single call to
+    schedule, allocated once at init time rather than on every slot, except
+    for request. In dense slots request holds a bit for each non-empty VOQ,
+    row-major by output with words words a row, and unmatched a bit for
+    each unmatched input. request is only allocated on the first dense
+    slot, so that a large switch under sparse traffic never holds N^2
+    bits. */
+struct iSLIP_state {
+    port_num_t num_ports;
+    int rounds;
+
+    port_num_t *grant_ptr;
+    port_num_t *accept_ptr;
+
+    char *input_matched;
+    char *output_matched;
+    port_num_t *grant_target;
+    port_num_t *grant_dist;
+    char *grant_made;
+    port_num_t *accept_target;
+    port_num_t *accept_dist;
+    char *accept_made;
+
+    uint64_t *request;
+    uint64_t *unmatched;
+    unsigned int words;
+};
+
+typedef struct iSLIP_state *iSLIP_state_t;
+
+/*  Forward declare helper functions. */
+static void requests_set(iSLIP_state_t state, voq_matrix_t voqs);
+static inline port_num_t request_find(
+    iSLIP_state_t state,
+    port_num_t output_port
+);
+
+/*  Create iSLIP scheduler state with all pointers starting at port 0. */
+static void *iSLIP_init(port_num_t num_ports) {
+    iSLIP_state_t state = (iSLIP_state_t) malloc(sizeof(struct iSLIP_state));
+    assert(state);
+
+    state->num_ports = num_ports;
+    state->rounds = sched_rounds(num_ports);
+
+    state->grant_ptr = (port_num_t *) calloc(num_ports, sizeof(port_num_t));
+    assert(state->grant_ptr);
+
+    state->accept_ptr = (port_num_t *) calloc(num_ports, sizeof(port_num_t));
+    assert(state->accept_ptr);
+
+    state->input_matched = (char *) malloc(sizeof(char) * num_ports);
+    assert(state->input_matched);
+
+    state->output_matched = (char *) malloc(sizeof(char) * num_ports);
+    assert(state->output_matched);
+
+    state->grant_target =
+        (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(state->grant_target);
+
+    state->grant_dist = (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(state->grant_dist);
+
+    state->grant_made = (char *) malloc(sizeof(char) * num_ports);
+    assert(state->grant_made);
+
+    state->accept_target =
+        (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(state->accept_target);
+
+    state->accept_dist = (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(state->accept_dist);
+
+    state->accept_made = (char *) malloc(sizeof(char) * num_ports);
+    assert(state->accept_made);
+
+    state->words = (num_ports + WORD_BITS - 1) / WORD_BITS;
+    state->request = NULL;
+
+    state->unmatched = (uint64_t *) malloc(sizeof(uint64_t) * state->words);
+    assert(state->unmatched);
+
+    return (void *) state;
+};
+
+/*  Free iSLIP scheduler state. */
+static void iSLIP_free(void *state_ptr) {
+    assert(state_ptr);
+    iSLIP_state_t state = (iSLIP_state_t) state_ptr;
+
+    free(state->grant_ptr);
+    free(state->accept_ptr);
+    free(state->input_matched);
+    free(state->output_matched);
+    free(state->grant_target);
+    free(state->grant_dist);
+    free(state->grant_made);
+    free(state->accept_target);
+    free(state->accept_dist);
+    free(state->accept_made);
+    free(state->request);
+    free(state->unmatched);
+    free(state);
+};
+
+/*  iSLIP works as follows:
+        Input round:
+            The input ports send messages to all of the output ports they wish
+            to output to.
+            
+        Output round:
+            The output ports receive their messages and then choose one to
+            grant starting from the output pointer entry.
+        
+        Input grant:
+            The input ports then receive their grants and accept those starting
+            from the grant.
+            
+    Pointers are only updated when a grant is accepted, which is what
+    desynchronises the outputs and gives iSLIP its 100% throughput under
+    uniform traffic. As in McKeown's iSLIP, an accepted grant moves the
+    output's grant pointer to one beyond the input it matched, and the
+    input's accept pointer to one beyond the output, and only in the first
+    round, so that matches added in later rounds cannot starve a VOQ.
+
+    When few VOQs are non-empty, scanning every input from each grant
+    pointer costs O(N^2) per round, so instead the requests are found by
+    walking the non-empty outputs of each input, with each output keeping
+    the request nearest after its pointer. When most VOQs are non-empty the
+    requests are instead set in a bit matrix by output, and each output
+    finds the first unmatched input requesting it from its pointer 64
+    inputs at a time. In either case the accept phase walks the grants, of
+    which there are at most N. */
+static void iSLIP_schedule(
+    void *state_ptr,
+    const sched_voq_state_t *voq_state,
+    port_matching_t *matching
+) {
+    assert(state_ptr);
+    assert(voq_state);
+    assert(matching);
+
+    iSLIP_state_t state = (iSLIP_state_t) state_ptr;
+    port_num_t num_ports = state->num_ports;
+
+    int r;
+    port_num_t i;
+    port_num_t j;
+    port_num_t count;
+
+    /*  Reset schedule. */
+    port_matching_clear(matching);
+    memset(state->input_matched, 0, sizeof(char) * num_ports);
+    memset(state->output_matched, 0, sizeof(char) * num_ports);
+
+    unsigned long num_requests = 0;
+    for (i = 0; i < num_ports; i++) {
+        voq_matrix_nonempty_outputs(voq_state->voqs, i, &count);
+        num_requests += count;
+    };
+
+    char dense = num_requests * SPARSE_FRACTION >
+        (unsigned long) num_ports * num_ports;
+
+    if (dense) {
+        requests_set(state, voq_state->voqs);
+    };
+
+    SWITCH_PROFILE_RESUME(mark);
+    for (r = 0; r < state->rounds; r++) {
+        /*  Reset grants. */
+        memset(state->grant_made, 0, sizeof(char) * num_ports);
+        memset(state->accept_made, 0, sizeof(char) * num_ports);
+
+        /*  Grant phase - each unmatched output grants to the first unmatched
+            input with a packet for it, starting at the grant pointer. */
+        if (dense) {
+            for (j = 0; j < num_ports; j++) {
+                if (state->output_matched[j] == 1) {
+                    continue;
+                };
+
+                port_num_t input_port = request_find(state, j);
+
+                if (input_port < num_ports) {
+                    state->grant_target[j] = input_port;
+                    state->grant_made[j] = 1;
+                };
+            };
+        } else {
+            for (i = 0; i < num_ports; i++) {
+                if (state->input_matched[i] == 1) {
+                    continue;
+                };
+
+                const port_num_t *outputs =
+                    voq_matrix_nonempty_outputs(voq_state->voqs, i, &count);
+
+                port_num_t k;
+                for (k = 0; k < count; k++) {
+                    port_num_t output_port = outputs[k];
+
+                    if (state->output_matched[output_port] == 1) {
+                        continue;
+                    };
+
+                    port_num_t dist = sched_distance(
+                        state->grant_ptr[output_port], i, num_ports
+                    );
+
+                    if (
+                        state->grant_made[output_port] == 0 ||
+                        dist < state->grant_dist[output_port]
+                    ) {
+                        state->grant_target[output_port] = i;
+                        state->grant_dist[output_port] = dist;
+                        state->grant_made[output_port] = 1;
+                    };
+                };
+            };
+        };
+
+        /*  Accept phase - each input which received grants accepts the first
+            one starting from its accept pointer, and the input and output
+            become matched. Pointers are only updated in the first round. */
+        for (j = 0; j < num_ports; j++) {
+            if (state->grant_made[j] == 0) {
+                continue;
+            };
+
+            port_num_t input_port = state->grant_target[j];
+            port_num_t dist =
+                sched_distance(state->accept_ptr[input_port], j, num_ports);
+
+            if (
+                state->accept_made[input_port] == 0 ||
+                dist < state->accept_dist[input_port]
+            ) {
+                state->accept_target[input_port] = j;
+                state->accept_dist[input_port] = dist;
+                state->accept_made[input_port] = 1;
+            };
+        };
+
+        for (i = 0; i < num_ports; i++) {
+            if (state->accept_made[i] == 0) {
+                continue;
+            };
+
+            port_num_t output_port = state->accept_target[i];
+
+            state->input_matched[i] = 1;
+            state->output_matched[output_port] = 1;
+            state->unmatched[i / WORD_BITS] &=
+                ~((uint64_t) 1 << (i % WORD_BITS));
+            port_matching_add(matching, i, output_port);
+
+            if (r == 0) {
+                state->grant_ptr[output_port] = (i + 1) % num_ports;
+                state->accept_ptr[i] = (output_port + 1) % num_ports;
+            };
+        };
+
+        SWITCH_PROFILE_ROUND(r, mark);
+    };
+
+    if (dense) {
+        memset(
+            state->request,
+            0,
+            sizeof(uint64_t) * num_ports * state->words
+        );
+    };
+};
+
+/*  API implementation. */
+i_crossbar_scheduler_t iSLIP_scheduler() {
+    i_crossbar_scheduler_t scheduler;
+    scheduler.init = iSLIP_init;
+    scheduler.schedule = iSLIP_schedule;
+    scheduler.free = iSLIP_free;
+
+    return scheduler;
+};
+
+/*  Helper function implementations. */
+
+/*  Set the request bit of every non-empty VOQ, allocating the request
+    matrix, all clear, if it has not been, and mark every input unmatched.
+    The matrix is cleared again at the end of the slot, which as more than
+    one in SPARSE_FRACTION bits are set costs less than setting them. */
+static void requests_set(iSLIP_state_t state, voq_matrix_t voqs) {
+    port_num_t num_ports = state->num_ports;
+    unsigned int words = state->words;
+
+    if (!state->request) {
+        state->request = (uint64_t *)
+            calloc((size_t) num_ports * words, sizeof(uint64_t));
+        assert(state->request);
+    };
+
+    port_num_t i;
+    for (i = 0; i < num_ports; i++) {
+        port_num_t count;
+        const port_num_t *outputs =
+            voq_matrix_nonempty_outputs(voqs, i, &count);
+        uint64_t bit = (uint64_t) 1 << (i % WORD_BITS);
+
+        port_num_t k;
+        for (k = 0; k < count; k++) {
+            state->request[(size_t) outputs[k] * words + i / WORD_BITS] |= bit;
+        };
+    };
+
+    memset(state->unmatched, 0xff, sizeof(uint64_t) * words);
+};
+
+/*  First unmatched input requesting an output, in round robin order from
+    the output's grant pointer, or num_ports if there is none. The word
+    holding the pointer is searched from the pointer on, then the words
+    after it, and then the same word again from its start. Bits of ports
+    beyond num_ports are never set in the request matrix. */
+static inline port_num_t request_find(
+    iSLIP_state_t state,
+    port_num_t output_port
+) {
+    unsigned int words = state->words;
+    const uint64_t *row = state->request + (size_t) output_port * words;
+    port_num_t from = state->grant_ptr[output_port];
+    unsigned int word = from / WORD_BITS;
+    uint64_t bits = row[word] & state->unmatched[word] &
+        (~(uint64_t) 0 << (from % WORD_BITS));
+
+    unsigned int k;
+    for (k = 0; k < words && !bits; k++) {
+        word = word + 1 == words ? 0 : word + 1;
+        bits = row[word] & state->unmatched[word];
+    };
+
+    return bits
+        ? word * WORD_BITS + (port_num_t) __builtin_ctzll(bits)
+        : state->num_ports;
+};
@@ -0,0 +1,13 @@
+/*  iSLIP.h
+
+    iSLIP crossbar scheduler (McKeown, 1999). */
+
+#ifndef ISLIP_H
+#define ISLIP_H
+
+#include "crossbar_scheduler.h"
+
+/*  API functions. */
+i_crossbar_scheduler_t iSLIP_scheduler();
+
+#endif
@@ -0,0 +1,161 @@
+/*  pim.c
+
+    Implementation of the parallel iterative matching (PIM) crossbar
+    scheduler. */
+
+#include "pim.h"
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+#define PIM_SEED 0x9e3779b97f4a7c15ULL
+
+/*  Scheduler state - PIM keeps no state between time slots other than its
+    random number generator. The remaining arrays are scratch space. */
+struct pim_state {
+    port_num_t num_ports;
+    int rounds;
+    unsigned long long rng;
+
+    char *input_matched;
+    char *output_matched;
+    port_num_t *grant_target;
+    port_num_t *request_count;
+};
+
+typedef struct pim_state *pim_state_t;
+
+/*  Create PIM scheduler state. */
+static void *pim_init(port_num_t num_ports) {
+    pim_state_t state = (pim_state_t) malloc(sizeof(struct pim_state));
+    assert(state);
+
+    state->num_ports = num_ports;
+    state->rounds = sched_rounds(num_ports);
+    state->rng = PIM_SEED;
+
+    state->input_matched = (char *) malloc(sizeof(char) * num_ports);
+    assert(state->input_matched);
+
+    state->output_matched = (char *) malloc(sizeof(char) * num_ports);
+    assert(state->output_matched);
+
+    state->grant_target =
+        (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(state->grant_target);
+
+    state->request_count =
+        (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(state->request_count);
+
+    return (void *) state;
+};
+
+/*  Free PIM scheduler state. */
+static void pim_free(void *state_ptr) {
+    assert(state_ptr);
+    pim_state_t state = (pim_state_t) state_ptr;
+
+    free(state->input_matched);
+    free(state->output_matched);
+    free(state->grant_target);
+    free(state->request_count);
+    free(state);
+};
+
+/*  PIM works in the same request-grant-accept rounds as iSLIP, except that
+    each unmatched output grants to an input chosen uniformly at random from
+    those requesting it, and each input accepts a grant chosen uniformly at
+    random. No pointers are kept between slots.
+
+    Requests are found by walking the non-empty outputs of each input, and
+    the random choices are made by reservoir sampling as the candidates are
+    visited - the k-th candidate replaces the current choice with probability
+    1/k - so that no candidate list needs to be built. */
+static void pim_schedule(
+    void *state_ptr,
+    const sched_voq_state_t *voq_state,
+    port_matching_t *matching
+) {
+    assert(state_ptr);
+    assert(voq_state);
+    assert(matching);
+
+    pim_state_t state = (pim_state_t) state_ptr;
+    port_num_t num_ports = state->num_ports;
+
+    int r;
+    port_num_t i;
+    port_num_t k;
+    port_num_t count;
+    const port_num_t *outputs;
+
+    port_matching_clear(matching);
+    memset(state->input_matched, 0, sizeof(char) * num_ports);
+    memset(state->output_matched, 0, sizeof(char) * num_ports);
+
+    for (r = 0; r < state->rounds; r++) {
+        memset(state->request_count, 0, sizeof(port_num_t) * num_ports);
+
+        /*  Grant phase - each unmatched output grants to one of the unmatched
+            inputs requesting it at random. */
+        for (i = 0; i < num_ports; i++) {
+            if (state->input_matched[i] == 1) {
+                continue;
+            };
+
+            outputs = voq_matrix_nonempty_outputs(voq_state->voqs, i, &count);
+
+            for (k = 0; k < count; k++) {
+                port_num_t output_port = outputs[k];
+
+                if (
+                    state->output_matched[output_port] == 0 &&
+                    sched_rand(&state->rng) %
+                        ++state->request_count[output_port] == 0
+                ) {
+                    state->grant_target[output_port] = i;
+                };
+            };
+        };
+
+        /*  Accept phase - each unmatched input accepts one of the grants made
+            to it at random. */
+        for (i = 0; i < num_ports; i++) {
+            if (state->input_matched[i] == 1) {
+                continue;
+            };
+
+            port_num_t num_grants = 0;
+            port_num_t output_port = 0;
+
+            outputs = voq_matrix_nonempty_outputs(voq_state->voqs, i, &count);
+
+            for (k = 0; k < count; k++) {
+                if (
+                    state->request_count[outputs[k]] > 0 &&
+                    state->grant_target[outputs[k]] == i &&
+                    sched_rand(&state->rng) % ++num_grants == 0
+                ) {
+                    output_port = outputs[k];
+                };
+            };
+
+            if (num_grants > 0) {
+                state->input_matched[i] = 1;
+                state->output_matched[output_port] = 1;
+                port_matching_add(matching, i, output_port);
+            };
+        };
+    };
+};
+
+/*  API implementation. */
+i_crossbar_scheduler_t pim_scheduler() {
+    i_crossbar_scheduler_t scheduler;
+    scheduler.init = pim_init;
+    scheduler.schedule = pim_schedule;
+    scheduler.free = pim_free;
+
+    return scheduler;
+};
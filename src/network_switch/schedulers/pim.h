@@ -0,0 +1,13 @@
+/*  pim.h
+
+    Parallel iterative matching crossbar scheduler (Anderson et al., 1993). */
+
+#ifndef PIM_H
+#define PIM_H
+
+#include "crossbar_scheduler.h"
+
+/*  API functions. */
+i_crossbar_scheduler_t pim_scheduler();
+
+#endif
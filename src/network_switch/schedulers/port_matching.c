@@ -0,0 +1,62 @@
+/*  port_matching.c */
+
+#include "port_matching.h"
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+/*  Create an empty matching. */
+port_matching_t *port_matching_create(port_num_t num_ports) {
+    port_matching_t *matching =
+        (port_matching_t *) malloc(sizeof(port_matching_t));
+    assert(matching);
+
+    matching->num_ports = num_ports;
+    matching->size = 0;
+
+    matching->in_to_out =
+        (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(matching->in_to_out);
+
+    matching->out_to_in =
+        (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(matching->out_to_in);
+
+    matching->matched_inputs =
+        (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(matching->matched_inputs);
+
+    port_num_t i;
+    for (i = 0; i < num_ports; i++) {
+        matching->in_to_out[i] = PORT_UNMATCHED;
+        matching->out_to_in[i] = PORT_UNMATCHED;
+    };
+
+    return matching;
+};
+
+/*  Free a matching. */
+void port_matching_free(port_matching_t *matching) {
+    assert(matching);
+
+    free(matching->in_to_out);
+    free(matching->out_to_in);
+    free(matching->matched_inputs);
+    free(matching);
+};
+
+/*  Copy a matching - dest must have been created with the same number of
+    ports as src. */
+void port_matching_copy(port_matching_t *dest, const port_matching_t *src) {
+    assert(dest);
+    assert(src);
+    assert(dest->num_ports == src->num_ports);
+
+    port_matching_clear(dest);
+
+    port_num_t k;
+    for (k = 0; k < src->size; k++) {
+        port_num_t input_port = src->matched_inputs[k];
+        port_matching_add(dest, input_port, src->in_to_out[input_port]);
+    };
+};
@@ -0,0 +1,57 @@
+/*  port_matching.h
+
+    A matching of input ports to output ports, as produced by a crossbar
+    scheduler. The matching is stored in both directions, along with the list
+    of matched inputs, so that consumers can walk only the matched pairs and
+    clearing the matching costs O(size) rather than O(N). */
+
+#ifndef PORT_MATCHING_H
+#define PORT_MATCHING_H
+
+#include "./../network_switch_common.h"
+
+#define PORT_UNMATCHED ((port_num_t) -1)
+
+/*  Port matching - in_to_out[i] is the output matched to input i and
+    out_to_in[j] the input matched to output j, or PORT_UNMATCHED. The first
+    size entries of matched_inputs are the matched inputs, in the order they
+    were added. */
+struct port_matching {
+    port_num_t num_ports;
+    port_num_t size;
+    port_num_t *in_to_out;
+    port_num_t *out_to_in;
+    port_num_t *matched_inputs;
+};
+
+typedef struct port_matching port_matching_t;
+
+/*  API functions. */
+port_matching_t *port_matching_create(port_num_t num_ports);
+void port_matching_free(port_matching_t *matching);
+void port_matching_copy(port_matching_t *dest, const port_matching_t *src);
+
+/*  Clear matching - only the entries set since the last clear are reset. */
+static inline void port_matching_clear(port_matching_t *matching) {
+    port_num_t k;
+    for (k = 0; k < matching->size; k++) {
+        port_num_t input_port = matching->matched_inputs[k];
+        matching->out_to_in[matching->in_to_out[input_port]] = PORT_UNMATCHED;
+        matching->in_to_out[input_port] = PORT_UNMATCHED;
+    };
+
+    matching->size = 0;
+};
+
+/*  Add edge - both ports must currently be unmatched. */
+static inline void port_matching_add(
+    port_matching_t *matching,
+    port_num_t input_port,
+    port_num_t output_port
+) {
+    matching->in_to_out[input_port] = output_port;
+    matching->out_to_in[output_port] = input_port;
+    matching->matched_inputs[matching->size++] = input_port;
+};
+
+#endif
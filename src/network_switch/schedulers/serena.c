@@ -0,0 +1,400 @@
+/*  serena.c
+
+    Implementation of the SERENA crossbar scheduler. Each slot, a matching is
+    built from the cells that arrived in that slot and merged with the
+    previous slot's matching. The union of two matchings is a set of disjoint
+    paths and cycles, and on each of these SERENA keeps the edges of whichever
+    matching has the greater total VOQ occupancy. The weight of the matching
+    therefore never falls below that of the previous one (less what was
+    served), which gives throughput close to maximum weight matching at O(N)
+    cost per slot. */
+
+#include "serena.h"
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+#define SERENA_SEED 0x2545f4914f6cdd1dULL
+
+/*  Matching identifiers used while walking the union of the two matchings. */
+enum serena_matching {
+    MATCHING_ARRIVAL = 0,
+    MATCHING_PREVIOUS = 1
+};
+
+typedef enum serena_matching serena_matching_t;
+
+/*  Scheduler state - two matchings stored in both directions, plus scratch
+    space for walking their union. The walk records the edges of one
+    component at a time in walk_input, walk_output, walk_matching and
+    walk_size, the size of the edge's VOQ. */
+struct serena_state {
+    port_num_t num_ports;
+    unsigned long long rng;
+
+    port_num_t *in_to_out[2];
+    port_num_t *out_to_in[2];
+    port_num_t *arrival_count;
+
+    char *input_visited;
+    char *output_visited;
+
+    port_num_t *walk_input;
+    port_num_t *walk_output;
+    serena_matching_t *walk_matching;
+    unsigned int *walk_size;
+};
+
+typedef struct serena_state *serena_state_t;
+
+/*  Forward declare helper functions. */
+static void build_arrival_matching(
+    serena_state_t state,
+    const sched_voq_state_t *voq_state
+);
+static void build_previous_matching(
+    serena_state_t state,
+    const sched_voq_state_t *voq_state
+);
+static void merge_component(
+    serena_state_t state,
+    const sched_voq_state_t *voq_state,
+    char start_is_input,
+    port_num_t start_port,
+    serena_matching_t start_matching,
+    port_matching_t *matching
+);
+
+/*  Create SERENA scheduler state. */
+static void *serena_init(port_num_t num_ports) {
+    serena_state_t state = (serena_state_t) malloc(sizeof(struct serena_state));
+    assert(state);
+
+    state->num_ports = num_ports;
+    state->rng = SERENA_SEED;
+
+    int m;
+    for (m = 0; m < 2; m++) {
+        state->in_to_out[m] =
+            (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+        assert(state->in_to_out[m]);
+
+        state->out_to_in[m] =
+            (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+        assert(state->out_to_in[m]);
+    };
+
+    state->arrival_count =
+        (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+    assert(state->arrival_count);
+
+    state->input_visited = (char *) malloc(sizeof(char) * num_ports);
+    assert(state->input_visited);
+
+    state->output_visited = (char *) malloc(sizeof(char) * num_ports);
+    assert(state->output_visited);
+
+    /*  A component has at most one edge per input in each matching. */
+    state->walk_input =
+        (port_num_t *) malloc(sizeof(port_num_t) * 2 * num_ports);
+    assert(state->walk_input);
+
+    state->walk_output =
+        (port_num_t *) malloc(sizeof(port_num_t) * 2 * num_ports);
+    assert(state->walk_output);
+
+    state->walk_matching =
+        (serena_matching_t *) malloc(sizeof(serena_matching_t) * 2 * num_ports);
+    assert(state->walk_matching);
+
+    state->walk_size =
+        (unsigned int *) malloc(sizeof(unsigned int) * 2 * num_ports);
+    assert(state->walk_size);
+
+    return (void *) state;
+};
+
+/*  Free SERENA scheduler state. */
+static void serena_free(void *state_ptr) {
+    assert(state_ptr);
+    serena_state_t state = (serena_state_t) state_ptr;
+
+    int m;
+    for (m = 0; m < 2; m++) {
+        free(state->in_to_out[m]);
+        free(state->out_to_in[m]);
+    };
+
+    free(state->arrival_count);
+    free(state->input_visited);
+    free(state->output_visited);
+    free(state->walk_input);
+    free(state->walk_output);
+    free(state->walk_matching);
+    free(state->walk_size);
+    free(state);
+};
+
+/*  SERENA schedule - build the arrival and previous matchings, then merge
+    them component by component. Edges common to both matchings form their
+    own component and are kept directly. Paths are walked from an endpoint
+    (a port matched in only one of the two matchings) and whatever remains
+    unvisited afterwards lies on a cycle. */
+static void serena_schedule(
+    void *state_ptr,
+    const sched_voq_state_t *voq_state,
+    port_matching_t *matching
+) {
+    assert(state_ptr);
+    assert(voq_state);
+    assert(voq_state->arrival_output);
+    assert(voq_state->arrival_active);
+    assert(voq_state->prev_matching);
+    assert(matching);
+
+    serena_state_t state = (serena_state_t) state_ptr;
+    port_num_t num_ports = state->num_ports;
+
+    /*  The previous matching may alias the output, so read it first. */
+    build_previous_matching(state, voq_state);
+    build_arrival_matching(state, voq_state);
+
+    port_matching_clear(matching);
+    memset(state->input_visited, 0, sizeof(char) * num_ports);
+    memset(state->output_visited, 0, sizeof(char) * num_ports);
+
+    port_num_t i;
+    port_num_t **in_to_out = state->in_to_out;
+    port_num_t **out_to_in = state->out_to_in;
+
+    /*  Common edges. */
+    for (i = 0; i < num_ports; i++) {
+        port_num_t output_port = in_to_out[MATCHING_ARRIVAL][i];
+
+        if (
+            output_port != PORT_UNMATCHED &&
+            output_port == in_to_out[MATCHING_PREVIOUS][i]
+        ) {
+            state->input_visited[i] = 1;
+            state->output_visited[output_port] = 1;
+            port_matching_add(matching, i, output_port);
+        };
+    };
+
+    /*  Paths, walked from an input or output endpoint. */
+    serena_matching_t m;
+    for (m = MATCHING_ARRIVAL; m <= MATCHING_PREVIOUS; m++) {
+        serena_matching_t other = 1 - m;
+
+        for (i = 0; i < num_ports; i++) {
+            if (
+                !state->input_visited[i] &&
+                in_to_out[m][i] != PORT_UNMATCHED &&
+                in_to_out[other][i] == PORT_UNMATCHED
+            ) {
+                merge_component(state, voq_state, 1, i, m, matching);
+            };
+
+            if (
+                !state->output_visited[i] &&
+                out_to_in[m][i] != PORT_UNMATCHED &&
+                out_to_in[other][i] == PORT_UNMATCHED
+            ) {
+                merge_component(state, voq_state, 0, i, m, matching);
+            };
+        };
+    };
+
+    /*  Cycles - every remaining matched input is matched in both. */
+    for (i = 0; i < num_ports; i++) {
+        if (
+            !state->input_visited[i] &&
+            in_to_out[MATCHING_ARRIVAL][i] != PORT_UNMATCHED
+        ) {
+            merge_component(state, voq_state, 1, i, MATCHING_ARRIVAL,
+                matching);
+        };
+    };
+};
+
+/*  API implementation. */
+i_crossbar_scheduler_t serena_scheduler() {
+    i_crossbar_scheduler_t scheduler;
+    scheduler.init = serena_init;
+    scheduler.schedule = serena_schedule;
+    scheduler.free = serena_free;
+
+    return scheduler;
+};
+
+/*  Helper function implementations. */
+
+/*  Arrival matching - every input that received a cell this slot requests
+    that cell's output. Where several inputs request the same output, one is
+    chosen uniformly at random by reservoir sampling, so a single pass over
+    the inputs suffices. As in SERENA, the result is then completed to a full
+    matching by pairing the remaining inputs and outputs, here from a random
+    offset. Completion edges on empty VOQs carry no weight and are discarded
+    when the merged matching is written out, but those that land on a
+    backlogged VOQ give it a chance of service it would not otherwise get. */
+static void build_arrival_matching(
+    serena_state_t state,
+    const sched_voq_state_t *voq_state
+) {
+    port_num_t num_ports = state->num_ports;
+    port_num_t *in_to_out = state->in_to_out[MATCHING_ARRIVAL];
+    port_num_t *out_to_in = state->out_to_in[MATCHING_ARRIVAL];
+
+    port_num_t i;
+    for (i = 0; i < num_ports; i++) {
+        in_to_out[i] = PORT_UNMATCHED;
+        out_to_in[i] = PORT_UNMATCHED;
+        state->arrival_count[i] = 0;
+    };
+
+    for (i = 0; i < num_ports; i++) {
+        if (voq_state->arrival_active[i]) {
+            port_num_t output_port = voq_state->arrival_output[i];
+            state->arrival_count[output_port]++;
+
+            if (
+                sched_rand(&state->rng) % state->arrival_count[output_port]
+                    == 0
+            ) {
+                out_to_in[output_port] = i;
+            };
+        };
+    };
+
+    for (i = 0; i < num_ports; i++) {
+        if (out_to_in[i] != PORT_UNMATCHED) {
+            in_to_out[out_to_in[i]] = i;
+        };
+    };
+
+    /*  Complete the matching. */
+    port_num_t output_port = sched_rand(&state->rng) % num_ports;
+    port_num_t checked = 0;
+
+    for (i = 0; i < num_ports; i++) {
+        if (in_to_out[i] == PORT_UNMATCHED) {
+            while (checked < num_ports && out_to_in[output_port] != PORT_UNMATCHED) {
+                output_port = (output_port + 1) % num_ports;
+                checked++;
+            };
+
+            if (checked == num_ports) {
+                break;
+            };
+
+            in_to_out[i] = output_port;
+            out_to_in[output_port] = i;
+        };
+    };
+};
+
+/*  Previous matching - the previous slot's matching with any edge whose VOQ
+    has since drained removed. */
+static void build_previous_matching(
+    serena_state_t state,
+    const sched_voq_state_t *voq_state
+) {
+    port_num_t num_ports = state->num_ports;
+    port_num_t *in_to_out = state->in_to_out[MATCHING_PREVIOUS];
+    port_num_t *out_to_in = state->out_to_in[MATCHING_PREVIOUS];
+
+    const port_matching_t *prev = voq_state->prev_matching;
+
+    port_num_t i;
+    for (i = 0; i < num_ports; i++) {
+        in_to_out[i] = PORT_UNMATCHED;
+        out_to_in[i] = PORT_UNMATCHED;
+    };
+
+    port_num_t k;
+    for (k = 0; k < prev->size; k++) {
+        port_num_t input_port = prev->matched_inputs[k];
+        port_num_t output_port = prev->in_to_out[input_port];
+
+        if (voq_matrix_size(voq_state->voqs, input_port, output_port) > 0) {
+            in_to_out[input_port] = output_port;
+            out_to_in[output_port] = input_port;
+        };
+    };
+};
+
+/*  Merge component - walk the component of the union containing the given
+    port, alternating between the two matchings, and keep the edges of the
+    heavier one. Ties go to the previous matching, which avoids needless
+    reconfiguration. */
+static void merge_component(
+    serena_state_t state,
+    const sched_voq_state_t *voq_state,
+    char start_is_input,
+    port_num_t start_port,
+    serena_matching_t start_matching,
+    port_matching_t *matching
+) {
+    unsigned long weight[2] = {0, 0};
+    port_num_t num_edges = 0;
+
+    char is_input = start_is_input;
+    port_num_t port = start_port;
+    serena_matching_t m = start_matching;
+
+    while (1) {
+        port_num_t next;
+
+        if (is_input) {
+            state->input_visited[port] = 1;
+            next = state->in_to_out[m][port];
+        } else {
+            state->output_visited[port] = 1;
+            next = state->out_to_in[m][port];
+        };
+
+        if (next == PORT_UNMATCHED) {
+            break;
+        };
+
+        port_num_t input_port = is_input ? port : next;
+        port_num_t output_port = is_input ? next : port;
+
+        unsigned int size =
+            voq_matrix_size(voq_state->voqs, input_port, output_port);
+
+        state->walk_input[num_edges] = input_port;
+        state->walk_output[num_edges] = output_port;
+        state->walk_matching[num_edges] = m;
+        state->walk_size[num_edges] = size;
+        num_edges++;
+
+        weight[m] += size;
+
+        is_input = !is_input;
+        port = next;
+        m = 1 - m;
+
+        if (
+            (is_input && state->input_visited[port]) ||
+            (!is_input && state->output_visited[port])
+        ) {
+            break;
+        };
+    };
+
+    serena_matching_t keep = weight[MATCHING_ARRIVAL] > weight[MATCHING_PREVIOUS]
+        ? MATCHING_ARRIVAL
+        : MATCHING_PREVIOUS;
+
+    port_num_t e;
+    for (e = 0; e < num_edges; e++) {
+        if (state->walk_matching[e] == keep && state->walk_size[e] > 0) {
+            port_matching_add(
+                matching,
+                state->walk_input[e],
+                state->walk_output[e]
+            );
+        };
+    };
+};
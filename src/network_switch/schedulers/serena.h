@@ -0,0 +1,15 @@
+/*  serena.h
+
+    SERENA crossbar scheduler (Giaccone, Prabhakar and Shah, 2003). An
+    incremental scheduler that reuses the previous slot's matching rather than
+    computing a new one from scratch. */
+
+#ifndef SERENA_H
+#define SERENA_H
+
+#include "crossbar_scheduler.h"
+
+/*  API functions. */
+i_crossbar_scheduler_t serena_scheduler();
+
+#endif
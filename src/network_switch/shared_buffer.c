@@ -0,0 +1,126 @@
+/*  shared_buffer.c */
+
+#include "shared_buffer.h"
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+/*  Shared buffer structure. */
+struct shared_buffer {
+    port_num_t num_ports;
+    shared_buffer_config_t config;
+    shared_buffer_stats_t stats;
+    unsigned long *output_drops;
+};
+
+/*  API implementation. */
+
+/*  Create shared buffer. */
+shared_buffer_t shared_buffer_create(
+    port_num_t num_ports,
+    shared_buffer_config_t config
+) {
+    assert(config.policy == BUFFER_POLICY_NONE || config.capacity > 0);
+    assert(config.policy != BUFFER_POLICY_DYNAMIC || config.alpha > 0);
+
+    shared_buffer_t shared_buffer =
+        (shared_buffer_t) malloc(sizeof(struct shared_buffer));
+    assert(shared_buffer);
+
+    shared_buffer->num_ports = num_ports;
+    shared_buffer->config = config;
+    memset(&shared_buffer->stats, 0, sizeof(shared_buffer_stats_t));
+
+    shared_buffer->output_drops =
+        (unsigned long *) calloc(num_ports, sizeof(unsigned long));
+    assert(shared_buffer->output_drops);
+
+    return shared_buffer;
+};
+
+/*  Free shared buffer. */
+void shared_buffer_free(shared_buffer_t shared_buffer) {
+    assert(shared_buffer);
+
+    free(shared_buffer->output_drops);
+    free(shared_buffer);
+};
+
+/*  Configuration of an unbounded buffer, which admits every cell. */
+shared_buffer_config_t shared_buffer_unbounded_config() {
+    shared_buffer_config_t config;
+    config.policy = BUFFER_POLICY_NONE;
+    config.capacity = 0;
+    config.voq_threshold = 0;
+    config.alpha = 0;
+
+    return config;
+};
+
+/*  Decide whether a cell arriving for the VOQ from input_port to
+    output_port is admitted, and count it. The caller enqueues admitted cells
+    and drops the rest. */
+int shared_buffer_admit(
+    shared_buffer_t shared_buffer,
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port
+) {
+    assert(shared_buffer);
+    assert(voq_matrix);
+    assert(output_port < shared_buffer->num_ports);
+
+    const shared_buffer_config_t *config = &shared_buffer->config;
+    unsigned long total = voq_matrix_total_backlog(voq_matrix);
+
+    int full = 0;
+    int over_threshold = 0;
+
+    if (config->policy != BUFFER_POLICY_NONE) {
+        full = total >= config->capacity;
+    };
+
+    if (!full && config->policy == BUFFER_POLICY_STATIC) {
+        over_threshold = voq_matrix_size(voq_matrix, input_port, output_port) >=
+            config->voq_threshold;
+    } else if (!full && config->policy == BUFFER_POLICY_DYNAMIC) {
+        /*  The threshold shrinks as the buffer fills, leaving free cells for
+            VOQs which become active later. */
+        over_threshold = voq_matrix_size(voq_matrix, input_port, output_port) >=
+            config->alpha * (double) (config->capacity - total);
+    };
+
+    if (full || over_threshold) {
+        shared_buffer->stats.dropped++;
+        shared_buffer->stats.dropped_full += full;
+        shared_buffer->stats.dropped_threshold += over_threshold;
+        shared_buffer->output_drops[output_port]++;
+
+        return 0;
+    };
+
+    shared_buffer->stats.admitted++;
+    if (total + 1 > shared_buffer->stats.high_water) {
+        shared_buffer->stats.high_water = total + 1;
+    };
+
+    return 1;
+};
+
+/*  Buffer statistics. */
+void shared_buffer_stats(
+    shared_buffer_t shared_buffer,
+    shared_buffer_stats_t *stats_out
+) {
+    assert(shared_buffer);
+    assert(stats_out);
+
+    *stats_out = shared_buffer->stats;
+};
+
+/*  Cells dropped for each output port. */
+const unsigned long *shared_buffer_output_drops(shared_buffer_t shared_buffer) {
+    assert(shared_buffer);
+
+    return shared_buffer->output_drops;
+};
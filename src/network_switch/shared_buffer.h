@@ -0,0 +1,81 @@
+/*  shared_buffer.h
+
+    Admission control for a switch-wide shared buffer of a fixed number of
+    cells, which all VOQs draw on. Arriving cells are admitted or dropped by
+    one of these policies:
+
+        BUFFER_POLICY_NONE       admit everything - the buffer is unbounded
+        BUFFER_POLICY_TAIL_DROP  admit while the buffer has a free cell
+        BUFFER_POLICY_STATIC     admit while the buffer has a free cell and
+                                 the VOQ holds fewer than voq_threshold cells
+        BUFFER_POLICY_DYNAMIC    Dynamic Threshold - admit while the VOQ holds
+                                 fewer than alpha times the free cells
+
+    The buffer keeps no occupancy of its own - it is read from the VOQ
+    matrix, so cells are returned to the buffer simply by dequeueing them.
+    Drops are counted in total, by reason and by output port. */
+
+#ifndef SHARED_BUFFER_H
+#define SHARED_BUFFER_H
+
+#include "network_switch_common.h"
+#include "voq_matrix.h"
+
+/*  Admission policy. */
+enum buffer_policy {
+    BUFFER_POLICY_NONE,
+    BUFFER_POLICY_TAIL_DROP,
+    BUFFER_POLICY_STATIC,
+    BUFFER_POLICY_DYNAMIC
+};
+
+typedef enum buffer_policy buffer_policy_t;
+
+/*  Buffer configuration - capacity is the total number of cells, and
+    voq_threshold and alpha are only used by the static and dynamic policies
+    respectively. */
+struct shared_buffer_config {
+    buffer_policy_t policy;
+    unsigned long capacity;
+    unsigned long voq_threshold;
+    double alpha;
+};
+
+typedef struct shared_buffer_config shared_buffer_config_t;
+
+/*  Buffer statistics - dropped_full counts cells dropped because the buffer
+    was full, dropped_threshold those dropped by a per-VOQ threshold, and
+    high_water the largest number of cells held. */
+struct shared_buffer_stats {
+    unsigned long admitted;
+    unsigned long dropped;
+    unsigned long dropped_full;
+    unsigned long dropped_threshold;
+    unsigned long high_water;
+};
+
+typedef struct shared_buffer_stats shared_buffer_stats_t;
+
+struct shared_buffer;
+typedef struct shared_buffer *shared_buffer_t;
+
+/*  API functions. */
+shared_buffer_t shared_buffer_create(
+    port_num_t num_ports,
+    shared_buffer_config_t config
+);
+void shared_buffer_free(shared_buffer_t shared_buffer);
+shared_buffer_config_t shared_buffer_unbounded_config();
+int shared_buffer_admit(
+    shared_buffer_t shared_buffer,
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port
+);
+void shared_buffer_stats(
+    shared_buffer_t shared_buffer,
+    shared_buffer_stats_t *stats_out
+);
+const unsigned long *shared_buffer_output_drops(shared_buffer_t shared_buffer);
+
+#endif
@@ -0,0 +1,81 @@
+/*  switch_profile.c */
+
+#include "switch_profile.h"
+
+#ifdef SWITCH_PROFILE
+
+#include "./../stats/histogram.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int switch_profile_sampled = 0;
+unsigned int switch_profile_countdown = SWITCH_PROFILE_PERIOD;
+
+static histogram_t phases[SWITCH_NUM_PHASES];
+
+_Static_assert(SWITCH_PROFILE_ROUNDS == 4, "phase_names lists four rounds");
+
+static const char *phase_names[SWITCH_NUM_PHASES] = {
+    "tick", "age", "ingress", "round 1", "round 2", "round 3", "round 4+",
+    "schedule", "egress"
+};
+
+/*  Helper function declarations. */
+static void switch_profile_dump();
+
+/*  Record the cycles since since against phase, returning the counter.
+    The histograms are created on the first call, which also arranges for
+    them to be printed at exit. */
+uint64_t switch_profile_record(switch_phase_t phase, uint64_t since) {
+    uint64_t now = switch_profile_now();
+
+    if (!phases[0]) {
+        int p;
+        for (p = 0; p < SWITCH_NUM_PHASES; p++) {
+            phases[p] = histogram_create();
+        };
+
+        atexit(switch_profile_dump);
+    };
+
+    histogram_record(phases[phase], now - since);
+
+    return now;
+};
+
+/*  Helper functions. */
+
+/*  Print the histogram of every phase which was recorded, then free them
+    all. Phase times include the cost of reading the counter once. */
+static void switch_profile_dump() {
+    fprintf(stderr, "switch profile: 1 in %d ticks, %lu sampled, %s\n",
+        SWITCH_PROFILE_PERIOD, histogram_count(phases[SWITCH_PHASE_TICK]),
+#if defined(__x86_64__) || defined(__i386__)
+        "TSC cycles");
+#else
+        "nanoseconds");
+#endif
+    fprintf(stderr, "%-10s %10s %10s %8s %8s %8s %8s %8s\n", "phase",
+        "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+
+    int p;
+    for (p = 0; p < SWITCH_NUM_PHASES; p++) {
+        histogram_t histogram = phases[p];
+
+        if (histogram_count(histogram) > 0) {
+            fprintf(stderr, "%-10s %10lu %10.1f %8lu %8lu %8lu %8lu %8lu\n",
+                phase_names[p], histogram_count(histogram),
+                histogram_mean(histogram),
+                histogram_percentile(histogram, 50),
+                histogram_percentile(histogram, 90),
+                histogram_percentile(histogram, 99),
+                histogram_percentile(histogram, 99.9),
+                histogram_max(histogram));
+        };
+
+        histogram_free(histogram);
+        phases[p] = NULL;
+    };
+};
+
+#endif
@@ -0,0 +1,110 @@
+/*  switch_profile.h
+
+    Per-phase cycle counts of the switch tick, built only when
+    SWITCH_PROFILE is defined (see the cycle_simulation_profile target of
+    the makefile). Otherwise every macro below expands to nothing, and the
+    switch is as if uninstrumented.
+
+    One tick in SWITCH_PROFILE_PERIOD is sampled, so that the cost of
+    reading the time stamp counter and recording into the histograms is
+    spread over many ticks. In a sampled tick the counter is read at the
+    end of every phase - aging VOQs, ingress (lookup, admission and
+    enqueue), the scheduler and egress - and the cycles since the last read
+    recorded in the phase's histogram, as is the whole tick. Schedulers may
+    also record each of their rounds, from the point at which they start
+    them, within the scheduler phase. The histograms are printed to stderr
+    at exit.
+
+    The counter is read without serialising, so phases of a few tens of
+    cycles are blurred by out of order execution. Off x86 nanoseconds of
+    the monotonic clock are recorded instead. Profiling state is global,
+    and only one thread may tick profiled switches. */
+
+#ifndef SWITCH_PROFILE_H
+#define SWITCH_PROFILE_H
+
+#ifdef SWITCH_PROFILE
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#ifndef SWITCH_PROFILE_PERIOD
+#define SWITCH_PROFILE_PERIOD 64
+#endif
+
+/*  Scheduler rounds beyond the last are counted with it. */
+#define SWITCH_PROFILE_ROUNDS 4
+
+typedef enum switch_phase {
+    SWITCH_PHASE_TICK,
+    SWITCH_PHASE_AGE,
+    SWITCH_PHASE_INGRESS,
+    SWITCH_PHASE_ROUND,
+    SWITCH_PHASE_SCHEDULE = SWITCH_PHASE_ROUND + SWITCH_PROFILE_ROUNDS,
+    SWITCH_PHASE_EGRESS,
+    SWITCH_NUM_PHASES
+} switch_phase_t;
+
+/*  Whether the current tick is sampled, and the ticks until the next one
+    which is. */
+extern int switch_profile_sampled;
+extern unsigned int switch_profile_countdown;
+
+uint64_t switch_profile_record(switch_phase_t phase, uint64_t since);
+
+static inline uint64_t switch_profile_now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000UL + now.tv_nsec;
+#endif
+};
+
+/*  Start a tick, deciding whether it is sampled. Returns the counter if
+    so, and 0 otherwise. */
+static inline uint64_t switch_profile_begin() {
+    if (--switch_profile_countdown > 0) {
+        switch_profile_sampled = 0;
+        return 0;
+    };
+
+    switch_profile_countdown = SWITCH_PROFILE_PERIOD;
+    switch_profile_sampled = 1;
+    return switch_profile_now();
+};
+
+/*  BEGIN declares mark, holding the counter at the start of a tick, and
+    RESUME the counter part way through one. MARK records the cycles since
+    mark against phase, and moves mark on to now. ROUND does the same for
+    scheduler round r. */
+#define SWITCH_PROFILE_BEGIN(mark) uint64_t mark = switch_profile_begin()
+#define SWITCH_PROFILE_RESUME(mark) \
+    uint64_t mark = switch_profile_sampled ? switch_profile_now() : 0
+#define SWITCH_PROFILE_MARK(phase, mark) do { \
+    if (switch_profile_sampled) { \
+        mark = switch_profile_record((phase), (mark)); \
+    }; \
+} while (0)
+#define SWITCH_PROFILE_ROUND(r, mark) SWITCH_PROFILE_MARK( \
+    SWITCH_PHASE_ROUND + ((r) < SWITCH_PROFILE_ROUNDS \
+        ? (r) \
+        : SWITCH_PROFILE_ROUNDS - 1), \
+    mark)
+
+#else
+
+#define SWITCH_PROFILE_BEGIN(mark)
+#define SWITCH_PROFILE_RESUME(mark)
+#define SWITCH_PROFILE_MARK(phase, mark) ((void) 0)
+#define SWITCH_PROFILE_ROUND(r, mark) ((void) 0)
+
+#endif
+
+#endif
@@ -0,0 +1,1237 @@
+/*  voq_matrix.c */
+
+#include "voq_matrix.h"
+#include "packet_pool.h"
+#include "./../data_structures/block_pool.h"
+#include <assert.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_LINE_SIZE 64
+#define INITIAL_HEADERS 64
+#define INITIAL_LIST_CAPACITY 4
+#define INITIAL_DIRECTORY_CAPACITY 8
+
+/*  Default cells per block - a 256 byte block holds 15 descriptors and its
+    link, and a 64 byte block 14 arrival slots and its link. */
+#define DEFAULT_PACKETS_CELLS 15
+#define DEFAULT_COUNTS_CELLS 14
+
+/*  Header of a VOQ which is not materialised, and list position of one
+    which is empty. */
+#define NO_HEADER ((unsigned int) -1)
+#define NOT_LISTED ((unsigned int) -1)
+
+/*  Directory entry - the header of the VOQ from an input to output_port, or
+    NO_HEADER in an empty slot. */
+struct directory_entry {
+    port_num_t output_port;
+    unsigned int header;
+};
+
+/*  VOQ matrix structure.
+
+    Each input has a directory, an open addressing hash table with linear
+    probing from output port to the header of its materialised VOQ. A
+    directory is allocated on the first VOQ its input materialises, and
+    doubled whenever it would become more than half full, so it holds at
+    most twice as many entries as the input has ever had VOQs at once. A
+    pair which is not in the directory of its input has an empty VOQ.
+
+    Headers are a structure of arrays, carved out of an aligned block which
+    is reallocated at double the size when every header is in use. Unused
+    headers form a free list linked through list_pos. index is the pair a
+    header belongs to, row-major by input, list_pos its position in the
+    non-empty list of its input, or NOT_LISTED if its VOQ is empty, and
+    idle_since the slot in which it last drained.
+
+    Each input's non-empty list is a structure of arrays too, growing by
+    doubling - the output, size, head of line arrival and header of every
+    non-empty VOQ, so that schedulers walking the list read sizes and
+    arrivals without looking VOQs up.
+
+    The cells of a VOQ are kept in a chain of blocks from block_pool, from
+    head_pos in head_block to tail_pos in tail_block, with every block in
+    between full. A block holds block_cells cell_size byte cells - whole
+    descriptors, or just the arrival slots in VOQ_MODE_COUNTS - accessed
+    through cell_store and cell_load, followed by the link to the next block.
+    A materialised VOQ keeps its last block while empty.
+
+    Drained VOQs are queued, oldest first, in the idle ring of (header, slot)
+    entries. Entries are checked lazily on advance, and skipped if the VOQ
+    has refilled or been released since. */
+struct voq_matrix {
+    port_num_t num_ports;
+    voq_mode_t mode;
+    size_t cell_size;
+    unsigned int block_cells;
+    size_t link_offset;
+    block_pool_t block_pool;
+    unsigned long idle_slots;
+    unsigned long now;
+    unsigned long total_backlog;
+
+    struct directory_entry **directory;
+    unsigned int *directory_capacity;
+    unsigned int *directory_count;
+
+    void *header_block;
+    unsigned int header_capacity;
+    unsigned int num_headers;
+    unsigned int active_headers;
+    unsigned int free_header;
+    unsigned int *head_pos;
+    unsigned int *tail_pos;
+    unsigned int *index;
+    unsigned int *list_pos;
+    unsigned long *idle_since;
+    char **head_block;
+    char **tail_block;
+
+    unsigned int *idle_header;
+    unsigned long *idle_stamp;
+    unsigned int idle_head;
+    unsigned int idle_size;
+    unsigned int idle_mask;
+
+    port_num_t **nonempty;
+    unsigned int **nonempty_size;
+    uint32_t **nonempty_hol;
+    unsigned int **nonempty_header;
+    port_num_t *nonempty_count;
+    port_num_t *nonempty_capacity;
+
+    unsigned int *input_backlog;
+    unsigned int *output_backlog;
+};
+
+/*  Forward declare helper functions. */
+static inline size_t align_up(size_t size);
+static inline char **block_link(voq_matrix_t voq_matrix, char *block);
+static inline void cell_store(
+    voq_matrix_t voq_matrix,
+    char *block,
+    unsigned int pos,
+    packet_desc_t cell
+);
+static inline packet_desc_t cell_load(
+    voq_matrix_t voq_matrix,
+    unsigned int header,
+    char *block,
+    unsigned int pos
+);
+static void cells_store(
+    voq_matrix_t voq_matrix,
+    char *block,
+    unsigned int pos,
+    const packet_desc_t *cells,
+    unsigned int count
+);
+static void cells_load(
+    voq_matrix_t voq_matrix,
+    unsigned int header,
+    char *block,
+    unsigned int pos,
+    packet_desc_t *cells_out,
+    unsigned int count
+);
+static inline unsigned int directory_slot(
+    port_num_t output_port,
+    unsigned int capacity
+);
+static inline unsigned int directory_find(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port
+);
+static void directory_insert(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port,
+    unsigned int header
+);
+static void directory_remove(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port
+);
+static void headers_grow(voq_matrix_t voq_matrix);
+static unsigned int voq_materialise(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port
+);
+static void voq_release(voq_matrix_t voq_matrix, unsigned int header);
+static void voq_append_block(voq_matrix_t voq_matrix, unsigned int header);
+static void nonempty_add(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port,
+    unsigned int header,
+    uint32_t arrival_slot
+);
+static void nonempty_remove(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    unsigned int header
+);
+static void idle_push(voq_matrix_t voq_matrix, unsigned int header);
+
+/*  API implementation. */
+
+/*  Create VOQ matrix - the mode selects whether cells keep their packets,
+    see VOQ_MODE_COUNTS. Queues are built from blocks of block_cells cells,
+    and passing 0 selects the default, which fills a 256 byte block with
+    descriptors or a 64 byte block with arrival slots. A VOQ is released once
+    it has been empty for idle_slots time slots, or never if idle_slots is
+    VOQ_IDLE_NEVER. */
+voq_matrix_t voq_matrix_create(
+    port_num_t num_ports,
+    voq_mode_t mode,
+    unsigned int block_cells,
+    unsigned long idle_slots
+) {
+    voq_matrix_t voq_matrix = (voq_matrix_t) malloc(sizeof(struct voq_matrix));
+    assert(voq_matrix);
+
+    voq_matrix->num_ports = num_ports;
+    voq_matrix->mode = mode;
+
+    if (mode == VOQ_MODE_COUNTS) {
+        voq_matrix->cell_size = sizeof(uint32_t);
+        voq_matrix->block_cells = block_cells ? block_cells : DEFAULT_COUNTS_CELLS;
+    } else {
+        voq_matrix->cell_size = sizeof(packet_desc_t);
+        voq_matrix->block_cells = block_cells ? block_cells : DEFAULT_PACKETS_CELLS;
+    };
+
+    voq_matrix->link_offset =
+        (voq_matrix->cell_size * voq_matrix->block_cells + sizeof(char *) - 1) &
+            ~(sizeof(char *) - 1);
+    voq_matrix->block_pool =
+        block_pool_create(voq_matrix->link_offset + sizeof(char *));
+    voq_matrix->idle_slots = idle_slots;
+    voq_matrix->now = 0;
+    voq_matrix->total_backlog = 0;
+
+    voq_matrix->directory = (struct directory_entry **)
+        calloc(num_ports, sizeof(struct directory_entry *));
+    assert(voq_matrix->directory);
+
+    voq_matrix->directory_capacity =
+        (unsigned int *) calloc(num_ports, sizeof(unsigned int));
+    assert(voq_matrix->directory_capacity);
+
+    voq_matrix->directory_count =
+        (unsigned int *) calloc(num_ports, sizeof(unsigned int));
+    assert(voq_matrix->directory_count);
+
+    voq_matrix->header_block = NULL;
+    voq_matrix->header_capacity = 0;
+    voq_matrix->num_headers = 0;
+    voq_matrix->active_headers = 0;
+    voq_matrix->free_header = NO_HEADER;
+    headers_grow(voq_matrix);
+
+    voq_matrix->idle_header =
+        (unsigned int *) malloc(sizeof(unsigned int) * INITIAL_HEADERS);
+    assert(voq_matrix->idle_header);
+
+    voq_matrix->idle_stamp =
+        (unsigned long *) malloc(sizeof(unsigned long) * INITIAL_HEADERS);
+    assert(voq_matrix->idle_stamp);
+
+    voq_matrix->idle_head = 0;
+    voq_matrix->idle_size = 0;
+    voq_matrix->idle_mask = INITIAL_HEADERS - 1;
+
+    voq_matrix->nonempty =
+        (port_num_t **) calloc(num_ports, sizeof(port_num_t *));
+    assert(voq_matrix->nonempty);
+
+    voq_matrix->nonempty_size =
+        (unsigned int **) calloc(num_ports, sizeof(unsigned int *));
+    assert(voq_matrix->nonempty_size);
+
+    voq_matrix->nonempty_hol =
+        (uint32_t **) calloc(num_ports, sizeof(uint32_t *));
+    assert(voq_matrix->nonempty_hol);
+
+    voq_matrix->nonempty_header =
+        (unsigned int **) calloc(num_ports, sizeof(unsigned int *));
+    assert(voq_matrix->nonempty_header);
+
+    voq_matrix->nonempty_count =
+        (port_num_t *) calloc(num_ports, sizeof(port_num_t));
+    assert(voq_matrix->nonempty_count);
+
+    voq_matrix->nonempty_capacity =
+        (port_num_t *) calloc(num_ports, sizeof(port_num_t));
+    assert(voq_matrix->nonempty_capacity);
+
+    voq_matrix->input_backlog =
+        (unsigned int *) calloc(num_ports, sizeof(unsigned int));
+    assert(voq_matrix->input_backlog);
+
+    voq_matrix->output_backlog =
+        (unsigned int *) calloc(num_ports, sizeof(unsigned int));
+    assert(voq_matrix->output_backlog);
+
+    return voq_matrix;
+};
+
+/*  Free VOQ matrix - free_packet is called on the payload of every cell
+    still buffered, and may be NULL if cells do not own their payloads. It is
+    not called in VOQ_MODE_COUNTS. */
+void voq_matrix_free(voq_matrix_t voq_matrix, free_func_t free_packet) {
+    assert(voq_matrix);
+
+    /*  The blocks themselves all go with the block pool. */
+    unsigned int header;
+    for (header = 0; header < voq_matrix->num_headers; header++) {
+        char *block = voq_matrix->head_block[header];
+
+        if (
+            block &&
+            free_packet &&
+            voq_matrix->mode == VOQ_MODE_PACKETS &&
+            voq_matrix->list_pos[header] != NOT_LISTED
+        ) {
+            unsigned int size = voq_matrix->nonempty_size[
+                voq_matrix->index[header] / voq_matrix->num_ports
+            ][voq_matrix->list_pos[header]];
+            unsigned int pos = voq_matrix->head_pos[header];
+
+            unsigned int k;
+            for (k = 0; k < size; k++) {
+                if (pos == voq_matrix->block_cells) {
+                    block = *block_link(voq_matrix, block);
+                    pos = 0;
+                };
+
+                packet_ref_t payload = ((packet_desc_t *) block)[pos++].payload;
+
+                if (payload != PACKET_REF_NONE) {
+                    free_packet(packet_deref(payload));
+                };
+            };
+        };
+    };
+
+    port_num_t i;
+    for (i = 0; i < voq_matrix->num_ports; i++) {
+        free(voq_matrix->directory[i]);
+        free(voq_matrix->nonempty[i]);
+        free(voq_matrix->nonempty_size[i]);
+        free(voq_matrix->nonempty_hol[i]);
+        free(voq_matrix->nonempty_header[i]);
+    };
+
+    block_pool_free(voq_matrix->block_pool);
+    free(voq_matrix->directory);
+    free(voq_matrix->directory_capacity);
+    free(voq_matrix->directory_count);
+    free(voq_matrix->header_block);
+    free(voq_matrix->idle_header);
+    free(voq_matrix->idle_stamp);
+    free(voq_matrix->nonempty);
+    free(voq_matrix->nonempty_size);
+    free(voq_matrix->nonempty_hol);
+    free(voq_matrix->nonempty_header);
+    free(voq_matrix->nonempty_count);
+    free(voq_matrix->nonempty_capacity);
+    free(voq_matrix->input_backlog);
+    free(voq_matrix->output_backlog);
+    free(voq_matrix);
+};
+
+/*  Enqueue - add a cell at the tail of a VOQ, materialising the VOQ if it
+    has no header and chaining on a new block if its tail block is full.
+    Cells are never moved once stored. A cell arriving
+    at an empty VOQ becomes its head of line, and the VOQ joins the non-empty
+    list of its input. */
+void voq_matrix_enqueue(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port,
+    packet_desc_t cell
+) {
+    assert(voq_matrix);
+    assert(input_port < voq_matrix->num_ports);
+    assert(output_port < voq_matrix->num_ports);
+
+    unsigned int header = directory_find(voq_matrix, input_port, output_port);
+
+    if (header == NO_HEADER) {
+        header = voq_materialise(voq_matrix, input_port, output_port);
+    } else if (voq_matrix->tail_pos[header] == voq_matrix->block_cells) {
+        voq_append_block(voq_matrix, header);
+    };
+
+    cell_store(
+        voq_matrix,
+        voq_matrix->tail_block[header],
+        voq_matrix->tail_pos[header]++,
+        cell
+    );
+
+    unsigned int pos = voq_matrix->list_pos[header];
+
+    if (pos == NOT_LISTED) {
+        nonempty_add(
+            voq_matrix,
+            input_port,
+            output_port,
+            header,
+            cell.arrival_slot
+        );
+    } else {
+        voq_matrix->nonempty_size[input_port][pos]++;
+    };
+
+    voq_matrix->input_backlog[input_port]++;
+    voq_matrix->output_backlog[output_port]++;
+    voq_matrix->total_backlog++;
+};
+
+/*  Dequeue - remove the head of line cell of a VOQ into cell_out. Returns 1
+    on success and 0 if the VOQ is empty. A head block which has been read to
+    the end goes back to the block pool. A VOQ which drains rewinds to the
+    start of its last block, leaves the non-empty list of its input and
+    starts its idle period. */
+int voq_matrix_dequeue(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port,
+    packet_desc_t *cell_out
+) {
+    assert(voq_matrix);
+    assert(cell_out);
+
+    unsigned int header = directory_find(voq_matrix, input_port, output_port);
+
+    if (header == NO_HEADER || voq_matrix->list_pos[header] == NOT_LISTED) {
+        return 0;
+    };
+
+    unsigned int pos = voq_matrix->list_pos[header];
+    unsigned int size = voq_matrix->nonempty_size[input_port][pos];
+    char *block = voq_matrix->head_block[header];
+    unsigned int head = voq_matrix->head_pos[header];
+    *cell_out = cell_load(voq_matrix, header, block, head++);
+
+    if (size > 1) {
+        if (head == voq_matrix->block_cells) {
+            char *next = *block_link(voq_matrix, block);
+            block_pool_dealloc(voq_matrix->block_pool, block);
+
+            voq_matrix->head_block[header] = next;
+            block = next;
+            head = 0;
+        };
+
+        voq_matrix->head_pos[header] = head;
+        voq_matrix->nonempty_size[input_port][pos] = size - 1;
+        voq_matrix->nonempty_hol[input_port][pos] =
+            cell_load(voq_matrix, header, block, head).arrival_slot;
+    } else {
+        voq_matrix->head_pos[header] = 0;
+        voq_matrix->tail_pos[header] = 0;
+
+        nonempty_remove(voq_matrix, input_port, header);
+        idle_push(voq_matrix, header);
+    };
+
+    voq_matrix->input_backlog[input_port]--;
+    voq_matrix->output_backlog[output_port]--;
+    voq_matrix->total_backlog--;
+
+    return 1;
+};
+
+/*  Bulk enqueue - add count cells at the tail of a VOQ, in order, as count
+    calls to voq_matrix_enqueue would, but looking the VOQ up once and
+    copying a run of cells into each block. */
+void voq_matrix_enqueue_bulk(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port,
+    const packet_desc_t *cells,
+    unsigned int count
+) {
+    assert(voq_matrix);
+    assert(input_port < voq_matrix->num_ports);
+    assert(output_port < voq_matrix->num_ports);
+    assert(cells || count == 0);
+
+    if (count == 0) {
+        return;
+    };
+
+    unsigned int header = directory_find(voq_matrix, input_port, output_port);
+
+    if (header == NO_HEADER) {
+        header = voq_materialise(voq_matrix, input_port, output_port);
+    };
+
+    unsigned int done = 0;
+    while (done < count) {
+        if (voq_matrix->tail_pos[header] == voq_matrix->block_cells) {
+            voq_append_block(voq_matrix, header);
+        };
+
+        unsigned int run =
+            voq_matrix->block_cells - voq_matrix->tail_pos[header];
+        if (run > count - done) {
+            run = count - done;
+        };
+
+        cells_store(
+            voq_matrix,
+            voq_matrix->tail_block[header],
+            voq_matrix->tail_pos[header],
+            cells + done,
+            run
+        );
+        voq_matrix->tail_pos[header] += run;
+        done += run;
+    };
+
+    unsigned int pos = voq_matrix->list_pos[header];
+
+    if (pos == NOT_LISTED) {
+        nonempty_add(
+            voq_matrix,
+            input_port,
+            output_port,
+            header,
+            cells[0].arrival_slot
+        );
+        voq_matrix->nonempty_size[input_port][voq_matrix->list_pos[header]] =
+            count;
+    } else {
+        voq_matrix->nonempty_size[input_port][pos] += count;
+    };
+
+    voq_matrix->input_backlog[input_port] += count;
+    voq_matrix->output_backlog[output_port] += count;
+    voq_matrix->total_backlog += count;
+};
+
+/*  Bulk dequeue - remove up to max_count cells from the head of a VOQ into
+    cells_out, in order, as repeated calls to voq_matrix_dequeue would, but
+    copying a run of cells out of each block. Returns the number of cells
+    removed, 0 if the VOQ is empty. */
+unsigned int voq_matrix_dequeue_bulk(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port,
+    packet_desc_t *cells_out,
+    unsigned int max_count
+) {
+    assert(voq_matrix);
+    assert(cells_out || max_count == 0);
+
+    unsigned int header = directory_find(voq_matrix, input_port, output_port);
+
+    if (
+        max_count == 0 ||
+        header == NO_HEADER ||
+        voq_matrix->list_pos[header] == NOT_LISTED
+    ) {
+        return 0;
+    };
+
+    unsigned int pos = voq_matrix->list_pos[header];
+    unsigned int size = voq_matrix->nonempty_size[input_port][pos];
+    unsigned int count = size < max_count ? size : max_count;
+    char *block = voq_matrix->head_block[header];
+    unsigned int head = voq_matrix->head_pos[header];
+
+    /*  Every block but the tail block is full, so a block read to its end
+        is followed by another whenever cells remain, and goes back to the
+        pool. */
+    unsigned int done = 0;
+    while (done < count) {
+        unsigned int run = voq_matrix->block_cells - head;
+        if (run > count - done) {
+            run = count - done;
+        };
+
+        cells_load(voq_matrix, header, block, head, cells_out + done, run);
+        head += run;
+        done += run;
+
+        if (head == voq_matrix->block_cells && done < size) {
+            char *next = *block_link(voq_matrix, block);
+            block_pool_dealloc(voq_matrix->block_pool, block);
+
+            block = next;
+            head = 0;
+        };
+    };
+
+    voq_matrix->head_block[header] = block;
+
+    if (count < size) {
+        voq_matrix->head_pos[header] = head;
+        voq_matrix->nonempty_size[input_port][pos] = size - count;
+        voq_matrix->nonempty_hol[input_port][pos] =
+            cell_load(voq_matrix, header, block, head).arrival_slot;
+    } else {
+        voq_matrix->head_pos[header] = 0;
+        voq_matrix->tail_pos[header] = 0;
+
+        nonempty_remove(voq_matrix, input_port, header);
+        idle_push(voq_matrix, header);
+    };
+
+    voq_matrix->input_backlog[input_port] -= count;
+    voq_matrix->output_backlog[output_port] -= count;
+    voq_matrix->total_backlog -= count;
+
+    return count;
+};
+
+/*  Peek - copy the head of line cell of a VOQ into cell_out without removing
+    it. Returns 1 on success and 0 if the VOQ is empty. */
+int voq_matrix_peek(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port,
+    packet_desc_t *cell_out
+) {
+    assert(voq_matrix);
+    assert(cell_out);
+
+    unsigned int header = directory_find(voq_matrix, input_port, output_port);
+
+    if (header == NO_HEADER || voq_matrix->list_pos[header] == NOT_LISTED) {
+        return 0;
+    };
+
+    *cell_out = cell_load(
+        voq_matrix,
+        header,
+        voq_matrix->head_block[header],
+        voq_matrix->head_pos[header]
+    );
+
+    return 1;
+};
+
+/*  Size of a single VOQ. */
+unsigned int voq_matrix_size(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port
+) {
+    assert(voq_matrix);
+
+    unsigned int header = directory_find(voq_matrix, input_port, output_port);
+
+    if (header == NO_HEADER || voq_matrix->list_pos[header] == NOT_LISTED) {
+        return 0;
+    };
+
+    return voq_matrix->nonempty_size[input_port][voq_matrix->list_pos[header]];
+};
+
+/*  Head of line arrival - the arrival slot of the cell at the head of a VOQ,
+    which must be non-empty. */
+uint32_t voq_matrix_hol_arrival(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port
+) {
+    assert(voq_matrix);
+
+    unsigned int header = directory_find(voq_matrix, input_port, output_port);
+    assert(header != NO_HEADER && voq_matrix->list_pos[header] != NOT_LISTED);
+
+    return voq_matrix->nonempty_hol[input_port][voq_matrix->list_pos[header]];
+};
+
+/*  Advance - set the current time slot and release every VOQ which has now
+    been empty for the idle period. Since all VOQs share one idle period, the
+    idle ring is in expiry order and only expired entries are visited. */
+void voq_matrix_advance(voq_matrix_t voq_matrix, unsigned long slot) {
+    assert(voq_matrix);
+
+    voq_matrix->now = slot;
+
+    while (voq_matrix->idle_size > 0) {
+        unsigned int pos = voq_matrix->idle_head;
+        unsigned int header = voq_matrix->idle_header[pos];
+        unsigned long stamp = voq_matrix->idle_stamp[pos];
+
+        if (slot - stamp < voq_matrix->idle_slots) {
+            break;
+        };
+
+        voq_matrix->idle_head = (pos + 1) & voq_matrix->idle_mask;
+        voq_matrix->idle_size--;
+
+        if (
+            voq_matrix->head_block[header] != NULL &&
+            voq_matrix->idle_since[header] == stamp &&
+            voq_matrix->list_pos[header] == NOT_LISTED
+        ) {
+            voq_release(voq_matrix, header);
+        };
+    };
+};
+
+/*  Non-empty outputs - the outputs to which an input has buffered cells, in
+    no particular order. The list is only valid until the next enqueue or
+    dequeue at that input. */
+const port_num_t *voq_matrix_nonempty_outputs(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t *count_out
+) {
+    assert(voq_matrix);
+    assert(count_out);
+
+    *count_out = voq_matrix->nonempty_count[input_port];
+    return voq_matrix->nonempty[input_port];
+};
+
+/*  Sizes and head of line arrival slots of the non-empty VOQs of an input,
+    in the order of voq_matrix_nonempty_outputs, and valid for as long. */
+const unsigned int *voq_matrix_nonempty_sizes(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port
+) {
+    assert(voq_matrix);
+    return voq_matrix->nonempty_size[input_port];
+};
+
+const uint32_t *voq_matrix_nonempty_hol_arrivals(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port
+) {
+    assert(voq_matrix);
+    return voq_matrix->nonempty_hol[input_port];
+};
+
+/*  Backlogs - these return internal arrays, which remain valid for the
+    lifetime of the matrix and reflect every later enqueue and dequeue. */
+const unsigned int *voq_matrix_input_backlog(voq_matrix_t voq_matrix) {
+    assert(voq_matrix);
+    return voq_matrix->input_backlog;
+};
+
+const unsigned int *voq_matrix_output_backlog(voq_matrix_t voq_matrix) {
+    assert(voq_matrix);
+    return voq_matrix->output_backlog;
+};
+
+unsigned long voq_matrix_total_backlog(voq_matrix_t voq_matrix) {
+    assert(voq_matrix);
+    return voq_matrix->total_backlog;
+};
+
+/*  Number of materialised VOQs, empty or not. */
+unsigned int voq_matrix_active_voqs(voq_matrix_t voq_matrix) {
+    assert(voq_matrix);
+    return voq_matrix->active_headers;
+};
+
+/*  Helper function implementations. */
+
+/*  Round a size up to a whole number of cache lines. */
+static inline size_t align_up(size_t size) {
+    return (size + CACHE_LINE_SIZE - 1) & ~((size_t) CACHE_LINE_SIZE - 1);
+};
+
+/*  Link to the block after a block. */
+static inline char **block_link(voq_matrix_t voq_matrix, char *block) {
+    return (char **) (block + voq_matrix->link_offset);
+};
+
+/*  Store a cell at a position in a block. */
+static inline void cell_store(
+    voq_matrix_t voq_matrix,
+    char *block,
+    unsigned int pos,
+    packet_desc_t cell
+) {
+    void *buffer = block;
+
+    if (voq_matrix->mode == VOQ_MODE_COUNTS) {
+        ((uint32_t *) buffer)[pos] = cell.arrival_slot;
+    } else {
+        ((packet_desc_t *) buffer)[pos] = cell;
+    };
+};
+
+/*  Load the cell at a position in a block of a VOQ, rebuilding it from the
+    VOQ in VOQ_MODE_COUNTS. */
+static inline packet_desc_t cell_load(
+    voq_matrix_t voq_matrix,
+    unsigned int header,
+    char *block,
+    unsigned int pos
+) {
+    void *buffer = block;
+
+    if (voq_matrix->mode == VOQ_MODE_COUNTS) {
+        unsigned int index = voq_matrix->index[header];
+
+        packet_desc_t cell;
+        cell.arrival_slot = ((uint32_t *) buffer)[pos];
+        cell.flow_id = index;
+        cell.payload = PACKET_REF_NONE;
+        cell.src_port = index / voq_matrix->num_ports;
+        cell.dst_port = index % voq_matrix->num_ports;
+        cell.length = PACKET_SIZE;
+
+        return cell;
+    };
+
+    return ((packet_desc_t *) buffer)[pos];
+};
+
+/*  Store a run of cells at consecutive positions in a block. */
+static void cells_store(
+    voq_matrix_t voq_matrix,
+    char *block,
+    unsigned int pos,
+    const packet_desc_t *cells,
+    unsigned int count
+) {
+    void *buffer = block;
+
+    if (voq_matrix->mode == VOQ_MODE_COUNTS) {
+        uint32_t *slots = (uint32_t *) buffer + pos;
+
+        unsigned int k;
+        for (k = 0; k < count; k++) {
+            slots[k] = cells[k].arrival_slot;
+        };
+    } else {
+        memcpy(
+            (packet_desc_t *) buffer + pos,
+            cells,
+            sizeof(packet_desc_t) * count
+        );
+    };
+};
+
+/*  Load a run of cells from consecutive positions in a block of a VOQ. */
+static void cells_load(
+    voq_matrix_t voq_matrix,
+    unsigned int header,
+    char *block,
+    unsigned int pos,
+    packet_desc_t *cells_out,
+    unsigned int count
+) {
+    void *buffer = block;
+
+    if (voq_matrix->mode == VOQ_MODE_COUNTS) {
+        unsigned int k;
+        for (k = 0; k < count; k++) {
+            cells_out[k] = cell_load(voq_matrix, header, block, pos + k);
+        };
+    } else {
+        memcpy(
+            cells_out,
+            (packet_desc_t *) buffer + pos,
+            sizeof(packet_desc_t) * count
+        );
+    };
+};
+
+/*  Home slot of an output port in a directory of a given capacity, a power
+    of two. Outputs are multiplied by 2^32 / phi and the high half folded
+    into the low, so that outputs a power of two apart do not collide. */
+static inline unsigned int directory_slot(
+    port_num_t output_port,
+    unsigned int capacity
+) {
+    uint32_t hash = (uint32_t) output_port * 2654435769u;
+
+    return (hash ^ (hash >> 16)) & (capacity - 1);
+};
+
+/*  Find the header of the VOQ from an input to an output, or NO_HEADER if
+    it is not materialised. */
+static inline unsigned int directory_find(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port
+) {
+    unsigned int capacity = voq_matrix->directory_capacity[input_port];
+
+    if (capacity == 0) {
+        return NO_HEADER;
+    };
+
+    struct directory_entry *entries = voq_matrix->directory[input_port];
+    unsigned int slot = directory_slot(output_port, capacity);
+
+    while (entries[slot].header != NO_HEADER) {
+        if (entries[slot].output_port == output_port) {
+            return entries[slot].header;
+        };
+
+        slot = (slot + 1) & (capacity - 1);
+    };
+
+    return NO_HEADER;
+};
+
+/*  Enter the header of the VOQ from an input to an output, which must not
+    be in the directory, doubling the directory first if it would become
+    more than half full. */
+static void directory_insert(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port,
+    unsigned int header
+) {
+    unsigned int capacity = voq_matrix->directory_capacity[input_port];
+    unsigned int count = voq_matrix->directory_count[input_port];
+
+    if (2 * (count + 1) > capacity) {
+        struct directory_entry *old_entries = voq_matrix->directory[input_port];
+        unsigned int old_capacity = capacity;
+        capacity = capacity ? capacity * 2 : INITIAL_DIRECTORY_CAPACITY;
+
+        struct directory_entry *entries = (struct directory_entry *)
+            malloc(sizeof(struct directory_entry) * capacity);
+        assert(entries);
+
+        unsigned int slot;
+        for (slot = 0; slot < capacity; slot++) {
+            entries[slot].header = NO_HEADER;
+        };
+
+        voq_matrix->directory[input_port] = entries;
+        voq_matrix->directory_capacity[input_port] = capacity;
+        voq_matrix->directory_count[input_port] = 0;
+
+        for (slot = 0; slot < old_capacity; slot++) {
+            if (old_entries[slot].header != NO_HEADER) {
+                directory_insert(
+                    voq_matrix,
+                    input_port,
+                    old_entries[slot].output_port,
+                    old_entries[slot].header
+                );
+            };
+        };
+
+        free(old_entries);
+    };
+
+    struct directory_entry *entries = voq_matrix->directory[input_port];
+    unsigned int slot = directory_slot(output_port, capacity);
+
+    while (entries[slot].header != NO_HEADER) {
+        slot = (slot + 1) & (capacity - 1);
+    };
+
+    entries[slot].output_port = output_port;
+    entries[slot].header = header;
+    voq_matrix->directory_count[input_port]++;
+};
+
+/*  Remove the VOQ from an input to an output, which must be in the
+    directory. Rather than leaving a tombstone, later entries of the probe
+    run are shifted back into the hole when their home slot allows, so that
+    lookups never probe further than entries which are present. */
+static void directory_remove(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port
+) {
+    struct directory_entry *entries = voq_matrix->directory[input_port];
+    unsigned int mask = voq_matrix->directory_capacity[input_port] - 1;
+    unsigned int hole = directory_slot(output_port, mask + 1);
+
+    while (entries[hole].output_port != output_port) {
+        assert(entries[hole].header != NO_HEADER);
+        hole = (hole + 1) & mask;
+    };
+
+    unsigned int slot = (hole + 1) & mask;
+
+    while (entries[slot].header != NO_HEADER) {
+        unsigned int home = directory_slot(entries[slot].output_port, mask + 1);
+
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            entries[hole] = entries[slot];
+            hole = slot;
+        };
+
+        slot = (slot + 1) & mask;
+    };
+
+    entries[hole].header = NO_HEADER;
+    voq_matrix->directory_count[input_port]--;
+};
+
+/*  Grow headers - move the header arrays to a new block of double the
+    capacity, and put the new headers on the free list. */
+static void headers_grow(voq_matrix_t voq_matrix) {
+    unsigned int old_capacity = voq_matrix->header_capacity;
+    unsigned int capacity = old_capacity ? old_capacity * 2 : INITIAL_HEADERS;
+
+    size_t u_int_size = align_up(sizeof(unsigned int) * capacity);
+    size_t u_long_size = align_up(sizeof(unsigned long) * capacity);
+    size_t blocks_size = align_up(sizeof(char *) * capacity);
+    size_t block_size = 4 * u_int_size + u_long_size + 2 * blocks_size;
+
+    void *block = aligned_alloc(CACHE_LINE_SIZE, block_size);
+    assert(block);
+
+    char *next = (char *) block;
+    unsigned int *head_pos = (unsigned int *) next;
+    next += u_int_size;
+    unsigned int *tail_pos = (unsigned int *) next;
+    next += u_int_size;
+    unsigned int *index = (unsigned int *) next;
+    next += u_int_size;
+    unsigned int *list_pos = (unsigned int *) next;
+    next += u_int_size;
+    unsigned long *idle_since = (unsigned long *) next;
+    next += u_long_size;
+    char **head_block = (char **) next;
+    next += blocks_size;
+    char **tail_block = (char **) next;
+
+    if (old_capacity) {
+        memcpy(
+            head_pos,
+            voq_matrix->head_pos,
+            sizeof(unsigned int) * old_capacity
+        );
+        memcpy(
+            tail_pos,
+            voq_matrix->tail_pos,
+            sizeof(unsigned int) * old_capacity
+        );
+        memcpy(index, voq_matrix->index, sizeof(unsigned int) * old_capacity);
+        memcpy(
+            list_pos,
+            voq_matrix->list_pos,
+            sizeof(unsigned int) * old_capacity
+        );
+        memcpy(
+            idle_since,
+            voq_matrix->idle_since,
+            sizeof(unsigned long) * old_capacity
+        );
+        memcpy(
+            head_block,
+            voq_matrix->head_block,
+            sizeof(char *) * old_capacity
+        );
+        memcpy(
+            tail_block,
+            voq_matrix->tail_block,
+            sizeof(char *) * old_capacity
+        );
+
+        free(voq_matrix->header_block);
+    };
+
+    voq_matrix->header_block = block;
+    voq_matrix->header_capacity = capacity;
+    voq_matrix->head_pos = head_pos;
+    voq_matrix->tail_pos = tail_pos;
+    voq_matrix->index = index;
+    voq_matrix->list_pos = list_pos;
+    voq_matrix->idle_since = idle_since;
+    voq_matrix->head_block = head_block;
+    voq_matrix->tail_block = tail_block;
+};
+
+/*  Materialise VOQ - take a header from the free list, or the next never
+    used one, give it a block from the pool and enter it in the directory of
+    its input. */
+static unsigned int voq_materialise(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port
+) {
+    unsigned int header = voq_matrix->free_header;
+
+    if (header != NO_HEADER) {
+        voq_matrix->free_header = voq_matrix->list_pos[header];
+    } else {
+        if (voq_matrix->num_headers == voq_matrix->header_capacity) {
+            headers_grow(voq_matrix);
+        };
+
+        header = voq_matrix->num_headers++;
+    };
+
+    char *block = (char *) block_pool_alloc(voq_matrix->block_pool);
+    *block_link(voq_matrix, block) = NULL;
+
+    voq_matrix->head_block[header] = block;
+    voq_matrix->tail_block[header] = block;
+    voq_matrix->head_pos[header] = 0;
+    voq_matrix->tail_pos[header] = 0;
+    voq_matrix->index[header] =
+        input_port * voq_matrix->num_ports + output_port;
+    voq_matrix->list_pos[header] = NOT_LISTED;
+    voq_matrix->active_headers++;
+
+    directory_insert(voq_matrix, input_port, output_port, header);
+
+    return header;
+};
+
+/*  Release VOQ - return the last block of an empty VOQ to the pool, and its
+    header to the free list. */
+static void voq_release(voq_matrix_t voq_matrix, unsigned int header) {
+    unsigned int index = voq_matrix->index[header];
+
+    block_pool_dealloc(voq_matrix->block_pool, voq_matrix->head_block[header]);
+    directory_remove(
+        voq_matrix,
+        index / voq_matrix->num_ports,
+        index % voq_matrix->num_ports
+    );
+
+    voq_matrix->head_block[header] = NULL;
+    voq_matrix->tail_block[header] = NULL;
+    voq_matrix->list_pos[header] = voq_matrix->free_header;
+    voq_matrix->free_header = header;
+    voq_matrix->active_headers--;
+};
+
+/*  Append block - chain a block from the pool onto a VOQ whose tail block is
+    full. */
+static void voq_append_block(voq_matrix_t voq_matrix, unsigned int header) {
+    char *block = (char *) block_pool_alloc(voq_matrix->block_pool);
+    *block_link(voq_matrix, block) = NULL;
+
+    *block_link(voq_matrix, voq_matrix->tail_block[header]) = block;
+    voq_matrix->tail_block[header] = block;
+    voq_matrix->tail_pos[header] = 0;
+};
+
+/*  Add a VOQ, holding the one cell which arrived in arrival_slot, to the
+    non-empty list of its input, growing the list if it is full. */
+static void nonempty_add(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port,
+    unsigned int header,
+    uint32_t arrival_slot
+) {
+    port_num_t count = voq_matrix->nonempty_count[input_port];
+
+    if (count == voq_matrix->nonempty_capacity[input_port]) {
+        port_num_t capacity = count ? count * 2 : INITIAL_LIST_CAPACITY;
+
+        voq_matrix->nonempty[input_port] = (port_num_t *) realloc(
+            voq_matrix->nonempty[input_port],
+            sizeof(port_num_t) * capacity
+        );
+        assert(voq_matrix->nonempty[input_port]);
+
+        voq_matrix->nonempty_size[input_port] = (unsigned int *) realloc(
+            voq_matrix->nonempty_size[input_port],
+            sizeof(unsigned int) * capacity
+        );
+        assert(voq_matrix->nonempty_size[input_port]);
+
+        voq_matrix->nonempty_hol[input_port] = (uint32_t *) realloc(
+            voq_matrix->nonempty_hol[input_port],
+            sizeof(uint32_t) * capacity
+        );
+        assert(voq_matrix->nonempty_hol[input_port]);
+
+        voq_matrix->nonempty_header[input_port] = (unsigned int *) realloc(
+            voq_matrix->nonempty_header[input_port],
+            sizeof(unsigned int) * capacity
+        );
+        assert(voq_matrix->nonempty_header[input_port]);
+
+        voq_matrix->nonempty_capacity[input_port] = capacity;
+    };
+
+    voq_matrix->nonempty[input_port][count] = output_port;
+    voq_matrix->nonempty_size[input_port][count] = 1;
+    voq_matrix->nonempty_hol[input_port][count] = arrival_slot;
+    voq_matrix->nonempty_header[input_port][count] = header;
+    voq_matrix->nonempty_count[input_port] = count + 1;
+    voq_matrix->list_pos[header] = count;
+};
+
+/*  Remove a VOQ from the non-empty list of its input, moving the last entry
+    of the list into its place. */
+static void nonempty_remove(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    unsigned int header
+) {
+    port_num_t last = --voq_matrix->nonempty_count[input_port];
+    unsigned int pos = voq_matrix->list_pos[header];
+
+    if (pos != last) {
+        unsigned int moved = voq_matrix->nonempty_header[input_port][last];
+
+        voq_matrix->nonempty[input_port][pos] =
+            voq_matrix->nonempty[input_port][last];
+        voq_matrix->nonempty_size[input_port][pos] =
+            voq_matrix->nonempty_size[input_port][last];
+        voq_matrix->nonempty_hol[input_port][pos] =
+            voq_matrix->nonempty_hol[input_port][last];
+        voq_matrix->nonempty_header[input_port][pos] = moved;
+        voq_matrix->list_pos[moved] = pos;
+    };
+
+    voq_matrix->list_pos[header] = NOT_LISTED;
+};
+
+/*  Start the idle period of a drained VOQ, growing the idle ring if it is
+    full. Nothing is queued if VOQs are never released. */
+static void idle_push(voq_matrix_t voq_matrix, unsigned int header) {
+    voq_matrix->idle_since[header] = voq_matrix->now;
+
+    if (voq_matrix->idle_slots == VOQ_IDLE_NEVER) {
+        return;
+    };
+
+    unsigned int capacity = voq_matrix->idle_mask + 1;
+
+    if (voq_matrix->idle_size == capacity) {
+        unsigned int *new_header =
+            (unsigned int *) malloc(sizeof(unsigned int) * capacity * 2);
+        assert(new_header);
+
+        unsigned long *new_stamp =
+            (unsigned long *) malloc(sizeof(unsigned long) * capacity * 2);
+        assert(new_stamp);
+
+        unsigned int k;
+        for (k = 0; k < capacity; k++) {
+            unsigned int pos = (voq_matrix->idle_head + k) & voq_matrix->idle_mask;
+            new_header[k] = voq_matrix->idle_header[pos];
+            new_stamp[k] = voq_matrix->idle_stamp[pos];
+        };
+
+        free(voq_matrix->idle_header);
+        free(voq_matrix->idle_stamp);
+
+        voq_matrix->idle_header = new_header;
+        voq_matrix->idle_stamp = new_stamp;
+        voq_matrix->idle_head = 0;
+        voq_matrix->idle_mask = capacity * 2 - 1;
+    };
+
+    unsigned int tail =
+        (voq_matrix->idle_head + voq_matrix->idle_size) & voq_matrix->idle_mask;
+    voq_matrix->idle_header[tail] = header;
+    voq_matrix->idle_stamp[tail] = voq_matrix->now;
+    voq_matrix->idle_size++;
+};
@@ -0,0 +1,123 @@
+/*  voq_matrix.h
+
+    The full set of N^2 virtual output queues of an input buffered switch,
+    stored together. Each queue is a chain of fixed size blocks of cells,
+    taken from a block pool shared by the whole matrix, so enqueue and
+    dequeue are O(1) in the worst case - a growing queue never copies its
+    cells - and blocks go back to the pool as a queue drains past them.
+    Cells can also be enqueued and dequeued in bulk, a run of cells copied
+    into or out of each block in turn.
+
+    Queues are sparse - a VOQ is only materialised (given a header and a
+    block) on its first enqueue, and once it has been empty for a
+    configurable number of time slots it is released, with its block returned
+    to the pool for reuse by the next VOQ to be materialised. Each input
+    finds its materialised VOQs through a hash table from output port, and a
+    VOQ's size is kept in its header, so nothing is allocated per
+    input/output pair, and memory scales with the number of active flows
+    rather than with N^2. Headers of materialised VOQs are kept as a
+    structure of arrays in one cache aligned block.
+
+    Per-input lists of non-empty VOQs, with their sizes and head of line
+    arrival slots, and per-port backlogs are maintained on every enqueue and
+    dequeue, and can be read in bulk, e.g. by a crossbar scheduler, without
+    touching the queues.
+
+    Cells are packet descriptors, stored by value. In VOQ_MODE_COUNTS only
+    the arrival slot of each cell is stored, so a VOQ is a counter plus a
+    FIFO of 4 byte timestamps. This is for studies which never read packets.
+    Dequeued and peeked descriptors are then rebuilt from the VOQ, with the
+    VOQ's ports, flow id input_port * num_ports + output_port, length
+    PACKET_SIZE and no payload. */
+
+#ifndef VOQ_MATRIX_H
+#define VOQ_MATRIX_H
+
+#include "network_switch_common.h"
+
+/*  VOQ mode - whether cells keep their packet. */
+enum voq_mode {
+    VOQ_MODE_PACKETS,
+    VOQ_MODE_COUNTS
+};
+
+typedef enum voq_mode voq_mode_t;
+
+/*  Idle period which disables releasing drained VOQs. */
+#define VOQ_IDLE_NEVER ((unsigned long) -1)
+
+struct voq_matrix;
+typedef struct voq_matrix *voq_matrix_t;
+
+/*  API functions. */
+voq_matrix_t voq_matrix_create(
+    port_num_t num_ports,
+    voq_mode_t mode,
+    unsigned int block_cells,
+    unsigned long idle_slots
+);
+void voq_matrix_free(voq_matrix_t voq_matrix, free_func_t free_packet);
+void voq_matrix_enqueue(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port,
+    packet_desc_t cell
+);
+int voq_matrix_dequeue(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port,
+    packet_desc_t *cell_out
+);
+void voq_matrix_enqueue_bulk(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port,
+    const packet_desc_t *cells,
+    unsigned int count
+);
+unsigned int voq_matrix_dequeue_bulk(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port,
+    packet_desc_t *cells_out,
+    unsigned int max_count
+);
+int voq_matrix_peek(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port,
+    packet_desc_t *cell_out
+);
+unsigned int voq_matrix_size(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port
+);
+uint32_t voq_matrix_hol_arrival(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port
+);
+void voq_matrix_advance(voq_matrix_t voq_matrix, unsigned long slot);
+
+/*  Bulk occupancy queries. */
+const port_num_t *voq_matrix_nonempty_outputs(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t *count_out
+);
+const unsigned int *voq_matrix_nonempty_sizes(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port
+);
+const uint32_t *voq_matrix_nonempty_hol_arrivals(
+    voq_matrix_t voq_matrix,
+    port_num_t input_port
+);
+const unsigned int *voq_matrix_input_backlog(voq_matrix_t voq_matrix);
+const unsigned int *voq_matrix_output_backlog(voq_matrix_t voq_matrix);
+unsigned long voq_matrix_total_backlog(voq_matrix_t voq_matrix);
+unsigned int voq_matrix_active_voqs(voq_matrix_t voq_matrix);
+
+#endif
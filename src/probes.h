@@ -0,0 +1,103 @@
+/*  probes.h
+
+    Static tracepoints (USDT) of provider switch_sim, to which perf, bpftrace
+    or SystemTap can attach in any run, e.g.
+
+        bpftrace -e 'usdt:./cycle_simulation:switch_sim:voq_dequeue
+            { @delay = hist(arg4); }'
+
+    Each probe is a single nop at its site, plus a note in the
+    .note.stapsdt section giving its address and where its arguments are
+    held, so a detached probe costs the nop and keeping its arguments live.
+    Arguments should be values already at hand, or cheap to find.
+
+    The probes come from <sys/sdt.h> where it is installed. Otherwise, on
+    x86-64 ELF targets, the notes are emitted here in the same format
+    (version 3, without semaphores), with every argument passed as a signed
+    64 bit integer. Elsewhere, or when PROBES_DISABLE is defined, the probes
+    expand to nothing and their arguments are not evaluated. */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#if !defined(PROBES_DISABLE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define PROBES_SDT
+#endif
+#endif
+
+#if !defined(PROBES_DISABLE) && !defined(PROBES_SDT) && \
+    defined(__GNUC__) && defined(__x86_64__) && defined(__ELF__)
+#define PROBES_NOTES
+#endif
+
+#if defined(PROBES_SDT)
+
+#include <sys/sdt.h>
+
+#define PROBE2(name, a1, a2) DTRACE_PROBE2(switch_sim, name, a1, a2)
+#define PROBE3(name, a1, a2, a3) DTRACE_PROBE3(switch_sim, name, a1, a2, a3)
+#define PROBE4(name, a1, a2, a3, a4) \
+    DTRACE_PROBE4(switch_sim, name, a1, a2, a3, a4)
+#define PROBE5(name, a1, a2, a3, a4, a5) \
+    DTRACE_PROBE5(switch_sim, name, a1, a2, a3, a4, a5)
+
+#elif defined(PROBES_NOTES)
+
+#include <stdint.h>
+
+/*  The probe site, its note, and the section whose address the note
+    records so that tools can adjust for prelinking, which is shared by all
+    probes of an object. args lists the arguments as size@operand. */
+#define PROBE_ASM(name, args) \
+    "990: nop\n" \
+    ".pushsection .note.stapsdt, \"\", \"note\"\n" \
+    ".balign 4\n" \
+    ".4byte 992f - 991f, 994f - 993f, 3\n" \
+    "991: .asciz \"stapsdt\"\n" \
+    "992: .balign 4\n" \
+    "993: .8byte 990b\n" \
+    ".8byte _.stapsdt.base\n" \
+    ".8byte 0\n" \
+    ".asciz \"switch_sim\"\n" \
+    ".asciz \"" #name "\"\n" \
+    ".asciz \"" args "\"\n" \
+    "994: .balign 4\n" \
+    ".popsection\n" \
+    ".ifndef _.stapsdt.base\n" \
+    ".pushsection .stapsdt.base, \"aG\", \"progbits\", " \
+        ".stapsdt.base, comdat\n" \
+    ".weak _.stapsdt.base\n" \
+    ".hidden _.stapsdt.base\n" \
+    "_.stapsdt.base: .space 1\n" \
+    ".size _.stapsdt.base, 1\n" \
+    ".popsection\n" \
+    ".endif\n"
+
+#define PROBE_ARG(n, value) [a##n] "nor" ((int64_t) (value))
+
+#define PROBE2(name, a1, a2) __asm__ __volatile__ ( \
+    PROBE_ASM(name, "-8@%[a1] -8@%[a2]") \
+    :: PROBE_ARG(1, a1), PROBE_ARG(2, a2))
+#define PROBE3(name, a1, a2, a3) __asm__ __volatile__ ( \
+    PROBE_ASM(name, "-8@%[a1] -8@%[a2] -8@%[a3]") \
+    :: PROBE_ARG(1, a1), PROBE_ARG(2, a2), PROBE_ARG(3, a3))
+#define PROBE4(name, a1, a2, a3, a4) __asm__ __volatile__ ( \
+    PROBE_ASM(name, "-8@%[a1] -8@%[a2] -8@%[a3] -8@%[a4]") \
+    :: PROBE_ARG(1, a1), PROBE_ARG(2, a2), PROBE_ARG(3, a3), \
+        PROBE_ARG(4, a4))
+#define PROBE5(name, a1, a2, a3, a4, a5) __asm__ __volatile__ ( \
+    PROBE_ASM(name, "-8@%[a1] -8@%[a2] -8@%[a3] -8@%[a4] -8@%[a5]") \
+    :: PROBE_ARG(1, a1), PROBE_ARG(2, a2), PROBE_ARG(3, a3), \
+        PROBE_ARG(4, a4), PROBE_ARG(5, a5))
+
+#else
+
+#define PROBE2(name, a1, a2) ((void) 0)
+#define PROBE3(name, a1, a2, a3) ((void) 0)
+#define PROBE4(name, a1, a2, a3, a4) ((void) 0)
+#define PROBE5(name, a1, a2, a3, a4, a5) ((void) 0)
+
+#endif
+
+#endif
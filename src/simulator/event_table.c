@@ -2,6 +2,7 @@
 #include "event_table.h"
 #include "hash_table.h"
 #include <assert.h>
+#include <malloc.h>
 
 struct event_table {
     hash_table_t hash_table;
@@ -66,9 +67,12 @@ void event_table_register_event(
 ) {
     event_entry_key_t key = malloc(sizeof(struct event_entry_key));
     assert(key);
+    key->key = evt_id;
 
     event_entry_val_t val = malloc(sizeof(struct event_entry_val));
     assert(val);
+    val->callback = callback;
+    val->free_arg = free_arg;
 
     hash_table_insert(event_table->hash_table, (void *) key, (void *) val);
 };
@@ -112,7 +116,7 @@ static comparison_t event_entry_key_compare(void *lhs, void *rhs) {
     assert(rhs);
 
     event_entry_key_t lhs_key = (event_entry_key_t) lhs;
-    event_entry_key_t rhs_key = (event_entry_val_t) rhs;
+    event_entry_key_t rhs_key = (event_entry_key_t) rhs;
 
     if (lhs_key->key < rhs_key->key) {
         return LT;
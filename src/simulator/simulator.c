@@ -1,7 +1,38 @@
-/*  simulator.c */
+/*  simulator.c
+
+    Discrete event simulator. When built with SIMULATOR_PROFILE the main loop
+    also profiles the callbacks of each event id - the number of times it
+    was dispatched, the total and greatest cycles of the time stamp counter
+    spent in its callback, and the mean number of events left queued at
+    dispatch - and simulator_terminate prints them to stderr, most costly
+    first. Otherwise nothing is added to the loop.
+
+    Events carry the tracepoints event_enqueue and event_dispatch (see
+    probes.h), whose arguments are the event id, the time of the event, and
+    the number of events queued after the event was added or removed. The
+    time is passed by value for the default time types - an unsigned int as
+    is, and a double as the 64 bits of its representation, so that no
+    fraction is lost - and as the address of the time for CUSTOM_TIME. */
 
 #include "simulator.h"
 #include "event_table.h"
+#include "./../probes.h"
+#include <assert.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef SIMULATOR_PROFILE
+#include "hash_table.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+#endif
 
 /*  Structures and types. */
 struct event {
@@ -26,6 +57,7 @@ typedef struct double_time *double_time_t;
 
 static event_table_t event_table;
 static heap_t event_queue;
+static time_type_t current_time_type;
 static add_func_t add_time;
 static comparator_func_t compare_time;
 static copy_func_t copy_time;
@@ -33,6 +65,26 @@ static free_func_t free_time;
 static void *current_time;
 static char should_terminate;
 
+#ifdef SIMULATOR_PROFILE
+/*  Event profile - what has been spent on the dispatches of one event id.
+    Profiles are found by id in profile_table, and listed in profiles in the
+    order their ids were first dispatched. */
+struct event_profile {
+    event_id_t evt_id;
+    unsigned long dispatches;
+    uint64_t total_cycles;
+    uint64_t max_cycles;
+    unsigned long long queue_sum;
+};
+
+typedef struct event_profile *event_profile_t;
+
+static hash_table_t profile_table;
+static event_profile_t *profiles;
+static unsigned int num_profiles;
+static unsigned int profiles_capacity;
+#endif
+
 /*  Forward declare helper functions. */
 static comparison_t compare_event(void *lhs, void *rhs);
 static void free_event(void *event);
@@ -46,6 +98,16 @@ static void add_double_time(void *lhs, void *rhs);
 static comparison_t compare_double_time(void *lhs, void *rhs);
 static void copy_double_time(void *lhs, void *rhs);
 static void free_double_time(void *double_time);
+static inline int64_t probe_time(void *time);
+#ifdef SIMULATOR_PROFILE
+static event_profile_t profile_lookup(event_id_t evt_id);
+static void profile_report();
+static uint64_t profile_now();
+static hash_t profile_hash(void *evt_id);
+static comparison_t profile_compare(void *lhs, void *rhs);
+static int profile_order(const void *lhs, const void *rhs);
+static void profile_key_free(void *evt_id);
+#endif
 
 /*  Simulator API implementation. */
 
@@ -60,7 +122,8 @@ static void free_double_time(void *double_time);
     time comparison and freeing functions. The start time parameter should also
     only be provided with a non-NULL value when CUSTOM_TIME is passed, and
     should be the representation of the start time / zero time in the custom
-    representation. */
+    representation. The simulator keeps it as the current time, and frees it
+    in simulator_terminate. */
 void simulator_init(
     time_type_t time_type,
     add_func_t custom_time_add,
@@ -70,6 +133,7 @@ void simulator_init(
     void *start_time
 ) {
     should_terminate = 0;
+    current_time_type = time_type;
 
     event_table = event_table_create();
 
@@ -106,14 +170,36 @@ void simulator_init(
     }
 
     event_queue = heap_create(compare_event, free_event);
+
+#ifdef SIMULATOR_PROFILE
+    profile_table = hash_table_create(
+        profile_hash,
+        profile_compare,
+        profile_key_free,
+        free
+    );
+    profiles = NULL;
+    num_profiles = 0;
+    profiles_capacity = 0;
+#endif
 };
 
-/*  Terminate the simulator - this involves freeing the event table and event
-    queue. */
+/*  Terminate the simulator - this involves freeing the event queue, whose
+    remaining events are freed with the free functions of the event table,
+    then the event table and the current time. */
 void simulator_terminate() {
+    heap_free(event_queue);
+
     event_table_free(event_table);
 
-    heap_free(event_queue);
+    free_time(current_time);
+
+#ifdef SIMULATOR_PROFILE
+    profile_report();
+
+    hash_table_free(profile_table);
+    free(profiles);
+#endif
 };
 
 /*  Register simulator event - this is simply a wrapper around the
@@ -141,12 +227,17 @@ void simulator_register_event(
     simulation is terminated. */
 void simulator_invoke_event(event_id_t evt_id, void *arg, void *future_time) {
     event_t event = (event_t) malloc(sizeof(struct event));
+    assert(event);
+
     event->evt_id = evt_id;
     event->arg = arg;
     event->time = future_time;
     add_time(current_time, event->time);
 
     heap_insert(event_queue, (void *) event);
+
+    PROBE3(event_enqueue, evt_id, probe_time(event->time),
+        heap_size(event_queue));
 };
 
 /*  Simulator main loop. */
@@ -157,7 +248,10 @@ void simulator_main_loop() {
         assert(next_event_ptr);
 
         event_t next_event = (event_t) next_event_ptr;
-        time_copy(current_time, next_event->time);
+        copy_time(next_event->time, current_time);
+
+        PROBE3(event_dispatch, next_event->evt_id,
+            probe_time(next_event->time), heap_size(event_queue));
 
         /* Lookup event in event table and execute callback with arg. */
         callback_func_t callback;
@@ -170,8 +264,26 @@ void simulator_main_loop() {
             &free_arg
         );
 
-        if (callback && free_arg) {
+#ifdef SIMULATOR_PROFILE
+        event_profile_t profile = profile_lookup(next_event->evt_id);
+        unsigned int queued = heap_size(event_queue);
+        uint64_t start = profile_now();
+#endif
+
+        if (callback) {
             callback(next_event->arg);
+        };
+
+#ifdef SIMULATOR_PROFILE
+        uint64_t cycles = profile_now() - start;
+        profile->dispatches++;
+        profile->total_cycles += cycles;
+        profile->max_cycles =
+            cycles > profile->max_cycles ? cycles : profile->max_cycles;
+        profile->queue_sum += queued;
+#endif
+
+        if (free_arg) {
             free_arg(next_event->arg);
         };
 
@@ -198,7 +310,7 @@ static comparison_t compare_event(void *lhs, void *rhs) {
     event_t evt_lhs = (event_t) lhs;
     event_t evt_rhs = (event_t) rhs;
 
-    return time_comparator(evt_lhs->time, evt_rhs->time);
+    return compare_time(evt_lhs->time, evt_rhs->time);
 };
 
 /*  Free event - to free an event we first free its argument and time values
@@ -340,4 +452,152 @@ static void copy_double_time(void *lhs, void *rhs) {
 static void free_double_time(void *double_time) {
     assert(double_time);
     free(double_time);
-};
\ No newline at end of file
+};
+
+/*  Time of an event as a probe argument - the value of an unsigned int
+    time, the bits of a double time, or the address of a custom time. */
+static inline int64_t probe_time(void *time) {
+    int64_t value = (int64_t) (intptr_t) time;
+
+    switch (current_time_type) {
+        case UINT_TIME: {
+            value = ((uint_time_t) time)->time;
+            break;
+        };
+
+        case DOUBLE_TIME: {
+            memcpy(&value, &((double_time_t) time)->time, sizeof(int64_t));
+            break;
+        };
+
+        case CUSTOM_TIME: {
+            break;
+        };
+    }
+
+    return value;
+};
+
+#ifdef SIMULATOR_PROFILE
+/*  Profile lookup - find the profile of an event id, creating it on its first
+    dispatch. The profile owns the key it is filed under, its own id. */
+static event_profile_t profile_lookup(event_id_t evt_id) {
+    event_profile_t profile =
+        (event_profile_t) hash_table_lookup(profile_table, &evt_id);
+
+    if (profile) {
+        return profile;
+    };
+
+    profile = (event_profile_t) malloc(sizeof(struct event_profile));
+    assert(profile);
+
+    profile->evt_id = evt_id;
+    profile->dispatches = 0;
+    profile->total_cycles = 0;
+    profile->max_cycles = 0;
+    profile->queue_sum = 0;
+
+    if (num_profiles == profiles_capacity) {
+        profiles_capacity = profiles_capacity ? profiles_capacity * 2 : 16;
+        profiles = (event_profile_t *) realloc(profiles,
+            sizeof(event_profile_t) * profiles_capacity);
+        assert(profiles);
+    };
+
+    profiles[num_profiles++] = profile;
+    hash_table_insert(profile_table, &profile->evt_id, profile);
+
+    return profile;
+};
+
+/*  Profile report - print one line per event id, in decreasing order of the
+    cycles spent in its callbacks. */
+static void profile_report() {
+    qsort(profiles, num_profiles, sizeof(event_profile_t), profile_order);
+
+    uint64_t total_cycles = 0;
+    unsigned long dispatches = 0;
+    unsigned int i;
+    for (i = 0; i < num_profiles; i++) {
+        total_cycles += profiles[i]->total_cycles;
+        dispatches += profiles[i]->dispatches;
+    };
+
+    fprintf(stderr, "simulator profile: %lu dispatches, %lu %s in "
+        "callbacks\n", dispatches, (unsigned long) total_cycles,
+#if defined(__x86_64__) || defined(__i386__)
+        "TSC cycles");
+#else
+        "nanoseconds");
+#endif
+    fprintf(stderr, "%10s %12s %14s %6s %10s %10s %8s\n", "event",
+        "dispatches", "cycles", "share", "mean", "max", "queue");
+
+    for (i = 0; i < num_profiles; i++) {
+        event_profile_t profile = profiles[i];
+
+        fprintf(stderr, "%10d %12lu %14lu %5.1f%% %10.1f %10lu %8.1f\n",
+            profile->evt_id, profile->dispatches,
+            (unsigned long) profile->total_cycles,
+            total_cycles ? 100.0 * profile->total_cycles / total_cycles : 0.0,
+            (double) profile->total_cycles / profile->dispatches,
+            (unsigned long) profile->max_cycles,
+            (double) profile->queue_sum / profile->dispatches);
+    };
+};
+
+/*  Profile now - the time stamp counter, or nanoseconds of the monotonic
+    clock off x86. It is read without serialising, so callbacks of a few
+    tens of cycles are blurred by out of order execution. */
+static uint64_t profile_now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000UL + now.tv_nsec;
+#endif
+};
+
+/*  Profile table functions - profiles are keyed by event id, which they
+    own, so keys are not freed separately. */
+static hash_t profile_hash(void *evt_id) {
+    assert(evt_id);
+
+    return (hash_t) *(event_id_t *) evt_id;
+};
+
+static comparison_t profile_compare(void *lhs, void *rhs) {
+    assert(lhs);
+    assert(rhs);
+
+    event_id_t lhs_id = *(event_id_t *) lhs;
+    event_id_t rhs_id = *(event_id_t *) rhs;
+
+    if (lhs_id < rhs_id) {
+        return LT;
+    } else if (lhs_id > rhs_id) {
+        return GT;
+    } else {
+        return EQ;
+    };
+};
+
+static int profile_order(const void *lhs, const void *rhs) {
+    event_profile_t lhs_profile = *(const event_profile_t *) lhs;
+    event_profile_t rhs_profile = *(const event_profile_t *) rhs;
+
+    if (lhs_profile->total_cycles > rhs_profile->total_cycles) {
+        return -1;
+    } else if (lhs_profile->total_cycles < rhs_profile->total_cycles) {
+        return 1;
+    } else {
+        return 0;
+    };
+};
+
+static void profile_key_free(void *evt_id) {
+    (void) evt_id;
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,127 @@
+/*  batch_means.c */
+
+#include "batch_means.h"
+#include <assert.h>
+#include <malloc.h>
+#include <math.h>
+
+/*  97.5th percentile of the standard normal distribution. */
+#define NORMAL_975 1.959963984540054
+
+/*  Batch means structure - batch_sum and batch_count are of the current
+    batch, and mean and m2 the running mean of the ended batches' means and
+    the sum of their squared deviations from it. */
+struct batch_means {
+    double batch_sum;
+    unsigned long batch_count;
+    unsigned long batches;
+    double mean;
+    double m2;
+};
+
+/*  Helper function declarations. */
+static double student_t_975(unsigned long freedom);
+
+/*  Create batch means. */
+batch_means_t batch_means_create() {
+    batch_means_t batch_means =
+        (batch_means_t) malloc(sizeof(struct batch_means));
+    assert(batch_means);
+
+    batch_means->batch_sum = 0.0;
+    batch_means->batch_count = 0;
+    batch_means->batches = 0;
+    batch_means->mean = 0.0;
+    batch_means->m2 = 0.0;
+
+    return batch_means;
+};
+
+/*  Free batch means. */
+void batch_means_free(batch_means_t batch_means) {
+    assert(batch_means);
+
+    free(batch_means);
+};
+
+/*  Add an observation to the current batch. */
+void batch_means_observe(batch_means_t batch_means, double value) {
+    batch_means->batch_sum += value;
+    batch_means->batch_count++;
+};
+
+/*  End the current batch, folding its mean into the running mean and sum of
+    squared deviations. */
+void batch_means_end_batch(batch_means_t batch_means) {
+    assert(batch_means);
+
+    if (batch_means->batch_count == 0) {
+        return;
+    };
+
+    double batch_mean = batch_means->batch_sum / batch_means->batch_count;
+    batch_means->batch_sum = 0.0;
+    batch_means->batch_count = 0;
+
+    batch_means->batches++;
+    double delta = batch_mean - batch_means->mean;
+    batch_means->mean += delta / batch_means->batches;
+    batch_means->m2 += delta * (batch_mean - batch_means->mean);
+};
+
+/*  Number of batches ended, and the mean and sample variance of their
+    means. */
+unsigned long batch_means_batches(batch_means_t batch_means) {
+    assert(batch_means);
+
+    return batch_means->batches;
+};
+
+double batch_means_mean(batch_means_t batch_means) {
+    assert(batch_means);
+
+    return batch_means->mean;
+};
+
+double batch_means_variance(batch_means_t batch_means) {
+    assert(batch_means);
+
+    return batch_means->batches > 1
+        ? batch_means->m2 / (batch_means->batches - 1)
+        : 0.0;
+};
+
+double batch_means_half_width(batch_means_t batch_means) {
+    assert(batch_means);
+
+    if (batch_means->batches < 2) {
+        return INFINITY;
+    };
+
+    return student_t_975(batch_means->batches - 1) * sqrt(
+        batch_means_variance(batch_means) / batch_means->batches);
+};
+
+/*  Helper functions. */
+
+/*  97.5th percentile of Student's t distribution - exact for up to three
+    degrees of freedom, and otherwise from the Cornish-Fisher expansion about
+    the normal percentile, which is within 0.3% from four degrees on. */
+static double student_t_975(unsigned long freedom) {
+    if (freedom == 1) {
+        return 12.706204736174707;
+    } else if (freedom == 2) {
+        return 4.302652729749464;
+    } else if (freedom == 3) {
+        return 3.182446305284263;
+    };
+
+    double z = NORMAL_975;
+    double z3 = z * z * z;
+    double z5 = z3 * z * z;
+    double n = (double) freedom;
+
+    return z + (z3 + z) / (4 * n) +
+        (5 * z5 + 16 * z3 + 3 * z) / (96 * n * n) +
+        (3 * z5 * z * z + 19 * z5 + 17 * z3 - 15 * z) / (384 * n * n * n);
+};
@@ -0,0 +1,35 @@
+/*  batch_means.h
+
+    Streaming estimate of a steady-state mean and its confidence interval by
+    the method of batch means. Observations are summed into the current
+    batch, and when a batch is ended its mean is folded into a running mean
+    and sum of squared deviations of the batch means by Welford's
+    algorithm, so memory is constant however long the run.
+
+    The observations of a simulation are correlated, but the means of long
+    enough batches are close to independent, so the variance of the grand
+    mean is estimated from that of the batch means. The caller chooses the
+    batch length, which should be well beyond the time over which
+    observations are correlated, and a minimum number of batches before the
+    interval is trusted. */
+
+#ifndef BATCH_MEANS_H
+#define BATCH_MEANS_H
+
+struct batch_means;
+typedef struct batch_means *batch_means_t;
+
+/*  API functions. A batch with no observations is not counted.
+    batch_means_half_width gives the half-width of the 95% confidence
+    interval of the mean, from Student's t distribution, or infinity before
+    two batches have ended. */
+batch_means_t batch_means_create();
+void batch_means_free(batch_means_t batch_means);
+void batch_means_observe(batch_means_t batch_means, double value);
+void batch_means_end_batch(batch_means_t batch_means);
+unsigned long batch_means_batches(batch_means_t batch_means);
+double batch_means_mean(batch_means_t batch_means);
+double batch_means_variance(batch_means_t batch_means);
+double batch_means_half_width(batch_means_t batch_means);
+
+#endif
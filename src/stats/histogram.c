@@ -0,0 +1,162 @@
+/*  histogram.c */
+
+#include "histogram.h"
+#include <assert.h>
+#include <malloc.h>
+#include <string.h>
+
+#define SUB_BUCKETS (1UL << HISTOGRAM_SUB_BITS)
+#define HALF_BUCKETS (SUB_BUCKETS / 2)
+#define MAX_VALUE ((1UL << HISTOGRAM_MAX_BITS) - 1)
+
+/*  Histogram structure - counts holds HISTOGRAM_BUCKETS counters, and
+    count, sum, min and max are of the exact values recorded. */
+struct histogram {
+    unsigned long count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    unsigned long counts[HISTOGRAM_BUCKETS];
+};
+
+/*  Helper function declarations. */
+static inline unsigned int bucket_index(uint64_t value);
+static uint64_t bucket_highest(unsigned int index);
+
+/*  Create histogram. */
+histogram_t histogram_create() {
+    histogram_t histogram = (histogram_t) malloc(sizeof(struct histogram));
+    assert(histogram);
+
+    histogram_reset(histogram);
+
+    return histogram;
+};
+
+/*  Free histogram. */
+void histogram_free(histogram_t histogram) {
+    assert(histogram);
+
+    free(histogram);
+};
+
+/*  Forget every value recorded. */
+void histogram_reset(histogram_t histogram) {
+    assert(histogram);
+
+    histogram->count = 0;
+    histogram->sum = 0;
+    histogram->min = UINT64_MAX;
+    histogram->max = 0;
+    memset(histogram->counts, 0, sizeof(histogram->counts));
+};
+
+/*  Record a value. */
+void histogram_record(histogram_t histogram, uint64_t value) {
+    histogram->counts[bucket_index(value)]++;
+    histogram->count++;
+    histogram->sum += value;
+    histogram->min = value < histogram->min ? value : histogram->min;
+    histogram->max = value > histogram->max ? value : histogram->max;
+};
+
+/*  Add the values recorded in other to histogram. */
+void histogram_merge(histogram_t histogram, histogram_t other) {
+    assert(histogram);
+    assert(other);
+
+    unsigned int i;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        histogram->counts[i] += other->counts[i];
+    };
+
+    histogram->count += other->count;
+    histogram->sum += other->sum;
+    histogram->min = other->min < histogram->min ? other->min : histogram->min;
+    histogram->max = other->max > histogram->max ? other->max : histogram->max;
+};
+
+/*  Number, least, greatest and mean of the values recorded. min and max
+    are 0 if none have been. */
+unsigned long histogram_count(histogram_t histogram) {
+    assert(histogram);
+
+    return histogram->count;
+};
+
+uint64_t histogram_min(histogram_t histogram) {
+    assert(histogram);
+
+    return histogram->count ? histogram->min : 0;
+};
+
+uint64_t histogram_max(histogram_t histogram) {
+    assert(histogram);
+
+    return histogram->max;
+};
+
+double histogram_mean(histogram_t histogram) {
+    assert(histogram);
+
+    return histogram->count
+        ? (double) histogram->sum / histogram->count
+        : 0.0;
+};
+
+/*  Value at a percentile - found by summing the counters from the lowest
+    until they reach the percentile's share of all values. */
+uint64_t histogram_percentile(histogram_t histogram, double percentile) {
+    assert(histogram);
+
+    if (histogram->count == 0) {
+        return 0;
+    };
+
+    double share = percentile / 100.0 * histogram->count;
+    unsigned long target = (unsigned long) share;
+    target += target < share || target == 0;
+    target = target > histogram->count ? histogram->count : target;
+
+    unsigned long seen = 0;
+    unsigned int i;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+
+        if (seen >= target) {
+            break;
+        };
+    };
+
+    uint64_t value = bucket_highest(i);
+    value = value > histogram->max ? histogram->max : value;
+    value = value < histogram->min ? histogram->min : value;
+
+    return value;
+};
+
+/*  Helper functions. */
+
+/*  Bucket of a value. A value of bit length L above HISTOGRAM_SUB_BITS
+    falls in sub-bucket value >> e of the power of two e = L -
+    HISTOGRAM_SUB_BITS, whose sub-buckets start at index e *
+    HALF_BUCKETS + HALF_BUCKETS. Below that e is 0 and the index the value
+    itself. */
+static inline unsigned int bucket_index(uint64_t value) {
+    value = value > MAX_VALUE ? MAX_VALUE : value;
+
+    unsigned int length = 64 - __builtin_clzll(value | (SUB_BUCKETS - 1));
+    unsigned int e = length - HISTOGRAM_SUB_BITS;
+
+    return (e << (HISTOGRAM_SUB_BITS - 1)) + (unsigned int) (value >> e);
+};
+
+/*  Highest value counted in a bucket. */
+static uint64_t bucket_highest(unsigned int index) {
+    unsigned int e = index >> (HISTOGRAM_SUB_BITS - 1);
+    e = e > 0 ? e - 1 : 0;
+
+    uint64_t low = (uint64_t) (index - (e << (HISTOGRAM_SUB_BITS - 1))) << e;
+
+    return low + (1UL << e) - 1;
+};
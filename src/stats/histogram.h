@@ -0,0 +1,48 @@
+/*  histogram.h
+
+    Log-linear histogram of non-negative integer values, in the manner of
+    HdrHistogram, e.g. of packet delays in slots. Values below
+    2^HISTOGRAM_SUB_BITS are counted exactly. Above that each power of two
+    is split into 2^(HISTOGRAM_SUB_BITS - 1) equal sub-buckets, so a value
+    is known to within 1 part in 2^(HISTOGRAM_SUB_BITS - 1) of itself
+    (under 1.6%). Values of 2^HISTOGRAM_MAX_BITS and above are counted in
+    the top bucket, but the exact maximum is kept.
+
+    Memory is fixed at HISTOGRAM_BUCKETS counters, 1728 with the defaults
+    below - 128 exact buckets and 64 for each of the 25 powers of two from
+    2^7 to 2^31 - and recording a value takes a count of leading zeros, a
+    shift and an increment, with no division. A histogram is not safe to
+    record into from several threads, so each thread or port keeps its own,
+    and they are merged by adding their counters. */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+#define HISTOGRAM_SUB_BITS 7
+#define HISTOGRAM_MAX_BITS 32
+
+/*  Values below 2^HISTOGRAM_SUB_BITS take one bucket each, and then each
+    power of two up to 2^HISTOGRAM_MAX_BITS half as many again. */
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 2) \
+    << (HISTOGRAM_SUB_BITS - 1))
+
+struct histogram;
+typedef struct histogram *histogram_t;
+
+/*  API functions. histogram_percentile gives the highest value counted in
+    the bucket holding the given percentile (in [0, 100]) of the values
+    recorded, capped at the maximum, or 0 if none have been. */
+histogram_t histogram_create();
+void histogram_free(histogram_t histogram);
+void histogram_reset(histogram_t histogram);
+void histogram_record(histogram_t histogram, uint64_t value);
+void histogram_merge(histogram_t histogram, histogram_t other);
+unsigned long histogram_count(histogram_t histogram);
+uint64_t histogram_min(histogram_t histogram);
+uint64_t histogram_max(histogram_t histogram);
+double histogram_mean(histogram_t histogram);
+uint64_t histogram_percentile(histogram_t histogram, double percentile);
+
+#endif
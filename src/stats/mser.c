@@ -0,0 +1,148 @@
+/*  mser.c */
+
+#include "mser.h"
+#include <assert.h>
+#include <malloc.h>
+
+/*  Batch - the mean of a completed batch, and the time of its first
+    observation. */
+struct batch {
+    double mean;
+    unsigned long start;
+};
+
+/*  MSER structure - batches holds num_batches completed batches of
+    batch_size observations each, and sum, count and start are of the batch
+    being filled. */
+struct mser {
+    struct batch *batches;
+    unsigned long num_batches;
+    unsigned long batch_size;
+    double sum;
+    unsigned long count;
+    unsigned long start;
+};
+
+/*  Helper function declarations. */
+static void batches_merge(mser_t mser);
+
+/*  Create MSER. */
+mser_t mser_create() {
+    mser_t mser = (mser_t) malloc(sizeof(struct mser));
+    assert(mser);
+
+    mser->batches =
+        (struct batch *) malloc(sizeof(struct batch) * MSER_MAX_BATCHES);
+    assert(mser->batches);
+
+    mser->num_batches = 0;
+    mser->batch_size = MSER_BATCH;
+    mser->sum = 0.0;
+    mser->count = 0;
+    mser->start = 0;
+
+    return mser;
+};
+
+/*  Free MSER. */
+void mser_free(mser_t mser) {
+    assert(mser);
+
+    free(mser->batches);
+    free(mser);
+};
+
+/*  Add an observation made at time to the batch being filled, completing it
+    once it holds batch_size. */
+void mser_observe(mser_t mser, double value, unsigned long time) {
+    if (mser->count == 0) {
+        mser->start = time;
+    };
+
+    mser->sum += value;
+    mser->count++;
+
+    if (mser->count < mser->batch_size) {
+        return;
+    };
+
+    /*  Merging doubles batch_size, so the batch carries on filling. */
+    if (mser->num_batches == MSER_MAX_BATCHES) {
+        batches_merge(mser);
+        return;
+    };
+
+    struct batch *batch = &mser->batches[mser->num_batches++];
+    batch->mean = mser->sum / mser->count;
+    batch->start = mser->start;
+
+    mser->sum = 0.0;
+    mser->count = 0;
+};
+
+/*  Find the truncation which minimises MSER over the completed batches.
+    Going back from the last batch, the mean and sum of squared deviations
+    of the batches after each truncation are kept by Welford's algorithm. */
+void mser_truncate(mser_t mser, mser_truncation_t *truncation_out) {
+    assert(mser);
+    assert(truncation_out);
+
+    unsigned long n = mser->num_batches;
+
+    truncation_out->discarded = 0;
+    truncation_out->start = n > 0 ? mser->batches[0].start : mser->start;
+    truncation_out->mean = n > 0 ? mser->batches[0].mean :
+        mser->count > 0 ? mser->sum / mser->count : 0.0;
+    truncation_out->settled = 0;
+
+    if (n < 2) {
+        return;
+    };
+
+    unsigned long limit = n / 2;
+    unsigned long best = limit;
+    double best_mser = 0.0;
+    double best_mean = 0.0;
+
+    double mean = 0.0;
+    double m2 = 0.0;
+    unsigned long d;
+    for (d = n; d-- > 0;) {
+        double k = (double) (n - d);
+        double delta = mser->batches[d].mean - mean;
+        mean += delta / k;
+        m2 += delta * (mser->batches[d].mean - mean);
+
+        if (d > limit) {
+            continue;
+        };
+
+        double value = m2 / (k * k);
+        if (d == limit || value <= best_mser) {
+            best = d;
+            best_mser = value;
+            best_mean = mean;
+        };
+    };
+
+    truncation_out->discarded = best * mser->batch_size;
+    truncation_out->start = mser->batches[best].start;
+    truncation_out->mean = best_mean;
+    truncation_out->settled = best < limit;
+};
+
+/*  Helper functions. */
+
+/*  Merge adjacent pairs of batches, halving their number and doubling their
+    length. */
+static void batches_merge(mser_t mser) {
+    unsigned long i;
+    for (i = 0; i < mser->num_batches / 2; i++) {
+        mser->batches[i].mean =
+            (mser->batches[2 * i].mean + mser->batches[2 * i + 1].mean) / 2;
+        mser->batches[i].start = mser->batches[2 * i].start;
+    };
+
+    mser->num_batches /= 2;
+    mser->batch_size *= 2;
+};
@@ -0,0 +1,49 @@
+/*  mser.h
+
+    Warm-up detection by MSER-5 (the Marginal Standard Error Rule, over
+    batches of 5 observations). A simulation started empty passes through a
+    transient before it settles, which biases its estimates. MSER picks the
+    number of leading batches d to discard which minimises
+
+        MSER(d) = (1 / (n - d)^2) * sum over j > d of (Z_j - Z(d))^2
+
+    over n batch means Z_j with mean Z(d) after truncation, i.e. which
+    minimises the width of the confidence interval of the truncated mean,
+    and only considers d up to n / 2.
+
+    Observations are taken online, each batch keeping only its mean and
+    the time (e.g. slot) of its first observation. Once there are
+    MSER_MAX_BATCHES batches, adjacent pairs are merged and batches double
+    in length, so memory is bounded however long the run. The truncation
+    is found on demand, in one backward pass over the batches. */
+
+#ifndef MSER_H
+#define MSER_H
+
+#define MSER_BATCH 5
+#define MSER_MAX_BATCHES 65536
+
+struct mser;
+typedef struct mser *mser_t;
+
+/*  Truncation - the number of observations discarded, the time of the first
+    observation kept, and the mean of those kept. settled is 0 when the
+    truncation is the most MSER considers, i.e. the run is too short for the
+    transient to be told apart from the steady state, or fewer than two
+    batches have been completed. */
+struct mser_truncation {
+    unsigned long discarded;
+    unsigned long start;
+    double mean;
+    int settled;
+};
+
+typedef struct mser_truncation mser_truncation_t;
+
+/*  API functions. Observations must be given in order of time. */
+mser_t mser_create();
+void mser_free(mser_t mser);
+void mser_observe(mser_t mser, double value, unsigned long time);
+void mser_truncate(mser_t mser, mser_truncation_t *truncation_out);
+
+#endif
@@ -0,0 +1,671 @@
+/*  pcap.c */
+
+#include "pcap.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*  File format - the global header, and the header of each record, which is
+    followed by incl_len bytes of the packet. */
+#define FILE_HEADER_SIZE 24
+#define RECORD_HEADER_SIZE 16
+#define MAGIC_MICROSECONDS 0xa1b2c3d4U
+#define MAGIC_NANOSECONDS 0xa1b23c4dU
+#define MAX_SNAPLEN 262144
+
+/*  Link types. */
+#define LINK_ETHERNET 1
+#define LINK_RAW 101
+#define LINK_LINUX_SLL 113
+#define LINK_IPV4 228
+
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_VLAN 0x8100
+#define ETHERTYPE_QINQ 0x88a8
+
+/*  Each buffer has room for what is left of a record at the end of the
+    previous chunk in front of its chunk, so that every record can be
+    decoded from one place. */
+#define CARRY_SIZE (RECORD_HEADER_SIZE + MAX_SNAPLEN)
+
+/*  Chunk - a buffer filled by the helper thread. length counts the bytes
+    read into it after the carry area, and last is set on the chunk at the
+    end of the file, or at a read error. full is set while the chunk waits
+    to be decoded, and guarded by the reader's lock. */
+struct chunk {
+    uint8_t *data;
+    size_t length;
+    int last;
+    int error;
+    int full;
+};
+
+/*  Packet - one decoded IPv4 packet, waiting for its slot. */
+struct packet {
+    unsigned long slot;
+    port_num_t port;
+    uint32_t addr;
+    uint32_t length;
+};
+
+/*  Reader structure. The reader decodes chunks[current] from pos to end
+    while the helper fills the other. pending is the next packet to arrive,
+    and each input's backlog a ring of PCAP_BACKLOG packets which have
+    arrived but not yet been taken. done is set once there are no more
+    packets, and damaged if a malformed record ended them. */
+struct pcap_reader {
+    int fd;
+    pthread_t helper;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int stop;
+    struct chunk chunks[2];
+    int current;
+    const uint8_t *pos;
+    const uint8_t *end;
+    int last;
+    int swapped;
+    int nanoseconds;
+    unsigned int link_type;
+    pcap_config_t config;
+    pcap_rule_t *rules;
+    int started;
+    uint64_t start_ns;
+    unsigned long slot;
+    struct packet pending;
+    int has_pending;
+    int done;
+    int damaged;
+    int malformed;
+    uint32_t *backlog_addrs;
+    uint32_t *backlog_lengths;
+    unsigned int *backlog_head;
+    unsigned int *backlog_count;
+    unsigned long backlogged;
+    pcap_stats_t stats;
+};
+
+/*  Helper function declarations. */
+static void *helper_main(void *reader_ptr);
+static int ensure(pcap_reader_t reader, size_t size);
+static uint32_t get32(pcap_reader_t reader, const uint8_t *in);
+static uint32_t get_be32(const uint8_t *in);
+static int ipv4_header(
+    pcap_reader_t reader,
+    const uint8_t *packet,
+    uint32_t size,
+    const uint8_t **ip_out
+);
+static int next_packet(pcap_reader_t reader);
+static void backlog_push(pcap_reader_t reader, struct packet *packet);
+static int rule_parse(
+    const char *line,
+    port_num_t num_ports,
+    pcap_rule_t *rule_out
+);
+
+/*  Open a capture, starting the helper thread and decoding the capture's
+    header from its first chunk. */
+pcap_reader_t pcap_reader_open(const char *path, pcap_config_t config) {
+    assert(config.num_ports > 0);
+    assert(config.slot_ns > 0);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    };
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    pcap_reader_t reader = (pcap_reader_t) malloc(sizeof(struct pcap_reader));
+    assert(reader);
+
+    reader->fd = fd;
+    reader->stop = 0;
+    reader->current = -1;
+    reader->pos = NULL;
+    reader->end = NULL;
+    reader->last = 0;
+    reader->config = config;
+    reader->started = 0;
+    reader->start_ns = 0;
+    reader->slot = 0;
+    reader->has_pending = 0;
+    reader->done = 0;
+    reader->damaged = 0;
+    reader->malformed = 0;
+    reader->backlogged = 0;
+    memset(&reader->stats, 0, sizeof(pcap_stats_t));
+
+    reader->rules = (pcap_rule_t *) malloc(
+        (config.num_rules + 1) * sizeof(pcap_rule_t));
+    assert(reader->rules);
+
+    unsigned int r;
+    for (r = 0; r < config.num_rules; r++) {
+        assert(config.rules[r].prefix_len <= 32);
+        assert(config.rules[r].port < config.num_ports);
+        reader->rules[r] = config.rules[r];
+    };
+    reader->config.rules = reader->rules;
+
+    size_t slots = (size_t) config.num_ports * PCAP_BACKLOG;
+    reader->backlog_addrs = (uint32_t *) malloc(slots * sizeof(uint32_t));
+    assert(reader->backlog_addrs);
+    reader->backlog_lengths = (uint32_t *) malloc(slots * sizeof(uint32_t));
+    assert(reader->backlog_lengths);
+    reader->backlog_head =
+        (unsigned int *) calloc(config.num_ports, sizeof(unsigned int));
+    assert(reader->backlog_head);
+    reader->backlog_count =
+        (unsigned int *) calloc(config.num_ports, sizeof(unsigned int));
+    assert(reader->backlog_count);
+
+    int k;
+    for (k = 0; k < 2; k++) {
+        reader->chunks[k].data =
+            (uint8_t *) malloc(CARRY_SIZE + PCAP_CHUNK_SIZE);
+        assert(reader->chunks[k].data);
+        reader->chunks[k].length = 0;
+        reader->chunks[k].last = 0;
+        reader->chunks[k].error = 0;
+        reader->chunks[k].full = 0;
+    };
+
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->changed, NULL);
+    pthread_create(&reader->helper, NULL, helper_main, reader);
+
+    /*  The magic number gives the byte order and timestamp resolution. */
+    if (!ensure(reader, FILE_HEADER_SIZE)) {
+        pcap_reader_close(reader);
+        return NULL;
+    };
+
+    uint32_t magic;
+    memcpy(&magic, reader->pos, 4);
+    reader->swapped = magic == __builtin_bswap32(MAGIC_MICROSECONDS) ||
+        magic == __builtin_bswap32(MAGIC_NANOSECONDS);
+    magic = get32(reader, reader->pos);
+    reader->nanoseconds = magic == MAGIC_NANOSECONDS;
+    reader->link_type = get32(reader, reader->pos + 20) & 0xffff;
+
+    if ((magic != MAGIC_MICROSECONDS && magic != MAGIC_NANOSECONDS) ||
+        (reader->link_type != LINK_ETHERNET &&
+        reader->link_type != LINK_RAW &&
+        reader->link_type != LINK_LINUX_SLL &&
+        reader->link_type != LINK_IPV4)) {
+        pcap_reader_close(reader);
+        return NULL;
+    };
+
+    reader->pos += FILE_HEADER_SIZE;
+
+    return reader;
+};
+
+/*  Close a capture, stopping the helper thread. */
+void pcap_reader_close(pcap_reader_t reader) {
+    assert(reader);
+
+    pthread_mutex_lock(&reader->lock);
+    reader->stop = 1;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->lock);
+
+    pthread_join(reader->helper, NULL);
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->changed);
+    close(reader->fd);
+
+    free(reader->chunks[0].data);
+    free(reader->chunks[1].data);
+    free(reader->backlog_addrs);
+    free(reader->backlog_lengths);
+    free(reader->backlog_head);
+    free(reader->backlog_count);
+    free(reader->rules);
+    free(reader);
+};
+
+/*  Read the arrivals of the next slot - every packet up to the slot joins
+    its input's backlog, and each input then takes the first of its
+    backlog. */
+int pcap_read(
+    pcap_reader_t reader,
+    uint32_t *addrs_out,
+    uint32_t *lengths_out
+) {
+    assert(reader);
+    assert(addrs_out);
+    assert(lengths_out);
+
+    if (reader->malformed) {
+        return PCAP_MALFORMED;
+    };
+
+    while (1) {
+        if (reader->has_pending) {
+            if (reader->pending.slot > reader->slot) {
+                break;
+            };
+
+            backlog_push(reader, &reader->pending);
+            reader->has_pending = 0;
+        };
+
+        if (reader->done) {
+            break;
+        };
+
+        /*  Packets before a malformed record still arrive. */
+        int res = next_packet(reader);
+        reader->done = res <= 0;
+        reader->damaged = res < 0;
+        reader->has_pending = res > 0;
+    };
+
+    if (reader->done && reader->backlogged == 0) {
+        reader->malformed = reader->damaged;
+        return reader->damaged ? PCAP_MALFORMED : PCAP_END;
+    };
+
+    memset(lengths_out, 0, reader->config.num_ports * sizeof(uint32_t));
+
+    int arrivals = 0;
+    port_num_t i;
+    for (i = 0; i < reader->config.num_ports; i++) {
+        if (reader->backlog_count[i] == 0) {
+            continue;
+        };
+
+        unsigned int head = reader->backlog_head[i];
+        addrs_out[i] = reader->backlog_addrs[i * PCAP_BACKLOG + head];
+        lengths_out[i] = reader->backlog_lengths[i * PCAP_BACKLOG + head];
+
+        reader->backlog_head[i] = (head + 1) % PCAP_BACKLOG;
+        reader->backlog_count[i]--;
+        reader->backlogged--;
+        arrivals++;
+    };
+
+    reader->slot++;
+
+    return arrivals;
+};
+
+/*  Get reader statistics. */
+void pcap_reader_stats(pcap_reader_t reader, pcap_stats_t *stats_out) {
+    assert(reader);
+    assert(stats_out);
+
+    *stats_out = reader->stats;
+};
+
+/*  Port of addr - that of the first rule matching it, or else a hash of it,
+    scaled to the number of ports. */
+port_num_t pcap_port_lookup(
+    const pcap_rule_t *rules,
+    unsigned int num_rules,
+    uint32_t addr,
+    port_num_t num_ports
+) {
+    unsigned int r;
+    for (r = 0; r < num_rules; r++) {
+        unsigned int len = rules[r].prefix_len;
+
+        if (len == 0 || ((addr ^ rules[r].prefix) >> (32 - len)) == 0) {
+            return rules[r].port;
+        };
+    };
+
+    uint32_t hash = addr * 2654435761U;
+    hash ^= hash >> 16;
+
+    return (port_num_t) (((uint64_t) hash * num_ports) >> 32);
+};
+
+/*  Read rules from a file, growing the array by doubling. */
+int pcap_rules_read(
+    const char *path,
+    port_num_t num_ports,
+    pcap_rule_t **rules_out
+) {
+    assert(rules_out);
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    };
+
+    pcap_rule_t *rules = NULL;
+    unsigned int num_rules = 0;
+    unsigned int capacity = 0;
+    int malformed = 0;
+    char line[PCAP_RULES_LINE_SIZE];
+
+    while (!malformed && fgets(line, sizeof(line), file)) {
+        size_t length = strlen(line);
+
+        if (line[length - 1] != '\n' && !feof(file)) {
+            malformed = 1;
+            continue;
+        };
+
+        const char *start = line + strspn(line, " \t\r\n");
+        if (*start == '\0' || *start == '#') {
+            continue;
+        };
+
+        if (num_rules == capacity) {
+            capacity = capacity ? capacity * 2 : 8;
+            rules = (pcap_rule_t *)
+                realloc(rules, capacity * sizeof(pcap_rule_t));
+            assert(rules);
+        };
+
+        malformed = !rule_parse(start, num_ports, &rules[num_rules++]);
+    };
+
+    malformed = malformed || ferror(file);
+    fclose(file);
+
+    if (malformed) {
+        free(rules);
+        return -1;
+    };
+
+    *rules_out = rules;
+
+    return (int) num_rules;
+};
+
+/*  Helper functions. */
+
+/*  Helper thread - reads chunks into the buffers in turn, waiting for each
+    to be decoded before refilling it, until the end of the file. */
+static void *helper_main(void *reader_ptr) {
+    pcap_reader_t reader = (pcap_reader_t) reader_ptr;
+    int k = 0;
+
+    while (1) {
+        struct chunk *chunk = &reader->chunks[k];
+
+        pthread_mutex_lock(&reader->lock);
+        while (chunk->full && !reader->stop) {
+            pthread_cond_wait(&reader->changed, &reader->lock);
+        };
+        int stop = reader->stop;
+        pthread_mutex_unlock(&reader->lock);
+
+        if (stop) {
+            return NULL;
+        };
+
+        size_t length = 0;
+        int error = 0;
+        while (length < PCAP_CHUNK_SIZE) {
+            ssize_t got = read(reader->fd, chunk->data + CARRY_SIZE + length,
+                PCAP_CHUNK_SIZE - length);
+
+            if (got < 0 && errno == EINTR) {
+                continue;
+            } else if (got < 0) {
+                error = 1;
+                break;
+            } else if (got == 0) {
+                break;
+            };
+
+            length += got;
+        };
+
+        pthread_mutex_lock(&reader->lock);
+        chunk->length = length;
+        chunk->last = error || length < PCAP_CHUNK_SIZE;
+        chunk->error = error;
+        chunk->full = 1;
+        pthread_cond_broadcast(&reader->changed);
+        pthread_mutex_unlock(&reader->lock);
+
+        if (chunk->last) {
+            return NULL;
+        };
+
+        k ^= 1;
+    };
+};
+
+/*  Make size bytes available from pos, moving on to the next chunk as
+    needed, with what is left of the current one copied in front of it.
+    Returns 0 if the file ends first. */
+static int ensure(pcap_reader_t reader, size_t size) {
+    while ((size_t) (reader->end - reader->pos) < size) {
+        if (reader->last) {
+            return 0;
+        };
+
+        int next = reader->current < 0 ? 0 : reader->current ^ 1;
+        struct chunk *chunk = &reader->chunks[next];
+
+        pthread_mutex_lock(&reader->lock);
+        while (!chunk->full) {
+            pthread_cond_wait(&reader->changed, &reader->lock);
+        };
+        pthread_mutex_unlock(&reader->lock);
+
+        size_t left = reader->end - reader->pos;
+        uint8_t *start = chunk->data + CARRY_SIZE - left;
+        if (left > 0) {
+            memcpy(start, reader->pos, left);
+        };
+
+        if (reader->current >= 0) {
+            pthread_mutex_lock(&reader->lock);
+            reader->chunks[reader->current].full = 0;
+            pthread_cond_broadcast(&reader->changed);
+            pthread_mutex_unlock(&reader->lock);
+        };
+
+        reader->current = next;
+        reader->pos = start;
+        reader->end = chunk->data + CARRY_SIZE + chunk->length;
+        reader->last = chunk->last;
+
+        if (chunk->error) {
+            reader->malformed = 1;
+            return 0;
+        };
+    };
+
+    return 1;
+};
+
+/*  32 bit integers in the capture's byte order, and in network order. */
+static uint32_t get32(pcap_reader_t reader, const uint8_t *in) {
+    uint32_t value;
+    memcpy(&value, in, 4);
+
+    return reader->swapped ? __builtin_bswap32(value) : value;
+};
+
+static uint32_t get_be32(const uint8_t *in) {
+    return ((uint32_t) in[0] << 24) | ((uint32_t) in[1] << 16) |
+        ((uint32_t) in[2] << 8) | in[3];
+};
+
+/*  Find the IPv4 header of a packet of size bytes, under the capture's link
+    type. Returns 0 if the packet is not IPv4, or too short. */
+static int ipv4_header(
+    pcap_reader_t reader,
+    const uint8_t *packet,
+    uint32_t size,
+    const uint8_t **ip_out
+) {
+    uint32_t offset = 0;
+    unsigned int ethertype;
+
+    switch (reader->link_type) {
+        case LINK_ETHERNET:
+            if (size < 14) {
+                return 0;
+            };
+
+            ethertype = (packet[12] << 8) | packet[13];
+            offset = 14;
+
+            while ((ethertype == ETHERTYPE_VLAN ||
+                ethertype == ETHERTYPE_QINQ) && size >= offset + 4) {
+                ethertype = (packet[offset + 2] << 8) | packet[offset + 3];
+                offset += 4;
+            };
+
+            if (ethertype != ETHERTYPE_IPV4) {
+                return 0;
+            };
+            break;
+
+        case LINK_LINUX_SLL:
+            if (size < 16 ||
+                ((packet[14] << 8) | packet[15]) != ETHERTYPE_IPV4) {
+                return 0;
+            };
+
+            offset = 16;
+            break;
+
+        default:
+            break;
+    };
+
+    if (size < offset + 20 || (packet[offset] >> 4) != 4) {
+        return 0;
+    };
+
+    *ip_out = packet + offset;
+
+    return 1;
+};
+
+/*  Decode records up to the next IPv4 packet, into pending. Returns 1 for a
+    packet, 0 at the end of the capture and -1 for a truncated or
+    oversized record, or a read error. */
+static int next_packet(pcap_reader_t reader) {
+    while (1) {
+        if (!ensure(reader, RECORD_HEADER_SIZE)) {
+            return reader->malformed || reader->pos != reader->end ? -1 : 0;
+        };
+
+        uint64_t seconds = get32(reader, reader->pos);
+        uint64_t fraction = get32(reader, reader->pos + 4);
+        uint32_t incl_len = get32(reader, reader->pos + 8);
+        uint32_t orig_len = get32(reader, reader->pos + 12);
+
+        if (incl_len > MAX_SNAPLEN ||
+            !ensure(reader, RECORD_HEADER_SIZE + incl_len)) {
+            return -1;
+        };
+
+        const uint8_t *packet = reader->pos + RECORD_HEADER_SIZE;
+        reader->pos += RECORD_HEADER_SIZE + incl_len;
+        reader->stats.packets++;
+
+        const uint8_t *ip;
+        if (!ipv4_header(reader, packet, incl_len, &ip)) {
+            reader->stats.skipped++;
+            continue;
+        };
+
+        uint64_t time_ns = seconds * 1000000000
+            + (reader->nanoseconds ? fraction : fraction * 1000);
+
+        if (!reader->started) {
+            reader->start_ns = time_ns;
+            reader->started = 1;
+        };
+
+        /*  Packets stamped before the first are taken as arriving with
+            it. */
+        reader->pending.slot = time_ns > reader->start_ns
+            ? (time_ns - reader->start_ns) / reader->config.slot_ns
+            : 0;
+        reader->pending.port = pcap_port_lookup(reader->rules,
+            reader->config.num_rules, get_be32(ip + 12),
+            reader->config.num_ports);
+        reader->pending.addr = get_be32(ip + 16);
+        reader->pending.length = orig_len ? orig_len : incl_len;
+
+        return 1;
+    };
+};
+
+/*  Add a packet to its input's backlog, or drop it if that is full. */
+static void backlog_push(pcap_reader_t reader, struct packet *packet) {
+    port_num_t port = packet->port;
+    unsigned int count = reader->backlog_count[port];
+
+    if (count == PCAP_BACKLOG) {
+        reader->stats.dropped++;
+        return;
+    };
+
+    if (count > 0) {
+        reader->stats.deferred++;
+    };
+
+    unsigned int tail = (reader->backlog_head[port] + count) % PCAP_BACKLOG;
+    reader->backlog_addrs[port * PCAP_BACKLOG + tail] = packet->addr;
+    reader->backlog_lengths[port * PCAP_BACKLOG + tail] = packet->length;
+    reader->backlog_count[port]++;
+    reader->backlogged++;
+};
+
+/*  Parse a rule from a line, a dotted quad prefix, its length and a port.
+    Returns 0 if the line is not a rule, or has a port not below
+    num_ports. */
+static int rule_parse(
+    const char *line,
+    port_num_t num_ports,
+    pcap_rule_t *rule_out
+) {
+    unsigned int octets[4];
+    unsigned int prefix_len;
+    unsigned int port;
+    char extra;
+
+    int fields = sscanf(
+        line,
+        "%u.%u.%u.%u/%u %u %c",
+        &octets[0],
+        &octets[1],
+        &octets[2],
+        &octets[3],
+        &prefix_len,
+        &port,
+        &extra
+    );
+
+    if (
+        fields != 6 ||
+        octets[0] > 255 ||
+        octets[1] > 255 ||
+        octets[2] > 255 ||
+        octets[3] > 255 ||
+        prefix_len > 32 ||
+        port >= num_ports
+    ) {
+        return 0;
+    };
+
+    rule_out->prefix = octets[0] << 24 | octets[1] << 16 | octets[2] << 8 |
+        octets[3];
+    rule_out->prefix_len = prefix_len;
+    rule_out->port = port;
+
+    return 1;
+};
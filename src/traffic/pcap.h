@@ -0,0 +1,107 @@
+/*  pcap.h
+
+    Reader of packet captures in the pcap format, turning them into the
+    arrivals of each time slot at the input ports of a switch, as trace.h
+    does for binary traces. Both byte orders and both microsecond and
+    nanosecond timestamps are read, from captures of Ethernet (with VLAN
+    tags), Linux cooked or raw IP links. Packets which are not IPv4 are
+    skipped.
+
+    The file is read in PCAP_CHUNK_SIZE chunks by a helper thread, into two
+    buffers in turn, so that reading the next chunk overlaps decoding the
+    last, and memory use is bounded whatever the size of the capture.
+
+    Each packet arrives in the slot of its timestamp, counted in slots of
+    slot_ns nanoseconds from the first packet, at the input port given by
+    the first rule whose prefix matches its IPv4 source address, or by a
+    hash of the source address if none does. Its address is its IPv4
+    destination address, in host byte order, and its length that on the
+    wire. An input takes at most one packet per slot, so packets which
+    arrive at a busy input wait, up to PCAP_BACKLOG of them per input,
+    beyond which they are dropped. */
+
+#ifndef PCAP_H
+#define PCAP_H
+
+#include "./../network_switch/network_switch_common.h"
+#include <stdint.h>
+
+#define PCAP_CHUNK_SIZE (1UL << 20)
+#define PCAP_BACKLOG 64
+#define PCAP_RULES_LINE_SIZE 256
+
+/*  Returned by pcap_read once every packet has arrived, and for a capture
+    which is malformed. */
+#define PCAP_END (-1)
+#define PCAP_MALFORMED (-2)
+
+/*  Rule - packets from addresses whose top prefix_len bits match those of
+    prefix arrive at port. */
+struct pcap_rule {
+    uint32_t prefix;
+    unsigned int prefix_len;
+    port_num_t port;
+};
+
+typedef struct pcap_rule pcap_rule_t;
+
+/*  Reader configuration - rules are copied by pcap_reader_open. */
+struct pcap_config {
+    port_num_t num_ports;
+    unsigned long slot_ns;
+    const pcap_rule_t *rules;
+    unsigned int num_rules;
+};
+
+typedef struct pcap_config pcap_config_t;
+
+/*  Reader statistics - packets counts every packet read, of which skipped
+    were not IPv4, deferred waited for a later slot and dropped found their
+    input's backlog full. */
+struct pcap_stats {
+    unsigned long packets;
+    unsigned long skipped;
+    unsigned long deferred;
+    unsigned long dropped;
+};
+
+typedef struct pcap_stats pcap_stats_t;
+
+struct pcap_reader;
+typedef struct pcap_reader *pcap_reader_t;
+
+/*  API functions. pcap_reader_open returns NULL if the file cannot be
+    opened or is not a capture of a supported link type. pcap_read writes
+    the addresses and lengths of the arrivals of the next slot to arrays
+    with one entry per port, with a length of 0 for inputs with no arrival,
+    and returns their number, or PCAP_END or PCAP_MALFORMED. pcap_port_lookup
+    gives the port of an address under rules, as used for source addresses,
+    e.g. to map destination addresses to output ports the same way.
+
+    pcap_rules_read reads rules from a text file of one rule a line, a
+    prefix and a port, e.g. "10.1.0.0/16 3", in the order they are tried.
+    Blank lines and lines starting with # are skipped. It returns the number
+    of rules, in an array written to rules_out which the caller frees, or -1
+    if the file cannot be read, or a line is not a rule, is longer than
+    PCAP_RULES_LINE_SIZE or names a port not below num_ports. */
+pcap_reader_t pcap_reader_open(const char *path, pcap_config_t config);
+void pcap_reader_close(pcap_reader_t reader);
+int pcap_read(
+    pcap_reader_t reader,
+    uint32_t *addrs_out,
+    uint32_t *lengths_out
+);
+void pcap_reader_stats(pcap_reader_t reader, pcap_stats_t *stats_out);
+port_num_t pcap_port_lookup(
+    const pcap_rule_t *rules,
+    unsigned int num_rules,
+    uint32_t addr,
+    port_num_t num_ports
+);
+int pcap_rules_read(
+    const char *path,
+    port_num_t num_ports,
+    pcap_rule_t **rules_out
+);
+
+#endif
@@ -0,0 +1,82 @@
+/*  philox.h
+
+    Philox4x32-10 counter based random number generator (Salmon et al.,
+    "Parallel random numbers: as easy as 1, 2, 3"). Each 128 bit counter is
+    turned into 128 random bits under a 64 bit key by ten rounds of
+    multiplication and mixing, so any draw can be made directly from its
+    counter, with no state carried between draws. Choosing the counter by
+    what the draw is for (e.g. a port, a slot and a draw index) gives the
+    same numbers whichever thread makes the draw, and in whatever order.
+
+    The batch form draws for PHILOX_BATCH counters at once, laid out as one
+    array per counter word, in loops the compiler vectorises. */
+
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <stdint.h>
+
+#define PHILOX_M0 0xd2511f53U
+#define PHILOX_M1 0xcd9e8d57U
+#define PHILOX_W0 0x9e3779b9U
+#define PHILOX_W1 0xbb67ae85U
+#define PHILOX_ROUNDS 10
+
+#define PHILOX_BATCH 8
+
+/*  Draw the 4 words for counter ctr under key into out, which may be ctr. */
+static inline void philox4x32(
+    const uint32_t ctr[4],
+    const uint32_t key[2],
+    uint32_t out[4]
+) {
+    uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+    uint32_t k0 = key[0], k1 = key[1];
+
+    int round;
+    for (round = 0; round < PHILOX_ROUNDS; round++) {
+        uint64_t p0 = (uint64_t) PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t) PHILOX_M1 * c2;
+
+        c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+        c1 = (uint32_t) p1;
+        c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+        c3 = (uint32_t) p0;
+
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    };
+
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+};
+
+/*  Draw for PHILOX_BATCH counters at once, in place - word w of counter k
+    is ctr[w][k]. */
+static inline void philox4x32_batch(
+    uint32_t ctr[4][PHILOX_BATCH],
+    const uint32_t key[2]
+) {
+    uint32_t k0 = key[0], k1 = key[1];
+
+    int round;
+    for (round = 0; round < PHILOX_ROUNDS; round++) {
+        int k;
+        for (k = 0; k < PHILOX_BATCH; k++) {
+            uint64_t p0 = (uint64_t) PHILOX_M0 * ctr[0][k];
+            uint64_t p1 = (uint64_t) PHILOX_M1 * ctr[2][k];
+
+            ctr[0][k] = (uint32_t) (p1 >> 32) ^ ctr[1][k] ^ k0;
+            ctr[1][k] = (uint32_t) p1;
+            ctr[2][k] = (uint32_t) (p0 >> 32) ^ ctr[3][k] ^ k1;
+            ctr[3][k] = (uint32_t) p0;
+        };
+
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    };
+};
+
+#endif
@@ -0,0 +1,400 @@
+/*  trace.c */
+
+#include "trace.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HEADER_SIZE 32
+#define MAGIC_SIZE 8
+
+/*  Maximum size of a LEB128 encoded 64 bit integer, and of a record. */
+#define VARINT_MAX 10
+#define RECORD_MAX (4 * VARINT_MAX)
+
+/*  The reader asks for READAHEAD bytes ahead of it at a time, and lets the
+    kernel drop what it has passed by the same amount. */
+#define READAHEAD (4UL << 20)
+
+/*  Size of the writer's buffer of encoded records. */
+#define WRITE_BUFFER_SIZE (64UL << 10)
+
+/*  Trace reader structure. pos is the next byte to decode, and record_slot
+    the slot of the record decoded up to its input port, if any are left.
+    Bytes up to advised have been asked for, and those before dropped let
+    go. */
+struct trace_reader {
+    const uint8_t *data;
+    size_t size;
+    const uint8_t *pos;
+    const uint8_t *end;
+    size_t advised;
+    size_t dropped;
+    port_num_t num_ports;
+    unsigned long num_slots;
+    unsigned long records_left;
+    unsigned long slot;
+    unsigned long record_slot;
+    int malformed;
+};
+
+/*  Trace writer structure. Records are encoded into buffer, and written out
+    whenever it might not have room for the next slot. */
+struct trace_writer {
+    FILE *file;
+    port_num_t num_ports;
+    unsigned long num_slots;
+    unsigned long num_records;
+    unsigned long last_slot;
+    uint8_t *buffer;
+    size_t used;
+    size_t capacity;
+    int failed;
+};
+
+/*  Helper function declarations. */
+static void put_le(uint8_t *out, uint64_t value, int size);
+static uint64_t get_le(const uint8_t *in, int size);
+static int get_varint(trace_reader_t reader, uint64_t *value_out);
+static uint8_t *put_varint(uint8_t *out, uint64_t value);
+static void read_ahead(trace_reader_t reader);
+static void flush_buffer(trace_writer_t writer);
+
+/*  Open a trace, and decode the slot of its first record. */
+trace_reader_t trace_reader_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    };
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < HEADER_SIZE) {
+        close(fd);
+        return NULL;
+    };
+
+    size_t size = st.st_size;
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        return NULL;
+    };
+
+    const uint8_t *header = (const uint8_t *) data;
+    if (memcmp(header, TRACE_MAGIC, MAGIC_SIZE) != 0 ||
+        get_le(header + 8, 4) != TRACE_VERSION) {
+        munmap(data, size);
+        return NULL;
+    };
+
+    trace_reader_t reader =
+        (trace_reader_t) malloc(sizeof(struct trace_reader));
+    assert(reader);
+
+    reader->data = header;
+    reader->size = size;
+    reader->pos = header + HEADER_SIZE;
+    reader->end = header + size;
+    reader->advised = 0;
+    reader->dropped = 0;
+    reader->num_ports = (port_num_t) get_le(header + 12, 4);
+    reader->num_slots = get_le(header + 16, 8);
+    reader->records_left = get_le(header + 24, 8);
+    reader->slot = 0;
+    reader->record_slot = 0;
+    reader->malformed = 0;
+
+    madvise(data, size, MADV_SEQUENTIAL);
+    read_ahead(reader);
+
+    uint64_t delta;
+    if (reader->records_left > 0) {
+        if (get_varint(reader, &delta)) {
+            reader->record_slot = delta;
+        } else {
+            reader->malformed = 1;
+        };
+    };
+
+    return reader;
+};
+
+/*  Close a trace. */
+void trace_reader_close(trace_reader_t reader) {
+    assert(reader);
+
+    munmap((void *) reader->data, reader->size);
+    free(reader);
+};
+
+/*  Number of ports and of slots of a trace. */
+port_num_t trace_reader_num_ports(trace_reader_t reader) {
+    assert(reader);
+
+    return reader->num_ports;
+};
+
+unsigned long trace_reader_num_slots(trace_reader_t reader) {
+    assert(reader);
+
+    return reader->num_slots;
+};
+
+/*  Read the arrivals of the next slot. Records must name each input at
+    most once per slot, in increasing order, and lie within the trace's
+    slots and ports. */
+int trace_read(
+    trace_reader_t reader,
+    uint32_t *addrs_out,
+    uint32_t *lengths_out
+) {
+    assert(reader);
+    assert(addrs_out);
+    assert(lengths_out);
+
+    if (reader->malformed) {
+        return TRACE_MALFORMED;
+    };
+
+    if (reader->slot >= reader->num_slots) {
+        return TRACE_END;
+    };
+
+    memset(lengths_out, 0, reader->num_ports * sizeof(uint32_t));
+
+    if ((size_t) (reader->pos - reader->data) + READAHEAD / 2 >
+        reader->advised) {
+        read_ahead(reader);
+    };
+
+    int arrivals = 0;
+    uint64_t min_port = 0;
+
+    while (reader->records_left > 0 && reader->record_slot == reader->slot) {
+        uint64_t port, addr, length, delta;
+
+        if (!get_varint(reader, &port) || !get_varint(reader, &addr) ||
+            !get_varint(reader, &length) || port < min_port ||
+            port >= reader->num_ports || addr > UINT32_MAX || length == 0 ||
+            length > UINT32_MAX) {
+            reader->malformed = 1;
+            return TRACE_MALFORMED;
+        };
+
+        addrs_out[port] = (uint32_t) addr;
+        lengths_out[port] = (uint32_t) length;
+        min_port = port + 1;
+        arrivals++;
+
+        if (--reader->records_left > 0) {
+            if (!get_varint(reader, &delta) ||
+                delta >= reader->num_slots - reader->slot) {
+                reader->malformed = 1;
+                return TRACE_MALFORMED;
+            };
+
+            reader->record_slot += delta;
+        };
+    };
+
+    if (reader->records_left > 0 && reader->record_slot >= reader->num_slots) {
+        reader->malformed = 1;
+        return TRACE_MALFORMED;
+    };
+
+    reader->slot++;
+
+    return arrivals;
+};
+
+/*  Create a trace, leaving room for its header. */
+trace_writer_t trace_writer_create(const char *path, port_num_t num_ports) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return NULL;
+    };
+
+    trace_writer_t writer =
+        (trace_writer_t) malloc(sizeof(struct trace_writer));
+    assert(writer);
+
+    writer->file = file;
+    writer->num_ports = num_ports;
+    writer->num_slots = 0;
+    writer->num_records = 0;
+    writer->last_slot = 0;
+    writer->capacity = WRITE_BUFFER_SIZE + (size_t) num_ports * RECORD_MAX;
+    writer->buffer = (uint8_t *) malloc(writer->capacity);
+    assert(writer->buffer);
+    writer->used = HEADER_SIZE;
+    writer->failed = 0;
+
+    memset(writer->buffer, 0, HEADER_SIZE);
+
+    return writer;
+};
+
+/*  Append the arrivals of the next slot. */
+int trace_write(
+    trace_writer_t writer,
+    const uint32_t *addrs,
+    const uint32_t *lengths
+) {
+    assert(writer);
+    assert(addrs);
+    assert(lengths);
+
+    uint8_t *out = writer->buffer + writer->used;
+
+    port_num_t i;
+    for (i = 0; i < writer->num_ports; i++) {
+        if (lengths[i] == 0) {
+            continue;
+        };
+
+        out = put_varint(out, writer->num_slots - writer->last_slot);
+        out = put_varint(out, i);
+        out = put_varint(out, addrs[i]);
+        out = put_varint(out, lengths[i]);
+
+        writer->last_slot = writer->num_slots;
+        writer->num_records++;
+    };
+
+    writer->used = out - writer->buffer;
+    writer->num_slots++;
+
+    if (writer->used > WRITE_BUFFER_SIZE) {
+        flush_buffer(writer);
+    };
+
+    return !writer->failed;
+};
+
+/*  Write out the remaining records and the header, and close the trace. */
+int trace_writer_close(trace_writer_t writer) {
+    assert(writer);
+
+    flush_buffer(writer);
+
+    uint8_t header[HEADER_SIZE];
+    memcpy(header, TRACE_MAGIC, MAGIC_SIZE);
+    put_le(header + 8, TRACE_VERSION, 4);
+    put_le(header + 12, writer->num_ports, 4);
+    put_le(header + 16, writer->num_slots, 8);
+    put_le(header + 24, writer->num_records, 8);
+
+    if (fseek(writer->file, 0, SEEK_SET) != 0 ||
+        fwrite(header, HEADER_SIZE, 1, writer->file) != 1) {
+        writer->failed = 1;
+    };
+
+    if (fclose(writer->file) != 0) {
+        writer->failed = 1;
+    };
+
+    int ok = !writer->failed;
+
+    free(writer->buffer);
+    free(writer);
+
+    return ok;
+};
+
+/*  Helper functions. */
+
+/*  Little endian integers of size bytes. */
+static void put_le(uint8_t *out, uint64_t value, int size) {
+    int k;
+    for (k = 0; k < size; k++) {
+        out[k] = (uint8_t) (value >> (8 * k));
+    };
+};
+
+static uint64_t get_le(const uint8_t *in, int size) {
+    uint64_t value = 0;
+
+    int k;
+    for (k = 0; k < size; k++) {
+        value |= (uint64_t) in[k] << (8 * k);
+    };
+
+    return value;
+};
+
+/*  Decode an unsigned LEB128 integer - 7 bits per byte, low bits first,
+    with the top bit set on all but the last byte. Returns 0 if it runs past
+    the end of the trace or is too long. */
+static int get_varint(trace_reader_t reader, uint64_t *value_out) {
+    const uint8_t *pos = reader->pos;
+    uint64_t value = 0;
+
+    int k;
+    for (k = 0; k < VARINT_MAX && pos < reader->end; k++) {
+        uint8_t byte = *pos++;
+        value |= (uint64_t) (byte & 0x7f) << (7 * k);
+
+        if (!(byte & 0x80)) {
+            reader->pos = pos;
+            *value_out = value;
+            return 1;
+        };
+    };
+
+    return 0;
+};
+
+static uint8_t *put_varint(uint8_t *out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    };
+
+    *out++ = (uint8_t) value;
+
+    return out;
+};
+
+/*  Ask for the next READAHEAD bytes past those already asked for, and drop
+    the pages more than READAHEAD behind the reader. Offsets are rounded to
+    pages, as madvise requires. */
+static void read_ahead(trace_reader_t reader) {
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t offset = reader->pos - reader->data;
+
+    size_t start = reader->advised > offset ? reader->advised : offset;
+    start -= start % page;
+
+    if (start < reader->size) {
+        size_t length = reader->size - start < READAHEAD
+            ? reader->size - start
+            : READAHEAD;
+        madvise((void *) (reader->data + start), length, MADV_WILLNEED);
+        reader->advised = start + length;
+    };
+
+    if (offset > reader->dropped + READAHEAD + page) {
+        size_t behind = offset - READAHEAD;
+        behind -= behind % page;
+        madvise((void *) (reader->data + reader->dropped),
+            behind - reader->dropped, MADV_DONTNEED);
+        reader->dropped = behind;
+    };
+};
+
+/*  Write out the buffered records, keeping the header's room at the start
+    of the file on the first write. */
+static void flush_buffer(trace_writer_t writer) {
+    if (writer->used > 0 &&
+        fwrite(writer->buffer, 1, writer->used, writer->file) != writer->used) {
+        writer->failed = 1;
+    };
+
+    writer->used = 0;
+};
@@ -0,0 +1,67 @@
+/*  trace.h
+
+    Binary arrival traces - a record of the arrivals of every slot at every
+    input port, which can be replayed to reproduce a run exactly. A trace
+    holds at most one arrival per input per slot, each with the address it
+    is destined for and its length in bytes.
+
+    A trace file is a header followed by one record per arrival, in order of
+    slot and then of input port. The header is the magic TRACE_MAGIC, then
+    the format version, number of ports, number of slots and number of
+    records, as 32, 32, 64 and 64 bit little endian integers. Each record is
+    four unsigned LEB128 integers - the number of slots since the previous
+    record's slot (or since slot 0), the input port, the destination address
+    and the length - so a record usually takes 4 to 7 bytes.
+
+    The reader maps the file into memory and decodes it in order, asking the
+    kernel to read ahead of it and to drop what it has passed, so memory use
+    stays bounded however long the trace is. trace_read writes the arrivals
+    of the next slot to arrays with one entry per port, with a length of 0
+    for inputs with no arrival, and allocates nothing per arrival.
+
+    The writer is given the arrivals of each slot in the same form, and
+    fills in the header once it is closed. */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "./../network_switch/network_switch_common.h"
+#include <stdint.h>
+
+#define TRACE_MAGIC "SWTRACE\n"
+#define TRACE_VERSION 1
+
+/*  Returned by trace_read once every slot has been read, and for a record
+    which is truncated or out of order. */
+#define TRACE_END (-1)
+#define TRACE_MALFORMED (-2)
+
+struct trace_reader;
+typedef struct trace_reader *trace_reader_t;
+
+struct trace_writer;
+typedef struct trace_writer *trace_writer_t;
+
+/*  API functions. trace_reader_open returns NULL if the file cannot be
+    opened or is not a trace. trace_read returns the number of arrivals of
+    the next slot, or TRACE_END or TRACE_MALFORMED. trace_writer_create
+    returns NULL if the file cannot be created, and trace_write and
+    trace_writer_close return 0 if writing failed. */
+trace_reader_t trace_reader_open(const char *path);
+void trace_reader_close(trace_reader_t reader);
+port_num_t trace_reader_num_ports(trace_reader_t reader);
+unsigned long trace_reader_num_slots(trace_reader_t reader);
+int trace_read(
+    trace_reader_t reader,
+    uint32_t *addrs_out,
+    uint32_t *lengths_out
+);
+trace_writer_t trace_writer_create(const char *path, port_num_t num_ports);
+int trace_write(
+    trace_writer_t writer,
+    const uint32_t *addrs,
+    const uint32_t *lengths
+);
+int trace_writer_close(trace_writer_t writer);
+
+#endif
@@ -0,0 +1,964 @@
+/*  traffic.c */
+
+#include "traffic.h"
+#include "xoshiro.h"
+#include "philox.h"
+#include "./../data_structures/heap.h"
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+/*  Number of independent xoshiro256** streams the uniform pattern draws
+    from at once - a 256 bit vector of 64 bit lanes. */
+#define LANES 4
+
+#define DEFAULT_HOTSPOT_FRACTION 0.5
+#define DEFAULT_BURST_LENGTH 16.0
+
+/*  Next arrival slot of a source which never sends again, and the longest
+    gap drawn, which keeps the conversion of a drawn gap in range. */
+#define SLOT_NEVER ((unsigned long) -1)
+#define MAX_GAP 1e15
+
+/*  Bounds on the number of slots covered by the timing wheel, which is
+    sized to cover several mean gaps between arrivals, and the end of a
+    bucket's list of sources. */
+#define MIN_WHEEL_SLOTS 64
+#define MAX_WHEEL_SLOTS 65536
+#define WHEEL_GAPS 8
+#define SOURCE_NONE ((port_num_t) -1)
+
+/*  Lane vector - GCC vector extensions, which compile to SIMD instructions
+    where the target has them and to scalar code otherwise. The uniform
+    pattern is built for AVX2 as well as the baseline target, and the
+    version the CPU supports is picked at load time. Both give the same
+    arrivals. */
+typedef uint64_t lanes_t __attribute__((vector_size(LANES * sizeof(uint64_t))));
+
+/*  Source - the arrival process of one input when sampling gaps. next_slot
+    is the slot of its next arrival, clock the time of its next Poisson
+    arrival, and burst_left the arrivals left in its current burst, with a
+    new burst starting when it is 0. next links the sources due in the same
+    slot of the timing wheel. */
+struct source {
+    unsigned long next_slot;
+    double clock;
+    unsigned long burst_left;
+    port_num_t burst_dest;
+    port_num_t input;
+    port_num_t next;
+};
+
+/*  Draws - where the random numbers for one input come from. Under
+    xoshiro256** every input draws from the generator's one stream in turn.
+    Under Philox the draws of an input in a slot come from the counters
+    (input, low and high words of slot, block), each block giving two
+    draws. */
+struct draws {
+    xoshiro256_t *rng;
+    const uint32_t *key;
+    uint32_t ctr[4];
+    uint32_t block[4];
+    int left;
+};
+
+/*  Traffic structure. Probabilities are held as thresholds on 32 bit random
+    numbers, so a Bernoulli trial is one compare. lanes holds the state of
+    the uniform pattern's streams, one xoshiro256** state word per vector,
+    and key the Philox key, the seed.
+    When sampling gaps, sources holds the state of every input. Sources
+    due within the wheel's span of slots wait in the bucket of their slot,
+    a list through the sources headed in wheel, and those due later in the
+    overflow heap until they come within it. due marks the inputs with an
+    arrival in the current slot. Geometric gaps are drawn with the inverse
+    logs of the probabilities of failure of the trials they replace. inputs
+    and dests hold the arrivals of a slot on their way between sparse and
+    dense form. */
+struct traffic {
+    port_num_t num_ports;
+    traffic_config_t config;
+    unsigned long slot;
+    xoshiro256_t rng;
+    lanes_t lanes[4];
+    uint32_t key[2];
+
+    uint64_t arrival_threshold;
+    uint64_t hotspot_threshold;
+    uint64_t burst_end_threshold;
+    uint64_t idle_end_threshold;
+
+    char *bursting;
+    port_num_t *burst_dest;
+
+    struct source *sources;
+    port_num_t *wheel;
+    unsigned long wheel_slots;
+    heap_t overflow;
+    uint64_t *due;
+    double arrival_inv_log;
+    double burst_end_inv_log;
+    double idle_end_inv_log;
+
+    port_num_t *inputs;
+    port_num_t *dests;
+};
+
+/*  Forward declare helper functions. */
+static uint64_t probability_threshold(double probability);
+static inline void draws_init(
+    traffic_t traffic,
+    struct draws *draws,
+    port_num_t input,
+    unsigned long slot
+);
+static inline uint64_t draws_next(struct draws *draws);
+static inline int trial(struct draws *draws, uint64_t threshold);
+static inline uint32_t draw_below(struct draws *draws, uint32_t n);
+static inline void lanes_next(lanes_t *s, lanes_t *out);
+static port_num_t generate_range(
+    traffic_t traffic,
+    unsigned long slot,
+    port_num_t first,
+    port_num_t count,
+    port_num_t *dest_out
+);
+static port_num_t generate_uniform(traffic_t traffic, port_num_t *dest_out);
+static port_num_t generate_uniform_philox(
+    traffic_t traffic,
+    unsigned long slot,
+    port_num_t first,
+    port_num_t count,
+    port_num_t *dest_out
+);
+static port_num_t generate_scalar(
+    traffic_t traffic,
+    unsigned long slot,
+    port_num_t first,
+    port_num_t count,
+    port_num_t *dest_out
+);
+static port_num_t generate_bursty(
+    traffic_t traffic,
+    unsigned long slot,
+    port_num_t first,
+    port_num_t count,
+    port_num_t *dest_out
+);
+static port_num_t draw_destination(
+    traffic_t traffic,
+    struct draws *draws,
+    port_num_t input
+);
+static double inv_log_failure(double probability);
+static unsigned long draw_gap(struct draws *draws, double inv_log);
+static void source_schedule(
+    traffic_t traffic,
+    struct source *source,
+    struct draws *draws
+);
+static void source_wait(traffic_t traffic, struct source *source);
+static port_num_t generate_gaps(
+    traffic_t traffic,
+    port_num_t *inputs_out,
+    port_num_t *dests_out
+);
+static comparison_t source_compare(void *lhs, void *rhs);
+static void source_free(void *source);
+
+/*  API implementation. */
+
+/*  Default configuration of a pattern - per-slot trials, xoshiro256**
+    seeded with 1, half of all hotspot traffic to output 0, and bursts of
+    16 slots on average. */
+traffic_config_t traffic_default_config(traffic_pattern_t pattern, double load) {
+    traffic_config_t config;
+    config.pattern = pattern;
+    config.arrivals = TRAFFIC_ARRIVALS_TRIALS;
+    config.rng = TRAFFIC_RNG_XOSHIRO;
+    config.load = load;
+    config.seed = 1;
+    config.hotspot_port = 0;
+    config.hotspot_fraction = DEFAULT_HOTSPOT_FRACTION;
+    config.burst_length = DEFAULT_BURST_LENGTH;
+
+    return config;
+};
+
+/*  Look up a pattern by name - uniform, hotspot, diagonal, logdiagonal or
+    bursty. Returns 0 for an unknown name. */
+int traffic_pattern_from_name(const char *name, traffic_pattern_t *pattern_out) {
+    if (strcmp(name, "uniform") == 0) {
+        *pattern_out = TRAFFIC_UNIFORM;
+    } else if (strcmp(name, "hotspot") == 0) {
+        *pattern_out = TRAFFIC_HOTSPOT;
+    } else if (strcmp(name, "diagonal") == 0) {
+        *pattern_out = TRAFFIC_DIAGONAL;
+    } else if (strcmp(name, "logdiagonal") == 0) {
+        *pattern_out = TRAFFIC_LOG_DIAGONAL;
+    } else if (strcmp(name, "bursty") == 0) {
+        *pattern_out = TRAFFIC_BURSTY;
+    } else {
+        return 0;
+    };
+
+    return 1;
+};
+
+/*  Look up an arrival process by name - trials, geometric or poisson.
+    Returns 0 for an unknown name. */
+int traffic_arrivals_from_name(
+    const char *name,
+    traffic_arrivals_t *arrivals_out
+) {
+    if (strcmp(name, "trials") == 0) {
+        *arrivals_out = TRAFFIC_ARRIVALS_TRIALS;
+    } else if (strcmp(name, "geometric") == 0) {
+        *arrivals_out = TRAFFIC_ARRIVALS_GEOMETRIC;
+    } else if (strcmp(name, "poisson") == 0) {
+        *arrivals_out = TRAFFIC_ARRIVALS_POISSON;
+    } else {
+        return 0;
+    };
+
+    return 1;
+};
+
+/*  Look up a random number generator by name - xoshiro or philox. Returns
+    0 for an unknown name. */
+int traffic_rng_from_name(const char *name, traffic_rng_t *rng_out) {
+    if (strcmp(name, "xoshiro") == 0) {
+        *rng_out = TRAFFIC_RNG_XOSHIRO;
+    } else if (strcmp(name, "philox") == 0) {
+        *rng_out = TRAFFIC_RNG_PHILOX;
+    } else {
+        return 0;
+    };
+
+    return 1;
+};
+
+/*  Create traffic generator. The streams of the uniform pattern are the
+    seeded stream jumped ahead 1 to LANES times. */
+traffic_t traffic_create(port_num_t num_ports, traffic_config_t config) {
+    assert(num_ports > 0);
+    assert(config.load >= 0 && config.load <= 1);
+    assert(config.pattern != TRAFFIC_HOTSPOT || config.hotspot_port < num_ports);
+    assert(config.pattern != TRAFFIC_BURSTY || config.burst_length >= 1);
+
+    traffic_t traffic = (traffic_t) aligned_alloc(
+        sizeof(lanes_t),
+        (sizeof(struct traffic) + sizeof(lanes_t) - 1) & ~(sizeof(lanes_t) - 1)
+    );
+    assert(traffic);
+
+    traffic->num_ports = num_ports;
+    traffic->config = config;
+    traffic->slot = 0;
+    xoshiro256_seed(&traffic->rng, config.seed);
+
+    xoshiro256_t stream = traffic->rng;
+    int k;
+    for (k = 0; k < LANES; k++) {
+        xoshiro256_jump(&stream);
+
+        int w;
+        for (w = 0; w < 4; w++) {
+            traffic->lanes[w][k] = stream.s[w];
+        };
+    };
+
+    traffic->key[0] = (uint32_t) config.seed;
+    traffic->key[1] = (uint32_t) ((uint64_t) config.seed >> 32);
+
+    traffic->arrival_threshold = probability_threshold(config.load);
+    traffic->hotspot_threshold = probability_threshold(config.hotspot_fraction);
+
+    traffic->arrival_inv_log = inv_log_failure(config.load);
+
+    traffic->bursting = NULL;
+    traffic->burst_dest = NULL;
+
+    if (config.pattern == TRAFFIC_BURSTY) {
+        /*  Ends of bursts and idle periods are Bernoulli trials each slot,
+            so their lengths are geometric, with means the inverse of the
+            probabilities. An idle period lasts at least a slot, so under
+            loads where the idle periods for burst_length would be shorter,
+            bursts are lengthened instead. */
+        double burst_length = config.burst_length;
+        double idle_length = 0;
+
+        if (config.load > 0 && config.load < 1) {
+            idle_length = burst_length * (1 - config.load) / config.load;
+
+            if (idle_length < 1) {
+                idle_length = 1;
+                burst_length = config.load / (1 - config.load);
+            };
+        };
+
+        double burst_end = config.load < 1 ? 1 / burst_length : 0;
+        double idle_end = config.load > 0
+            ? (idle_length > 0 ? 1 / idle_length : 1)
+            : 0;
+
+        traffic->burst_end_threshold = probability_threshold(burst_end);
+        traffic->idle_end_threshold = probability_threshold(idle_end);
+        traffic->burst_end_inv_log = inv_log_failure(burst_end);
+        traffic->idle_end_inv_log = inv_log_failure(idle_end);
+
+        traffic->bursting = (char *) calloc(num_ports, sizeof(char));
+        assert(traffic->bursting);
+
+        traffic->burst_dest = (port_num_t *) calloc(num_ports, sizeof(port_num_t));
+        assert(traffic->burst_dest);
+    };
+
+    traffic->inputs = (port_num_t *) malloc(num_ports * sizeof(port_num_t));
+    assert(traffic->inputs);
+
+    traffic->dests = (port_num_t *) malloc(num_ports * sizeof(port_num_t));
+    assert(traffic->dests);
+
+    traffic->sources = NULL;
+    traffic->wheel = NULL;
+    traffic->overflow = NULL;
+    traffic->due = NULL;
+
+    if (config.arrivals != TRAFFIC_ARRIVALS_TRIALS) {
+        traffic->sources =
+            (struct source *) malloc(num_ports * sizeof(struct source));
+        assert(traffic->sources);
+
+        traffic->wheel_slots = MIN_WHEEL_SLOTS;
+        while (traffic->wheel_slots < MAX_WHEEL_SLOTS &&
+            traffic->wheel_slots * config.load < WHEEL_GAPS) {
+            traffic->wheel_slots *= 2;
+        };
+
+        traffic->wheel =
+            (port_num_t *) malloc(traffic->wheel_slots * sizeof(port_num_t));
+        assert(traffic->wheel);
+
+        unsigned long w;
+        for (w = 0; w < traffic->wheel_slots; w++) {
+            traffic->wheel[w] = SOURCE_NONE;
+        };
+
+        traffic->overflow = heap_create(source_compare, source_free);
+
+        traffic->due = (uint64_t *) calloc((num_ports + 63) / 64, sizeof(uint64_t));
+        assert(traffic->due);
+
+        /*  Schedule the first arrival of every source, as if its previous
+            one was in the slot before the first. */
+        port_num_t i;
+        for (i = 0; i < num_ports; i++) {
+            struct source *source = &traffic->sources[i];
+            struct draws draws;
+            draws_init(traffic, &draws, i, SLOT_NEVER);
+
+            source->next_slot = SLOT_NEVER;
+            source->clock = 0;
+            source->burst_left = 0;
+            source->burst_dest = 0;
+            source->input = i;
+            source->next = SOURCE_NONE;
+
+            source_schedule(traffic, source, &draws);
+        };
+    };
+
+    return traffic;
+};
+
+void traffic_free(traffic_t traffic) {
+    assert(traffic);
+
+    if (traffic->overflow) {
+        heap_free(traffic->overflow);
+    };
+
+    free(traffic->sources);
+    free(traffic->wheel);
+    free(traffic->due);
+    free(traffic->inputs);
+    free(traffic->dests);
+    free(traffic->bursting);
+    free(traffic->burst_dest);
+    free(traffic);
+};
+
+/*  Generate the arrivals of one slot. With sampled gaps, only the inputs
+    with an arrival are visited after clearing the vector. */
+port_num_t traffic_generate(traffic_t traffic, port_num_t *dest_out) {
+    assert(traffic);
+    assert(dest_out);
+
+    port_num_t arrivals;
+
+    if (traffic->config.arrivals != TRAFFIC_ARRIVALS_TRIALS) {
+        arrivals = generate_gaps(traffic, traffic->inputs, traffic->dests);
+
+        port_num_t i;
+        for (i = 0; i < traffic->num_ports; i++) {
+            dest_out[i] = TRAFFIC_NO_ARRIVAL;
+        };
+
+        for (i = 0; i < arrivals; i++) {
+            dest_out[traffic->inputs[i]] = traffic->dests[i];
+        };
+    } else if (traffic->config.rng == TRAFFIC_RNG_XOSHIRO &&
+        traffic->config.pattern == TRAFFIC_UNIFORM) {
+        arrivals = generate_uniform(traffic, dest_out);
+    } else {
+        arrivals = generate_range(
+            traffic,
+            traffic->slot,
+            0,
+            traffic->num_ports,
+            dest_out
+        );
+    };
+
+    traffic->slot++;
+
+    return arrivals;
+};
+
+/*  Generate the arrivals of one slot at a range of inputs. Under Philox with
+    per-slot trials, the arrivals at an input depend only on the seed, the
+    input, the slot and, for bursty traffic, the input's previous slots, so
+    threads may each take a range of inputs. */
+port_num_t traffic_generate_ports(
+    traffic_t traffic,
+    unsigned long slot,
+    port_num_t first,
+    port_num_t count,
+    port_num_t *dest_out
+) {
+    assert(traffic);
+    assert(dest_out);
+    assert(traffic->config.rng == TRAFFIC_RNG_PHILOX);
+    assert(traffic->config.arrivals == TRAFFIC_ARRIVALS_TRIALS);
+    assert(first + count <= traffic->num_ports);
+
+    return generate_range(traffic, slot, first, count, dest_out);
+};
+
+/*  Generate the arrivals of one slot as a list, in order of input. With
+    per-slot trials, the vector is generated and then compacted. */
+port_num_t traffic_generate_sparse(
+    traffic_t traffic,
+    port_num_t *inputs_out,
+    port_num_t *dests_out
+) {
+    assert(traffic);
+    assert(inputs_out);
+    assert(dests_out);
+
+    if (traffic->config.arrivals != TRAFFIC_ARRIVALS_TRIALS) {
+        port_num_t arrivals = generate_gaps(traffic, inputs_out, dests_out);
+        traffic->slot++;
+
+        return arrivals;
+    };
+
+    traffic_generate(traffic, traffic->dests);
+
+    port_num_t arrivals = 0;
+    port_num_t i;
+    for (i = 0; i < traffic->num_ports; i++) {
+        if (traffic->dests[i] != TRAFFIC_NO_ARRIVAL) {
+            inputs_out[arrivals] = i;
+            dests_out[arrivals] = traffic->dests[i];
+            arrivals++;
+        };
+    };
+
+    return arrivals;
+};
+
+/*  Helper function implementations. */
+
+/*  Threshold below which a 32 bit uniform random number falls with the
+    given probability. */
+static uint64_t probability_threshold(double probability) {
+    if (probability <= 0) {
+        return 0;
+    } else if (probability >= 1) {
+        return (uint64_t) 1 << 32;
+    };
+
+    return (uint64_t) (probability * 4294967296.0);
+};
+
+/*  Start the draws of input in slot. */
+static inline void draws_init(
+    traffic_t traffic,
+    struct draws *draws,
+    port_num_t input,
+    unsigned long slot
+) {
+    draws->rng = traffic->config.rng == TRAFFIC_RNG_XOSHIRO
+        ? &traffic->rng
+        : NULL;
+    draws->key = traffic->key;
+    draws->ctr[0] = input;
+    draws->ctr[1] = (uint32_t) slot;
+    draws->ctr[2] = (uint32_t) ((uint64_t) slot >> 32);
+    draws->ctr[3] = 0;
+    draws->left = 0;
+};
+
+/*  Next 64 bit draw - under Philox words 0 and 1 of a block, then words 2
+    and 3, as the low and high halves. */
+static inline uint64_t draws_next(struct draws *draws) {
+    if (draws->rng) {
+        return xoshiro256_next(draws->rng);
+    };
+
+    if (draws->left == 0) {
+        philox4x32(draws->ctr, draws->key, draws->block);
+        draws->ctr[3]++;
+        draws->left = 4;
+    };
+
+    int word = 4 - draws->left;
+    draws->left -= 2;
+
+    return ((uint64_t) draws->block[word + 1] << 32) | draws->block[word];
+};
+
+/*  Bernoulli trial with a probability given as a threshold. */
+static inline int trial(struct draws *draws, uint64_t threshold) {
+    return (draws_next(draws) >> 32) < threshold;
+};
+
+/*  Uniform integer in [0, n), by multiply and shift of the top 32 bits. */
+static inline uint32_t draw_below(struct draws *draws, uint32_t n) {
+    return (uint32_t) (((draws_next(draws) >> 32) * n) >> 32);
+};
+
+/*  Advance every stream of a lane vector state, and write the next output
+    of each to out. Vectors are passed through pointers, as their by value
+    ABI depends on the target's vector extensions. */
+static inline void lanes_next(lanes_t *s, lanes_t *out) {
+    lanes_t x = s[1] * 5;
+    lanes_t result = ((x << 7) | (x >> 57)) * 9;
+    lanes_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+
+    *out = result;
+};
+
+/*  Generate the arrivals at count inputs from first in slot, by pattern. */
+static port_num_t generate_range(
+    traffic_t traffic,
+    unsigned long slot,
+    port_num_t first,
+    port_num_t count,
+    port_num_t *dest_out
+) {
+    switch (traffic->config.pattern) {
+        case TRAFFIC_UNIFORM:
+            return generate_uniform_philox(traffic, slot, first, count, dest_out);
+        case TRAFFIC_BURSTY:
+            return generate_bursty(traffic, slot, first, count, dest_out);
+        default:
+            return generate_scalar(traffic, slot, first, count, dest_out);
+    };
+};
+
+/*  Uniform - the low 32 bits of each draw decide the arrival and the high
+    32 bits pick the destination by multiply and shift, so a whole vector of
+    inputs is decided without branches. The stream state stays in registers
+    for the whole slot. */
+__attribute__((target_clones("avx2", "default")))
+static port_num_t generate_uniform(traffic_t traffic, port_num_t *dest_out) {
+    port_num_t num_ports = traffic->num_ports;
+    lanes_t zero = {0};
+    lanes_t threshold = zero + traffic->arrival_threshold;
+    lanes_t low_mask = zero + 0xffffffffULL;
+    lanes_t no_arrival = zero + TRAFFIC_NO_ARRIVAL;
+
+    lanes_t s[4];
+    memcpy(s, traffic->lanes, sizeof(s));
+
+    lanes_t arrivals = zero;
+    port_num_t base;
+    for (base = 0; base < num_ports; base += LANES) {
+        lanes_t r;
+        lanes_next(s, &r);
+        lanes_t dest = ((r >> 32) * num_ports) >> 32;
+
+        /*  Both sides of the compare are below 2^33, so the sign of their
+            difference decides it. arrive is 1 in lanes with an arrival,
+            and 0 elsewhere. */
+        lanes_t arrive = ((r & low_mask) - threshold) >> 63;
+        dest = (dest & -arrive) | (no_arrival & (arrive - 1));
+
+        if (num_ports - base >= LANES) {
+            int k;
+            for (k = 0; k < LANES; k++) {
+                dest_out[base + k] = (port_num_t) dest[k];
+            };
+            arrivals += arrive;
+        } else {
+            port_num_t k;
+            for (k = 0; k < num_ports - base; k++) {
+                dest_out[base + k] = (port_num_t) dest[k];
+                arrivals[k] += arrive[k];
+            };
+        };
+    };
+
+    memcpy(traffic->lanes, s, sizeof(s));
+
+    port_num_t total = 0;
+    int k;
+    for (k = 0; k < LANES; k++) {
+        total += arrivals[k];
+    };
+
+    return total;
+};
+
+/*  Uniform under Philox - the Philox blocks of PHILOX_BATCH inputs are drawn
+    at once, and each decided as by a trial and a draw for the destination,
+    from words 1 and 3 of its block. */
+__attribute__((target_clones("avx2", "default")))
+static port_num_t generate_uniform_philox(
+    traffic_t traffic,
+    unsigned long slot,
+    port_num_t first,
+    port_num_t count,
+    port_num_t *dest_out
+) {
+    uint64_t num_ports = traffic->num_ports;
+    uint64_t threshold = traffic->arrival_threshold;
+
+    port_num_t arrivals = 0;
+    port_num_t base;
+    for (base = 0; base < count; base += PHILOX_BATCH) {
+        uint32_t ctr[4][PHILOX_BATCH];
+        port_num_t dest[PHILOX_BATCH];
+
+        int k;
+        for (k = 0; k < PHILOX_BATCH; k++) {
+            ctr[0][k] = first + base + k;
+            ctr[1][k] = (uint32_t) slot;
+            ctr[2][k] = (uint32_t) ((uint64_t) slot >> 32);
+            ctr[3][k] = 0;
+        };
+
+        philox4x32_batch(ctr, traffic->key);
+
+        /*  As in generate_uniform, arrive is 1 in lanes with an arrival,
+            and 0 elsewhere. */
+        for (k = 0; k < PHILOX_BATCH; k++) {
+            uint64_t arrive = ((uint64_t) ctr[1][k] - threshold) >> 63;
+            uint64_t to = ((uint64_t) ctr[3][k] * num_ports) >> 32;
+
+            dest[k] = (port_num_t) ((to & -arrive)
+                | ((uint64_t) TRAFFIC_NO_ARRIVAL & (arrive - 1)));
+        };
+
+        int left = count - base < PHILOX_BATCH
+            ? (int) (count - base)
+            : PHILOX_BATCH;
+        for (k = 0; k < left; k++) {
+            dest_out[base + k] = dest[k];
+            arrivals += dest[k] != TRAFFIC_NO_ARRIVAL;
+        };
+    };
+
+    return arrivals;
+};
+
+/*  Draw the destination of an arrival at input under the hotspot, diagonal,
+    log-diagonal or uniform pattern. */
+static port_num_t draw_destination(
+    traffic_t traffic,
+    struct draws *draws,
+    port_num_t input
+) {
+    port_num_t num_ports = traffic->num_ports;
+    port_num_t offset;
+
+    switch (traffic->config.pattern) {
+        case TRAFFIC_HOTSPOT:
+            if (trial(draws, traffic->hotspot_threshold)) {
+                return traffic->config.hotspot_port;
+            };
+            return draw_below(draws, num_ports);
+
+        case TRAFFIC_DIAGONAL:
+            offset = draw_below(draws, 3) == 2;
+            return (input + offset) % num_ports;
+
+        case TRAFFIC_LOG_DIAGONAL:
+            /*  The number of trailing zeros of a random word is j with
+                probability 2^-(j + 1). Offsets past the last port are
+                redrawn, which keeps the weights of the rest in
+                proportion. */
+            do {
+                uint64_t r = draws_next(draws);
+                offset = r ? __builtin_ctzll(r) : 64;
+            } while (offset >= num_ports);
+
+            return (input + offset) % num_ports;
+
+        default:
+            return draw_below(draws, num_ports);
+    };
+};
+
+/*  Hotspot, diagonal and log-diagonal - one trial per input for the arrival,
+    then a draw for its destination. */
+static port_num_t generate_scalar(
+    traffic_t traffic,
+    unsigned long slot,
+    port_num_t first,
+    port_num_t count,
+    port_num_t *dest_out
+) {
+    port_num_t arrivals = 0;
+    port_num_t k;
+    for (k = 0; k < count; k++) {
+        struct draws draws;
+        draws_init(traffic, &draws, first + k, slot);
+
+        dest_out[k] = TRAFFIC_NO_ARRIVAL;
+
+        if (trial(&draws, traffic->arrival_threshold)) {
+            dest_out[k] = draw_destination(traffic, &draws, first + k);
+            arrivals++;
+        };
+    };
+
+    return arrivals;
+};
+
+/*  Markov modulated on/off - each input first moves between bursting and
+    idling, then sends to its burst's output if bursting. */
+static port_num_t generate_bursty(
+    traffic_t traffic,
+    unsigned long slot,
+    port_num_t first,
+    port_num_t count,
+    port_num_t *dest_out
+) {
+    port_num_t arrivals = 0;
+    port_num_t k;
+    for (k = 0; k < count; k++) {
+        port_num_t i = first + k;
+        struct draws draws;
+        draws_init(traffic, &draws, i, slot);
+
+        if (traffic->bursting[i]) {
+            if (trial(&draws, traffic->burst_end_threshold)) {
+                traffic->bursting[i] = 0;
+            };
+        } else if (trial(&draws, traffic->idle_end_threshold)) {
+            traffic->bursting[i] = 1;
+            traffic->burst_dest[i] = draw_below(&draws, traffic->num_ports);
+        };
+
+        if (traffic->bursting[i]) {
+            dest_out[k] = traffic->burst_dest[i];
+            arrivals++;
+        } else {
+            dest_out[k] = TRAFFIC_NO_ARRIVAL;
+        };
+    };
+
+    return arrivals;
+};
+
+/*  Inverse log of the probability of failure of a Bernoulli trial, which
+    turns the log of a uniform random number into a geometric gap. It is 0
+    for certain success, and never used for certain failure. */
+static double inv_log_failure(double probability) {
+    if (probability <= 0 || probability >= 1) {
+        return 0;
+    };
+
+    return 1 / log(1 - probability);
+};
+
+/*  Draw the number of trials up to and including the first success, which
+    is at least 1, by inversion. */
+static unsigned long draw_gap(struct draws *draws, double inv_log) {
+    double u = (draws_next(draws) >> 11) * 0x1.0p-53;
+    double gap = log(1 - u) * inv_log;
+
+    return 1 + (unsigned long) (gap < MAX_GAP ? gap : MAX_GAP);
+};
+
+/*  Set the slot of the next arrival of a source, with next_slot holding the
+    slot of its last arrival, or SLOT_NEVER before the first. Sources which
+    never send again are not rescheduled.
+
+    Bernoulli arrivals with probability load are a geometric number of slots
+    apart. Poisson arrivals are exponentially distributed times apart, at
+    rate load - each arrives in the slot of its time, or in the slot after
+    the last arrival if that is later, as an input takes at most one per
+    slot. Bursty sources send in every slot of a burst, and their idle
+    periods have geometric lengths. */
+static void source_schedule(
+    traffic_t traffic,
+    struct source *source,
+    struct draws *draws
+) {
+    traffic_config_t *config = &traffic->config;
+
+    /*  The slot after the last arrival, wrapping round to 0 before the
+        first. */
+    unsigned long earliest = source->next_slot + 1;
+
+    if (config->load <= 0) {
+        return;
+    };
+
+    if (config->pattern == TRAFFIC_BURSTY) {
+        /*  Sources start idle, with the first chance of a burst in the
+            first slot, while a burst is followed by at least a slot of
+            idling. */
+        if (source->burst_left > 0) {
+            source->next_slot = earliest;
+        } else {
+            source->next_slot = earliest - (source->next_slot == SLOT_NEVER)
+                + draw_gap(draws, traffic->idle_end_inv_log);
+        };
+    } else if (config->arrivals == TRAFFIC_ARRIVALS_POISSON) {
+        double u = (draws_next(draws) >> 11) * 0x1.0p-53;
+        source->clock -= log(1 - u) / config->load;
+
+        unsigned long slot = source->clock < MAX_GAP
+            ? (unsigned long) source->clock
+            : (unsigned long) MAX_GAP;
+        source->next_slot = slot > earliest ? slot : earliest;
+    } else {
+        source->next_slot =
+            earliest - 1 + draw_gap(draws, traffic->arrival_inv_log);
+    };
+
+    source_wait(traffic, source);
+};
+
+/*  Put a source in the bucket of its next arrival's slot, if the wheel
+    spans it, and otherwise in the overflow heap. The wheel spans the
+    current slot and those up to one less than its size after it. */
+static void source_wait(traffic_t traffic, struct source *source) {
+    if (source->next_slot - traffic->slot >= traffic->wheel_slots) {
+        heap_insert(traffic->overflow, source);
+        return;
+    };
+
+    port_num_t *bucket =
+        &traffic->wheel[source->next_slot & (traffic->wheel_slots - 1)];
+    source->next = *bucket;
+    *bucket = source->input;
+};
+
+/*  Generate the arrivals of the current slot from the sources due in it,
+    scheduling the next arrival of each. Sources in the overflow heap which
+    the wheel now spans are moved into it first. The sources due are then
+    visited in order of input, so the arrivals are listed in that order and
+    the random draws do not depend on the order of the bucket. */
+static port_num_t generate_gaps(
+    traffic_t traffic,
+    port_num_t *inputs_out,
+    port_num_t *dests_out
+) {
+    heap_t overflow = traffic->overflow;
+    struct source *sources = traffic->sources;
+
+    while (heap_size(overflow) > 0) {
+        struct source *source = (struct source *) heap_min(overflow);
+
+        if (source->next_slot - traffic->slot >= traffic->wheel_slots) {
+            break;
+        };
+
+        heap_pop_min(overflow);
+        source_wait(traffic, source);
+    };
+
+    port_num_t *bucket =
+        &traffic->wheel[traffic->slot & (traffic->wheel_slots - 1)];
+    port_num_t input = *bucket;
+    *bucket = SOURCE_NONE;
+
+    while (input != SOURCE_NONE) {
+        traffic->due[input / 64] |= (uint64_t) 1 << (input % 64);
+        input = sources[input].next;
+    };
+
+    port_num_t arrivals = 0;
+    port_num_t word;
+    for (word = 0; word < (traffic->num_ports + 63) / 64; word++) {
+        uint64_t bits = traffic->due[word];
+        traffic->due[word] = 0;
+
+        while (bits) {
+            struct source *source = &sources[word * 64 + __builtin_ctzll(bits)];
+            bits &= bits - 1;
+
+            struct draws draws;
+            draws_init(traffic, &draws, source->input, traffic->slot);
+
+            port_num_t dest;
+            if (traffic->config.pattern == TRAFFIC_BURSTY) {
+                /*  A burst's length is drawn as it starts, and is unbounded
+                    under full load. */
+                if (source->burst_left == 0) {
+                    source->burst_dest = draw_below(&draws, traffic->num_ports);
+                    source->burst_left = traffic->config.load < 1
+                        ? draw_gap(&draws, traffic->burst_end_inv_log)
+                        : SLOT_NEVER;
+                };
+
+                dest = source->burst_dest;
+                source->burst_left--;
+            } else {
+                dest = draw_destination(traffic, &draws, source->input);
+            };
+
+            inputs_out[arrivals] = source->input;
+            dests_out[arrivals] = dest;
+            arrivals++;
+
+            source_schedule(traffic, source, &draws);
+        };
+    };
+
+    return arrivals;
+};
+
+/*  Order sources by the slot of their next arrival, then by input. */
+static comparison_t source_compare(void *lhs, void *rhs) {
+    struct source *source_lhs = (struct source *) lhs;
+    struct source *source_rhs = (struct source *) rhs;
+
+    if (source_lhs->next_slot != source_rhs->next_slot) {
+        return source_lhs->next_slot < source_rhs->next_slot ? LT : GT;
+    } else if (source_lhs->input != source_rhs->input) {
+        return source_lhs->input < source_rhs->input ? LT : GT;
+    };
+
+    return EQ;
+};
+
+/*  Sources belong to the traffic generator, not its overflow heap. */
+static void source_free(void *source) {
+    (void) source;
+};
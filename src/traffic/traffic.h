@@ -0,0 +1,130 @@
+/*  traffic.h
+
+    Traffic generator - produces the arrivals of one time slot at every input
+    port of a switch at once, as a vector of destination output ports. Every
+    pattern offers load packets per slot at each input, on average:
+
+        TRAFFIC_UNIFORM       Bernoulli arrivals, destinations uniform
+        TRAFFIC_HOTSPOT       Bernoulli arrivals, a fraction hotspot_fraction
+                              of them to output hotspot_port and the rest
+                              uniform
+        TRAFFIC_DIAGONAL      Bernoulli arrivals, from input i to output i
+                              with probability 2/3 and to i + 1 with 1/3
+        TRAFFIC_LOG_DIAGONAL  Bernoulli arrivals, from input i to output
+                              i + j with probability proportional to 2^-j
+        TRAFFIC_BURSTY        Markov modulated on/off - each input alternates
+                              between bursts, which send a packet every slot
+                              to one uniformly chosen output, and idle
+                              periods, with geometric lengths of mean
+                              burst_length and burst_length (1 - load) / load
+                              (at least 1, with longer bursts under high
+                              loads)
+
+    Output ports wrap modulo the number of ports. Random draws come from
+    xoshiro256**, and the uniform pattern draws for several inputs at a time
+    from independent streams, in a form the compiler vectorises.
+
+    Arrivals are decided by a trial at every input in every slot by default
+    (TRAFFIC_ARRIVALS_TRIALS). Under low loads almost every trial fails, so
+    instead each input can draw the gap to its next arrival - geometric for
+    the same Bernoulli arrivals (TRAFFIC_ARRIVALS_GEOMETRIC), or exponential
+    for Poisson arrivals at rate load (TRAFFIC_ARRIVALS_POISSON, with those
+    arriving at a busy input deferred to its next free slot). Inputs then
+    wait on a timing wheel until their next arrival, or in a heap if it is
+    beyond the wheel, so the cost of a slot is proportional to its arrivals
+    rather than to the number of ports. Bursty traffic draws the lengths of
+    its idle periods either way.
+
+    Random numbers come from one xoshiro256** stream by default
+    (TRAFFIC_RNG_XOSHIRO), so each slot's arrivals depend on all those
+    before it. Under TRAFFIC_RNG_PHILOX they come from the Philox4x32-10
+    counter based generator instead (philox.h), keyed by the seed, with the
+    input and slot as the counter. With per-slot trials, the arrivals of a
+    slot can then be generated for any range of inputs, from any thread,
+    and come out the same however the inputs are split. The uniform pattern
+    draws for several inputs at a time there too. */
+
+#ifndef TRAFFIC_H
+#define TRAFFIC_H
+
+#include "./../network_switch/network_switch_common.h"
+
+/*  Destination of an input with no arrival. */
+#define TRAFFIC_NO_ARRIVAL ((port_num_t) -1)
+
+enum traffic_pattern {
+    TRAFFIC_UNIFORM,
+    TRAFFIC_HOTSPOT,
+    TRAFFIC_DIAGONAL,
+    TRAFFIC_LOG_DIAGONAL,
+    TRAFFIC_BURSTY
+};
+
+typedef enum traffic_pattern traffic_pattern_t;
+
+enum traffic_arrivals {
+    TRAFFIC_ARRIVALS_TRIALS,
+    TRAFFIC_ARRIVALS_GEOMETRIC,
+    TRAFFIC_ARRIVALS_POISSON
+};
+
+typedef enum traffic_arrivals traffic_arrivals_t;
+
+enum traffic_rng {
+    TRAFFIC_RNG_XOSHIRO,
+    TRAFFIC_RNG_PHILOX
+};
+
+typedef enum traffic_rng traffic_rng_t;
+
+/*  Traffic configuration - hotspot_port and hotspot_fraction are only used
+    by TRAFFIC_HOTSPOT, and burst_length by TRAFFIC_BURSTY. */
+struct traffic_config {
+    traffic_pattern_t pattern;
+    traffic_arrivals_t arrivals;
+    traffic_rng_t rng;
+    double load;
+    unsigned long seed;
+    port_num_t hotspot_port;
+    double hotspot_fraction;
+    double burst_length;
+};
+
+typedef struct traffic_config traffic_config_t;
+
+struct traffic;
+typedef struct traffic *traffic_t;
+
+/*  API functions. traffic_generate writes the destination of the arrival at
+    each of the num_ports inputs, or TRAFFIC_NO_ARRIVAL, to dest_out, and
+    returns the number of arrivals. traffic_generate_sparse instead lists
+    the inputs with an arrival, in order, and their destinations. Each call
+    of either generates the next slot. traffic_generate_ports writes the
+    arrivals of the given slot at the count inputs from first to dest_out,
+    and needs TRAFFIC_RNG_PHILOX and per-slot trials. Calls for disjoint
+    ranges may run concurrently, and for bursty traffic each input's slots
+    must be generated in order. */
+traffic_config_t traffic_default_config(traffic_pattern_t pattern, double load);
+int traffic_pattern_from_name(const char *name, traffic_pattern_t *pattern_out);
+int traffic_arrivals_from_name(
+    const char *name,
+    traffic_arrivals_t *arrivals_out
+);
+int traffic_rng_from_name(const char *name, traffic_rng_t *rng_out);
+traffic_t traffic_create(port_num_t num_ports, traffic_config_t config);
+void traffic_free(traffic_t traffic);
+port_num_t traffic_generate(traffic_t traffic, port_num_t *dest_out);
+port_num_t traffic_generate_sparse(
+    traffic_t traffic,
+    port_num_t *inputs_out,
+    port_num_t *dests_out
+);
+port_num_t traffic_generate_ports(
+    traffic_t traffic,
+    unsigned long slot,
+    port_num_t first,
+    port_num_t count,
+    port_num_t *dest_out
+);
+
+#endif
@@ -0,0 +1,93 @@
+/*  xoshiro.h
+
+    xoshiro256** pseudo random number generator (Blackman and Vigna), seeded
+    through splitmix64. It is fast, has a period of 2^256 - 1 and passes the
+    usual statistical test suites, and jump gives non-overlapping streams,
+    2^128 draws apart, e.g. one per vector lane or thread. */
+
+#ifndef XOSHIRO_H
+#define XOSHIRO_H
+
+#include <stdint.h>
+
+struct xoshiro256 {
+    uint64_t s[4];
+};
+
+typedef struct xoshiro256 xoshiro256_t;
+
+static inline uint64_t xoshiro_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+};
+
+/*  Seed - expand a 64 bit seed into the full state with splitmix64, which
+    never gives the all zero state. */
+static inline void xoshiro256_seed(xoshiro256_t *state, uint64_t seed) {
+    int i;
+    for (i = 0; i < 4; i++) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        state->s[i] = z ^ (z >> 31);
+    };
+};
+
+static inline uint64_t xoshiro256_next(xoshiro256_t *state) {
+    uint64_t *s = state->s;
+    uint64_t result = xoshiro_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = xoshiro_rotl(s[3], 45);
+
+    return result;
+};
+
+/*  Jump - advance the state by 2^128 draws. */
+static inline void xoshiro256_jump(xoshiro256_t *state) {
+    static const uint64_t jump[4] = {
+        0x180ec6d33cfd0abaULL,
+        0xd5a61266f0c9392cULL,
+        0xa9582618e03fc9aaULL,
+        0x39abdc4529b1661cULL
+    };
+
+    uint64_t s[4] = {0, 0, 0, 0};
+
+    int i;
+    for (i = 0; i < 4; i++) {
+        int b;
+        for (b = 0; b < 64; b++) {
+            if (jump[i] & ((uint64_t) 1 << b)) {
+                s[0] ^= state->s[0];
+                s[1] ^= state->s[1];
+                s[2] ^= state->s[2];
+                s[3] ^= state->s[3];
+            };
+
+            xoshiro256_next(state);
+        };
+    };
+
+    state->s[0] = s[0];
+    state->s[1] = s[1];
+    state->s[2] = s[2];
+    state->s[3] = s[3];
+};
+
+/*  Uniform double in [0, 1), from the top 53 bits. */
+static inline double xoshiro256_double(xoshiro256_t *state) {
+    return (xoshiro256_next(state) >> 11) * 0x1.0p-53;
+};
+
+/*  Uniform integer in [0, n), by multiply and shift of the top 32 bits
+    rather than a modulo. */
+static inline uint32_t xoshiro256_below(xoshiro256_t *state, uint32_t n) {
+    return (uint32_t) (((xoshiro256_next(state) >> 32) * n) >> 32);
+};
+
+#endif
@@ -0,0 +1,516 @@
+/*  bench_data_structures.c
+
+    Microbenchmarks of the heap, hash table and queue, in nanoseconds per
+    operation:
+
+        heap_hold       a hold operation (pop the minimum and insert it again
+                        with a later priority, as an event queue does) on a
+                        heap of size elements
+        hash_build      inserting size keys into an empty table, resizes
+                        included
+        hash_*          insert, lookup of present and absent keys, and
+                        remove, in a table of size buckets at the load
+                        factor param, which each batch of inserts and
+                        removes returns it to
+        queue_steady    an enqueue and a dequeue with size elements queued,
+                        so the head and tail wrap around
+        queue_grow      enqueueing size elements into an empty queue,
+                        resizes included, and queue_drain dequeueing them
+
+    Every benchmark is run once to warm up and then REPETITIONS times, and
+    the median, minimum and median absolute deviation of the repetitions
+    reported.
+
+    Usage:
+        bench_data_structures [csv] [baseline]
+
+    writes the results to the file csv, if given, and compares them to
+    those of an earlier run in baseline, if given, marking those whose
+    median is more than REGRESSION slower and more than 3 deviations from
+    it. */
+
+#include "heap.h"
+#include "hash_table.h"
+#include "queue.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <math.h>
+#include <time.h>
+
+#define REPETITIONS 9
+#define REGRESSION 0.1
+
+#define HOLD_OPS (1 << 19)
+#define MIN_HEAP 16
+#define MAX_HEAP 65536
+
+#define HASH_BUCKETS 65536
+#define HASH_BATCH (HASH_BUCKETS / 16)
+
+#define QUEUE_OPS (1 << 20)
+#define MIN_GROW (1 << 12)
+#define MAX_GROW (1 << 20)
+
+#define MAX_BASELINE 256
+
+/*  Heap element - a priority, an event time for the hold model. */
+struct elem {
+    double priority;
+};
+
+typedef struct elem *elem_t;
+
+/*  Baseline result, found by benchmark, parameter and size. */
+struct baseline {
+    char key[128];
+    double median;
+    double mad;
+};
+
+static FILE *csv;
+static struct baseline baselines[MAX_BASELINE];
+static unsigned int num_baselines;
+static unsigned int num_regressions;
+
+/*  Helper functions. */
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+};
+
+/*  Uniform value in [0, 1) from a 64 bit linear congruential generator. */
+static double uniform_next(unsigned long *state) {
+    *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+    return (double) (*state >> 11) / (double) (1UL << 53);
+};
+
+/*  Fill order with a random permutation of 0 to count - 1. */
+static void shuffle(unsigned int *order, unsigned int count,
+    unsigned long *state) {
+    unsigned int i;
+    for (i = 0; i < count; i++) {
+        order[i] = i;
+    };
+
+    for (i = count - 1; i > 0; i--) {
+        unsigned int j = (unsigned int) (uniform_next(state) * (i + 1));
+        unsigned int swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    };
+};
+
+static comparison_t elem_compare(void *lhs, void *rhs) {
+    double lhs_priority = ((elem_t) lhs)->priority;
+    double rhs_priority = ((elem_t) rhs)->priority;
+
+    if (lhs_priority < rhs_priority) {
+        return LT;
+    } else if (lhs_priority > rhs_priority) {
+        return GT;
+    } else {
+        return EQ;
+    };
+};
+
+/*  Keys are unsigned ints owned by the benchmark, so are never freed by the
+    table. */
+static hash_t key_hash(void *key) {
+    return *(unsigned int *) key;
+};
+
+static comparison_t key_compare(void *lhs, void *rhs) {
+    unsigned int lhs_key = *(unsigned int *) lhs;
+    unsigned int rhs_key = *(unsigned int *) rhs;
+
+    if (lhs_key < rhs_key) {
+        return LT;
+    } else if (lhs_key > rhs_key) {
+        return GT;
+    } else {
+        return EQ;
+    };
+};
+
+static void no_free(void *ptr) {
+    (void) ptr;
+};
+
+static int double_order(const void *lhs, const void *rhs) {
+    double lhs_value = *(const double *) lhs;
+    double rhs_value = *(const double *) rhs;
+
+    return (lhs_value > rhs_value) - (lhs_value < rhs_value);
+};
+
+/*  Median of count values, which are sorted in place. */
+static double median(double *values, unsigned int count) {
+    qsort(values, count, sizeof(double), double_order);
+
+    return count % 2
+        ? values[count / 2]
+        : (values[count / 2 - 1] + values[count / 2]) / 2;
+};
+
+/*  Read the results of an earlier run. */
+static void baseline_load(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Cannot read baseline %s\n", path);
+        exit(1);
+    };
+
+    char line[256];
+    char name[64];
+    char param[32];
+    unsigned long size;
+    unsigned int repetitions;
+    double median_ns;
+    double min_ns;
+    double mad_ns;
+
+    while (num_baselines < MAX_BASELINE && fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "%63[^,],%31[^,],%lu,%u,%lf,%lf,%lf", name, param,
+            &size, &repetitions, &median_ns, &min_ns, &mad_ns) != 7) {
+            continue;
+        };
+
+        struct baseline *baseline = &baselines[num_baselines++];
+        snprintf(baseline->key, sizeof(baseline->key), "%s,%s,%lu", name,
+            param, size);
+        baseline->median = median_ns;
+        baseline->mad = mad_ns;
+    };
+
+    fclose(file);
+};
+
+/*  Report the repetitions of a benchmark, in nanoseconds per operation, and
+    compare them to the baseline. */
+static void report(
+    const char *name,
+    const char *param,
+    unsigned long size,
+    double *samples
+) {
+    double sorted[REPETITIONS];
+    double deviations[REPETITIONS];
+
+    memcpy(sorted, samples, sizeof(sorted));
+    double mid = median(sorted, REPETITIONS);
+
+    unsigned int r;
+    for (r = 0; r < REPETITIONS; r++) {
+        deviations[r] = samples[r] > mid ? samples[r] - mid : mid - samples[r];
+    };
+    double mad = median(deviations, REPETITIONS);
+
+    printf("%-18s %8s %9lu %10.2f %10.2f %8.2f", name, param, size, mid,
+        sorted[0], mad);
+
+    if (csv) {
+        fprintf(csv, "%s,%s,%lu,%u,%.3f,%.3f,%.3f\n", name, param, size,
+            REPETITIONS, mid, sorted[0], mad);
+    };
+
+    char key[128];
+    snprintf(key, sizeof(key), "%s,%s,%lu", name, param, size);
+
+    unsigned int b;
+    for (b = 0; b < num_baselines; b++) {
+        if (strcmp(baselines[b].key, key) != 0) {
+            continue;
+        };
+
+        double change = mid / baselines[b].median - 1;
+        double noise = 3 * (mad > baselines[b].mad ? mad : baselines[b].mad);
+        int slower = change > REGRESSION &&
+            mid - baselines[b].median > noise;
+
+        printf(" %+8.1f%%%s", 100 * change, slower ? "  slower" : "");
+        num_regressions += slower;
+        break;
+    };
+
+    printf("\n");
+};
+
+/*  Benchmarks. */
+
+/*  Hold model - a heap of size elements with exponentially distributed
+    increments, so the heap keeps its size and the distribution of its
+    priorities settles. */
+static void bench_heap(unsigned long size) {
+    elem_t elems = (elem_t) malloc(sizeof(struct elem) * size);
+    assert(elems);
+
+    heap_t heap = heap_create(elem_compare, no_free);
+    unsigned long state = size;
+
+    unsigned long i;
+    for (i = 0; i < size; i++) {
+        elems[i].priority = uniform_next(&state);
+        heap_insert(heap, &elems[i]);
+    };
+
+    double samples[REPETITIONS];
+    int r;
+    for (r = -1; r < REPETITIONS; r++) {
+        double start = now_ns();
+        for (i = 0; i < HOLD_OPS; i++) {
+            elem_t elem = (elem_t) heap_pop_min(heap);
+            elem->priority -= 0.5 * log(1 - uniform_next(&state));
+            heap_insert(heap, elem);
+        };
+        double elapsed = now_ns() - start;
+
+        if (r >= 0) {
+            samples[r] = elapsed / HOLD_OPS;
+        };
+    };
+
+    report("heap_hold", "hold", size, samples);
+
+    heap_free(heap);
+    free(elems);
+};
+
+/*  Build a table from empty, then bring it down to each load factor and
+    time batches of operations there. */
+static void bench_hash() {
+    unsigned int num_keys = 2 * HASH_BUCKETS;
+    unsigned int *keys = (unsigned int *) malloc(sizeof(int) * num_keys);
+    unsigned int *hit_order =
+        (unsigned int *) malloc(sizeof(int) * HASH_BUCKETS);
+    unsigned int *miss_order =
+        (unsigned int *) malloc(sizeof(int) * HASH_BUCKETS);
+    unsigned int *batch_order =
+        (unsigned int *) malloc(sizeof(int) * HASH_BATCH);
+    assert(keys);
+    assert(hit_order);
+    assert(miss_order);
+    assert(batch_order);
+
+    /*  Distinct keys, spread by a multiplicative hash, visited in random
+        orders. */
+    unsigned long state = 1;
+    unsigned int i;
+    for (i = 0; i < num_keys; i++) {
+        keys[i] = i * 2654435761U;
+    };
+
+    shuffle(miss_order, HASH_BUCKETS, &state);
+    shuffle(batch_order, HASH_BATCH, &state);
+
+    double samples[REPETITIONS];
+    hash_table_t hash_table = NULL;
+    int r;
+    for (r = -1; r < REPETITIONS; r++) {
+        if (hash_table) {
+            hash_table_free(hash_table);
+        };
+
+        hash_table =
+            hash_table_create(key_hash, key_compare, no_free, no_free);
+
+        double start = now_ns();
+        for (i = 0; i < HASH_BUCKETS; i++) {
+            hash_table_insert(hash_table, &keys[i], &keys[i]);
+        };
+        double elapsed = now_ns() - start;
+
+        if (r >= 0) {
+            samples[r] = elapsed / HASH_BUCKETS;
+        };
+    };
+
+    report("hash_build", "-", HASH_BUCKETS, samples);
+
+    /*  Keys below present are in the table, the batch inserted and removed
+        follows them, and the absent keys looked up are from HASH_BUCKETS
+        on, which are never inserted. */
+    double load_factors[] = {0.25, 0.5, 0.75, 0.9375};
+    unsigned int present = HASH_BUCKETS;
+    unsigned int l;
+    for (l = 0; l < sizeof(load_factors) / sizeof(double); l++) {
+        unsigned int target = (unsigned int) (load_factors[l] * HASH_BUCKETS);
+
+        while (present > target) {
+            present--;
+            hash_table_remove(hash_table, &keys[present]);
+        };
+
+        shuffle(hit_order, present, &state);
+
+        double insert[REPETITIONS];
+        double hit[REPETITIONS];
+        double miss[REPETITIONS];
+        double remove[REPETITIONS];
+        unsigned long found = 0;
+
+        for (r = -1; r < REPETITIONS; r++) {
+            double start = now_ns();
+            for (i = 0; i < HASH_BATCH; i++) {
+                unsigned int key = present + batch_order[i];
+                hash_table_insert(hash_table, &keys[key], &keys[key]);
+            };
+            double inserted = now_ns();
+            for (i = 0; i < present; i++) {
+                found += hash_table_lookup(hash_table,
+                    &keys[hit_order[i]]) != NULL;
+            };
+            double hits = now_ns();
+            for (i = 0; i < HASH_BUCKETS; i++) {
+                found += hash_table_lookup(hash_table,
+                    &keys[HASH_BUCKETS + miss_order[i]]) != NULL;
+            };
+            double misses = now_ns();
+            for (i = 0; i < HASH_BATCH; i++) {
+                unsigned int key = present + batch_order[i];
+                hash_table_remove(hash_table, &keys[key]);
+            };
+            double removed = now_ns();
+
+            if (r >= 0) {
+                insert[r] = (inserted - start) / HASH_BATCH;
+                hit[r] = (hits - inserted) / present;
+                miss[r] = (misses - hits) / HASH_BUCKETS;
+                remove[r] = (removed - misses) / HASH_BATCH;
+            };
+        };
+
+        assert(found == (unsigned long) (REPETITIONS + 1) * present);
+        assert(hash_table_size(hash_table) == (int) present);
+
+        char param[16];
+        snprintf(param, sizeof(param), "lf%.4g", load_factors[l]);
+        report("hash_insert", param, HASH_BUCKETS, insert);
+        report("hash_lookup_hit", param, HASH_BUCKETS, hit);
+        report("hash_lookup_miss", param, HASH_BUCKETS, miss);
+        report("hash_remove", param, HASH_BUCKETS, remove);
+    };
+
+    hash_table_free(hash_table);
+    free(batch_order);
+    free(miss_order);
+    free(hit_order);
+    free(keys);
+};
+
+/*  A queue holding size elements, through which QUEUE_OPS more pass. */
+static void bench_queue_steady(unsigned long size) {
+    queue_t queue = queue_create(no_free);
+    static char elem;
+
+    unsigned long i;
+    for (i = 0; i < size; i++) {
+        queue_enqueue(queue, &elem);
+    };
+
+    double samples[REPETITIONS];
+    int r;
+    for (r = -1; r < REPETITIONS; r++) {
+        double start = now_ns();
+        for (i = 0; i < QUEUE_OPS; i++) {
+            queue_enqueue(queue, &elem);
+            queue_dequeue(queue);
+        };
+        double elapsed = now_ns() - start;
+
+        if (r >= 0) {
+            samples[r] = elapsed / QUEUE_OPS;
+        };
+    };
+
+    report("queue_steady", "pair", size, samples);
+
+    queue_free(queue);
+};
+
+/*  A queue grown from empty to size elements, then drained. */
+static void bench_queue_grow(unsigned long size) {
+    static char elem;
+
+    double grow[REPETITIONS];
+    double drain[REPETITIONS];
+    int r;
+    for (r = -1; r < REPETITIONS; r++) {
+        queue_t queue = queue_create(no_free);
+
+        unsigned long i;
+        double start = now_ns();
+        for (i = 0; i < size; i++) {
+            queue_enqueue(queue, &elem);
+        };
+        double grown = now_ns();
+        for (i = 0; i < size; i++) {
+            queue_dequeue(queue);
+        };
+        double drained = now_ns();
+
+        queue_free(queue);
+
+        if (r >= 0) {
+            grow[r] = (grown - start) / size;
+            drain[r] = (drained - grown) / size;
+        };
+    };
+
+    report("queue_grow", "enqueue", size, grow);
+    report("queue_drain", "dequeue", size, drain);
+};
+
+int main(int argc, char *argv[]) {
+    const char *csv_path = argc > 1 ? argv[1] : NULL;
+    const char *baseline_path = argc > 2 ? argv[2] : NULL;
+
+    if (baseline_path) {
+        baseline_load(baseline_path);
+    };
+
+    if (csv_path) {
+        csv = fopen(csv_path, "w");
+        if (!csv) {
+            fprintf(stderr, "Cannot write %s\n", csv_path);
+            return 1;
+        };
+
+        fprintf(csv, "benchmark,param,size,repetitions,median_ns,min_ns,"
+            "mad_ns\n");
+    };
+
+    printf("%-18s %8s %9s %10s %10s %8s%s\n", "benchmark", "param", "size",
+        "median ns", "min ns", "mad", baseline_path ? "   change" : "");
+
+    unsigned long size;
+    for (size = MIN_HEAP; size <= MAX_HEAP; size *= 16) {
+        bench_heap(size);
+    };
+
+    bench_hash();
+
+    unsigned long sizes[] = {1, 64, 4096};
+    unsigned int s;
+    for (s = 0; s < sizeof(sizes) / sizeof(unsigned long); s++) {
+        bench_queue_steady(sizes[s]);
+    };
+
+    for (size = MIN_GROW; size <= MAX_GROW; size *= 16) {
+        bench_queue_grow(size);
+    };
+
+    if (csv) {
+        fclose(csv);
+    };
+
+    if (baseline_path) {
+        printf("%u slower than %s\n", num_regressions, baseline_path);
+    };
+
+    return 0;
+};
@@ -0,0 +1,167 @@
+/*  bench_mpmc_queue.c
+
+    Measures the throughput of the MPMC queue for 1 to 64 threads, half of
+    them producers and half consumers (a single thread alternates between
+    the two), with single and bulk operations. Reported are millions of
+    elements moved through the queue per second and nanoseconds per element,
+    from the first thread starting to the last one finishing. */
+
+#include "mpmc_queue.h"
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <time.h>
+
+#define QUEUE_CAPACITY 1024
+#define TOTAL_ELEMS 4000000
+#define MAX_THREADS 64
+#define BULK_SIZE 16
+
+struct bench {
+    mpmc_queue_t queue;
+    unsigned long per_thread;
+    unsigned int batch;
+    atomic_int ready;
+    atomic_int go;
+};
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+};
+
+/*  Wait for every thread to be ready, so thread creation is not timed. */
+static void start_line(struct bench *bench) {
+    atomic_fetch_add(&bench->ready, 1);
+    while (!atomic_load_explicit(&bench->go, memory_order_acquire)) {
+        sched_yield();
+    };
+};
+
+static void *producer_main(void *bench_ptr) {
+    struct bench *bench = (struct bench *) bench_ptr;
+    void *batch[BULK_SIZE];
+    unsigned long done = 0;
+
+    unsigned int k;
+    for (k = 0; k < BULK_SIZE; k++) {
+        batch[k] = (void *) (uintptr_t) (k + 1);
+    };
+
+    start_line(bench);
+
+    while (done < bench->per_thread) {
+        unsigned long left = bench->per_thread - done;
+        unsigned int count = left < bench->batch ? left : bench->batch;
+        unsigned int n = mpmc_queue_enqueue_bulk(bench->queue, batch, count);
+
+        if (n == 0) {
+            sched_yield();
+        };
+        done += n;
+    };
+
+    return NULL;
+};
+
+static void *consumer_main(void *bench_ptr) {
+    struct bench *bench = (struct bench *) bench_ptr;
+    void *batch[BULK_SIZE];
+    unsigned long done = 0;
+
+    start_line(bench);
+
+    while (done < bench->per_thread) {
+        unsigned long left = bench->per_thread - done;
+        unsigned int count = left < bench->batch ? left : bench->batch;
+        unsigned int n = mpmc_queue_dequeue_bulk(bench->queue, batch, count);
+
+        if (n == 0) {
+            sched_yield();
+        };
+        done += n;
+    };
+
+    return NULL;
+};
+
+/*  One thread - alternate between enqueueing and dequeueing a batch. */
+static double bench_single(unsigned int batch_size) {
+    mpmc_queue_t queue = mpmc_queue_create(QUEUE_CAPACITY, NULL);
+    void *batch[BULK_SIZE] = {0};
+
+    double start = now_ns();
+    unsigned long done;
+    for (done = 0; done < TOTAL_ELEMS; done += batch_size) {
+        unsigned int n = mpmc_queue_enqueue_bulk(queue, batch, batch_size);
+        mpmc_queue_dequeue_bulk(queue, batch, n);
+    };
+    double elapsed = now_ns() - start;
+
+    mpmc_queue_free(queue);
+
+    return elapsed / TOTAL_ELEMS;
+};
+
+/*  Several threads - as many producers as consumers, moving TOTAL_ELEMS
+    elements between them. */
+static double bench_threads(int num_threads, unsigned int batch_size) {
+    struct bench bench;
+    bench.queue = mpmc_queue_create(QUEUE_CAPACITY, NULL);
+    bench.per_thread = TOTAL_ELEMS / (num_threads / 2);
+    bench.batch = batch_size;
+    atomic_init(&bench.ready, 0);
+    atomic_init(&bench.go, 0);
+
+    pthread_t threads[MAX_THREADS];
+    int t;
+    for (t = 0; t < num_threads; t++) {
+        pthread_create(
+            &threads[t],
+            NULL,
+            t % 2 ? consumer_main : producer_main,
+            &bench
+        );
+    };
+
+    while (atomic_load(&bench.ready) < num_threads) {
+        sched_yield();
+    };
+
+    double start = now_ns();
+    atomic_store_explicit(&bench.go, 1, memory_order_release);
+
+    for (t = 0; t < num_threads; t++) {
+        pthread_join(threads[t], NULL);
+    };
+    double elapsed = now_ns() - start;
+
+    mpmc_queue_free(bench.queue);
+
+    return elapsed / (bench.per_thread * (num_threads / 2));
+};
+
+int main() {
+    printf("%-8s %8s %10s %10s\n", "threads", "batch", "Mops/s", "ns/op");
+
+    int num_threads;
+    for (num_threads = 1; num_threads <= MAX_THREADS; num_threads *= 2) {
+        unsigned int batch_size;
+        for (batch_size = 1; batch_size <= BULK_SIZE; batch_size *= BULK_SIZE) {
+            double ns = num_threads == 1
+                ? bench_single(batch_size)
+                : bench_threads(num_threads, batch_size);
+
+            printf("%-8d %8u %10.2f %10.1f\n", num_threads, batch_size,
+                1e3 / ns, ns);
+        };
+    };
+
+    return 0;
+};
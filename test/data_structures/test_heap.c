@@ -194,6 +194,32 @@ DEFINE_TEST(test_heap_min_1)
     heap_free(heap);
 END_TEST
 
+/*  Many elements, inserted in a scrambled order with repeats and popped in
+    between, must come out in ascending order. */
+DEFINE_TEST(test_heap_pop_sorted)
+    heap_t heap = heap_create(elem_compare, elem_free);
+
+    int i;
+    for (i = 0; i < 500; i++) {
+        heap_insert(heap, elem_create((i * 37) % 101));
+    };
+
+    for (i = 0; i < 100; i++) {
+        free(heap_pop_min(heap));
+        heap_insert(heap, elem_create((i * 53) % 97 + 50));
+    };
+
+    int last = -1;
+    while (heap_size(heap) > 0) {
+        elem_t elem = (elem_t) heap_pop_min(heap);
+        ASSERT_TRUE((elem->data >= last))
+        last = elem->data;
+        free((void *) elem);
+    };
+
+    heap_free(heap);
+END_TEST
+
 REGISTER_TESTS(
     test_heap_create_destroy,
     test_heap_insert_1,
@@ -202,5 +228,6 @@ REGISTER_TESTS(
     test_heap_pop_3,
     test_heap_pop_4,
     test_heap_size_1,
-    test_heap_min_1
+    test_heap_min_1,
+    test_heap_pop_sorted
 )
\ No newline at end of file
@@ -0,0 +1,244 @@
+/*  test_mpmc_queue.c */
+
+#include "./../test.h"
+#include "mpmc_queue.h"
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define QUEUE_CAPACITY 64
+#define TOTAL_ELEMS 200000
+#define MAX_THREADS 64
+#define BATCH 8
+
+/*  Test helpers - elements encode their producer in the top 16 bits and
+    their sequence number within that producer in the rest. */
+#define ELEM(producer, seq) \
+    ((void *) (((uintptr_t) (producer) << 48) | (uintptr_t) (seq)))
+#define ELEM_PRODUCER(elem) ((uintptr_t) (elem) >> 48)
+#define ELEM_SEQ(elem) ((uintptr_t) (elem) & (((uintptr_t) 1 << 48) - 1))
+
+struct stress {
+    mpmc_queue_t queue;
+    int num_producers;
+    unsigned long per_producer;
+    atomic_ulong consumed;
+    atomic_uchar *seen;
+    atomic_int errors;
+};
+
+struct worker {
+    struct stress *stress;
+    int id;
+};
+
+/*  Producer - enqueue this producer's elements in order, alternating single
+    and bulk enqueues. */
+static void *producer_main(void *worker_ptr) {
+    struct worker *worker = (struct worker *) worker_ptr;
+    struct stress *stress = worker->stress;
+    unsigned long next = 0;
+
+    while (next < stress->per_producer) {
+        void *batch[BATCH];
+        unsigned int count = 0;
+
+        while (count < BATCH && next + count < stress->per_producer) {
+            batch[count] = ELEM(worker->id, next + count);
+            count++;
+        };
+
+        unsigned int done = next % 2
+            ? mpmc_queue_enqueue_bulk(stress->queue, batch, count)
+            : (unsigned int) mpmc_queue_enqueue(stress->queue, batch[0]);
+
+        if (done == 0) {
+            sched_yield();
+        };
+        next += done;
+    };
+
+    return NULL;
+};
+
+/*  Consumer - dequeue until every element has been consumed, checking that
+    each is seen once and that each producer's elements arrive in order. */
+static void *consumer_main(void *worker_ptr) {
+    struct worker *worker = (struct worker *) worker_ptr;
+    struct stress *stress = worker->stress;
+    unsigned long total = stress->per_producer * stress->num_producers;
+    long last[MAX_THREADS];
+
+    int p;
+    for (p = 0; p < MAX_THREADS; p++) {
+        last[p] = -1;
+    };
+
+    while (atomic_load(&stress->consumed) < total) {
+        void *batch[BATCH];
+        unsigned int count = (worker->id % 2)
+            ? mpmc_queue_dequeue_bulk(stress->queue, batch, BATCH)
+            : (unsigned int) mpmc_queue_dequeue(stress->queue, batch);
+
+        if (count == 0) {
+            sched_yield();
+            continue;
+        };
+
+        unsigned int k;
+        for (k = 0; k < count; k++) {
+            uintptr_t producer = ELEM_PRODUCER(batch[k]);
+            long seq = (long) ELEM_SEQ(batch[k]);
+
+            if (producer >= stress->num_producers || seq <= last[producer]) {
+                atomic_fetch_add(&stress->errors, 1);
+                continue;
+            };
+            last[producer] = seq;
+
+            unsigned long index = producer * stress->per_producer + seq;
+            if (atomic_exchange(&stress->seen[index], 1)) {
+                atomic_fetch_add(&stress->errors, 1);
+            };
+        };
+
+        atomic_fetch_add(&stress->consumed, count);
+    };
+
+    return NULL;
+};
+
+/*  Run producers and consumers over one queue and return the number of
+    errors seen, or -1 if elements went missing. */
+static int stress_run(int num_producers, int num_consumers) {
+    struct stress stress;
+    stress.queue = mpmc_queue_create(QUEUE_CAPACITY, NULL);
+    stress.num_producers = num_producers;
+    stress.per_producer = TOTAL_ELEMS / num_producers;
+    atomic_init(&stress.consumed, 0);
+    atomic_init(&stress.errors, 0);
+
+    unsigned long total = stress.per_producer * num_producers;
+    stress.seen = (atomic_uchar *) calloc(total, sizeof(atomic_uchar));
+    assert(stress.seen);
+
+    pthread_t threads[MAX_THREADS];
+    struct worker workers[MAX_THREADS];
+
+    int t;
+    for (t = 0; t < num_producers + num_consumers; t++) {
+        workers[t].stress = &stress;
+        workers[t].id = t < num_producers ? t : t - num_producers;
+        pthread_create(
+            &threads[t],
+            NULL,
+            t < num_producers ? producer_main : consumer_main,
+            &workers[t]
+        );
+    };
+
+    for (t = 0; t < num_producers + num_consumers; t++) {
+        pthread_join(threads[t], NULL);
+    };
+
+    int errors = atomic_load(&stress.errors);
+
+    unsigned long i;
+    for (i = 0; i < total; i++) {
+        if (!atomic_load(&stress.seen[i])) {
+            errors = -1;
+        };
+    };
+
+    void *elem;
+    if (mpmc_queue_dequeue(stress.queue, &elem)) {
+        errors = -1;
+    };
+
+    free(stress.seen);
+    mpmc_queue_free(stress.queue);
+
+    return errors;
+};
+
+/*  Tests. */
+
+DEFINE_TEST(test_mpmc_queue_create_free)
+    mpmc_queue_t queue = mpmc_queue_create(10, NULL);
+    assert(queue);
+    ASSERT_EQ(16, mpmc_queue_capacity(queue))
+    mpmc_queue_free(queue);
+END_TEST
+
+/*  On one thread the queue must be FIFO, refuse elements once full, and
+    return nothing once empty, over several laps of the ring. */
+DEFINE_TEST(test_mpmc_queue_full_empty)
+    mpmc_queue_t queue = mpmc_queue_create(8, NULL);
+    void *elem;
+
+    uintptr_t next_in = 0;
+    uintptr_t next_out = 0;
+
+    int lap;
+    for (lap = 0; lap < 5; lap++) {
+        ASSERT_EQ(0, mpmc_queue_dequeue(queue, &elem))
+
+        while (mpmc_queue_enqueue(queue, (void *) next_in)) {
+            next_in++;
+        };
+        ASSERT_EQ(8, (next_in - next_out))
+
+        while (mpmc_queue_dequeue(queue, &elem)) {
+            ASSERT_TRUE(((uintptr_t) elem == next_out))
+            next_out++;
+        };
+    };
+
+    mpmc_queue_free(queue);
+END_TEST
+
+/*  Bulk operations must move as many elements as fit or are present. */
+DEFINE_TEST(test_mpmc_queue_bulk)
+    mpmc_queue_t queue = mpmc_queue_create(8, NULL);
+    void *in[12];
+    void *out[12];
+
+    int i;
+    for (i = 0; i < 12; i++) {
+        in[i] = (void *) (uintptr_t) i;
+    };
+
+    ASSERT_EQ(5, mpmc_queue_enqueue_bulk(queue, in, 5))
+    ASSERT_EQ(3, mpmc_queue_enqueue_bulk(queue, in + 5, 7))
+    ASSERT_EQ(0, mpmc_queue_enqueue_bulk(queue, in + 8, 4))
+    ASSERT_EQ(6, mpmc_queue_dequeue_bulk(queue, out, 6))
+    ASSERT_EQ(4, mpmc_queue_enqueue_bulk(queue, in + 8, 4))
+    ASSERT_EQ(6, mpmc_queue_dequeue_bulk(queue, out + 6, 12))
+    ASSERT_EQ(0, mpmc_queue_dequeue_bulk(queue, out, 12))
+
+    for (i = 0; i < 12; i++) {
+        ASSERT_TRUE((out[i] == in[i]))
+    };
+
+    mpmc_queue_free(queue);
+END_TEST
+
+/*  Every element must be consumed exactly once, and in order per producer,
+    for thread counts from 2 up to 64. */
+DEFINE_TEST(test_mpmc_queue_stress)
+    ASSERT_EQ(0, stress_run(1, 1))
+    ASSERT_EQ(0, stress_run(2, 2))
+    ASSERT_EQ(0, stress_run(1, 7))
+    ASSERT_EQ(0, stress_run(7, 1))
+    ASSERT_EQ(0, stress_run(8, 8))
+    ASSERT_EQ(0, stress_run(32, 32))
+END_TEST
+
+REGISTER_TESTS(
+    test_mpmc_queue_create_free,
+    test_mpmc_queue_full_empty,
+    test_mpmc_queue_bulk,
+    test_mpmc_queue_stress
+)
@@ -0,0 +1,147 @@
+/*  test_spsc_ring.c */
+
+#include "./../test.h"
+#include "spsc_ring.h"
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define NUM_ELEMS 1000000
+#define BATCH 7
+
+/*  Test helpers. */
+
+/*  Producer thread - push 0 to NUM_ELEMS - 1 in batches. */
+static void *producer_main(void *ring_ptr) {
+    spsc_ring_t ring = (spsc_ring_t) ring_ptr;
+    unsigned long batch[BATCH];
+    unsigned long next = 0;
+
+    while (next < NUM_ELEMS) {
+        unsigned int count = 0;
+        while (count < BATCH && next + count < NUM_ELEMS) {
+            batch[count] = next + count;
+            count++;
+        };
+
+        unsigned int pushed = 0;
+        while (pushed < count) {
+            unsigned int n = spsc_ring_push(ring, batch + pushed, count - pushed);
+            if (n == 0) {
+                sched_yield();
+            };
+            pushed += n;
+        };
+
+        next += count;
+    };
+
+    return NULL;
+};
+
+/*  Tests. */
+
+DEFINE_TEST(test_spsc_ring_create_free)
+    spsc_ring_t ring = spsc_ring_create(sizeof(int), 10);
+    assert(ring);
+    ASSERT_EQ(16, spsc_ring_capacity(ring))
+    spsc_ring_free(ring);
+END_TEST
+
+/*  A ring must refuse elements once full, return nothing once empty, and
+    keep order across the wrap. */
+DEFINE_TEST(test_spsc_ring_full_empty)
+    spsc_ring_t ring = spsc_ring_create(sizeof(int), 8);
+    int in[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+    int out[12];
+
+    ASSERT_EQ(0, spsc_ring_pop(ring, out, 1))
+    ASSERT_EQ(8, spsc_ring_push(ring, in, 12))
+    ASSERT_EQ(0, spsc_ring_push(ring, in + 8, 1))
+
+    ASSERT_EQ(5, spsc_ring_pop(ring, out, 5))
+    ASSERT_EQ(4, spsc_ring_push(ring, in + 8, 4))
+    ASSERT_EQ(7, spsc_ring_pop(ring, out + 5, 12))
+    ASSERT_EQ(0, spsc_ring_pop(ring, out, 1))
+
+    int i;
+    for (i = 0; i < 12; i++) {
+        ASSERT_EQ(i, out[i])
+    };
+
+    spsc_ring_free(ring);
+END_TEST
+
+/*  Elements larger than a word must be copied whole. */
+DEFINE_TEST(test_spsc_ring_records)
+    struct record {
+        unsigned long a;
+        unsigned long b;
+        char c;
+    };
+
+    spsc_ring_t ring = spsc_ring_create(sizeof(struct record), 4);
+    struct record in[3];
+    struct record out[3];
+
+    int round;
+    for (round = 0; round < 10; round++) {
+        int i;
+        for (i = 0; i < 3; i++) {
+            in[i].a = round;
+            in[i].b = i;
+            in[i].c = 'a' + i;
+        };
+
+        ASSERT_EQ(3, spsc_ring_push(ring, in, 3))
+        ASSERT_EQ(3, spsc_ring_pop(ring, out, 3))
+
+        for (i = 0; i < 3; i++) {
+            ASSERT_EQ(round, out[i].a)
+            ASSERT_EQ(i, out[i].b)
+            ASSERT_EQ(('a' + i), out[i].c)
+        };
+    };
+
+    spsc_ring_free(ring);
+END_TEST
+
+/*  A consumer popping in different sized batches from a concurrent producer
+    must see every element exactly once, in order. */
+DEFINE_TEST(test_spsc_ring_threads)
+    spsc_ring_t ring = spsc_ring_create(sizeof(unsigned long), 64);
+
+    pthread_t producer;
+    pthread_create(&producer, NULL, producer_main, ring);
+
+    unsigned long out[BATCH * 2];
+    unsigned long expected = 0;
+    int in_order = 1;
+
+    while (expected < NUM_ELEMS) {
+        unsigned int count = spsc_ring_pop(ring, out, 1 + expected % (BATCH * 2));
+        if (count == 0) {
+            sched_yield();
+        };
+
+        unsigned int k;
+        for (k = 0; k < count; k++) {
+            in_order &= out[k] == expected;
+            expected++;
+        };
+    };
+
+    pthread_join(producer, NULL);
+
+    ASSERT_TRUE(in_order)
+    ASSERT_EQ(0, spsc_ring_pop(ring, out, 1))
+
+    spsc_ring_free(ring);
+END_TEST
+
+REGISTER_TESTS(
+    test_spsc_ring_create_free,
+    test_spsc_ring_full_empty,
+    test_spsc_ring_records,
+    test_spsc_ring_threads
+)
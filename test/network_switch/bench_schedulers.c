@@ -0,0 +1,151 @@
+/*  bench_schedulers.c
+
+    Measures the cost of each crossbar scheduler in nanoseconds per scheduling
+    decision (one call to schedule) over a range of switch sizes. VOQ states
+    are random, with each VOQ non-empty with probability one half and a
+    random arrival at every input. */
+
+#include "iSLIP.h"
+#include "pim.h"
+#include "iLQF.h"
+#include "drrm.h"
+#include "hopcroft_karp.h"
+#include "serena.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <time.h>
+
+#define NUM_STATES 16
+#define MIN_DECISIONS 64
+#define MIN_PORTS 8
+#define MAX_PORTS 256
+
+struct bench_scheduler {
+    const char *name;
+    i_crossbar_scheduler_t (*scheduler)();
+};
+
+static const struct bench_scheduler schedulers[] = {
+    {"islip", iSLIP_scheduler},
+    {"pim", pim_scheduler},
+    {"ilqf", iLQF_scheduler},
+    {"iocf", iOCF_scheduler},
+    {"drrm", drrm_scheduler},
+    {"serena", serena_scheduler},
+    {"mwm", hopcroft_karp_scheduler}
+};
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+};
+
+/*  Time the given scheduler on NUM_STATES precomputed VOQ states, cycling
+    through them until at least MIN_DECISIONS decisions have been made. */
+static double bench(
+    i_crossbar_scheduler_t scheduler,
+    port_num_t num_ports,
+    sched_voq_state_t *voq_states
+) {
+    port_matching_t *matching = port_matching_create(num_ports);
+    void *state = scheduler.init(num_ports);
+    unsigned long decisions = MIN_DECISIONS * (MAX_PORTS / num_ports);
+
+    double start = now_ns();
+    unsigned long d;
+    for (d = 0; d < decisions; d++) {
+        sched_voq_state_t voq_state = voq_states[d % NUM_STATES];
+        voq_state.prev_matching = matching;
+
+        scheduler.schedule(state, &voq_state, matching);
+    };
+    double elapsed = now_ns() - start;
+
+    scheduler.free(state);
+    port_matching_free(matching);
+
+    return elapsed / decisions;
+};
+
+int main() {
+    printf("%-8s %8s %14s\n", "sched", "ports", "ns/decision");
+
+    port_num_t num_ports;
+    for (num_ports = MIN_PORTS; num_ports <= MAX_PORTS; num_ports *= 2) {
+        sched_voq_state_t voq_states[NUM_STATES];
+        port_num_t cells = num_ports * num_ports;
+
+        int s;
+        for (s = 0; s < NUM_STATES; s++) {
+            voq_matrix_t voqs = voq_matrix_create(
+                num_ports,
+                VOQ_MODE_COUNTS,
+                0,
+                VOQ_IDLE_NEVER
+            );
+            port_num_t *arrival_output =
+                (port_num_t *) malloc(sizeof(port_num_t) * num_ports);
+            char *arrival_active = (char *) malloc(sizeof(char) * num_ports);
+            assert(arrival_output);
+            assert(arrival_active);
+
+            packet_desc_t run[16];
+            unsigned int k;
+            for (k = 0; k < 16; k++) {
+                run[k].flow_id = 0;
+                run[k].payload = PACKET_REF_NONE;
+                run[k].src_port = 0;
+                run[k].dst_port = 0;
+                run[k].length = PACKET_SIZE;
+            };
+
+            port_num_t c;
+            for (c = 0; c < cells; c++) {
+                unsigned int size = (rand() % 2) * (1 + rand() % 16);
+                uint32_t arrival_slot = rand() % 1000;
+
+                for (k = 0; k < size; k++) {
+                    run[k].arrival_slot = arrival_slot;
+                };
+
+                voq_matrix_enqueue_bulk(
+                    voqs,
+                    c / num_ports,
+                    c % num_ports,
+                    run,
+                    size
+                );
+            };
+
+            for (c = 0; c < num_ports; c++) {
+                arrival_output[c] = rand() % num_ports;
+                arrival_active[c] = 1;
+                run[0].arrival_slot = 1000;
+                voq_matrix_enqueue(voqs, c, arrival_output[c], run[0]);
+            };
+
+            voq_states[s].num_ports = num_ports;
+            voq_states[s].slot = 1000;
+            voq_states[s].voqs = voqs;
+            voq_states[s].arrival_output = arrival_output;
+            voq_states[s].arrival_active = arrival_active;
+        };
+
+        int i;
+        for (i = 0; i < sizeof(schedulers) / sizeof(schedulers[0]); i++) {
+            printf("%-8s %8u %14.1f\n", schedulers[i].name, num_ports,
+                bench(schedulers[i].scheduler(), num_ports, voq_states));
+        };
+
+        for (s = 0; s < NUM_STATES; s++) {
+            voq_matrix_free(voq_states[s].voqs, NULL);
+            free((void *) voq_states[s].arrival_output);
+            free((void *) voq_states[s].arrival_active);
+        };
+    };
+
+    return 0;
+};
@@ -0,0 +1,155 @@
+/*  test_packet_pool.c */
+
+#include "./../test.h"
+#include "packet_pool.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#define NUM_CELLS 40000
+
+/*  Test helpers. */
+static void *cells[NUM_CELLS];
+
+/*  Free every cell in cells, from whichever thread runs it. */
+static void *dealloc_all(void *arg) {
+    int i;
+    for (i = 0; i < NUM_CELLS; i++) {
+        packet_pool_dealloc(cells[i]);
+    };
+
+    return arg;
+};
+
+/*  Tests. */
+DEFINE_TEST(test_packet_pool_create_free)
+    packet_pool_t packet_pool = packet_pool_create(PACKET_SIZE, 0);
+    assert(packet_pool);
+    packet_pool_free(packet_pool);
+END_TEST
+
+/*  A freed cell must be the next one handed out. */
+DEFINE_TEST(test_packet_pool_reuse)
+    packet_pool_t packet_pool = packet_pool_create(PACKET_SIZE, 0);
+
+    void *first = packet_pool_alloc(packet_pool);
+    void *second = packet_pool_alloc(packet_pool);
+    ASSERT_TRUE((first != second))
+
+    packet_pool_dealloc(first);
+    ASSERT_TRUE((packet_pool_alloc(packet_pool) == first))
+
+    packet_pool_free(packet_pool);
+END_TEST
+
+/*  Cells must be distinct, writable and aligned across several slabs, and
+    the statistics must track them. */
+DEFINE_TEST(test_packet_pool_many_slabs)
+    packet_pool_t packet_pool =
+        packet_pool_create(PACKET_SIZE, PACKET_POOL_HUGE_PAGES);
+    packet_pool_stats_t stats;
+
+    int i;
+    for (i = 0; i < NUM_CELLS; i++) {
+        cells[i] = packet_pool_alloc(packet_pool);
+        ASSERT_EQ(0, (uintptr_t) cells[i] % 16)
+        memset(cells[i], i & 0xff, PACKET_SIZE);
+    };
+
+    for (i = 0; i < NUM_CELLS; i++) {
+        ASSERT_EQ((i & 0xff), ((unsigned char *) cells[i])[PACKET_SIZE - 1])
+    };
+
+    packet_pool_stats(packet_pool, &stats);
+    ASSERT_EQ(NUM_CELLS, stats.in_use)
+    ASSERT_EQ(NUM_CELLS, stats.high_water)
+    ASSERT_TRUE((stats.slabs > 1))
+    ASSERT_TRUE((stats.capacity >= NUM_CELLS))
+
+    for (i = 0; i < NUM_CELLS / 2; i++) {
+        packet_pool_dealloc(cells[i]);
+    };
+
+    packet_pool_stats(packet_pool, &stats);
+    ASSERT_EQ(NUM_CELLS - NUM_CELLS / 2, stats.in_use)
+    ASSERT_EQ(NUM_CELLS, stats.high_water)
+
+    packet_pool_free(packet_pool);
+END_TEST
+
+/*  Cells freed by another thread must return to the owning pool, and be
+    reused by it before any new slab is created. */
+DEFINE_TEST(test_packet_pool_remote_free)
+    packet_pool_t packet_pool = packet_pool_create(PACKET_SIZE, 0);
+    packet_pool_stats_t stats;
+
+    int i;
+    for (i = 0; i < NUM_CELLS; i++) {
+        cells[i] = packet_pool_alloc(packet_pool);
+    };
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, dealloc_all, NULL);
+    pthread_join(thread, NULL);
+
+    packet_pool_stats(packet_pool, &stats);
+    ASSERT_EQ(0, stats.in_use)
+    unsigned long slabs = stats.slabs;
+
+    for (i = 0; i < NUM_CELLS; i++) {
+        cells[i] = packet_pool_alloc(packet_pool);
+    };
+
+    packet_pool_stats(packet_pool, &stats);
+    ASSERT_EQ(NUM_CELLS, stats.in_use)
+    ASSERT_EQ(slabs, stats.slabs)
+
+    packet_pool_free(packet_pool);
+END_TEST
+
+/*  References must name their cell, across slabs and pools. */
+DEFINE_TEST(test_packet_pool_ref)
+    packet_pool_t first = packet_pool_create(PACKET_SIZE, 0);
+    packet_pool_t second = packet_pool_create(PACKET_SIZE, 0);
+
+    int i;
+    for (i = 0; i < NUM_CELLS; i++) {
+        cells[i] = packet_pool_alloc(i % 2 ? first : second);
+    };
+
+    ASSERT_TRUE((packet_deref(PACKET_REF_NONE) == NULL))
+
+    for (i = 0; i < NUM_CELLS; i++) {
+        packet_ref_t ref = packet_ref(cells[i]);
+        ASSERT_TRUE((ref != PACKET_REF_NONE))
+        ASSERT_TRUE((packet_deref(ref) == cells[i]))
+    };
+
+    packet_pool_free(first);
+    packet_pool_free(second);
+END_TEST
+
+DEFINE_TEST(test_packet_pool_local)
+    void *packet = packet_alloc();
+    assert(packet);
+    memset(packet, 0, PACKET_SIZE);
+    packet_free(packet);
+    packet_free(NULL);
+
+    packet_pool_stats_t stats;
+    packet_pool_stats(packet_pool_local(), &stats);
+    ASSERT_EQ(0, stats.in_use)
+    ASSERT_EQ(1, stats.high_water)
+
+    packet_pool_local_free();
+END_TEST
+
+REGISTER_TESTS(
+    test_packet_pool_create_free,
+    test_packet_pool_reuse,
+    test_packet_pool_many_slabs,
+    test_packet_pool_remote_free,
+    test_packet_pool_ref,
+    test_packet_pool_local
+)
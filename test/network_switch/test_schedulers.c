@@ -0,0 +1,341 @@
+/*  test_schedulers.c */
+
+#include "./../test.h"
+#include "port_matching.h"
+#include "iSLIP.h"
+#include "pim.h"
+#include "iLQF.h"
+#include "drrm.h"
+#include "hopcroft_karp.h"
+#include "serena.h"
+#include <assert.h>
+#include <string.h>
+
+#define NUM_PORTS 16
+#define NUM_TRIALS 200
+
+/*  Test helpers - VOQ states are described by the occupancy and head of
+    line arrival arrays, from which voq_state_create builds a VOQ matrix.
+    The matrix of the previous state is freed, and the last one is left
+    reachable from voqs at exit. */
+static unsigned int occupancy[NUM_PORTS * NUM_PORTS];
+static unsigned long hol_arrival[NUM_PORTS * NUM_PORTS];
+static port_num_t arrival_output[NUM_PORTS];
+static char arrival_active[NUM_PORTS];
+static voq_matrix_t voqs = NULL;
+
+static sched_voq_state_t voq_state_create(
+    unsigned long slot,
+    const port_matching_t *prev_matching
+) {
+    if (voqs) {
+        voq_matrix_free(voqs, NULL);
+    };
+    voqs = voq_matrix_create(NUM_PORTS, VOQ_MODE_PACKETS, 0, VOQ_IDLE_NEVER);
+
+    int i;
+    for (i = 0; i < NUM_PORTS * NUM_PORTS; i++) {
+        packet_desc_t cell;
+        cell.arrival_slot = (uint32_t) hol_arrival[i];
+        cell.flow_id = i;
+        cell.payload = PACKET_REF_NONE;
+        cell.src_port = i / NUM_PORTS;
+        cell.dst_port = i % NUM_PORTS;
+        cell.length = PACKET_SIZE;
+
+        unsigned int k;
+        for (k = 0; k < occupancy[i]; k++) {
+            voq_matrix_enqueue(voqs, i / NUM_PORTS, i % NUM_PORTS, cell);
+        };
+    };
+
+    sched_voq_state_t voq_state;
+    voq_state.num_ports = NUM_PORTS;
+    voq_state.slot = slot;
+    voq_state.voqs = voqs;
+    voq_state.arrival_output = arrival_output;
+    voq_state.arrival_active = arrival_active;
+    voq_state.prev_matching = prev_matching;
+
+    return voq_state;
+};
+
+/*  Fill the VOQs at random, with roughly one in density VOQs non-empty, and
+    record a random arrival at each input whose VOQ was given a cell. */
+static void randomise_voqs(unsigned long slot, int density) {
+    int i;
+    for (i = 0; i < NUM_PORTS * NUM_PORTS; i++) {
+        occupancy[i] = (rand() % density == 0) ? 1 + rand() % 8 : 0;
+        hol_arrival[i] = slot - rand() % (slot + 1);
+    };
+
+    for (i = 0; i < NUM_PORTS; i++) {
+        arrival_output[i] = rand() % NUM_PORTS;
+        arrival_active[i] = occupancy[i * NUM_PORTS + arrival_output[i]] > 0;
+    };
+};
+
+/*  Returns the size of the matching, or -1 if it is not a valid matching of
+    non-empty VOQs or its forward and inverse mappings disagree. */
+static int matching_size(const port_matching_t *matching) {
+    int size = 0;
+    int i;
+    for (i = 0; i < NUM_PORTS; i++) {
+        port_num_t output_port = matching->in_to_out[i];
+
+        if (output_port != PORT_UNMATCHED) {
+            if (
+                output_port >= NUM_PORTS ||
+                matching->out_to_in[output_port] != i ||
+                occupancy[i * NUM_PORTS + output_port] == 0
+            ) {
+                return -1;
+            };
+
+            size++;
+        };
+    };
+
+    for (i = 0; i < NUM_PORTS; i++) {
+        port_num_t input_port = matching->out_to_in[i];
+
+        if (
+            input_port != PORT_UNMATCHED &&
+            matching->in_to_out[input_port] != i
+        ) {
+            return -1;
+        };
+    };
+
+    return size == matching->size ? size : -1;
+};
+
+/*  Run a scheduler over random VOQ states, checking every matching is valid
+    and no larger than the maximum size matching. The matching is reused
+    between slots, as it is in the switch. */
+static int scheduler_valid(i_crossbar_scheduler_t scheduler) {
+    i_crossbar_scheduler_t reference = hopcroft_karp_scheduler();
+
+    void *state = scheduler.init(NUM_PORTS);
+    void *reference_state = reference.init(NUM_PORTS);
+    port_matching_t *matching = port_matching_create(NUM_PORTS);
+    port_matching_t *reference_matching = port_matching_create(NUM_PORTS);
+
+    int valid = 1;
+    int trial;
+    for (trial = 0; trial < NUM_TRIALS && valid; trial++) {
+        randomise_voqs(trial, 1 + trial % 6);
+        sched_voq_state_t voq_state = voq_state_create(trial, matching);
+
+        reference.schedule(reference_state, &voq_state, reference_matching);
+        int maximum = matching_size(reference_matching);
+
+        scheduler.schedule(state, &voq_state, matching);
+        int size = matching_size(matching);
+
+        valid = maximum >= 0 && size >= 0 && size <= maximum;
+    };
+
+    scheduler.free(state);
+    reference.free(reference_state);
+    port_matching_free(matching);
+    port_matching_free(reference_matching);
+
+    return valid;
+};
+
+/*  Tests. */
+DEFINE_TEST(test_iSLIP_valid)
+    ASSERT_TRUE(scheduler_valid(iSLIP_scheduler()))
+END_TEST
+
+DEFINE_TEST(test_pim_valid)
+    ASSERT_TRUE(scheduler_valid(pim_scheduler()))
+END_TEST
+
+DEFINE_TEST(test_iLQF_valid)
+    ASSERT_TRUE(scheduler_valid(iLQF_scheduler()))
+END_TEST
+
+DEFINE_TEST(test_iOCF_valid)
+    ASSERT_TRUE(scheduler_valid(iOCF_scheduler()))
+END_TEST
+
+DEFINE_TEST(test_drrm_valid)
+    ASSERT_TRUE(scheduler_valid(drrm_scheduler()))
+END_TEST
+
+DEFINE_TEST(test_serena_valid)
+    ASSERT_TRUE(scheduler_valid(serena_scheduler()))
+END_TEST
+
+DEFINE_TEST(test_empty_voqs_unmatched)
+    i_crossbar_scheduler_t scheduler = iSLIP_scheduler();
+    void *state = scheduler.init(NUM_PORTS);
+    port_matching_t *matching = port_matching_create(NUM_PORTS);
+
+    memset(occupancy, 0, sizeof(occupancy));
+    sched_voq_state_t voq_state = voq_state_create(0, matching);
+    scheduler.schedule(state, &voq_state, matching);
+
+    ASSERT_EQ(0, matching_size(matching))
+
+    scheduler.free(state);
+    port_matching_free(matching);
+END_TEST
+
+/*  A full request matrix must give a perfect matching from the maximum size
+    matching, and the same from iSLIP once its pointers have desynchronised. */
+DEFINE_TEST(test_full_voqs_perfect_matching)
+    i_crossbar_scheduler_t reference = hopcroft_karp_scheduler();
+    i_crossbar_scheduler_t scheduler = iSLIP_scheduler();
+    void *reference_state = reference.init(NUM_PORTS);
+    void *state = scheduler.init(NUM_PORTS);
+    port_matching_t *matching = port_matching_create(NUM_PORTS);
+
+    int i;
+    for (i = 0; i < NUM_PORTS * NUM_PORTS; i++) {
+        occupancy[i] = 1;
+    };
+    sched_voq_state_t voq_state = voq_state_create(0, matching);
+
+    reference.schedule(reference_state, &voq_state, matching);
+    ASSERT_EQ(NUM_PORTS, matching_size(matching))
+
+    for (i = 0; i < NUM_PORTS; i++) {
+        scheduler.schedule(state, &voq_state, matching);
+    };
+    ASSERT_EQ(NUM_PORTS, matching_size(matching))
+
+    reference.free(reference_state);
+    scheduler.free(state);
+    port_matching_free(matching);
+END_TEST
+
+/*  Input 0 requests outputs 0 and 1, input 1 requests only output 0. A
+    greedy choice of (0, 0) leaves a matching of size 1, whereas the maximum
+    size matching has size 2. */
+DEFINE_TEST(test_hopcroft_karp_augments)
+    i_crossbar_scheduler_t reference = hopcroft_karp_scheduler();
+    void *reference_state = reference.init(NUM_PORTS);
+    port_matching_t *matching = port_matching_create(NUM_PORTS);
+
+    memset(occupancy, 0, sizeof(occupancy));
+    occupancy[0 * NUM_PORTS + 0] = 1;
+    occupancy[0 * NUM_PORTS + 1] = 1;
+    occupancy[1 * NUM_PORTS + 0] = 1;
+    sched_voq_state_t voq_state = voq_state_create(0, matching);
+
+    reference.schedule(reference_state, &voq_state, matching);
+
+    ASSERT_EQ(2, matching_size(matching))
+    ASSERT_EQ(1, matching->in_to_out[0])
+    ASSERT_EQ(0, matching->in_to_out[1])
+    ASSERT_EQ(1, matching->out_to_in[0])
+    ASSERT_EQ(0, matching->out_to_in[1])
+
+    reference.free(reference_state);
+    port_matching_free(matching);
+END_TEST
+
+/*  iOCF must serve the oldest head of line cell when two inputs contend. */
+DEFINE_TEST(test_iOCF_oldest_first)
+    i_crossbar_scheduler_t scheduler = iOCF_scheduler();
+    void *state = scheduler.init(NUM_PORTS);
+    port_matching_t *matching = port_matching_create(NUM_PORTS);
+
+    memset(occupancy, 0, sizeof(occupancy));
+    occupancy[0 * NUM_PORTS + 3] = 5;
+    occupancy[7 * NUM_PORTS + 3] = 1;
+    hol_arrival[0 * NUM_PORTS + 3] = 90;
+    hol_arrival[7 * NUM_PORTS + 3] = 10;
+    sched_voq_state_t voq_state = voq_state_create(100, matching);
+
+    scheduler.schedule(state, &voq_state, matching);
+
+    ASSERT_EQ(7, matching->out_to_in[3])
+
+    scheduler.free(state);
+    port_matching_free(matching);
+END_TEST
+
+/*  iLQF must serve the longest queue when two inputs contend. */
+DEFINE_TEST(test_iLQF_longest_first)
+    i_crossbar_scheduler_t scheduler = iLQF_scheduler();
+    void *state = scheduler.init(NUM_PORTS);
+    port_matching_t *matching = port_matching_create(NUM_PORTS);
+
+    memset(occupancy, 0, sizeof(occupancy));
+    occupancy[0 * NUM_PORTS + 3] = 5;
+    occupancy[7 * NUM_PORTS + 3] = 1;
+    sched_voq_state_t voq_state = voq_state_create(100, matching);
+
+    scheduler.schedule(state, &voq_state, matching);
+
+    ASSERT_EQ(0, matching->out_to_in[3])
+
+    scheduler.free(state);
+    port_matching_free(matching);
+END_TEST
+
+/*  SERENA must keep a heavier previous matching over a lighter arrival one.
+    Previously 0 -> 0 and 1 -> 1 (weight 10 each), and a cell has just
+    arrived for 0 -> 1 (weight 1), whose component is the whole union. */
+DEFINE_TEST(test_serena_keeps_heavier_matching)
+    i_crossbar_scheduler_t scheduler = serena_scheduler();
+    void *state = scheduler.init(NUM_PORTS);
+    port_matching_t *matching = port_matching_create(NUM_PORTS);
+
+    memset(occupancy, 0, sizeof(occupancy));
+    memset(arrival_active, 0, sizeof(arrival_active));
+    occupancy[0 * NUM_PORTS + 0] = 10;
+    occupancy[1 * NUM_PORTS + 1] = 10;
+    occupancy[0 * NUM_PORTS + 1] = 1;
+    port_matching_add(matching, 0, 0);
+    port_matching_add(matching, 1, 1);
+    arrival_output[0] = 1;
+    arrival_active[0] = 1;
+    sched_voq_state_t voq_state = voq_state_create(0, matching);
+
+    scheduler.schedule(state, &voq_state, matching);
+
+    ASSERT_EQ(2, matching_size(matching))
+    ASSERT_EQ(0, matching->in_to_out[0])
+    ASSERT_EQ(1, matching->in_to_out[1])
+
+    scheduler.free(state);
+    port_matching_free(matching);
+END_TEST
+
+/*  Clearing a matching must reset both directions. */
+DEFINE_TEST(test_port_matching_clear)
+    port_matching_t *matching = port_matching_create(NUM_PORTS);
+
+    port_matching_add(matching, 2, 5);
+    port_matching_add(matching, 5, 2);
+    ASSERT_EQ(2, matching->size)
+    ASSERT_EQ(5, matching->out_to_in[2])
+
+    port_matching_clear(matching);
+    ASSERT_EQ(0, matching->size)
+    ASSERT_EQ(PORT_UNMATCHED, matching->in_to_out[2])
+    ASSERT_EQ(PORT_UNMATCHED, matching->out_to_in[5])
+
+    port_matching_free(matching);
+END_TEST
+
+REGISTER_TESTS(
+    test_iSLIP_valid,
+    test_pim_valid,
+    test_iLQF_valid,
+    test_iOCF_valid,
+    test_drrm_valid,
+    test_serena_valid,
+    test_empty_voqs_unmatched,
+    test_full_voqs_perfect_matching,
+    test_hopcroft_karp_augments,
+    test_iOCF_oldest_first,
+    test_iLQF_longest_first,
+    test_serena_keeps_heavier_matching,
+    test_port_matching_clear
+)
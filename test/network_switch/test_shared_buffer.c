@@ -0,0 +1,170 @@
+/*  test_shared_buffer.c */
+
+#include "./../test.h"
+#include "shared_buffer.h"
+#include "voq_matrix.h"
+#include <assert.h>
+
+#define NUM_PORTS 4
+
+/*  Test helpers. */
+
+/*  Offer a cell to the VOQ from input_port to output_port, enqueueing it if
+    admitted. */
+static int offer(
+    shared_buffer_t shared_buffer,
+    voq_matrix_t voq_matrix,
+    port_num_t input_port,
+    port_num_t output_port
+) {
+    if (!shared_buffer_admit(
+        shared_buffer,
+        voq_matrix,
+        input_port,
+        output_port
+    )) {
+        return 0;
+    };
+
+    packet_desc_t cell;
+    cell.arrival_slot = 0;
+    cell.flow_id = input_port * NUM_PORTS + output_port;
+    cell.payload = PACKET_REF_NONE;
+    cell.src_port = input_port;
+    cell.dst_port = output_port;
+    cell.length = PACKET_SIZE;
+
+    voq_matrix_enqueue(voq_matrix, input_port, output_port, cell);
+
+    return 1;
+};
+
+static shared_buffer_config_t config_create(
+    buffer_policy_t policy,
+    unsigned long capacity
+) {
+    shared_buffer_config_t config;
+    config.policy = policy;
+    config.capacity = capacity;
+    config.voq_threshold = 3;
+    config.alpha = 1.0;
+
+    return config;
+};
+
+/*  Tests. */
+DEFINE_TEST(test_shared_buffer_unbounded)
+    voq_matrix_t voq_matrix =
+        voq_matrix_create(NUM_PORTS, VOQ_MODE_COUNTS, 0, VOQ_IDLE_NEVER);
+    shared_buffer_t shared_buffer =
+        shared_buffer_create(NUM_PORTS, shared_buffer_unbounded_config());
+    shared_buffer_stats_t stats;
+
+    int i;
+    for (i = 0; i < 1000; i++) {
+        ASSERT_EQ(1, offer(shared_buffer, voq_matrix, 0, 0))
+    };
+
+    shared_buffer_stats(shared_buffer, &stats);
+    ASSERT_EQ(1000, stats.admitted)
+    ASSERT_EQ(0, stats.dropped)
+    ASSERT_EQ(1000, stats.high_water)
+
+    shared_buffer_free(shared_buffer);
+    voq_matrix_free(voq_matrix, NULL);
+END_TEST
+
+/*  Tail drop must fill the buffer from a single VOQ, and admit again once a
+    cell leaves. */
+DEFINE_TEST(test_shared_buffer_tail_drop)
+    voq_matrix_t voq_matrix =
+        voq_matrix_create(NUM_PORTS, VOQ_MODE_COUNTS, 0, VOQ_IDLE_NEVER);
+    shared_buffer_t shared_buffer = shared_buffer_create(
+        NUM_PORTS,
+        config_create(BUFFER_POLICY_TAIL_DROP, 8)
+    );
+    shared_buffer_stats_t stats;
+    packet_desc_t cell;
+
+    int i;
+    for (i = 0; i < 8; i++) {
+        ASSERT_EQ(1, offer(shared_buffer, voq_matrix, 1, 2))
+    };
+    ASSERT_EQ(0, offer(shared_buffer, voq_matrix, 1, 2))
+    ASSERT_EQ(0, offer(shared_buffer, voq_matrix, 3, 0))
+
+    voq_matrix_dequeue(voq_matrix, 1, 2, &cell);
+    ASSERT_EQ(1, offer(shared_buffer, voq_matrix, 3, 0))
+
+    shared_buffer_stats(shared_buffer, &stats);
+    ASSERT_EQ(9, stats.admitted)
+    ASSERT_EQ(2, stats.dropped)
+    ASSERT_EQ(2, stats.dropped_full)
+    ASSERT_EQ(0, stats.dropped_threshold)
+    ASSERT_EQ(8, stats.high_water)
+    ASSERT_EQ(1, shared_buffer_output_drops(shared_buffer)[2])
+    ASSERT_EQ(1, shared_buffer_output_drops(shared_buffer)[0])
+
+    shared_buffer_free(shared_buffer);
+    voq_matrix_free(voq_matrix, NULL);
+END_TEST
+
+/*  A static threshold must cap each VOQ, but not the others. */
+DEFINE_TEST(test_shared_buffer_static)
+    voq_matrix_t voq_matrix =
+        voq_matrix_create(NUM_PORTS, VOQ_MODE_COUNTS, 0, VOQ_IDLE_NEVER);
+    shared_buffer_t shared_buffer = shared_buffer_create(
+        NUM_PORTS,
+        config_create(BUFFER_POLICY_STATIC, 100)
+    );
+    shared_buffer_stats_t stats;
+
+    int i;
+    for (i = 0; i < 3; i++) {
+        ASSERT_EQ(1, offer(shared_buffer, voq_matrix, 0, 1))
+    };
+    ASSERT_EQ(0, offer(shared_buffer, voq_matrix, 0, 1))
+    ASSERT_EQ(1, offer(shared_buffer, voq_matrix, 0, 2))
+
+    shared_buffer_stats(shared_buffer, &stats);
+    ASSERT_EQ(1, stats.dropped_threshold)
+    ASSERT_EQ(0, stats.dropped_full)
+
+    shared_buffer_free(shared_buffer);
+    voq_matrix_free(voq_matrix, NULL);
+END_TEST
+
+/*  With alpha 1, a single active VOQ settles at half the buffer, and
+    leaves room for others. */
+DEFINE_TEST(test_shared_buffer_dynamic)
+    voq_matrix_t voq_matrix =
+        voq_matrix_create(NUM_PORTS, VOQ_MODE_COUNTS, 0, VOQ_IDLE_NEVER);
+    shared_buffer_t shared_buffer = shared_buffer_create(
+        NUM_PORTS,
+        config_create(BUFFER_POLICY_DYNAMIC, 64)
+    );
+    shared_buffer_stats_t stats;
+
+    int i;
+    for (i = 0; i < 100; i++) {
+        offer(shared_buffer, voq_matrix, 2, 2);
+    };
+    ASSERT_EQ(32, voq_matrix_size(voq_matrix, 2, 2))
+
+    ASSERT_EQ(1, offer(shared_buffer, voq_matrix, 1, 3))
+
+    shared_buffer_stats(shared_buffer, &stats);
+    ASSERT_EQ(68, stats.dropped_threshold)
+    ASSERT_EQ(0, stats.dropped_full)
+    ASSERT_EQ(68, shared_buffer_output_drops(shared_buffer)[2])
+
+    shared_buffer_free(shared_buffer);
+    voq_matrix_free(voq_matrix, NULL);
+END_TEST
+
+REGISTER_TESTS(
+    test_shared_buffer_unbounded,
+    test_shared_buffer_tail_drop,
+    test_shared_buffer_static,
+    test_shared_buffer_dynamic
+)
@@ -0,0 +1,416 @@
+/*  test_voq_matrix.c */
+
+#include "./../test.h"
+#include "voq_matrix.h"
+#include "packet_pool.h"
+#include <assert.h>
+
+#define NUM_PORTS 4
+#define NUM_BULK_CELLS 40
+
+/*  Test helpers. */
+static packet_desc_t cell_create(uint32_t arrival_slot) {
+    void *packet = packet_alloc();
+    assert(packet);
+
+    packet_desc_t cell;
+    cell.arrival_slot = arrival_slot;
+    cell.flow_id = 0;
+    cell.payload = packet_ref(packet);
+    cell.src_port = 0;
+    cell.dst_port = 0;
+    cell.length = PACKET_SIZE;
+
+    return cell;
+};
+
+/*  Tests. */
+DEFINE_TEST(test_voq_matrix_create_free)
+    voq_matrix_t voq_matrix =
+        voq_matrix_create(NUM_PORTS, VOQ_MODE_PACKETS, 0, VOQ_IDLE_NEVER);
+    assert(voq_matrix);
+    voq_matrix_free(voq_matrix, packet_free);
+END_TEST
+
+DEFINE_TEST(test_voq_matrix_memory_free)
+    voq_matrix_t voq_matrix =
+        voq_matrix_create(NUM_PORTS, VOQ_MODE_PACKETS, 0, VOQ_IDLE_NEVER);
+
+    voq_matrix_enqueue(voq_matrix, 1, 2, cell_create(0));
+    voq_matrix_enqueue(voq_matrix, 1, 2, cell_create(1));
+    voq_matrix_enqueue(voq_matrix, 3, 0, cell_create(1));
+
+    voq_matrix_free(voq_matrix, packet_free);
+END_TEST
+
+DEFINE_TEST(test_voq_matrix_fifo_order)
+    voq_matrix_t voq_matrix =
+        voq_matrix_create(NUM_PORTS, VOQ_MODE_PACKETS, 0, VOQ_IDLE_NEVER);
+    packet_desc_t cell;
+
+    voq_matrix_enqueue(voq_matrix, 0, 1, cell_create(5));
+    voq_matrix_enqueue(voq_matrix, 0, 1, cell_create(6));
+
+    ASSERT_EQ(1, voq_matrix_dequeue(voq_matrix, 0, 1, &cell))
+    ASSERT_EQ(5, cell.arrival_slot)
+    packet_free(packet_deref(cell.payload));
+
+    ASSERT_EQ(1, voq_matrix_dequeue(voq_matrix, 0, 1, &cell))
+    ASSERT_EQ(6, cell.arrival_slot)
+    packet_free(packet_deref(cell.payload));
+
+    ASSERT_EQ(0, voq_matrix_dequeue(voq_matrix, 0, 1, &cell))
+
+    voq_matrix_free(voq_matrix, packet_free);
+END_TEST
+
+/*  Interleave enqueues and dequeues with small blocks, so the queue chains
+    on and drops several blocks while partly read, which must preserve
+    order. */
+DEFINE_TEST(test_voq_matrix_block_chain)
+    voq_matrix_t voq_matrix =
+        voq_matrix_create(NUM_PORTS, VOQ_MODE_PACKETS, 4, VOQ_IDLE_NEVER);
+    packet_desc_t cell;
+
+    unsigned long next_in = 0;
+    unsigned long next_out = 0;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        voq_matrix_enqueue(voq_matrix, 2, 3, cell_create(next_in++));
+    };
+
+    for (i = 0; i < 2; i++) {
+        voq_matrix_dequeue(voq_matrix, 2, 3, &cell);
+        ASSERT_EQ(next_out, cell.arrival_slot)
+        next_out++;
+        packet_free(packet_deref(cell.payload));
+    };
+
+    for (i = 0; i < 20; i++) {
+        voq_matrix_enqueue(voq_matrix, 2, 3, cell_create(next_in++));
+    };
+
+    ASSERT_EQ(21, voq_matrix_size(voq_matrix, 2, 3))
+
+    while (voq_matrix_dequeue(voq_matrix, 2, 3, &cell)) {
+        ASSERT_EQ(next_out, cell.arrival_slot)
+        next_out++;
+        packet_free(packet_deref(cell.payload));
+    };
+
+    ASSERT_EQ(next_in, next_out)
+
+    voq_matrix_free(voq_matrix, packet_free);
+END_TEST
+
+DEFINE_TEST(test_voq_matrix_bulk_queries)
+    voq_matrix_t voq_matrix =
+        voq_matrix_create(NUM_PORTS, VOQ_MODE_PACKETS, 0, VOQ_IDLE_NEVER);
+    packet_desc_t cell;
+
+    voq_matrix_enqueue(voq_matrix, 1, 2, cell_create(7));
+    voq_matrix_enqueue(voq_matrix, 1, 2, cell_create(8));
+    voq_matrix_enqueue(voq_matrix, 1, 3, cell_create(9));
+    voq_matrix_enqueue(voq_matrix, 0, 2, cell_create(9));
+
+    ASSERT_EQ(2, voq_matrix_size(voq_matrix, 1, 2))
+    ASSERT_EQ(1, voq_matrix_size(voq_matrix, 1, 3))
+    ASSERT_EQ(0, voq_matrix_size(voq_matrix, 2, 1))
+    ASSERT_EQ(7, voq_matrix_hol_arrival(voq_matrix, 1, 2))
+    ASSERT_EQ(3, voq_matrix_input_backlog(voq_matrix)[1])
+    ASSERT_EQ(3, voq_matrix_output_backlog(voq_matrix)[2])
+    ASSERT_EQ(4, voq_matrix_total_backlog(voq_matrix))
+
+    voq_matrix_dequeue(voq_matrix, 1, 2, &cell);
+    packet_free(packet_deref(cell.payload));
+
+    ASSERT_EQ(1, voq_matrix_size(voq_matrix, 1, 2))
+    ASSERT_EQ(8, voq_matrix_hol_arrival(voq_matrix, 1, 2))
+    ASSERT_EQ(2, voq_matrix_input_backlog(voq_matrix)[1])
+    ASSERT_EQ(3, voq_matrix_total_backlog(voq_matrix))
+
+    voq_matrix_free(voq_matrix, packet_free);
+END_TEST
+
+/*  The non-empty list of an input must track its VOQs as they fill and
+    drain, in any order. */
+DEFINE_TEST(test_voq_matrix_nonempty_outputs)
+    voq_matrix_t voq_matrix =
+        voq_matrix_create(NUM_PORTS, VOQ_MODE_PACKETS, 0, VOQ_IDLE_NEVER);
+    packet_desc_t cell;
+    port_num_t count;
+
+    voq_matrix_nonempty_outputs(voq_matrix, 1, &count);
+    ASSERT_EQ(0, count)
+
+    voq_matrix_enqueue(voq_matrix, 1, 0, cell_create(0));
+    voq_matrix_enqueue(voq_matrix, 1, 2, cell_create(0));
+    voq_matrix_enqueue(voq_matrix, 1, 2, cell_create(0));
+    voq_matrix_enqueue(voq_matrix, 1, 3, cell_create(0));
+
+    voq_matrix_nonempty_outputs(voq_matrix, 1, &count);
+    ASSERT_EQ(3, count)
+
+    voq_matrix_dequeue(voq_matrix, 1, 0, &cell);
+    packet_free(packet_deref(cell.payload));
+    voq_matrix_dequeue(voq_matrix, 1, 2, &cell);
+    packet_free(packet_deref(cell.payload));
+
+    const port_num_t *outputs =
+        voq_matrix_nonempty_outputs(voq_matrix, 1, &count);
+    ASSERT_EQ(2, count)
+    ASSERT_EQ(5, outputs[0] + outputs[1])
+
+    voq_matrix_dequeue(voq_matrix, 1, 3, &cell);
+    packet_free(packet_deref(cell.payload));
+
+    outputs = voq_matrix_nonempty_outputs(voq_matrix, 1, &count);
+    ASSERT_EQ(1, count)
+    ASSERT_EQ(2, outputs[0])
+
+    voq_matrix_free(voq_matrix, packet_free);
+END_TEST
+
+/*  A drained VOQ must keep its buffer for the idle period and then be
+    released, and a released VOQ must be usable again. */
+DEFINE_TEST(test_voq_matrix_idle_release)
+    voq_matrix_t voq_matrix =
+        voq_matrix_create(NUM_PORTS, VOQ_MODE_PACKETS, 0, 2);
+    packet_desc_t cell;
+
+    ASSERT_EQ(0, voq_matrix_active_voqs(voq_matrix))
+
+    voq_matrix_enqueue(voq_matrix, 0, 1, cell_create(0));
+    voq_matrix_enqueue(voq_matrix, 2, 3, cell_create(0));
+    ASSERT_EQ(2, voq_matrix_active_voqs(voq_matrix))
+
+    voq_matrix_advance(voq_matrix, 1);
+    voq_matrix_dequeue(voq_matrix, 0, 1, &cell);
+    packet_free(packet_deref(cell.payload));
+
+    voq_matrix_advance(voq_matrix, 2);
+    ASSERT_EQ(2, voq_matrix_active_voqs(voq_matrix))
+
+    voq_matrix_advance(voq_matrix, 3);
+    ASSERT_EQ(1, voq_matrix_active_voqs(voq_matrix))
+    ASSERT_EQ(0, voq_matrix_size(voq_matrix, 0, 1))
+
+    voq_matrix_enqueue(voq_matrix, 0, 1, cell_create(3));
+    ASSERT_EQ(2, voq_matrix_active_voqs(voq_matrix))
+    ASSERT_EQ(1, voq_matrix_dequeue(voq_matrix, 0, 1, &cell))
+    ASSERT_EQ(3, cell.arrival_slot)
+    packet_free(packet_deref(cell.payload));
+
+    voq_matrix_free(voq_matrix, packet_free);
+END_TEST
+
+/*  A VOQ which refills during its idle period must not be released. */
+DEFINE_TEST(test_voq_matrix_refill_not_released)
+    voq_matrix_t voq_matrix =
+        voq_matrix_create(NUM_PORTS, VOQ_MODE_PACKETS, 0, 2);
+    packet_desc_t cell;
+
+    voq_matrix_enqueue(voq_matrix, 3, 3, cell_create(0));
+    voq_matrix_dequeue(voq_matrix, 3, 3, &cell);
+    packet_free(packet_deref(cell.payload));
+
+    voq_matrix_advance(voq_matrix, 1);
+    voq_matrix_enqueue(voq_matrix, 3, 3, cell_create(1));
+
+    voq_matrix_advance(voq_matrix, 10);
+    ASSERT_EQ(1, voq_matrix_active_voqs(voq_matrix))
+    ASSERT_EQ(1, voq_matrix_size(voq_matrix, 3, 3))
+
+    voq_matrix_free(voq_matrix, packet_free);
+END_TEST
+
+/*  On a large switch only the VOQs used are materialised, and an input's
+    VOQs must be found as they come and go in any order, here every output
+    of one input, of which every third is then released. */
+DEFINE_TEST(test_voq_matrix_many_ports)
+    port_num_t num_ports = 4096;
+    voq_matrix_t voq_matrix =
+        voq_matrix_create(num_ports, VOQ_MODE_COUNTS, 0, 1);
+    packet_desc_t cell;
+    cell.flow_id = 0;
+    cell.payload = PACKET_REF_NONE;
+    cell.src_port = 7;
+    cell.length = PACKET_SIZE;
+
+    port_num_t j;
+    for (j = 0; j < num_ports; j++) {
+        cell.arrival_slot = j;
+        cell.dst_port = j;
+        voq_matrix_enqueue(voq_matrix, 7, j, cell);
+    };
+
+    ASSERT_EQ(num_ports, voq_matrix_active_voqs(voq_matrix))
+    ASSERT_EQ(0, voq_matrix_size(voq_matrix, 6, 0))
+
+    for (j = 0; j < num_ports; j += 3) {
+        ASSERT_EQ(1, voq_matrix_dequeue(voq_matrix, 7, j, &cell))
+        ASSERT_EQ(j, cell.arrival_slot)
+    };
+
+    voq_matrix_advance(voq_matrix, 1);
+    port_num_t released = (num_ports + 2) / 3;
+    ASSERT_EQ(num_ports - released, voq_matrix_active_voqs(voq_matrix))
+
+    for (j = 0; j < num_ports; j++) {
+        ASSERT_EQ((j % 3 != 0), voq_matrix_size(voq_matrix, 7, j))
+    };
+
+    for (j = 1; j < num_ports; j += 3) {
+        ASSERT_EQ(j, voq_matrix_hol_arrival(voq_matrix, 7, j))
+    };
+
+    voq_matrix_free(voq_matrix, NULL);
+END_TEST
+
+/*  Descriptors must come back whole, with their payload, and with fields
+    at their widest. */
+DEFINE_TEST(test_voq_matrix_descriptor)
+    voq_matrix_t voq_matrix =
+        voq_matrix_create(NUM_PORTS, VOQ_MODE_PACKETS, 0, VOQ_IDLE_NEVER);
+    uint32_t flow_id = PACKET_DESC_MAX_PORTS * PACKET_DESC_MAX_PORTS - 1;
+    packet_desc_t cell = cell_create(0xfffffffe);
+    cell.flow_id = flow_id;
+    cell.src_port = 2;
+    cell.dst_port = PACKET_DESC_MAX_PORTS - 1;
+    cell.length = PACKET_DESC_MAX_LENGTH;
+    void *packet = packet_deref(cell.payload);
+
+    voq_matrix_enqueue(voq_matrix, 2, 3, cell);
+    ASSERT_EQ(0xfffffffe, voq_matrix_hol_arrival(voq_matrix, 2, 3))
+
+    ASSERT_EQ(1, voq_matrix_dequeue(voq_matrix, 2, 3, &cell))
+    ASSERT_EQ(0xfffffffe, cell.arrival_slot)
+    ASSERT_EQ(flow_id, cell.flow_id)
+    ASSERT_EQ(2, cell.src_port)
+    ASSERT_EQ((PACKET_DESC_MAX_PORTS - 1), cell.dst_port)
+    ASSERT_EQ(PACKET_DESC_MAX_LENGTH, cell.length)
+    ASSERT_TRUE((packet_deref(cell.payload) == packet))
+    packet_free(packet);
+
+    voq_matrix_free(voq_matrix, packet_free);
+END_TEST
+
+/*  In counts mode cells come back without their payload but with their
+    arrival slot, in order, across several blocks, and with the rest of
+    the descriptor rebuilt from the VOQ. */
+DEFINE_TEST(test_voq_matrix_counts_mode)
+    voq_matrix_t voq_matrix =
+        voq_matrix_create(NUM_PORTS, VOQ_MODE_COUNTS, 2, VOQ_IDLE_NEVER);
+    packet_desc_t cell;
+    cell.flow_id = 0;
+    cell.payload = PACKET_REF_NONE;
+    cell.src_port = 1;
+    cell.dst_port = 2;
+    cell.length = PACKET_SIZE;
+
+    uint32_t slot;
+    for (slot = 0; slot < 10; slot++) {
+        cell.arrival_slot = slot;
+        voq_matrix_enqueue(voq_matrix, 1, 2, cell);
+    };
+
+    ASSERT_EQ(10, voq_matrix_size(voq_matrix, 1, 2))
+    ASSERT_EQ(0, voq_matrix_hol_arrival(voq_matrix, 1, 2))
+
+    for (slot = 0; slot < 10; slot++) {
+        ASSERT_EQ(1, voq_matrix_dequeue(voq_matrix, 1, 2, &cell))
+        ASSERT_EQ(slot, cell.arrival_slot)
+        ASSERT_EQ((1 * NUM_PORTS + 2), cell.flow_id)
+        ASSERT_EQ(1, cell.src_port)
+        ASSERT_EQ(2, cell.dst_port)
+        ASSERT_TRUE((cell.payload == PACKET_REF_NONE))
+    };
+
+    voq_matrix_free(voq_matrix, packet_free);
+END_TEST
+
+/*  Bulk enqueue and dequeue must keep cells in order across blocks, mixed
+    with single cell operations, and keep the bulk queries up to date, in
+    both modes. */
+DEFINE_TEST(test_voq_matrix_bulk)
+    packet_desc_t cells[NUM_BULK_CELLS];
+    packet_desc_t out[NUM_BULK_CELLS];
+
+    unsigned int k;
+    for (k = 0; k < NUM_BULK_CELLS; k++) {
+        cells[k].arrival_slot = k;
+        cells[k].flow_id = 1 * NUM_PORTS + 2;
+        cells[k].payload = PACKET_REF_NONE;
+        cells[k].src_port = 1;
+        cells[k].dst_port = 2;
+        cells[k].length = PACKET_SIZE;
+    };
+
+    int mode;
+    for (mode = 0; mode < 2; mode++) {
+        voq_matrix_t voq_matrix = voq_matrix_create(
+            NUM_PORTS,
+            mode ? VOQ_MODE_COUNTS : VOQ_MODE_PACKETS,
+            3,
+            VOQ_IDLE_NEVER
+        );
+
+        voq_matrix_enqueue_bulk(voq_matrix, 1, 2, cells, 0);
+        ASSERT_EQ(0, voq_matrix_size(voq_matrix, 1, 2))
+
+        voq_matrix_enqueue(voq_matrix, 1, 2, cells[0]);
+        voq_matrix_enqueue_bulk(voq_matrix, 1, 2, cells + 1, 10);
+        voq_matrix_enqueue_bulk(
+            voq_matrix, 1, 2, cells + 11, NUM_BULK_CELLS - 11
+        );
+        ASSERT_EQ(NUM_BULK_CELLS, voq_matrix_size(voq_matrix, 1, 2))
+        ASSERT_EQ(NUM_BULK_CELLS, voq_matrix_input_backlog(voq_matrix)[1])
+        ASSERT_EQ(NUM_BULK_CELLS, voq_matrix_output_backlog(voq_matrix)[2])
+        ASSERT_EQ(0, voq_matrix_hol_arrival(voq_matrix, 1, 2))
+
+        ASSERT_EQ(1, voq_matrix_dequeue(voq_matrix, 1, 2, out))
+        ASSERT_EQ(4, voq_matrix_dequeue_bulk(voq_matrix, 1, 2, out + 1, 4))
+        ASSERT_EQ(5, voq_matrix_hol_arrival(voq_matrix, 1, 2))
+        ASSERT_EQ(
+            (NUM_BULK_CELLS - 5),
+            voq_matrix_dequeue_bulk(voq_matrix, 1, 2, out + 5, NUM_BULK_CELLS)
+        )
+        ASSERT_EQ(0, voq_matrix_dequeue_bulk(voq_matrix, 1, 2, out, 1))
+        ASSERT_EQ(0, voq_matrix_size(voq_matrix, 1, 2))
+        ASSERT_EQ(0, voq_matrix_total_backlog(voq_matrix))
+
+        port_num_t count;
+        voq_matrix_nonempty_outputs(voq_matrix, 1, &count);
+        ASSERT_EQ(0, count)
+
+        for (k = 0; k < NUM_BULK_CELLS; k++) {
+            ASSERT_EQ(k, out[k].arrival_slot)
+            ASSERT_EQ((1 * NUM_PORTS + 2), out[k].flow_id)
+            ASSERT_EQ(2, out[k].dst_port)
+        };
+
+        /*  A drained VOQ refills from the start of its last block. */
+        voq_matrix_enqueue_bulk(voq_matrix, 1, 2, cells + 3, 7);
+        ASSERT_EQ(3, voq_matrix_hol_arrival(voq_matrix, 1, 2))
+        ASSERT_EQ(7, voq_matrix_dequeue_bulk(voq_matrix, 1, 2, out, 10))
+        ASSERT_EQ(9, out[6].arrival_slot)
+
+        voq_matrix_free(voq_matrix, NULL);
+    };
+END_TEST
+
+REGISTER_TESTS(
+    test_voq_matrix_create_free,
+    test_voq_matrix_memory_free,
+    test_voq_matrix_fifo_order,
+    test_voq_matrix_block_chain,
+    test_voq_matrix_bulk_queries,
+    test_voq_matrix_nonempty_outputs,
+    test_voq_matrix_idle_release,
+    test_voq_matrix_refill_not_released,
+    test_voq_matrix_many_ports,
+    test_voq_matrix_descriptor,
+    test_voq_matrix_counts_mode,
+    test_voq_matrix_bulk
+)
@@ -0,0 +1,132 @@
+/*  test_simulator.c */
+
+#include "./../test.h"
+#include "simulator.h"
+#include <assert.h>
+
+#define EVT_RECORD 1
+#define EVT_REPEAT 2
+#define EVT_NO_FREE 3
+
+/*  Values of the recorded events in the order they were dispatched, the
+    dispatches of the repeating event, and the arguments freed. */
+static int dispatched[16];
+static int num_dispatched;
+static int repeats;
+static int freed;
+
+/*  Helper functions. */
+
+/*  Time slots from now - UINT_TIME times are unsigned integers, which the
+    simulator takes ownership of. */
+static void *after(unsigned int slots) {
+    unsigned int *time = (unsigned int *) malloc(sizeof(unsigned int));
+    assert(time);
+
+    *time = slots;
+    return time;
+};
+
+static int *value_create(int value) {
+    int *arg = (int *) malloc(sizeof(int));
+    assert(arg);
+
+    *arg = value;
+    return arg;
+};
+
+static void value_free(void *arg) {
+    assert(arg);
+
+    freed++;
+    free(arg);
+};
+
+static void record_callback(void *arg) {
+    dispatched[num_dispatched++] = *(int *) arg;
+};
+
+/*  Repeat every slot, stopping the simulation on the tenth. */
+static void repeat_callback(void *arg) {
+    repeats++;
+
+    simulator_invoke_event(EVT_REPEAT, value_create(repeats), after(1));
+
+    if (repeats == 10) {
+        simulator_set_should_terminate();
+    };
+
+    (void) arg;
+};
+
+static void simulation_start() {
+    num_dispatched = 0;
+    repeats = 0;
+    freed = 0;
+
+    simulator_init(UINT_TIME, NULL, NULL, NULL, NULL, NULL);
+    simulator_register_event(EVT_RECORD, record_callback, value_free);
+    simulator_register_event(EVT_REPEAT, repeat_callback, value_free);
+    simulator_register_event(EVT_NO_FREE, record_callback, NULL);
+};
+
+/*  Tests. */
+
+/*  Events must be dispatched in order of time, each freeing its argument. */
+DEFINE_TEST(test_simulator_order)
+    simulation_start();
+
+    simulator_invoke_event(EVT_RECORD, value_create(5), after(5));
+    simulator_invoke_event(EVT_RECORD, value_create(1), after(1));
+    simulator_invoke_event(EVT_RECORD, value_create(3), after(3));
+    simulator_main_loop();
+
+    ASSERT_EQ(3, num_dispatched)
+    ASSERT_EQ(1, dispatched[0])
+    ASSERT_EQ(3, dispatched[1])
+    ASSERT_EQ(5, dispatched[2])
+    ASSERT_EQ(3, freed)
+
+    simulator_terminate();
+END_TEST
+
+/*  Events invoked by callbacks must be timed from the current event, and
+    the loop must stop when asked to, leaving the rest to be freed by
+    simulator_terminate. */
+DEFINE_TEST(test_simulator_terminate)
+    simulation_start();
+
+    simulator_invoke_event(EVT_REPEAT, value_create(0), after(0));
+    simulator_invoke_event(EVT_RECORD, value_create(8), after(8));
+    simulator_invoke_event(EVT_RECORD, value_create(20), after(20));
+    simulator_main_loop();
+
+    ASSERT_EQ(10, repeats)
+    ASSERT_EQ(1, num_dispatched)
+    ASSERT_EQ(8, dispatched[0])
+    ASSERT_EQ(11, freed)
+
+    simulator_terminate();
+    ASSERT_EQ(13, freed)
+END_TEST
+
+/*  Events registered without a free function must still be dispatched. */
+DEFINE_TEST(test_simulator_no_free)
+    simulation_start();
+
+    int value = 7;
+    simulator_invoke_event(EVT_NO_FREE, &value, after(2));
+    simulator_main_loop();
+
+    ASSERT_EQ(1, num_dispatched)
+    ASSERT_EQ(7, dispatched[0])
+    ASSERT_EQ(0, freed)
+
+    simulator_terminate();
+END_TEST
+
+REGISTER_TESTS(
+    test_simulator_order,
+    test_simulator_terminate,
+    test_simulator_no_free
+)
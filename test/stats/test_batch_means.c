@@ -0,0 +1,125 @@
+/*  test_batch_means.c */
+
+#include "./../test.h"
+#include "batch_means.h"
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+
+/*  Helper functions. */
+
+/*  Next of a sequence of values uniform in [0, 1), from a 64 bit linear
+    congruential generator. */
+static double uniform_next(uint64_t *state) {
+    *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+    return (double) (*state >> 11) / (double) (1UL << 53);
+};
+
+/*  Tests. */
+
+/*  The running mean and variance of the batch means must match those found
+    in two passes, and batches with no observations must not count. */
+DEFINE_TEST(test_batch_means_welford)
+    batch_means_t batch_means = batch_means_create();
+
+    ASSERT_EQ(0, batch_means_batches(batch_means))
+    ASSERT_TRUE((isinf(batch_means_half_width(batch_means))))
+
+    double means[50];
+    uint64_t state = 1;
+    int b;
+    for (b = 0; b < 50; b++) {
+        double sum = 0;
+        int k;
+        for (k = 0; k <= b; k++) {
+            double value = 1e6 + uniform_next(&state) * b;
+            batch_means_observe(batch_means, value);
+            sum += value;
+        };
+
+        means[b] = sum / (b + 1);
+        batch_means_end_batch(batch_means);
+        batch_means_end_batch(batch_means);
+    };
+
+    double mean = 0;
+    for (b = 0; b < 50; b++) {
+        mean += means[b] / 50;
+    };
+
+    double variance = 0;
+    for (b = 0; b < 50; b++) {
+        variance += (means[b] - mean) * (means[b] - mean) / 49;
+    };
+
+    ASSERT_EQ(50, batch_means_batches(batch_means))
+    ASSERT_TRUE((fabs(batch_means_mean(batch_means) - mean) < 1e-6))
+    ASSERT_TRUE((fabs(batch_means_variance(batch_means) - variance) <
+        1e-9 * variance))
+
+    batch_means_free(batch_means);
+END_TEST
+
+/*  The half-width of batch means 1 to 5 must be t(0.975, 4) * sqrt(2.5 /
+    5), and that of two batches t(0.975, 1) * sqrt(0.5 / 2). */
+DEFINE_TEST(test_batch_means_half_width)
+    batch_means_t batch_means = batch_means_create();
+
+    batch_means_observe(batch_means, 1);
+    batch_means_end_batch(batch_means);
+    ASSERT_TRUE((isinf(batch_means_half_width(batch_means))))
+
+    batch_means_observe(batch_means, 1);
+    batch_means_observe(batch_means, 3);
+    batch_means_end_batch(batch_means);
+    ASSERT_TRUE((fabs(batch_means_half_width(batch_means) -
+        12.706204736174707 * 0.5) < 1e-9))
+
+    int b;
+    for (b = 3; b <= 5; b++) {
+        batch_means_observe(batch_means, b);
+        batch_means_end_batch(batch_means);
+    };
+
+    ASSERT_TRUE((batch_means_mean(batch_means) == 3))
+    ASSERT_TRUE((batch_means_variance(batch_means) == 2.5))
+    ASSERT_TRUE((fabs(batch_means_half_width(batch_means) /
+        (2.776445105 * sqrt(0.5)) - 1) < 0.003))
+
+    batch_means_free(batch_means);
+END_TEST
+
+/*  Intervals from 10 batches of independent uniform values must contain
+    the true mean of 1/2 in close to 95% of 1000 runs. */
+DEFINE_TEST(test_batch_means_coverage)
+    uint64_t state = 42;
+    int covered = 0;
+
+    int run;
+    for (run = 0; run < 1000; run++) {
+        batch_means_t batch_means = batch_means_create();
+
+        int k;
+        for (k = 0; k < 10 * 20; k++) {
+            batch_means_observe(batch_means, uniform_next(&state));
+
+            if (k % 20 == 19) {
+                batch_means_end_batch(batch_means);
+            };
+        };
+
+        double error = fabs(batch_means_mean(batch_means) - 0.5);
+        covered += error <= batch_means_half_width(batch_means);
+
+        batch_means_free(batch_means);
+    };
+
+    ASSERT_TRUE((covered >= 930))
+    ASSERT_TRUE((covered <= 970))
+END_TEST
+
+REGISTER_TESTS(
+    test_batch_means_welford,
+    test_batch_means_half_width,
+    test_batch_means_coverage
+)
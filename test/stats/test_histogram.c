@@ -0,0 +1,132 @@
+/*  test_histogram.c */
+
+#include "./../test.h"
+#include "histogram.h"
+#include <assert.h>
+
+/*  Tests. */
+
+/*  Small values must be exact, and every value's percentile must lie
+    within the histogram's precision above it, from one bucket to the
+    next. */
+DEFINE_TEST(test_histogram_precision)
+    histogram_t histogram = histogram_create();
+
+    uint64_t value;
+    for (value = 0; value < (1UL << HISTOGRAM_SUB_BITS); value++) {
+        histogram_reset(histogram);
+        histogram_record(histogram, value);
+        histogram_record(histogram, 1UL << HISTOGRAM_MAX_BITS);
+        ASSERT_EQ(value, histogram_percentile(histogram, 50))
+    };
+
+    for (value = 1; value < (1UL << HISTOGRAM_MAX_BITS);
+        value = value * 9 / 8 + 1) {
+        histogram_reset(histogram);
+        histogram_record(histogram, value);
+        histogram_record(histogram, 1UL << HISTOGRAM_MAX_BITS);
+
+        uint64_t found = histogram_percentile(histogram, 50);
+        ASSERT_TRUE((found >= value))
+        ASSERT_TRUE(((found - value) << (HISTOGRAM_SUB_BITS - 1) <= value))
+    };
+
+    histogram_free(histogram);
+END_TEST
+
+/*  Percentiles of the values 1 to 100000, and their count, extremes and
+    mean, must be as recorded. */
+DEFINE_TEST(test_histogram_percentiles)
+    histogram_t histogram = histogram_create();
+
+    ASSERT_EQ(0, histogram_count(histogram))
+    ASSERT_EQ(0, histogram_percentile(histogram, 99))
+    ASSERT_EQ(0, histogram_min(histogram))
+
+    uint64_t value;
+    for (value = 100000; value >= 1; value--) {
+        histogram_record(histogram, value);
+    };
+
+    ASSERT_EQ(100000, histogram_count(histogram))
+    ASSERT_EQ(1, histogram_min(histogram))
+    ASSERT_EQ(100000, histogram_max(histogram))
+    ASSERT_TRUE((histogram_mean(histogram) == 50000.5))
+    ASSERT_EQ(1, histogram_percentile(histogram, 0))
+    ASSERT_EQ(100000, histogram_percentile(histogram, 100))
+
+    double percentiles[] = {50, 90, 99, 99.9, 99.99, 99.999};
+    unsigned int p;
+    for (p = 0; p < sizeof(percentiles) / sizeof(double); p++) {
+        uint64_t exact = (uint64_t) (percentiles[p] * 1000 + 0.5);
+        uint64_t found = histogram_percentile(histogram, percentiles[p]);
+
+        ASSERT_TRUE((found >= exact))
+        ASSERT_TRUE(((found - exact) * 64 <= exact))
+    };
+
+    histogram_free(histogram);
+END_TEST
+
+/*  Merging histograms must give the histogram of all their values. */
+DEFINE_TEST(test_histogram_merge)
+    histogram_t parts[4];
+    histogram_t whole = histogram_create();
+    histogram_t merged = histogram_create();
+
+    int k;
+    for (k = 0; k < 4; k++) {
+        parts[k] = histogram_create();
+    };
+
+    uint64_t value;
+    for (value = 0; value < 200000; value++) {
+        uint64_t delay =
+            (value * 2654435761UL) % (value % 7 == 0 ? 50000 : 90);
+        histogram_record(parts[value % 4], delay);
+        histogram_record(whole, delay);
+    };
+
+    for (k = 0; k < 4; k++) {
+        histogram_merge(merged, parts[k]);
+        histogram_free(parts[k]);
+    };
+
+    ASSERT_EQ(histogram_count(whole), histogram_count(merged))
+    ASSERT_EQ(histogram_min(whole), histogram_min(merged))
+    ASSERT_EQ(histogram_max(whole), histogram_max(merged))
+    ASSERT_TRUE((histogram_mean(whole) == histogram_mean(merged)))
+
+    double percentile;
+    for (percentile = 0; percentile <= 100; percentile += 0.125) {
+        ASSERT_EQ(histogram_percentile(whole, percentile),
+            histogram_percentile(merged, percentile))
+    };
+
+    histogram_free(whole);
+    histogram_free(merged);
+END_TEST
+
+/*  Values beyond the histogram's range must be counted in its top bucket,
+    and still give the exact maximum. */
+DEFINE_TEST(test_histogram_overflow)
+    histogram_t histogram = histogram_create();
+
+    histogram_record(histogram, 5);
+    histogram_record(histogram, 1UL << 40);
+
+    ASSERT_EQ(2, histogram_count(histogram))
+    ASSERT_EQ((1UL << 40), histogram_max(histogram))
+    ASSERT_EQ(5, histogram_percentile(histogram, 50))
+    ASSERT_TRUE((histogram_percentile(histogram, 100) >=
+        (1UL << HISTOGRAM_MAX_BITS) - (1UL << (HISTOGRAM_MAX_BITS - 6))))
+
+    histogram_free(histogram);
+END_TEST
+
+REGISTER_TESTS(
+    test_histogram_precision,
+    test_histogram_percentiles,
+    test_histogram_merge,
+    test_histogram_overflow
+)
@@ -0,0 +1,111 @@
+/*  test_mser.c */
+
+#include "./../test.h"
+#include "mser.h"
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+
+/*  Helper functions. */
+
+/*  Next of a sequence of values uniform in [0, 1), from a 64 bit linear
+    congruential generator. */
+static double uniform_next(uint64_t *state) {
+    *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+    return (double) (*state >> 11) / (double) (1UL << 53);
+};
+
+/*  Tests. */
+
+/*  A series with no transient must lose little or nothing. */
+DEFINE_TEST(test_mser_stationary)
+    mser_t mser = mser_create();
+    mser_truncation_t truncation;
+
+    mser_truncate(mser, &truncation);
+    ASSERT_EQ(0, truncation.discarded)
+    ASSERT_FALSE(truncation.settled)
+
+    uint64_t state = 7;
+    unsigned long t;
+    for (t = 0; t < 20000; t++) {
+        mser_observe(mser, uniform_next(&state), t);
+    };
+
+    mser_truncate(mser, &truncation);
+    ASSERT_TRUE(truncation.settled)
+    ASSERT_TRUE((truncation.discarded < 2000))
+    ASSERT_EQ(truncation.discarded, truncation.start)
+    ASSERT_TRUE((fabs(truncation.mean - 0.5) < 0.01))
+
+    mser_free(mser);
+END_TEST
+
+/*  A decaying start must be cut once it has fallen into the noise, and the
+    mean of the rest be unbiased. */
+DEFINE_TEST(test_mser_transient)
+    mser_t mser = mser_create();
+    mser_truncation_t truncation;
+
+    uint64_t state = 11;
+    unsigned long t;
+    for (t = 0; t < 20000; t++) {
+        double value = 10 * exp(-(double) t / 200) + uniform_next(&state);
+        mser_observe(mser, value, 1000 + t);
+    };
+
+    mser_truncate(mser, &truncation);
+    ASSERT_TRUE(truncation.settled)
+    ASSERT_TRUE((truncation.discarded >= 600))
+    ASSERT_TRUE((truncation.discarded <= 3000))
+    ASSERT_EQ((1000 + truncation.discarded), truncation.start)
+    ASSERT_TRUE((fabs(truncation.mean - 0.5) < 0.01))
+
+    mser_free(mser);
+END_TEST
+
+/*  A step must still be found to within a batch once batches have merged
+    to bound memory. */
+DEFINE_TEST(test_mser_merge)
+    mser_t mser = mser_create();
+    mser_truncation_t truncation;
+
+    uint64_t state = 13;
+    unsigned long t;
+    for (t = 0; t < 1000000; t++) {
+        double value = t < 100000 ? 5.0 : uniform_next(&state);
+        mser_observe(mser, value, t);
+    };
+
+    mser_truncate(mser, &truncation);
+    ASSERT_TRUE(truncation.settled)
+    ASSERT_TRUE((truncation.start >= 100000))
+    ASSERT_TRUE((truncation.start <= 100000 + 4 * MSER_BATCH))
+    ASSERT_TRUE((fabs(truncation.mean - 0.5) < 0.005))
+
+    mser_free(mser);
+END_TEST
+
+/*  A series which never settles must be reported as such. */
+DEFINE_TEST(test_mser_unsettled)
+    mser_t mser = mser_create();
+    mser_truncation_t truncation;
+
+    unsigned long t;
+    for (t = 0; t < 10000; t++) {
+        mser_observe(mser, (double) t, t);
+    };
+
+    mser_truncate(mser, &truncation);
+    ASSERT_FALSE(truncation.settled)
+    ASSERT_EQ(5000, truncation.discarded)
+
+    mser_free(mser);
+END_TEST
+
+REGISTER_TESTS(
+    test_mser_stationary,
+    test_mser_transient,
+    test_mser_merge,
+    test_mser_unsettled
+)
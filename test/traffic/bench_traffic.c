@@ -0,0 +1,133 @@
+/*  bench_traffic.c
+
+    Measures the speed of the traffic generator for each pattern at load 0.8,
+    for switches of 64 to 1024 ports. Reported are nanoseconds per slot, and
+    millions of input port decisions and of arrivals generated per second.
+    Then compares per-slot trials with drawn geometric and Poisson gaps for
+    uniform traffic to 1024 ports, from low to high loads, in the sparse form
+    for gaps, as their cost should follow the arrivals. Finally compares
+    xoshiro256** with Philox for each pattern at 1024 ports. */
+
+#include "traffic.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <time.h>
+
+#define LOAD 0.8
+#define MIN_PORTS 64
+#define MAX_PORTS 1024
+#define DECISIONS 20000000
+#define GAP_PORTS 1024
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+};
+
+int main() {
+    const char *names[] = {"uniform", "hotspot", "diagonal", "logdiagonal",
+        "bursty"};
+
+    printf("%-12s %6s %10s %12s %12s\n", "pattern", "ports", "ns/slot",
+        "Mdecisions/s", "Marrivals/s");
+
+    port_num_t *dests = (port_num_t *) malloc(MAX_PORTS * sizeof(port_num_t));
+    assert(dests);
+
+    int p;
+    for (p = TRAFFIC_UNIFORM; p <= TRAFFIC_BURSTY; p++) {
+        port_num_t num_ports;
+        for (num_ports = MIN_PORTS; num_ports <= MAX_PORTS; num_ports *= 2) {
+            traffic_t traffic =
+                traffic_create(num_ports, traffic_default_config(p, LOAD));
+            unsigned long num_slots = DECISIONS / num_ports;
+            unsigned long arrivals = 0;
+
+            double start = now_ns();
+            unsigned long slot;
+            for (slot = 0; slot < num_slots; slot++) {
+                arrivals += traffic_generate(traffic, dests);
+            };
+            double elapsed = now_ns() - start;
+
+            traffic_free(traffic);
+
+            printf("%-12s %6u %10.1f %12.1f %12.1f\n", names[p], num_ports,
+                elapsed / num_slots, num_slots * num_ports * 1e3 / elapsed,
+                arrivals * 1e3 / elapsed);
+        };
+    };
+
+    const char *arrivals_names[] = {"trials", "geometric", "poisson"};
+    double loads[] = {0.001, 0.01, 0.1, 0.5, 0.9};
+    port_num_t *inputs = (port_num_t *) malloc(GAP_PORTS * sizeof(port_num_t));
+    assert(inputs);
+
+    printf("\n%-12s %6s %10s %12s %12s\n", "arrivals", "load", "ns/slot",
+        "ns/arrival", "Marrivals/s");
+
+    int a;
+    for (a = TRAFFIC_ARRIVALS_TRIALS; a <= TRAFFIC_ARRIVALS_POISSON; a++) {
+        unsigned int l;
+        for (l = 0; l < sizeof(loads) / sizeof(double); l++) {
+            traffic_config_t config =
+                traffic_default_config(TRAFFIC_UNIFORM, loads[l]);
+            config.arrivals = a;
+
+            traffic_t traffic = traffic_create(GAP_PORTS, config);
+            unsigned long num_slots = DECISIONS / GAP_PORTS;
+            unsigned long arrivals = 0;
+
+            double start = now_ns();
+            unsigned long slot;
+            for (slot = 0; slot < num_slots; slot++) {
+                arrivals += a == TRAFFIC_ARRIVALS_TRIALS
+                    ? traffic_generate(traffic, dests)
+                    : traffic_generate_sparse(traffic, inputs, dests);
+            };
+            double elapsed = now_ns() - start;
+
+            traffic_free(traffic);
+
+            printf("%-12s %6.3f %10.1f %12.1f %12.1f\n", arrivals_names[a],
+                loads[l], elapsed / num_slots, elapsed / arrivals,
+                arrivals * 1e3 / elapsed);
+        };
+    };
+
+    const char *rng_names[] = {"xoshiro", "philox"};
+
+    printf("\n%-12s %8s %10s %12s\n", "pattern", "rng", "ns/slot",
+        "Mdecisions/s");
+
+    for (p = TRAFFIC_UNIFORM; p <= TRAFFIC_BURSTY; p++) {
+        int r;
+        for (r = TRAFFIC_RNG_XOSHIRO; r <= TRAFFIC_RNG_PHILOX; r++) {
+            traffic_config_t config = traffic_default_config(p, LOAD);
+            config.rng = r;
+
+            traffic_t traffic = traffic_create(MAX_PORTS, config);
+            unsigned long num_slots = DECISIONS / MAX_PORTS;
+
+            double start = now_ns();
+            unsigned long slot;
+            for (slot = 0; slot < num_slots; slot++) {
+                traffic_generate(traffic, dests);
+            };
+            double elapsed = now_ns() - start;
+
+            traffic_free(traffic);
+
+            printf("%-12s %8s %10.1f %12.1f\n", names[p], rng_names[r],
+                elapsed / num_slots, num_slots * MAX_PORTS * 1e3 / elapsed);
+        };
+    };
+
+    free(inputs);
+    free(dests);
+
+    return 0;
+};
@@ -0,0 +1,413 @@
+/*  test_pcap.c */
+
+#include "./../test.h"
+#include "pcap.h"
+#include <assert.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUM_PORTS 4
+#define SLOT_NS 1000
+
+/*  Capture formats written by the tests. */
+#define FORMAT_SWAPPED 0x1
+#define FORMAT_NANOSECONDS 0x2
+#define FORMAT_VLAN 0x4
+
+/*  Test helpers. */
+
+/*  Create an empty temporary file, whose path is written to path. */
+static void temp_path(char *path) {
+    strcpy(path, "/tmp/test_pcap_XXXXXX");
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+};
+
+static void put32(FILE *file, uint32_t value, int format) {
+    if (format & FORMAT_SWAPPED) {
+        value = __builtin_bswap32(value);
+    };
+
+    fwrite(&value, 4, 1, file);
+};
+
+static void put_be(uint8_t *out, uint32_t value, int size) {
+    int k;
+    for (k = 0; k < size; k++) {
+        out[k] = (uint8_t) (value >> (8 * (size - 1 - k)));
+    };
+};
+
+/*  Open a capture of link_type for writing, with its header. */
+static FILE *capture_create(const char *path, uint32_t link_type, int format) {
+    FILE *file = fopen(path, "wb");
+    assert(file);
+
+    put32(file, format & FORMAT_NANOSECONDS ? 0xa1b23c4d : 0xa1b2c3d4, format);
+    put32(file, 2 | (4 << 16), format);
+    put32(file, 0, format);
+    put32(file, 0, format);
+    put32(file, 65535, format);
+    put32(file, link_type, format);
+
+    return file;
+};
+
+/*  Write a packet from src to dst of wire_len bytes at time_ns, of which
+    only the headers are captured. ethertype other than IPv4 gives a packet
+    which the reader skips. */
+static void capture_packet(
+    FILE *file,
+    uint32_t link_type,
+    int format,
+    uint64_t time_ns,
+    uint32_t src,
+    uint32_t dst,
+    uint32_t wire_len,
+    unsigned int ethertype
+) {
+    uint8_t packet[64];
+    uint32_t size = 0;
+
+    memset(packet, 0, sizeof(packet));
+
+    if (link_type == 1) {
+        size = 12;
+        if (format & FORMAT_VLAN) {
+            put_be(packet + size, 0x8100, 2);
+            put_be(packet + size + 2, 42, 2);
+            size += 4;
+        };
+        put_be(packet + size, ethertype, 2);
+        size += 2;
+    } else if (link_type == 113) {
+        put_be(packet + 14, ethertype, 2);
+        size = 16;
+    };
+
+    packet[size] = ethertype == 0x0800 ? 0x45 : 0x60;
+    put_be(packet + size + 12, src, 4);
+    put_be(packet + size + 16, dst, 4);
+    size += 20;
+
+    put32(file, (uint32_t) (time_ns / 1000000000), format);
+    put32(file, format & FORMAT_NANOSECONDS
+        ? (uint32_t) (time_ns % 1000000000)
+        : (uint32_t) (time_ns % 1000000000 / 1000), format);
+    put32(file, size, format);
+    put32(file, wire_len, format);
+    fwrite(packet, size, 1, file);
+};
+
+static pcap_config_t test_config(const pcap_rule_t *rules, unsigned int count) {
+    pcap_config_t config;
+    config.num_ports = NUM_PORTS;
+    config.slot_ns = SLOT_NS;
+    config.rules = rules;
+    config.num_rules = count;
+
+    return config;
+};
+
+/*  Rules of the tests - 10.0.k.0/24 arrives at input k, and 10.0.0.0/16 at
+    input 3. */
+static const pcap_rule_t rules[] = {
+    {0x0a000000, 24, 0},
+    {0x0a000100, 24, 1},
+    {0x0a000200, 24, 2},
+    {0x0a000000, 16, 3}
+};
+
+/*  Write the packets of check_capture under a link type and format. A
+    packet which is not IPv4 comes first, which must be skipped. */
+static void write_capture(const char *path, uint32_t link_type, int format) {
+    FILE *file = capture_create(path, link_type, format);
+
+    capture_packet(file, link_type, format, 5000000000UL, 0x0a000001,
+        0x0b000001, 60, 0x0806);
+
+    capture_packet(file, link_type, format, 5000000000UL, 0x0a000001,
+        0xc0a80001, 1500, 0x0800);
+    capture_packet(file, link_type, format, 5000000500UL, 0x0a000101,
+        0xc0a80002, 64, 0x0800);
+    capture_packet(file, link_type, format, 5000002000UL, 0x0a000201,
+        0xc0a80003, 100, 0x0800);
+    capture_packet(file, link_type, format, 5000002999UL, 0x0a00ff01,
+        0xc0a80004, 200, 0x0800);
+    capture_packet(file, link_type, format, 5000006000UL, 0x0a000001,
+        0xc0a80005, 300, 0x0800);
+
+    fclose(file);
+};
+
+/*  The arrivals of write_capture - inputs 0 and 1 in slot 0, 2 and 3 in
+    slot 2, and 0 in slot 6, with the rest of slots 0 to 6 empty. */
+static test_result_t check_capture(const char *path) {
+    pcap_reader_t reader = pcap_reader_open(path, test_config(rules, 4));
+    ASSERT_TRUE(reader)
+
+    uint32_t expected_addrs[7][NUM_PORTS] = {
+        {0xc0a80001, 0xc0a80002, 0, 0},
+        {0}, {0, 0, 0xc0a80003, 0xc0a80004}, {0}, {0}, {0},
+        {0xc0a80005, 0, 0, 0}
+    };
+    uint32_t expected_lengths[7][NUM_PORTS] = {
+        {1500, 64, 0, 0}, {0}, {0, 0, 100, 200}, {0}, {0}, {0},
+        {300, 0, 0, 0}
+    };
+
+    uint32_t addrs[NUM_PORTS];
+    uint32_t lengths[NUM_PORTS];
+
+    int slot;
+    for (slot = 0; slot < 7; slot++) {
+        int arrivals = pcap_read(reader, addrs, lengths);
+        int expected = 0;
+
+        port_num_t i;
+        for (i = 0; i < NUM_PORTS; i++) {
+            ASSERT_EQ(expected_lengths[slot][i], lengths[i])
+
+            if (lengths[i]) {
+                ASSERT_EQ(expected_addrs[slot][i], addrs[i])
+                expected++;
+            };
+        };
+
+        ASSERT_EQ(expected, arrivals)
+    };
+
+    ASSERT_EQ(PCAP_END, pcap_read(reader, addrs, lengths))
+
+    pcap_stats_t stats;
+    pcap_reader_stats(reader, &stats);
+    ASSERT_EQ(6, stats.packets)
+    ASSERT_EQ(1, stats.skipped)
+    ASSERT_EQ(0, stats.deferred)
+    ASSERT_EQ(0, stats.dropped)
+
+    pcap_reader_close(reader);
+
+    return PASS;
+};
+
+/*  Tests. */
+
+/*  Rules must be tried in order, a /0 rule must match every address, and
+    the hash of unmatched addresses must give ports in range. */
+DEFINE_TEST(test_pcap_port_lookup)
+    ASSERT_EQ(1, pcap_port_lookup(rules, 4, 0x0a0001ff, NUM_PORTS))
+    ASSERT_EQ(3, pcap_port_lookup(rules, 4, 0x0a00ff00, NUM_PORTS))
+    ASSERT_EQ(0, pcap_port_lookup(rules, 1, 0x0a000000, NUM_PORTS))
+
+    pcap_rule_t all = {0, 0, 2};
+    ASSERT_EQ(2, pcap_port_lookup(&all, 1, 0xffffffff, NUM_PORTS))
+
+    unsigned long counts[NUM_PORTS] = {0};
+    uint32_t addr;
+    for (addr = 0; addr < 40000; addr++) {
+        port_num_t port = pcap_port_lookup(rules, 0, addr, NUM_PORTS);
+        ASSERT_TRUE((port < NUM_PORTS))
+        counts[port]++;
+    };
+
+    port_num_t i;
+    for (i = 0; i < NUM_PORTS; i++) {
+        ASSERT_TRUE((counts[i] > 9000 && counts[i] < 11000))
+    };
+END_TEST
+
+/*  Packets must arrive in the slot of their timestamp, at the input of
+    their source address, under every link type, byte order and timestamp
+    resolution, with VLAN tags and other protocols skipped. */
+DEFINE_TEST(test_pcap_formats)
+    char path[64];
+    temp_path(path);
+
+    int formats[] = {0, FORMAT_SWAPPED, FORMAT_NANOSECONDS,
+        FORMAT_SWAPPED | FORMAT_NANOSECONDS | FORMAT_VLAN};
+
+    unsigned int f;
+    for (f = 0; f < sizeof(formats) / sizeof(int); f++) {
+        write_capture(path, 1, formats[f]);
+        ASSERT_EQ(PASS, check_capture(path))
+    };
+
+    write_capture(path, 113, FORMAT_SWAPPED);
+    ASSERT_EQ(PASS, check_capture(path))
+    write_capture(path, 101, 0);
+    ASSERT_EQ(PASS, check_capture(path))
+    write_capture(path, 228, FORMAT_NANOSECONDS);
+    ASSERT_EQ(PASS, check_capture(path))
+
+    unlink(path);
+END_TEST
+
+/*  Packets arriving at a busy input must wait for later slots in order, up
+    to PCAP_BACKLOG of them, and the rest be dropped. */
+DEFINE_TEST(test_pcap_backlog)
+    char path[64];
+    temp_path(path);
+
+    FILE *file = capture_create(path, 1, 0);
+    uint32_t k;
+    for (k = 0; k < PCAP_BACKLOG + 10; k++) {
+        capture_packet(file, 1, 0, 1000000, 0x0a000101, k, 64, 0x0800);
+    };
+    fclose(file);
+
+    pcap_reader_t reader = pcap_reader_open(path, test_config(rules, 4));
+    ASSERT_TRUE(reader)
+
+    uint32_t addrs[NUM_PORTS];
+    uint32_t lengths[NUM_PORTS];
+    for (k = 0; k < PCAP_BACKLOG; k++) {
+        ASSERT_EQ(1, pcap_read(reader, addrs, lengths))
+        ASSERT_EQ(64, lengths[1])
+        ASSERT_EQ(k, addrs[1])
+    };
+
+    ASSERT_EQ(PCAP_END, pcap_read(reader, addrs, lengths))
+
+    pcap_stats_t stats;
+    pcap_reader_stats(reader, &stats);
+    ASSERT_EQ((PCAP_BACKLOG - 1), stats.deferred)
+    ASSERT_EQ(10, stats.dropped)
+
+    pcap_reader_close(reader);
+    unlink(path);
+END_TEST
+
+/*  A capture spanning several chunks must be read whole, including packets
+    split between chunks. */
+DEFINE_TEST(test_pcap_chunks)
+    char path[64];
+    temp_path(path);
+
+    uint32_t num_packets = 3 * PCAP_CHUNK_SIZE / 50;
+
+    FILE *file = capture_create(path, 1, 0);
+    uint32_t k;
+    for (k = 0; k < num_packets; k++) {
+        capture_packet(file, 1, 0, (uint64_t) k * 4 * SLOT_NS, 0x0a000001,
+            k, 64, 0x0800);
+    };
+    fclose(file);
+
+    pcap_reader_t reader = pcap_reader_open(path, test_config(rules, 4));
+    ASSERT_TRUE(reader)
+
+    uint32_t addrs[NUM_PORTS];
+    uint32_t lengths[NUM_PORTS];
+    uint32_t arrived = 0;
+    int res;
+    while ((res = pcap_read(reader, addrs, lengths)) >= 0) {
+        if (res) {
+            ASSERT_EQ(arrived, addrs[0])
+            arrived++;
+        };
+    };
+
+    ASSERT_EQ(PCAP_END, res)
+    ASSERT_EQ(num_packets, arrived)
+
+    pcap_reader_close(reader);
+    unlink(path);
+END_TEST
+
+/*  Files which are missing, not captures or of other link types must not
+    open, and a truncated capture must be reported as malformed once the
+    packets before the damage have arrived. */
+DEFINE_TEST(test_pcap_malformed)
+    pcap_config_t config = test_config(rules, 4);
+    ASSERT_FALSE(pcap_reader_open("/nonexistent/capture", config))
+
+    char path[64];
+    temp_path(path);
+    ASSERT_FALSE(pcap_reader_open(path, config))
+
+    FILE *file = fopen(path, "wb");
+    assert(file);
+    fputs("this is not a packet capture file at all", file);
+    fclose(file);
+    ASSERT_FALSE(pcap_reader_open(path, config))
+
+    file = capture_create(path, 105, 0);
+    fclose(file);
+    ASSERT_FALSE(pcap_reader_open(path, config))
+
+    write_capture(path, 1, 0);
+    ASSERT_EQ(0, truncate(path, 24 + 3 * 50 + 30))
+
+    pcap_reader_t reader = pcap_reader_open(path, config);
+    ASSERT_TRUE(reader)
+
+    uint32_t addrs[NUM_PORTS];
+    uint32_t lengths[NUM_PORTS];
+    ASSERT_EQ(2, pcap_read(reader, addrs, lengths))
+    ASSERT_EQ(PCAP_MALFORMED, pcap_read(reader, addrs, lengths))
+
+    pcap_reader_close(reader);
+    unlink(path);
+END_TEST
+
+/*  Rules files must be read in order, skipping comments and blank lines,
+    and must be refused if missing, not rules or naming ports out of
+    range. */
+DEFINE_TEST(test_pcap_rules_read)
+    char path[64];
+    temp_path(path);
+
+    FILE *file = fopen(path, "w");
+    assert(file);
+    fputs("# Subnets behind each port.\n", file);
+    fputs("10.0.1.0/24 1\n\n", file);
+    fputs("  10.0.0.0/16 3\n", file);
+    fputs("0.0.0.0/0 2", file);
+    fclose(file);
+
+    pcap_rule_t *read_rules = NULL;
+    ASSERT_EQ(3, pcap_rules_read(path, NUM_PORTS, &read_rules))
+    ASSERT_EQ(0x0a000100, read_rules[0].prefix)
+    ASSERT_EQ(24, read_rules[0].prefix_len)
+    ASSERT_EQ(1, read_rules[0].port)
+    ASSERT_EQ(3, pcap_port_lookup(read_rules, 3, 0x0a00ff00, NUM_PORTS))
+    ASSERT_EQ(2, pcap_port_lookup(read_rules, 3, 0xc0a80001, NUM_PORTS))
+    free(read_rules);
+
+    ASSERT_EQ(-1, pcap_rules_read("/nonexistent/rules", NUM_PORTS, &read_rules))
+
+    const char *malformed[] = {
+        "10.0.0.0/16\n",
+        "10.0.0.0/16 4\n",
+        "10.0.0.0/33 1\n",
+        "10.0.256.0/16 1\n",
+        "10.0.0.0/16 1 2\n"
+    };
+
+    unsigned int k;
+    for (k = 0; k < sizeof(malformed) / sizeof(malformed[0]); k++) {
+        file = fopen(path, "w");
+        assert(file);
+        fputs("10.0.1.0/24 1\n", file);
+        fputs(malformed[k], file);
+        fclose(file);
+
+        ASSERT_EQ(-1, pcap_rules_read(path, NUM_PORTS, &read_rules))
+    };
+
+    unlink(path);
+END_TEST
+
+REGISTER_TESTS(
+    test_pcap_port_lookup,
+    test_pcap_formats,
+    test_pcap_backlog,
+    test_pcap_chunks,
+    test_pcap_malformed,
+    test_pcap_rules_read
+)
@@ -0,0 +1,172 @@
+/*  test_trace.c */
+
+#include "./../test.h"
+#include "trace.h"
+#include <assert.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUM_PORTS 16
+#define NUM_SLOTS 5000
+
+/*  Test helpers. */
+
+/*  Create an empty temporary file, whose path is written to path. */
+static void temp_path(char *path) {
+    strcpy(path, "/tmp/test_trace_XXXXXX");
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+};
+
+/*  Arrivals of slot at port - about a third of inputs receive one, with
+    addresses and lengths of every size. */
+static uint32_t trace_length(unsigned long slot, port_num_t port) {
+    return (slot * 7 + port * 13) % 3 == 0 ? 1 + (slot * port) % 1500 : 0;
+};
+
+static uint32_t trace_addr(unsigned long slot, port_num_t port) {
+    return (uint32_t) ((slot * 2654435761UL) ^ (port << 28));
+};
+
+/*  Write slots of trace_length and trace_addr arrivals, the last
+    empty_slots of them empty. */
+static void write_trace(
+    const char *path,
+    unsigned long num_slots,
+    unsigned long empty_slots
+) {
+    trace_writer_t writer = trace_writer_create(path, NUM_PORTS);
+    assert(writer);
+
+    unsigned long slot;
+    for (slot = 0; slot < num_slots; slot++) {
+        uint32_t addrs[NUM_PORTS];
+        uint32_t lengths[NUM_PORTS];
+
+        port_num_t i;
+        for (i = 0; i < NUM_PORTS; i++) {
+            addrs[i] = trace_addr(slot, i);
+            lengths[i] = slot < num_slots - empty_slots
+                ? trace_length(slot, i)
+                : 0;
+        };
+
+        int written = trace_write(writer, addrs, lengths);
+        assert(written);
+    };
+
+    int closed = trace_writer_close(writer);
+    assert(closed);
+};
+
+/*  Tests. */
+
+/*  A trace must replay exactly what was written, slot by slot, including
+    the empty slots at its end, and then end. */
+DEFINE_TEST(test_trace_round_trip)
+    char path[64];
+    temp_path(path);
+    write_trace(path, NUM_SLOTS, 10);
+
+    trace_reader_t reader = trace_reader_open(path);
+    ASSERT_TRUE(reader)
+    ASSERT_EQ(NUM_PORTS, trace_reader_num_ports(reader))
+    ASSERT_EQ(NUM_SLOTS, trace_reader_num_slots(reader))
+
+    unsigned long slot;
+    for (slot = 0; slot < NUM_SLOTS; slot++) {
+        uint32_t addrs[NUM_PORTS];
+        uint32_t lengths[NUM_PORTS];
+        int arrivals = trace_read(reader, addrs, lengths);
+        int expected = 0;
+
+        port_num_t i;
+        for (i = 0; i < NUM_PORTS; i++) {
+            uint32_t length = slot < NUM_SLOTS - 10 ? trace_length(slot, i) : 0;
+            ASSERT_EQ(length, lengths[i])
+
+            if (length) {
+                ASSERT_EQ(trace_addr(slot, i), addrs[i])
+                expected++;
+            };
+        };
+
+        ASSERT_EQ(expected, arrivals)
+    };
+
+    uint32_t addrs[NUM_PORTS];
+    uint32_t lengths[NUM_PORTS];
+    ASSERT_EQ(TRACE_END, trace_read(reader, addrs, lengths))
+
+    trace_reader_close(reader);
+    unlink(path);
+END_TEST
+
+/*  A trace with no slots must end at once. */
+DEFINE_TEST(test_trace_empty)
+    char path[64];
+    temp_path(path);
+    write_trace(path, 0, 0);
+
+    trace_reader_t reader = trace_reader_open(path);
+    ASSERT_TRUE(reader)
+    ASSERT_EQ(0, trace_reader_num_slots(reader))
+
+    uint32_t addrs[NUM_PORTS];
+    uint32_t lengths[NUM_PORTS];
+    ASSERT_EQ(TRACE_END, trace_read(reader, addrs, lengths))
+
+    trace_reader_close(reader);
+    unlink(path);
+END_TEST
+
+/*  Files which are missing or not traces must not open, and a truncated
+    trace must be reported as malformed where its records run out. */
+DEFINE_TEST(test_trace_malformed)
+    ASSERT_FALSE(trace_reader_open("/nonexistent/trace"))
+
+    char path[64];
+    temp_path(path);
+    ASSERT_FALSE(trace_reader_open(path))
+
+    FILE *file = fopen(path, "wb");
+    assert(file);
+    fputs("this is not a switch trace file at all", file);
+    fclose(file);
+    ASSERT_FALSE(trace_reader_open(path))
+
+    write_trace(path, NUM_SLOTS, 0);
+    file = fopen(path, "rb");
+    assert(file);
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    ASSERT_EQ(0, truncate(path, size / 2))
+
+    trace_reader_t reader = trace_reader_open(path);
+    ASSERT_TRUE(reader)
+
+    int result;
+    unsigned long slots = 0;
+    uint32_t addrs[NUM_PORTS];
+    uint32_t lengths[NUM_PORTS];
+    while ((result = trace_read(reader, addrs, lengths)) >= 0) {
+        slots++;
+    };
+
+    ASSERT_EQ(TRACE_MALFORMED, result)
+    ASSERT_TRUE((slots > NUM_SLOTS / 3 && slots < 2 * NUM_SLOTS / 3))
+
+    trace_reader_close(reader);
+    unlink(path);
+END_TEST
+
+REGISTER_TESTS(
+    test_trace_round_trip,
+    test_trace_empty,
+    test_trace_malformed
+)
@@ -0,0 +1,532 @@
+/*  test_traffic.c */
+
+#include "./../test.h"
+#include "traffic.h"
+#include "philox.h"
+#include <assert.h>
+#include <malloc.h>
+#include <pthread.h>
+
+#define NUM_PORTS 16
+#define NUM_SLOTS 20000
+#define TOLERANCE 0.01
+#define THREAD_PORTS 37
+#define THREAD_SLOTS 500
+
+/*  Test helpers. */
+
+static int close_to(double expected, double val, double tolerance) {
+    double diff = expected - val;
+    return diff < tolerance && -diff < tolerance;
+};
+
+/*  Run a pattern for NUM_SLOTS slots, counting the arrivals from each input
+    to each output in counts, and return the offered load. Returns -1 if the
+    returned arrival counts do not match the destinations written, or a
+    destination is out of range. */
+static double run(
+    traffic_config_t config,
+    port_num_t num_ports,
+    unsigned long *counts
+) {
+    traffic_t traffic = traffic_create(num_ports, config);
+    port_num_t *dests = (port_num_t *) malloc(num_ports * sizeof(port_num_t));
+    assert(dests);
+
+    unsigned long arrivals = 0;
+    int valid = 1;
+
+    unsigned long slot;
+    for (slot = 0; slot < NUM_SLOTS; slot++) {
+        port_num_t generated = traffic_generate(traffic, dests);
+        port_num_t seen = 0;
+
+        port_num_t i;
+        for (i = 0; i < num_ports; i++) {
+            if (dests[i] == TRAFFIC_NO_ARRIVAL) {
+                continue;
+            };
+
+            if (dests[i] >= num_ports) {
+                valid = 0;
+                continue;
+            };
+
+            seen++;
+            if (counts) {
+                counts[i * num_ports + dests[i]]++;
+            };
+        };
+
+        valid &= seen == generated;
+        arrivals += generated;
+    };
+
+    free(dests);
+    traffic_free(traffic);
+
+    return valid ? (double) arrivals / (NUM_SLOTS * num_ports) : -1;
+};
+
+/*  A thread's share of a run - count inputs from first, for THREAD_SLOTS
+    slots, with the destinations of slot s written to row s of dests. */
+struct range {
+    traffic_t traffic;
+    port_num_t first;
+    port_num_t count;
+    port_num_t *dests;
+};
+
+static void *generate_range(void *arg) {
+    struct range *range = (struct range *) arg;
+
+    unsigned long slot;
+    for (slot = 0; slot < THREAD_SLOTS; slot++) {
+        traffic_generate_ports(range->traffic, slot, range->first,
+            range->count, &range->dests[slot * THREAD_PORTS + range->first]);
+    };
+
+    return NULL;
+};
+
+/*  Tests. */
+
+DEFINE_TEST(test_traffic_pattern_names)
+    traffic_pattern_t pattern;
+    ASSERT_TRUE(traffic_pattern_from_name("uniform", &pattern))
+    ASSERT_EQ(TRAFFIC_UNIFORM, pattern)
+    ASSERT_TRUE(traffic_pattern_from_name("hotspot", &pattern))
+    ASSERT_EQ(TRAFFIC_HOTSPOT, pattern)
+    ASSERT_TRUE(traffic_pattern_from_name("diagonal", &pattern))
+    ASSERT_EQ(TRAFFIC_DIAGONAL, pattern)
+    ASSERT_TRUE(traffic_pattern_from_name("logdiagonal", &pattern))
+    ASSERT_EQ(TRAFFIC_LOG_DIAGONAL, pattern)
+    ASSERT_TRUE(traffic_pattern_from_name("bursty", &pattern))
+    ASSERT_EQ(TRAFFIC_BURSTY, pattern)
+    ASSERT_FALSE(traffic_pattern_from_name("poisson", &pattern))
+
+    traffic_arrivals_t arrivals;
+    ASSERT_TRUE(traffic_arrivals_from_name("trials", &arrivals))
+    ASSERT_EQ(TRAFFIC_ARRIVALS_TRIALS, arrivals)
+    ASSERT_TRUE(traffic_arrivals_from_name("geometric", &arrivals))
+    ASSERT_EQ(TRAFFIC_ARRIVALS_GEOMETRIC, arrivals)
+    ASSERT_TRUE(traffic_arrivals_from_name("poisson", &arrivals))
+    ASSERT_EQ(TRAFFIC_ARRIVALS_POISSON, arrivals)
+    ASSERT_FALSE(traffic_arrivals_from_name("uniform", &arrivals))
+
+    traffic_rng_t rng;
+    ASSERT_TRUE(traffic_rng_from_name("xoshiro", &rng))
+    ASSERT_EQ(TRAFFIC_RNG_XOSHIRO, rng)
+    ASSERT_TRUE(traffic_rng_from_name("philox", &rng))
+    ASSERT_EQ(TRAFFIC_RNG_PHILOX, rng)
+    ASSERT_FALSE(traffic_rng_from_name("trials", &rng))
+END_TEST
+
+/*  Philox4x32-10 must reproduce the known answers of its reference
+    implementation, singly and in a batch. */
+DEFINE_TEST(test_traffic_philox_known_answers)
+    uint32_t ctrs[3][4] = {
+        {0, 0, 0, 0},
+        {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+        {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}
+    };
+    uint32_t keys[3][2] = {
+        {0, 0},
+        {0xffffffff, 0xffffffff},
+        {0xa4093822, 0x299f31d0}
+    };
+    uint32_t answers[3][4] = {
+        {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8},
+        {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd},
+        {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}
+    };
+
+    int v, w, k;
+    for (v = 0; v < 3; v++) {
+        uint32_t out[4];
+        philox4x32(ctrs[v], keys[v], out);
+
+        uint32_t batch[4][PHILOX_BATCH];
+        for (w = 0; w < 4; w++) {
+            for (k = 0; k < PHILOX_BATCH; k++) {
+                batch[w][k] = ctrs[v][w];
+            };
+        };
+        philox4x32_batch(batch, keys[v]);
+
+        for (w = 0; w < 4; w++) {
+            ASSERT_EQ(answers[v][w], out[w])
+            for (k = 0; k < PHILOX_BATCH; k++) {
+                ASSERT_EQ(answers[v][w], batch[w][k])
+            };
+        };
+    };
+END_TEST
+
+/*  Every pattern must offer the configured load under every arrival
+    process, including for port counts which are not a multiple of the
+    uniform pattern's vector width. */
+DEFINE_TEST(test_traffic_offered_load)
+    double loads[] = {0.0, 0.01, 0.3, 0.8, 0.95, 1.0};
+
+    int p;
+    for (p = TRAFFIC_UNIFORM; p <= TRAFFIC_BURSTY; p++) {
+        int a;
+        for (a = TRAFFIC_ARRIVALS_TRIALS; a <= TRAFFIC_ARRIVALS_POISSON; a++) {
+            unsigned int l;
+            for (l = 0; l < sizeof(loads) / sizeof(double); l++) {
+                traffic_config_t config = traffic_default_config(p, loads[l]);
+                config.arrivals = a;
+
+                int r;
+                for (r = TRAFFIC_RNG_XOSHIRO; r <= TRAFFIC_RNG_PHILOX; r++) {
+                    config.rng = r;
+
+                    ASSERT_TRUE(close_to(loads[l],
+                        run(config, NUM_PORTS, NULL), TOLERANCE))
+                    ASSERT_TRUE(close_to(loads[l], run(config, 7, NULL),
+                        2 * TOLERANCE))
+                };
+            };
+        };
+    };
+END_TEST
+
+/*  Uniform destinations - each output must receive a share of 1 / N, from
+    either generator. */
+DEFINE_TEST(test_traffic_uniform)
+    unsigned long counts[NUM_PORTS * NUM_PORTS] = {0};
+    traffic_config_t config = traffic_default_config(TRAFFIC_UNIFORM, 0.5);
+    run(config, NUM_PORTS, counts);
+    config.rng = TRAFFIC_RNG_PHILOX;
+    run(config, NUM_PORTS, counts);
+
+    unsigned long total = 0;
+    unsigned long per_output[NUM_PORTS] = {0};
+
+    port_num_t i, j;
+    for (i = 0; i < NUM_PORTS; i++) {
+        for (j = 0; j < NUM_PORTS; j++) {
+            per_output[j] += counts[i * NUM_PORTS + j];
+            total += counts[i * NUM_PORTS + j];
+        };
+    };
+
+    for (j = 0; j < NUM_PORTS; j++) {
+        ASSERT_TRUE(close_to(1.0 / NUM_PORTS,
+            (double) per_output[j] / total, TOLERANCE))
+    };
+END_TEST
+
+/*  Hotspot - the hotspot output must receive its fraction of all traffic,
+    plus its uniform share of the rest. */
+DEFINE_TEST(test_traffic_hotspot)
+    unsigned long counts[NUM_PORTS * NUM_PORTS] = {0};
+    traffic_config_t config = traffic_default_config(TRAFFIC_HOTSPOT, 0.5);
+    config.hotspot_port = 3;
+    config.hotspot_fraction = 0.25;
+    run(config, NUM_PORTS, counts);
+
+    unsigned long total = 0;
+    unsigned long hot = 0;
+
+    port_num_t i, j;
+    for (i = 0; i < NUM_PORTS; i++) {
+        for (j = 0; j < NUM_PORTS; j++) {
+            total += counts[i * NUM_PORTS + j];
+        };
+        hot += counts[i * NUM_PORTS + 3];
+    };
+
+    ASSERT_TRUE(close_to(0.25 + 0.75 / NUM_PORTS, (double) hot / total,
+        TOLERANCE))
+END_TEST
+
+/*  Diagonal - input i must send 2/3 of its traffic to output i and the rest
+    to output i + 1. */
+DEFINE_TEST(test_traffic_diagonal)
+    unsigned long counts[NUM_PORTS * NUM_PORTS] = {0};
+    run(traffic_default_config(TRAFFIC_DIAGONAL, 0.8), NUM_PORTS, counts);
+
+    port_num_t i;
+    for (i = 0; i < NUM_PORTS; i++) {
+        unsigned long straight = counts[i * NUM_PORTS + i];
+        unsigned long next = counts[i * NUM_PORTS + (i + 1) % NUM_PORTS];
+        unsigned long total = 0;
+
+        port_num_t j;
+        for (j = 0; j < NUM_PORTS; j++) {
+            total += counts[i * NUM_PORTS + j];
+        };
+
+        ASSERT_EQ(total, (straight + next))
+        ASSERT_TRUE(close_to(2.0 / 3, (double) straight / total,
+            3 * TOLERANCE))
+    };
+END_TEST
+
+/*  Log-diagonal - the share of traffic at offset j must halve with each
+    step of j. */
+DEFINE_TEST(test_traffic_log_diagonal)
+    unsigned long counts[NUM_PORTS * NUM_PORTS] = {0};
+    run(traffic_default_config(TRAFFIC_LOG_DIAGONAL, 0.8), NUM_PORTS, counts);
+
+    unsigned long per_offset[NUM_PORTS] = {0};
+    unsigned long total = 0;
+
+    port_num_t i, j;
+    for (i = 0; i < NUM_PORTS; i++) {
+        for (j = 0; j < NUM_PORTS; j++) {
+            per_offset[(j + NUM_PORTS - i) % NUM_PORTS] +=
+                counts[i * NUM_PORTS + j];
+            total += counts[i * NUM_PORTS + j];
+        };
+    };
+
+    double share = 0.5;
+    for (j = 0; j < 5; j++) {
+        ASSERT_TRUE(close_to(share, (double) per_offset[j] / total,
+            TOLERANCE))
+        share /= 2;
+    };
+END_TEST
+
+/*  Bursty - arrivals in consecutive slots at an input go to the same output
+    within a burst, and bursts last burst_length slots on average, whether
+    idle periods are stepped through or drawn. Under low loads, drawn idle
+    periods often outlast the timing wheel. */
+static test_result_t check_bursty(
+    traffic_arrivals_t arrivals_process,
+    double load
+) {
+    traffic_config_t config = traffic_default_config(TRAFFIC_BURSTY, load);
+    config.arrivals = arrivals_process;
+    config.burst_length = 8;
+    traffic_t traffic = traffic_create(NUM_PORTS, config);
+
+    port_num_t dests[NUM_PORTS];
+    port_num_t last[NUM_PORTS];
+    unsigned long bursts = 0;
+    unsigned long arrivals = 0;
+
+    port_num_t i;
+    for (i = 0; i < NUM_PORTS; i++) {
+        last[i] = TRAFFIC_NO_ARRIVAL;
+    };
+
+    unsigned long slot;
+    for (slot = 0; slot < NUM_SLOTS; slot++) {
+        arrivals += traffic_generate(traffic, dests);
+
+        for (i = 0; i < NUM_PORTS; i++) {
+            if (dests[i] != TRAFFIC_NO_ARRIVAL && last[i] == TRAFFIC_NO_ARRIVAL) {
+                bursts++;
+            };
+            ASSERT_TRUE((dests[i] == TRAFFIC_NO_ARRIVAL
+                || last[i] == TRAFFIC_NO_ARRIVAL
+                || dests[i] == last[i]))
+
+            last[i] = dests[i];
+        };
+    };
+
+    ASSERT_TRUE(close_to(8.0, (double) arrivals / bursts, 0.5))
+
+    traffic_free(traffic);
+
+    return PASS;
+};
+
+DEFINE_TEST(test_traffic_bursty)
+    ASSERT_EQ(PASS, check_bursty(TRAFFIC_ARRIVALS_TRIALS, 0.3))
+    ASSERT_EQ(PASS, check_bursty(TRAFFIC_ARRIVALS_GEOMETRIC, 0.3))
+    ASSERT_EQ(PASS, check_bursty(TRAFFIC_ARRIVALS_GEOMETRIC, 0.05))
+END_TEST
+
+/*  Geometric gaps - the gaps between the arrivals at an input must be
+    those of Bernoulli trials, with a gap of 1 slot with probability load
+    and a mean of 1 / load. */
+DEFINE_TEST(test_traffic_geometric)
+    traffic_config_t config = traffic_default_config(TRAFFIC_UNIFORM, 0.2);
+    config.arrivals = TRAFFIC_ARRIVALS_GEOMETRIC;
+    traffic_t traffic = traffic_create(NUM_PORTS, config);
+
+    port_num_t dests[NUM_PORTS];
+    long last[NUM_PORTS];
+    unsigned long gaps = 0;
+    unsigned long unit_gaps = 0;
+    unsigned long total_gap = 0;
+
+    port_num_t i;
+    for (i = 0; i < NUM_PORTS; i++) {
+        last[i] = -1;
+    };
+
+    long slot;
+    for (slot = 0; slot < NUM_SLOTS; slot++) {
+        traffic_generate(traffic, dests);
+
+        for (i = 0; i < NUM_PORTS; i++) {
+            if (dests[i] == TRAFFIC_NO_ARRIVAL) {
+                continue;
+            };
+
+            if (last[i] >= 0) {
+                gaps++;
+                unit_gaps += slot - last[i] == 1;
+                total_gap += slot - last[i];
+            };
+            last[i] = slot;
+        };
+    };
+
+    ASSERT_TRUE(close_to(0.2, (double) unit_gaps / gaps, TOLERANCE))
+    ASSERT_TRUE(close_to(5.0, (double) total_gap / gaps, 0.1))
+
+    traffic_free(traffic);
+END_TEST
+
+/*  The sparse form must list the same arrivals as the vector, in order of
+    input, under every arrival process. */
+DEFINE_TEST(test_traffic_sparse)
+    int a;
+    for (a = TRAFFIC_ARRIVALS_TRIALS; a <= TRAFFIC_ARRIVALS_POISSON; a++) {
+        traffic_config_t config = traffic_default_config(TRAFFIC_HOTSPOT, 0.4);
+        config.arrivals = a;
+        traffic_t dense = traffic_create(NUM_PORTS, config);
+        traffic_t sparse = traffic_create(NUM_PORTS, config);
+
+        unsigned long slot;
+        for (slot = 0; slot < 1000; slot++) {
+            port_num_t dests[NUM_PORTS];
+            port_num_t sparse_inputs[NUM_PORTS];
+            port_num_t sparse_dests[NUM_PORTS];
+
+            port_num_t count = traffic_generate(dense, dests);
+            ASSERT_EQ(count,
+                traffic_generate_sparse(sparse, sparse_inputs, sparse_dests))
+
+            port_num_t i;
+            port_num_t k = 0;
+            for (i = 0; i < NUM_PORTS; i++) {
+                if (dests[i] == TRAFFIC_NO_ARRIVAL) {
+                    continue;
+                };
+
+                ASSERT_EQ(i, sparse_inputs[k])
+                ASSERT_EQ(dests[i], sparse_dests[k])
+                k++;
+            };
+        };
+
+        traffic_free(dense);
+        traffic_free(sparse);
+    };
+END_TEST
+
+/*  The same seed must give the same arrivals, and another seed others. */
+DEFINE_TEST(test_traffic_seed)
+    int p;
+    for (p = TRAFFIC_UNIFORM; p <= TRAFFIC_BURSTY; p++) {
+        traffic_config_t config = traffic_default_config(p, 0.5);
+        config.arrivals = p % 2
+            ? TRAFFIC_ARRIVALS_GEOMETRIC
+            : TRAFFIC_ARRIVALS_TRIALS;
+        traffic_t first = traffic_create(NUM_PORTS, config);
+        traffic_t second = traffic_create(NUM_PORTS, config);
+        config.seed = 2;
+        traffic_t other = traffic_create(NUM_PORTS, config);
+
+        int differ = 0;
+
+        unsigned long slot;
+        for (slot = 0; slot < 100; slot++) {
+            port_num_t first_dests[NUM_PORTS];
+            port_num_t second_dests[NUM_PORTS];
+            port_num_t other_dests[NUM_PORTS];
+
+            traffic_generate(first, first_dests);
+            traffic_generate(second, second_dests);
+            traffic_generate(other, other_dests);
+
+            port_num_t i;
+            for (i = 0; i < NUM_PORTS; i++) {
+                ASSERT_EQ(first_dests[i], second_dests[i])
+                differ |= first_dests[i] != other_dests[i];
+            };
+        };
+
+        ASSERT_TRUE(differ)
+
+        traffic_free(first);
+        traffic_free(second);
+        traffic_free(other);
+    };
+END_TEST
+
+/*  Under Philox the arrivals must not depend on how the inputs are split
+    between threads - every split must give what traffic_generate does. */
+DEFINE_TEST(test_traffic_philox_threads)
+    int splits[] = {1, 2, 3, 4, 8};
+    port_num_t expected[THREAD_SLOTS * THREAD_PORTS];
+    port_num_t dests[THREAD_SLOTS * THREAD_PORTS];
+
+    int p;
+    for (p = TRAFFIC_UNIFORM; p <= TRAFFIC_BURSTY; p++) {
+        traffic_config_t config = traffic_default_config(p, 0.6);
+        config.rng = TRAFFIC_RNG_PHILOX;
+
+        traffic_t traffic = traffic_create(THREAD_PORTS, config);
+        unsigned long slot;
+        for (slot = 0; slot < THREAD_SLOTS; slot++) {
+            traffic_generate(traffic, &expected[slot * THREAD_PORTS]);
+        };
+        traffic_free(traffic);
+
+        unsigned int s;
+        for (s = 0; s < sizeof(splits) / sizeof(int); s++) {
+            int num_threads = splits[s];
+            traffic = traffic_create(THREAD_PORTS, config);
+
+            pthread_t threads[8];
+            struct range ranges[8];
+
+            int t;
+            for (t = 0; t < num_threads; t++) {
+                ranges[t].traffic = traffic;
+                ranges[t].first = THREAD_PORTS * t / num_threads;
+                ranges[t].count =
+                    THREAD_PORTS * (t + 1) / num_threads - ranges[t].first;
+                ranges[t].dests = dests;
+                ASSERT_EQ(0, pthread_create(&threads[t], NULL,
+                    generate_range, &ranges[t]))
+            };
+
+            for (t = 0; t < num_threads; t++) {
+                pthread_join(threads[t], NULL);
+            };
+
+            traffic_free(traffic);
+
+            unsigned long i;
+            for (i = 0; i < THREAD_SLOTS * THREAD_PORTS; i++) {
+                ASSERT_EQ(expected[i], dests[i])
+            };
+        };
+    };
+END_TEST
+
+REGISTER_TESTS(
+    test_traffic_pattern_names,
+    test_traffic_philox_known_answers,
+    test_traffic_offered_load,
+    test_traffic_uniform,
+    test_traffic_hotspot,
+    test_traffic_diagonal,
+    test_traffic_log_diagonal,
+    test_traffic_bursty,
+    test_traffic_geometric,
+    test_traffic_sparse,
+    test_traffic_seed,
+    test_traffic_philox_threads
+)